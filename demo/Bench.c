@@ -1,3 +1,5 @@
+#include <stdio.h>
+
 #include "chipmunk/chipmunk.h"
 #include "chipmunk/chipmunk_unsafe.h"
 #include "ChipmunkDemo.h"
@@ -6,9 +8,13 @@
 #if ENABLE_HASTY
 	#include "chipmunk/cpHastySpace.h"
 	
+	// Cleared by BenchCompareVectorized() to run the benchmarks without the vectorized contact solver.
+	static cpBool bench_vectorized = cpTrue;
+	
 	static cpSpace *MakeHastySpace(){
 		cpSpace *space = cpHastySpaceNew();
 		cpHastySpaceSetThreads(space, 0);
+		cpHastySpaceSetVectorized(space, bench_vectorized);
 		return space;
 	}
 	
@@ -432,6 +438,191 @@ static cpSpace *init_NoCollide(void){
 }
 
 
+// Stacking
+// Solver bound scenes. Most of the time is spent iterating over contacts between awake bodies.
+
+static cpSpace *init_PyramidStack(void){
+	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpaceSetIterations(space, 30);
+	cpSpaceSetGravity(space, cpv(0, -100));
+	cpSpaceSetCollisionSlop(space, 0.5f);
+	
+	cpShapeSetFriction(cpSpaceAddShape(space, cpSegmentShapeNew(cpSpaceGetStaticBody(space), cpv(-320, -240), cpv(320, -240), 0.0f)), 1.0f);
+	
+	for(int i=0; i<14; i++){
+		for(int j=0; j<=i; j++){
+			cpBody *body = cpSpaceAddBody(space, cpBodyNew(1.0f, cpMomentForBox(1.0f, 30.0f, 30.0f)));
+			cpBodySetPosition(body, cpv(j*32 - i*16, 300 - i*32));
+			
+			cpShape *shape = cpSpaceAddShape(space, cpBoxShapeNew(body, 30.0f, 30.0f, 0.5f));
+			cpShapeSetElasticity(shape, 0.0f); cpShapeSetFriction(shape, 0.8f);
+		}
+	}
+	
+	return space;
+}
+
+static cpSpace *init_BoxPile_20000(void){
+	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpaceSetIterations(space, 10);
+	cpSpaceSetGravity(space, cpv(0, -100));
+	cpSpaceSetCollisionSlop(space, 0.5f);
+	
+	cpBody *staticBody = cpSpaceGetStaticBody(space);
+	cpShapeSetFriction(cpSpaceAddShape(space, cpSegmentShapeNew(staticBody, cpv(-610, -240), cpv( 610, -240), 0.0f)), 1.0f);
+	cpShapeSetFriction(cpSpaceAddShape(space, cpSegmentShapeNew(staticBody, cpv(-610, -240), cpv(-610, 2000), 0.0f)), 1.0f);
+	cpShapeSetFriction(cpSpaceAddShape(space, cpSegmentShapeNew(staticBody, cpv( 610, -240), cpv( 610, 2000), 0.0f)), 1.0f);
+	
+	cpFloat size = 5.0f;
+	for(int i=0; i<20000; i++){
+		cpFloat mass = 1.0f;
+		cpBody *body = cpSpaceAddBody(space, cpBodyNew(mass, cpMomentForBox(mass, size, size)));
+		cpBodySetPosition(body, cpv(-600 + (i%200)*6 + frand(), -235 + (i/200)*6));
+		
+		cpShape *shape = cpSpaceAddShape(space, cpBoxShapeNew(body, size, size, 0.0f));
+		cpShapeSetElasticity(shape, 0.0); cpShapeSetFriction(shape, 0.7);
+	}
+	
+	return space;
+}
+
+
+// Joint Chains
+// Heavy weights swinging on long chains of pivot, pin and slide joints.
+// The largest joint error during the run is printed so the error bias, soft joints and the direct solver can be compared at different iteration counts.
+
+static cpFloat chain_error = 0.0f;
+
+static void
+ChainJointError(cpConstraint *constraint, void *unused)
+{
+	cpBody *a = cpConstraintGetBodyA(constraint), *b = cpConstraintGetBodyB(constraint);
+	cpFloat error = 0.0f;
+	
+	if(cpConstraintIsPivotJoint(constraint)){
+		error = cpvdist(cpBodyLocalToWorld(a, cpPivotJointGetAnchorA(constraint)), cpBodyLocalToWorld(b, cpPivotJointGetAnchorB(constraint)));
+	} else if(cpConstraintIsPinJoint(constraint)){
+		cpFloat dist = cpvdist(cpBodyLocalToWorld(a, cpPinJointGetAnchorA(constraint)), cpBodyLocalToWorld(b, cpPinJointGetAnchorB(constraint)));
+		error = cpfabs(dist - cpPinJointGetDist(constraint));
+	} else if(cpConstraintIsSlideJoint(constraint)){
+		cpFloat dist = cpvdist(cpBodyLocalToWorld(a, cpSlideJointGetAnchorA(constraint)), cpBodyLocalToWorld(b, cpSlideJointGetAnchorB(constraint)));
+		error = cpfmax(0.0f, cpfmax(dist - cpSlideJointGetMax(constraint), cpSlideJointGetMin(constraint) - dist));
+	}
+	
+	chain_error = cpfmax(chain_error, error);
+}
+
+static cpSpace *
+SetupSpace_chains(int iterations, cpFloat frequency, cpBool direct)
+{
+	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpaceSetIterations(space, iterations);
+	cpSpaceSetDirectSolver(space, direct);
+	cpSpaceSetGravity(space, cpv(0, -100));
+	chain_error = 0.0f;
+	
+	for(int i=0; i<8; i++){
+		cpBody *prev = cpSpaceGetStaticBody(space);
+		cpVect anchor = cpv(-280 + i*80, 200);
+		
+		for(int j=0; j<30; j++){
+			cpFloat mass = (j == 29 ? 50.0f : 1.0f);
+			cpBody *body = cpSpaceAddBody(space, cpBodyNew(mass, cpMomentForCircle(mass, 0.0f, 5.0f, cpvzero)));
+			cpBodySetPosition(body, cpvadd(anchor, cpv(10, 0)));
+			
+			cpVect anchorA = cpBodyWorldToLocal(prev, anchor);
+			cpConstraint *joint = NULL;
+			switch(j%3){
+				case 0: joint = cpPivotJointNew2(prev, body, anchorA, cpv(-10, 0)); break;
+				case 1: joint = cpPinJointNew(prev, body, anchorA, cpv(-10, 0)); break;
+				case 2: joint = cpSlideJointNew(prev, body, anchorA, cpv(-10, 0), 0.0f, 1.0f); break;
+			}
+			
+			cpConstraintSetFrequency(joint, frequency);
+			cpSpaceAddConstraint(space, joint);
+			
+			anchor = cpvadd(anchor, cpv(20, 0));
+			prev = body;
+		}
+	}
+	
+	return space;
+}
+
+static cpSpace *init_RigidChains_4(void){return SetupSpace_chains(4, 0.0f, cpFalse);}
+static cpSpace *init_RigidChains_16(void){return SetupSpace_chains(16, 0.0f, cpFalse);}
+static cpSpace *init_RigidChains_64(void){return SetupSpace_chains(64, 0.0f, cpFalse);}
+static cpSpace *init_SoftChains_4(void){return SetupSpace_chains(4, 30.0f, cpFalse);}
+static cpSpace *init_SoftChains_16(void){return SetupSpace_chains(16, 30.0f, cpFalse);}
+static cpSpace *init_SoftChains_64(void){return SetupSpace_chains(64, 30.0f, cpFalse);}
+static cpSpace *init_DirectChains_1(void){return SetupSpace_chains(1, 0.0f, cpTrue);}
+static cpSpace *init_DirectChains_4(void){return SetupSpace_chains(4, 0.0f, cpTrue);}
+static cpSpace *init_DirectChains_16(void){return SetupSpace_chains(16, 0.0f, cpTrue);}
+
+
+// Soft Bodies
+// Blobs made from grids of small bodies tied together with damped springs dropped onto the floor.
+// The springs are either separate cpDampedSpring constraints or a single spring network.
+// Both are solved every iteration in either kind of space, so the two versions do the same work.
+
+static cpSpringNetwork *soft_network = NULL;
+
+static cpSpace *
+SetupSpace_softBodies(cpBool network)
+{
+	cpSpace *space = BENCH_SPACE_NEW();
+	cpSpaceSetIterations(space, 10);
+	cpSpaceSetGravity(space, cpv(0, -100));
+	
+	cpSpaceAddShape(space, cpSegmentShapeNew(cpSpaceGetStaticBody(space), cpv(-320, -240), cpv(320, -240), 0.0f));
+	soft_network = (network ? cpSpringNetworkNew() : NULL);
+	
+	int size = 12;
+	cpBody *grid[12*12];
+	
+	for(int blob=0; blob<16; blob++){
+		cpVect origin = cpv(-300 + (blob%4)*150, -200 + (blob/4)*130);
+		
+		for(int i=0; i<size*size; i++){
+			cpBody *body = cpSpaceAddBody(space, cpBodyNew(1.0f, cpMomentForCircle(1.0f, 0.0f, 4.0f, cpvzero)));
+			cpBodySetPosition(body, cpvadd(origin, cpv((i%size)*10, (i/size)*10)));
+			
+			cpShape *shape = cpSpaceAddShape(space, cpCircleShapeNew(body, 4.0f, cpvzero));
+			cpShapeSetFriction(shape, 0.7f);
+			
+			grid[i] = body;
+		}
+		
+		// Structural springs along the rows and columns and shear springs along the diagonals.
+		int offsets[4][2] = {{1, 0}, {0, 1}, {1, 1}, {1, -1}};
+		for(int i=0; i<size*size; i++){
+			int x = i%size, y = i/size;
+			
+			for(int j=0; j<4; j++){
+				int x2 = x + offsets[j][0], y2 = y + offsets[j][1];
+				if(x2 >= size || y2 < 0 || y2 >= size) continue;
+				
+				cpBody *a = grid[i], *b = grid[y2*size + x2];
+				cpFloat restLength = cpvdist(cpBodyGetPosition(a), cpBodyGetPosition(b));
+				
+				if(network){
+					cpSpringNetworkAddSpring(soft_network, a, b, cpvzero, cpvzero, restLength, 200.0f, 2.0f);
+				} else {
+					cpSpaceAddConstraint(space, cpDampedSpringNew(a, b, cpvzero, cpvzero, restLength, 200.0f, 2.0f));
+				}
+			}
+		}
+	}
+	
+	if(network) cpSpaceAddSpringNetwork(space, soft_network);
+	
+	return space;
+}
+
+static cpSpace *init_SoftBodySprings(void){return SetupSpace_softBodies(cpFalse);}
+static cpSpace *init_SoftBodyNetwork(void){return SetupSpace_softBodies(cpTrue);}
+
+
 // TODO ideas:
 // addition/removal
 // Memory usage? (too small to matter?)
@@ -448,6 +639,26 @@ static void destroy(cpSpace *space){
 	BENCH_SPACE_FREE(space);
 }
 
+static void update_chains(cpSpace *space, double dt){
+	BENCH_SPACE_STEP(space, dt);
+	cpSpaceEachConstraint(space, ChainJointError, NULL);
+}
+
+static void destroy_chains(cpSpace *space){
+	printf("Max joint error = %.3f (%d iterations)\n", chain_error, cpSpaceGetIterations(space));
+	destroy(space);
+}
+
+static void destroy_softBodies(cpSpace *space){
+	if(soft_network){
+		cpSpaceRemoveSpringNetwork(space, soft_network);
+		cpSpringNetworkFree(soft_network);
+		soft_network = NULL;
+	}
+	
+	destroy(space);
+}
+
 // Make a second demo declaration for this demo to use in the regular demo set.
 ChipmunkDemo BouncyHexagons = {
 	"Bouncy Hexagons",
@@ -459,6 +670,7 @@ ChipmunkDemo BouncyHexagons = {
 };
 
 #define BENCH(n) {"benchmark - " #n, 1.0/60.0, init_##n, update, 	ChipmunkDemoDefaultDrawImpl, destroy}
+#define BENCH_CHAINS(n) {"benchmark - " #n, 1.0/60.0, init_##n, update_chains, ChipmunkDemoDefaultDrawImpl, destroy_chains}
 ChipmunkDemo bench_list[] = {
 	BENCH(SimpleTerrainCircles_1000),
 	BENCH(SimpleTerrainCircles_500),
@@ -477,6 +689,103 @@ ChipmunkDemo bench_list[] = {
 	BENCH(BouncyTerrainCircles_500),
 	BENCH(BouncyTerrainHexagons_500),
 	BENCH(NoCollide),
+	BENCH(PyramidStack),
+	BENCH(BoxPile_20000),
+	BENCH_CHAINS(RigidChains_4),
+	BENCH_CHAINS(RigidChains_16),
+	BENCH_CHAINS(RigidChains_64),
+	BENCH_CHAINS(SoftChains_4),
+	BENCH_CHAINS(SoftChains_16),
+	BENCH_CHAINS(SoftChains_64),
+	BENCH_CHAINS(DirectChains_1),
+	BENCH_CHAINS(DirectChains_4),
+	BENCH_CHAINS(DirectChains_16),
+	{"benchmark - SoftBodySprings", 1.0/60.0, init_SoftBodySprings, update, ChipmunkDemoDefaultDrawImpl, destroy_softBodies},
+	{"benchmark - SoftBodyNetwork", 1.0/60.0, init_SoftBodyNetwork, update, ChipmunkDemoDefaultDrawImpl, destroy_softBodies},
 };
 
 int bench_count = sizeof(bench_list)/sizeof(ChipmunkDemo);
+
+// Compare mode (-compare)
+// Steps each benchmark with and without cpHastySpace's vectorized contact solver and compares the bodies afterwards.
+// The two solvers round differently, so the runs are kept short enough that the piles don't diverge.
+
+#if ENABLE_HASTY
+typedef struct BenchBodyState {
+	cpVect p, v;
+	cpFloat a, w;
+} BenchBodyState;
+
+typedef struct BenchBodyStates {
+	int count, capacity;
+	BenchBodyState *arr;
+} BenchBodyStates;
+
+static void
+StoreBodyState(cpBody *body, BenchBodyStates *states)
+{
+	if(states->count == states->capacity){
+		states->capacity = 3*(states->capacity + 1)/2;
+		states->arr = (BenchBodyState *)realloc(states->arr, states->capacity*sizeof(BenchBodyState));
+	}
+	
+	states->arr[states->count++] = (BenchBodyState){cpBodyGetPosition(body), cpBodyGetVelocity(body), cpBodyGetAngle(body), cpBodyGetAngularVelocity(body)};
+}
+
+static void
+RunBenchStates(ChipmunkDemo *demo, cpBool vectorized, int steps, BenchBodyStates *states)
+{
+	bench_vectorized = vectorized;
+	
+	// Seed the random scenes the same way each time.
+	srand(45073);
+	cpSpace *space = demo->initFunc();
+	for(int i=0; i<steps; i++) demo->updateFunc(space, demo->timestep);
+	
+	states->count = 0;
+	cpSpaceEachBody(space, (cpSpaceBodyIteratorFunc)StoreBodyState, states);
+	demo->destroyFunc(space);
+	
+	bench_vectorized = cpTrue;
+}
+#endif
+
+// Returns the number of benchmarks whose bodies differed by more than the tolerance.
+int
+BenchCompareVectorized(int steps, cpFloat tolerance)
+{
+#if ENABLE_HASTY
+	int failures = 0;
+	BenchBodyStates scalar = {0, 0, NULL}, vectorized = {0, 0, NULL};
+	
+	for(int i=0; i<bench_count; i++){
+		ChipmunkDemo *demo = bench_list + i;
+		RunBenchStates(demo, cpFalse, steps, &scalar);
+		RunBenchStates(demo, cpTrue, steps, &vectorized);
+		
+		cpFloat maxP = 0.0f, maxV = 0.0f, maxA = 0.0f;
+		cpBool match = (scalar.count == vectorized.count);
+		
+		for(int j=0; match && j<scalar.count; j++){
+			BenchBodyState *a = scalar.arr + j, *b = vectorized.arr + j;
+			maxP = cpfmax(maxP, cpvdist(a->p, b->p));
+			maxV = cpfmax(maxV, cpvdist(a->v, b->v));
+			maxA = cpfmax(maxA, cpfmax(cpfabs(a->a - b->a), cpfabs(a->w - b->w)));
+		}
+		
+		// Positions and angles are compared directly, velocities relative to the distance moved in a step.
+		match = match && maxP <= tolerance && maxA <= tolerance && maxV*demo->timestep <= tolerance;
+		if(!match) failures++;
+		
+		printf("Compare(%c) = %s position %.2e velocity %.2e angle %.2e (%s)\n", i + 'a', match ? "ok  " : "FAIL", maxP, maxV, maxA, demo->name);
+		fflush(stdout);
+	}
+	
+	free(scalar.arr);
+	free(vectorized.arr);
+	return failures;
+#else
+	printf("Set ENABLE_HASTY in Bench.c to compare the vectorized solver.\n");
+	return 0;
+#endif
+}
@@ -565,6 +565,7 @@ extern ChipmunkDemo GJK;
 
 extern ChipmunkDemo bench_list[];
 extern int bench_count;
+extern int BenchCompareVectorized(int steps, cpFloat tolerance);
 
 static void
 Init(void)
@@ -618,6 +619,8 @@ sapp_desc sokol_main(int argc, char* argv[]) {
 			demo_count = bench_count;
 		} else if(strcmp(argv[i], "-trial") == 0){
 			trial = 1;
+		} else if(strcmp(argv[i], "-compare") == 0){
+			exit(BenchCompareVectorized(60, 1e-3) == 0 ? 0 : 1);
 		}
 	}
 	
@@ -67,6 +67,11 @@ CP_EXPORT void cpMessage(const char *condition, const char *file, int line, int
 	#define CP_BUFFER_BYTES (32*1024)
 #endif
 
+/// Alignment of arrays that are walked often enough to care about cache line boundaries.
+#ifndef CP_CACHE_LINE_BYTES
+	#define CP_CACHE_LINE_BYTES 64
+#endif
+
 #ifndef cpcalloc
 	/// Chipmunk calloc() alias.
 	#define cpcalloc calloc
@@ -103,6 +108,7 @@ typedef struct cpRotaryLimitJoint cpRotaryLimitJoint;
 typedef struct cpRatchetJoint cpRatchetJoint;
 typedef struct cpGearJoint cpGearJoint;
 typedef struct cpSimpleMotorJoint cpSimpleMotorJoint;
+typedef struct cpSpringNetwork cpSpringNetwork;
 
 typedef struct cpCollisionHandler cpCollisionHandler;
 typedef struct cpContactPointSet cpContactPointSet;
@@ -122,6 +128,7 @@ typedef struct cpSpace cpSpace;
 #include "cpPolyShape.h"
 
 #include "cpConstraint.h"
+#include "cpSpringNetwork.h"
 
 #include "cpSpace.h"
 
@@ -22,6 +22,8 @@
 #ifndef CHIPMUNK_PRIVATE_H
 #define CHIPMUNK_PRIVATE_H
 
+#include <string.h>
+
 #include "chipmunk/chipmunk.h"
 #include "chipmunk/chipmunk_structs.h"
 
@@ -31,6 +33,13 @@
 // TODO: Eww. Magic numbers.
 #define MAGIC_EPSILON 1e-5
 
+// Counters are compiled out completely unless CP_ENABLE_COUNTERS is set.
+#if CP_ENABLE_COUNTERS
+	#define CP_COUNTER_ADD(counter, n) ((counter) += (n))
+#else
+	#define CP_COUNTER_ADD(counter, n)
+#endif
+
 
 //MARK: cpArray
 
@@ -67,6 +76,31 @@ void cpHashSetEach(cpHashSet *set, cpHashSetIteratorFunc func, void *data);
 typedef cpBool (*cpHashSetFilterFunc)(void *elt, void *data);
 void cpHashSetFilter(cpHashSet *set, cpHashSetFilterFunc func, void *data);
 
+// Number of bins compared by insert, remove and find since the last reset. Always 0 unless CP_ENABLE_COUNTERS is set.
+unsigned long cpHashSetGetProbeCount(cpHashSet *set);
+void cpHashSetResetProbeCount(cpHashSet *set);
+
+
+//MARK: cpThreadPool
+
+// Persistent pool of worker threads that parallel phases of a step can be dispatched to.
+// The calling thread always participates as worker 0.
+typedef struct cpThreadPool cpThreadPool;
+typedef void (*cpThreadPoolFunc)(void *data, unsigned long worker, unsigned long worker_count);
+
+// Number of logical CPUs available to the process, or 1 if it can't be detected.
+unsigned long cpThreadPoolDetectThreads(void);
+
+// When pinned is true, each worker thread is bound to its own CPU. Only supported on Linux.
+cpThreadPool *cpThreadPoolNew(unsigned long threads, cpBool pinned);
+void cpThreadPoolFree(cpThreadPool *pool);
+unsigned long cpThreadPoolGetThreads(cpThreadPool *pool);
+
+// Run func on every thread in the pool and wait for all of them to finish.
+void cpThreadPoolRun(cpThreadPool *pool, cpThreadPoolFunc func, void *data);
+// Block until worker_count workers running the current function have reached the barrier.
+void cpThreadPoolBarrier(cpThreadPool *pool, unsigned long worker_count);
+
 
 //MARK: Bodies
 
@@ -78,11 +112,28 @@ void cpBodyAccumulateMassFromShapes(cpBody *body);
 
 void cpBodyRemoveConstraint(cpBody *body, cpConstraint *constraint);
 
+// Run the velocity or position functions for an array of bodies.
+// Bodies that use the default functions are integrated inline instead of through the function pointers.
+void cpBodyIntegrateVelocities(cpBody **bodies, int count, cpVect gravity, cpFloat damping, cpFloat dt);
+void cpBodyIntegratePositions(cpBody **bodies, int count, cpFloat dt);
+
+// Transform the body would have if its center of gravity was at 'p' with angle 'a'.
+cpTransform cpBodyTransformAt(const cpBody *body, cpVect p, cpFloat a);
+
 
 //MARK: Spatial Index Functions
 
 cpSpatialIndex *cpSpatialIndexInit(cpSpatialIndex *index, cpSpatialIndexClass *klass, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
 
+// Number of leaves reinserted since the last reset. Always 0 for other index types or unless CP_ENABLE_COUNTERS is set.
+unsigned long cpBBTreeGetReinsertionCount(cpSpatialIndex *index);
+void cpBBTreeResetReinsertionCount(cpSpatialIndex *index);
+
+// Same as cpSpatialIndexReindexQuery(), but refits the leaves and searches the tree for pairs on the workers of the pool.
+// func is only called from the calling thread, in the same order as the serial version.
+// Falls back to cpSpatialIndexReindexQuery() for other index types.
+void cpBBTreeReindexQueryThreaded(cpSpatialIndex *index, cpThreadPool *pool, cpSpatialIndexQueryFunc func, void *data);
+
 
 //MARK: Arbiters
 
@@ -97,9 +148,28 @@ cpArbiterThreadForBody(cpArbiter *arb, cpBody *body)
 void cpArbiterUnthread(cpArbiter *arb);
 
 void cpArbiterUpdate(cpArbiter *arb, struct cpCollisionInfo *info, cpSpace *space);
+// Target bounce velocity for a contact with a normal relative velocity of vrn and separation of dist.
+// Speculative contacts that aren't touching yet only stop the shapes from closing more than the gap during the step.
+// Elastic contacts that would close the gap bounce right away instead so they don't lose their approach speed.
+static inline cpFloat
+cpArbiterBounceVelocity(cpFloat vrn, cpFloat e, cpFloat dist, cpFloat dt)
+{
+	if(dist > 0.0f && (e == 0.0f || vrn*dt + dist > 0.0f)){
+		return dist/dt;
+	} else {
+		return vrn*e;
+	}
+}
+
 void cpArbiterPreStep(cpArbiter *arb, cpFloat dt, cpFloat bias, cpFloat slop);
-void cpArbiterApplyCachedImpulse(cpArbiter *arb, cpFloat dt_coef);
-void cpArbiterApplyImpulse(cpArbiter *arb);
+void cpArbiterPreSubstep(cpArbiter *arb, cpVect rot_a, cpVect rot_b, cpFloat dt, cpFloat slop, cpFloat bias);
+// Set up the block solver for the normal impulses of two contact manifolds. Called by the prestep functions.
+void cpArbiterPreStepBlock(cpArbiter *arb);
+void cpArbiterApplyCachedImpulse(cpArbiter *arb, struct cpSolverBody *bodies, cpFloat dt_coef);
+// Returns the total change in the contacts' accumulated impulses.
+cpFloat cpArbiterApplyImpulse(cpArbiter *arb, struct cpSolverBody *bodies);
+// Solve the arbiter as if body_a (or body_b) had infinite mass, see cpSpaceSetShockIterations().
+void cpArbiterApplyShockImpulse(cpArbiter *arb, struct cpSolverBody *bodies, cpBool freezeA);
 
 
 //MARK: Shapes/Collisions
@@ -114,8 +184,25 @@ cpShapeActive(cpShape *shape)
 	return (shape->prev || (shape->body && shape->body->shapeList == shape));
 }
 
+cpBB cpPolyShapeCacheData(cpPolyShape *poly, cpTransform transform);
+// Update the cached data and bounding boxes of every shape attached to an array of bodies.
+void cpShapeCacheBBsForBodies(cpBody **bodies, int count);
+// Grow the cached bounding boxes of every shape attached to an array of bodies to cover dt of movement at their current velocities.
+void cpShapeSweepBBsForBodies(cpBody **bodies, int count, cpFloat dt);
+
 // Note: This function returns contact points with r1/r2 in absolute coordinates, not body relative.
-struct cpCollisionInfo cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, struct cpContact *contacts);
+// Contacts are generated for shapes up to 'margin' apart, and have a positive separation if they don't overlap.
+struct cpCollisionInfo cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, cpFloat margin, struct cpContact *contacts);
+
+// Distance between the surfaces of two shapes using their cached data, negative when they overlap.
+cpFloat cpShapesDistance(const cpShape *a, const cpShape *b);
+
+#if CP_ENABLE_COUNTERS
+// Add the GJK/EPA iterations and contacts from a call to cpCollide() to the space's counters.
+void cpSpaceCountCollision(cpSpace *space, const struct cpCollisionInfo *info);
+#else
+#define cpSpaceCountCollision(space, info)
+#endif
 
 static inline void
 CircleSegmentQuery(cpShape *shape, cpVect center, cpFloat r1, cpVect a, cpVect b, cpFloat r2, cpSegmentQueryInfo *info)
@@ -195,20 +282,101 @@ apply_impulses(cpBody *a , cpBody *b, cpVect r1, cpVect r2, cpVect j)
 	apply_impulse(b, j, r2);
 }
 
+//MARK: Solver Body Helpers
+// Versions of the helpers above that operate on the packed solver bodies.
+// Only valid between cpSpaceGatherSolverBodies() and cpSpaceScatterSolverBodies().
+
+static inline struct cpSolverBody *
+cpConstraintSolverBodyA(cpConstraint *constraint)
+{
+	return constraint->space->solverBodies + constraint->solver_a;
+}
+
+static inline struct cpSolverBody *
+cpConstraintSolverBodyB(cpConstraint *constraint)
+{
+	return constraint->space->solverBodies + constraint->solver_b;
+}
+
+static inline cpVect
+solver_relative_velocity(struct cpSolverBody *a, struct cpSolverBody *b, cpVect r1, cpVect r2){
+	cpVect v1_sum = cpvadd(a->v, cpvmult(cpvperp(r1), a->w));
+	cpVect v2_sum = cpvadd(b->v, cpvmult(cpvperp(r2), b->w));
+	
+	return cpvsub(v2_sum, v1_sum);
+}
+
+static inline cpFloat
+solver_normal_relative_velocity(struct cpSolverBody *a, struct cpSolverBody *b, cpVect r1, cpVect r2, cpVect n){
+	return cpvdot(solver_relative_velocity(a, b, r1, r2), n);
+}
+
 static inline void
-apply_bias_impulse(cpBody *body, cpVect j, cpVect r)
+solver_apply_impulse(struct cpSolverBody *body, cpVect j, cpVect r){
+	body->v = cpvadd(body->v, cpvmult(j, body->m_inv));
+	body->w += body->i_inv*cpvcross(r, j);
+}
+
+static inline void
+solver_apply_impulses(struct cpSolverBody *a , struct cpSolverBody *b, cpVect r1, cpVect r2, cpVect j)
+{
+	solver_apply_impulse(a, cpvneg(j), r1);
+	solver_apply_impulse(b, j, r2);
+}
+
+static inline void
+solver_apply_bias_impulse(struct cpSolverBody *body, cpVect j, cpVect r)
 {
 	body->v_bias = cpvadd(body->v_bias, cpvmult(j, body->m_inv));
 	body->w_bias += body->i_inv*cpvcross(r, j);
 }
 
 static inline void
-apply_bias_impulses(cpBody *a , cpBody *b, cpVect r1, cpVect r2, cpVect j)
+solver_apply_bias_impulses(struct cpSolverBody *a , struct cpSolverBody *b, cpVect r1, cpVect r2, cpVect j)
 {
-	apply_bias_impulse(a, cpvneg(j), r1);
-	apply_bias_impulse(b, j, r2);
+	solver_apply_bias_impulse(a, cpvneg(j), r1);
+	solver_apply_bias_impulse(b, j, r2);
+}
+
+// Apply the impulses of a constraint whose class works on the cpBody velocities instead of the solver bodies.
+void cpConstraintApplyBodyImpulse(cpConstraint *constraint, cpFloat dt);
+void cpConstraintApplyCachedBodyImpulse(cpConstraint *constraint, cpFloat dt_coef);
+
+static inline void
+cpConstraintApplyImpulse(cpConstraint *constraint, cpFloat dt)
+{
+	if(constraint->klass->solverBodies){
+		constraint->klass->applyImpulse(constraint, dt);
+	} else {
+		cpConstraintApplyBodyImpulse(constraint, dt);
+	}
 }
 
+static inline void
+cpConstraintApplyCachedImpulse(cpConstraint *constraint, cpFloat dt_coef)
+{
+	if(constraint->klass->solverBodies){
+		constraint->klass->applyCachedImpulse(constraint, dt_coef);
+	} else {
+		cpConstraintApplyCachedBodyImpulse(constraint, dt_coef);
+	}
+}
+
+//MARK: Batched Constraint Solver
+// Typed versions of the constraint callbacks that run over a whole batch of the same class.
+// The solver copies the batch into packed rows, iterates on those and stores the results back.
+
+void cpPivotJointPreStepBatch(cpConstraint **joints, int count, cpFloat dt);
+void cpPivotJointLoadRows(cpConstraint **joints, int count, struct cpPivotJointRow *rows, cpFloat dt);
+void cpPivotJointApplyCachedImpulseRows(struct cpPivotJointRow *rows, int count, struct cpSolverBody *bodies, cpFloat dt_coef);
+void cpPivotJointApplyImpulseRows(struct cpPivotJointRow *rows, int count, struct cpSolverBody *bodies);
+void cpPivotJointStoreRows(cpConstraint **joints, int count, struct cpPivotJointRow *rows);
+
+void cpDampedSpringPreStepBatch(cpConstraint **springs, int count, cpFloat dt);
+void cpDampedSpringLoadRows(cpConstraint **springs, int count, struct cpDampedSpringRow *rows);
+void cpDampedSpringApplyImpulseRows(struct cpDampedSpringRow *rows, int count, struct cpSolverBody *bodies);
+void cpDampedSpringStoreRows(cpConstraint **springs, int count, struct cpDampedSpringRow *rows);
+
 static inline cpFloat
 k_scalar_body(cpBody *body, cpVect r, cpVect n)
 {
@@ -267,6 +435,35 @@ bias_coef(cpFloat errorBias, cpFloat dt)
 	return 1.0f - cpfpow(errorBias, dt);
 }
 
+// Coefficients of a soft constraint with the given natural frequency (Hz) and damping ratio.
+// Impulses are then solved as j = massScale*mass*(bias - v) - impulseScale*jAcc with bias = -biasRate*error.
+static inline struct cpSoftness
+cpSoftnessForFrequency(cpFloat frequency, cpFloat dampingRatio, cpFloat dt)
+{
+	cpFloat omega = 2.0f*CP_PI*frequency;
+	cpFloat a1 = 2.0f*dampingRatio + dt*omega;
+	cpFloat a2 = dt*omega*a1;
+	cpFloat a3 = 1.0f/(1.0f + a2);
+	
+	struct cpSoftness soft = {omega/a1, a2*a3, a3};
+	return soft;
+}
+
+// Update the softness of a constraint for the timestep. Returns true if it's soft.
+// Rigid constraints get coefficients that leave their impulses unchanged.
+static inline cpBool
+cpConstraintUpdateSoftness(cpConstraint *constraint, cpFloat dt)
+{
+	if(constraint->frequency > 0.0f){
+		constraint->soft = cpSoftnessForFrequency(constraint->frequency, constraint->dampingRatio, dt);
+		return cpTrue;
+	} else {
+		struct cpSoftness rigid = {0.0f, 1.0f, 0.0f};
+		constraint->soft = rigid;
+		return cpFalse;
+	}
+}
+
 
 //MARK: Spaces
 
@@ -281,11 +478,43 @@ void cpSpaceSetStaticBody(cpSpace *space, cpBody *body);
 extern cpCollisionHandler cpCollisionHandlerDoNothing;
 
 void cpSpaceProcessComponents(cpSpace *space, cpFloat dt);
+// Fraction of the overlap between shapes to fix each step, from the collision bias or contact frequency.
+cpFloat cpSpaceContactBiasCoef(cpSpace *space, cpFloat dt);
 
 void cpSpacePushFreshContactBuffer(cpSpace *space);
 struct cpContact *cpContactBufferGetArray(cpSpace *space);
 void cpSpacePushContacts(cpSpace *space, int count);
 
+void cpSpaceGatherSolverBodies(cpSpace *space);
+void cpSpaceScatterSolverBodies(cpSpace *space);
+
+// Implementation of cpSpaceAdvance() that takes its fixed steps with the given step function.
+typedef void (*cpSpaceStepFunc)(cpSpace *space, cpFloat dt);
+int cpSpaceAdvanceWithStepFunc(cpSpace *space, cpFloat frameTime, cpSpaceStepFunc step);
+
+// Defined in cpSpaceCCD.c
+// Remember where the bullets are before their positions are integrated.
+void cpSpaceBeginBullets(cpSpace *space);
+// Move the bullets back to their earliest time of impact after their positions were integrated and their shapes' bounding boxes updated.
+// If 'stop' is true, the bullets that hit something lose their velocity too since collision detection won't run again to find the contact.
+void cpSpaceSweepBullets(cpSpace *space, cpBool stop);
+
+// Defined in cpSpaceDirect.c
+// Find the trees of joints that the direct solver can handle and flag them, must run before the constraints are sorted.
+void cpSpaceBuildDirectTrees(cpSpace *space);
+// Factor the trees after their joints have been prestepped.
+void cpSpaceFactorDirectTrees(cpSpace *space);
+// Solve all of the joints in the trees exactly for the current velocities and apply the impulses.
+void cpSpaceSolveDirectTrees(cpSpace *space);
+// Solve the tree starting at node 'root' and return the magnitude of the impulses it applied.
+cpFloat cpSpaceSolveDirectTree(cpSpace *space, int root);
+
+// Defined in cpSpringNetwork.c
+// Compute the spring forces and the damping coefficients of all of the springs in a network and apply the spring forces.
+void cpSpringNetworkPreStep(cpSpringNetwork *network, cpFloat dt);
+// Apply one iteration of the springs' damping to the solver bodies.
+void cpSpringNetworkApplyImpulse(cpSpringNetwork *network, struct cpSolverBody *bodies);
+
 cpPostStepCallback *cpSpaceGetPostStepCallback(cpSpace *space, void *key);
 
 cpBool cpSpaceArbiterSetFilter(cpArbiter *arb, cpSpace *space);
@@ -312,6 +541,97 @@ cpSpaceArrayForBodyType(cpSpace *space, cpBodyType type)
 }
 
 void cpShapeUpdateFunc(cpShape *shape, void *unused);
+void cpSpaceRunConstraintPreSolve(cpSpace *space, cpConstraint *constraint);
+void cpSpaceRunPostSolveCallbacks(cpSpace *space);
+
+//MARK: Profiling
+
+// Monotonic time in seconds.
+double cpProfileTime(void);
+
+typedef struct cpProfileTimer {
+	double start;
+	cpFloat callbacks;
+} cpProfileTimer;
+
+// Start timing a phase of the step. Does nothing unless profiling is enabled.
+static inline cpProfileTimer
+cpSpaceProfileStart(cpSpace *space)
+{
+	cpProfileTimer timer = {0.0, 0.0f};
+	
+	if(space->profilingEnabled){
+		timer.start = cpProfileTime();
+		timer.callbacks = space->stepProfile.callbacks;
+	}
+	
+	return timer;
+}
+
+// Add the time since the timer started to 'phase', minus any time spent in callbacks in the meantime.
+static inline void
+cpSpaceProfileStop(cpSpace *space, cpFloat *phase, cpProfileTimer timer)
+{
+	if(space->profilingEnabled){
+		*phase += (cpFloat)(cpProfileTime() - timer.start) - (space->stepProfile.callbacks - timer.callbacks);
+	}
+}
+
+// The total time of a step includes the callbacks.
+static inline void
+cpSpaceProfileStopTotal(cpSpace *space, cpProfileTimer timer)
+{
+	if(space->profilingEnabled) space->stepProfile.total = (cpFloat)(cpProfileTime() - timer.start);
+}
+
+static inline void
+cpSpaceProfileReset(cpSpace *space)
+{
+	if(space->profilingEnabled) memset(&space->stepProfile, 0, sizeof(space->stepProfile));
+}
+
+// Reasons cpSpaceQueryReject() can reject a pair of shapes, or 0 if it didn't.
+enum cpQueryRejectReason {
+	CP_QUERY_REJECT_BB = 1,
+	CP_QUERY_REJECT_SAME_BODY,
+	CP_QUERY_REJECT_FILTER,
+	CP_QUERY_REJECT_CONSTRAINT,
+};
+
+int cpSpaceQueryReject(cpShape *a, cpShape *b);
+
+// Separation at which speculative contacts should be generated for a pair of shapes.
+// Covers how far the shapes could close the gap at their current velocities within space->speculativeTime.
+// The collision slop is added so resting shapes keep all of their contact points.
+static inline cpFloat
+cpSpaceSpeculativeMargin(cpSpace *space, cpShape *a, cpShape *b)
+{
+	cpFloat dt = space->speculativeTime;
+	if(dt == 0.0f || a->sensor || b->sensor) return 0.0f;
+	
+	// The bounding boxes are already swept by now, so use the extents cached before that.
+	cpBody *body_a = a->body, *body_b = b->body;
+	cpFloat speed = cpvlength(cpvsub(body_b->v, body_a->v)) + cpfabs(body_a->w)*a->extent + cpfabs(body_b->w)*b->extent;
+	return speed*dt + space->collisionSlop;
+}
+
+static inline void
+cpSpaceCountQueryReject(cpSpace *space, int reason)
+{
+#if CP_ENABLE_COUNTERS
+	cpSpaceCounters *counters = &space->counters;
+	counters->candidatePairs++;
+	switch(reason){
+		case CP_QUERY_REJECT_BB: counters->rejectedBB++; break;
+		case CP_QUERY_REJECT_SAME_BODY: counters->rejectedSameBody++; break;
+		case CP_QUERY_REJECT_FILTER: counters->rejectedFilter++; break;
+		case CP_QUERY_REJECT_CONSTRAINT: counters->rejectedConstraint++; break;
+		default: break;
+	}
+#endif
+}
+
+void cpSpaceProcessCollision(cpSpace *space, struct cpCollisionInfo *info);
 cpCollisionID cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space);
 
 
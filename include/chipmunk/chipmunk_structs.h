@@ -67,6 +67,18 @@ struct cpBody {
 	cpVect v_bias;
 	cpFloat w_bias;
 	
+	// Index of the body's record in the space's solver body array.
+	// Only valid while the impulse solver is running.
+	int solverIndex;
+	
+	// Index of the awake contact graph component (island) the body belongs to.
+	// Only valid after cpSpaceProcessComponents() when the space generates islands.
+	int island;
+	
+	// Number of supporting contacts between the body and a static or kinematic body, or 0 if it isn't resting on one.
+	// Only valid after cpSpaceProcessComponents() when shock propagation is enabled.
+	int shockLevel;
+	
 	cpSpace *space;
 	
 	cpShape *shapeList;
@@ -78,6 +90,21 @@ struct cpBody {
 		cpBody *next;
 		cpFloat idleTime;
 	} sleeping;
+	
+	struct {
+		cpBool enabled;
+		// Position of the center of gravity and angle before the last position update.
+		cpVect p;
+		cpFloat a;
+	} bullet;
+	
+	struct {
+		// Position of the center of gravity and angle before the last step taken by cpSpaceAdvance().
+		cpVect p;
+		cpFloat a;
+		// Value of the space's stamp after that step, the pose is stale otherwise.
+		cpTimestamp stamp;
+	} interpolation;
 };
 
 enum cpArbiterState {
@@ -94,6 +121,83 @@ enum cpArbiterState {
 	CP_ARBITER_STATE_INVALIDATED,
 };
 
+// Packed copy of the velocity state of a body used by the impulse solver.
+// Arbiters and constraints refer to these by index so the solver iterations
+// stay inside a small contiguous array instead of chasing cpBody pointers.
+struct cpSolverBody {
+	cpVect v;
+	cpFloat w;
+	
+	cpVect v_bias;
+	cpFloat w_bias;
+	
+	cpFloat m_inv;
+	cpFloat i_inv;
+	
+#if CP_SOLVER_BODY_PADDING
+	char padding[CP_SOLVER_BODY_PADDING];
+#endif
+};
+
+// Packed copies of the fields the solver iterates on for the most common joint types.
+// Rows refer to their bodies by solver body index like arbiters do.
+struct cpPivotJointRow {
+	int a, b;
+	cpVect r1, r2;
+	cpMat2x2 k;
+	cpVect bias;
+	cpVect jAcc;
+	cpFloat jMax;
+	cpFloat massScale, impulseScale;
+};
+
+struct cpDampedSpringRow {
+	int a, b;
+	cpVect r1, r2, n;
+	cpFloat nMass, v_coef;
+	cpFloat target_vrn;
+	cpFloat jAcc;
+};
+
+enum cpConstraintBatchType {
+	CP_CONSTRAINT_BATCH_GENERIC,
+	CP_CONSTRAINT_BATCH_PIVOT_JOINT,
+	CP_CONSTRAINT_BATCH_DAMPED_SPRING,
+	// Joints of any class solved by the direct solver, the batch has no class.
+	CP_CONSTRAINT_BATCH_DIRECT,
+};
+
+// A run of constraints with the same class in cpSpace.batchedConstraints.
+struct cpConstraintBatch {
+	const struct cpConstraintClass *klass;
+	enum cpConstraintBatchType type;
+	int start, count;
+};
+
+// A body or joint in one of the trees solved by the direct solver, see cpSpaceDirect.c.
+// Nodes are stored in breadth first order so a node's parent always comes before it.
+struct cpDirectNode {
+	// Index of the parent node, or -1 for the root body of a tree.
+	int parent;
+	// Number of rows, 3 for a body and 1 or 2 for a joint.
+	int dim;
+	
+	// Exactly one of these is set.
+	cpBody *body;
+	cpConstraint *constraint;
+	
+	// Anchors, row directions and bias velocities of a joint, copied when the tree is factored.
+	cpVect r1, r2;
+	cpVect n[2];
+	cpFloat bias[2];
+	
+	// 3x3 row major blocks, only the first 'dim' rows are used.
+	// 'd' is the inverse of the diagonal block after factoring,
+	// and 'l' is the block coupling the node to its parent multiplied by 'd'.
+	cpFloat d[9], l[9];
+	cpFloat x[3];
+};
+
 struct cpArbiterThread {
 	struct cpArbiter *next, *prev;
 };
@@ -119,6 +223,20 @@ struct cpCollisionInfo {
 	int count;
 	// TODO Should this be a unique struct type?
 	struct cpContact *arr;
+	
+	// Separation at which contacts are still generated, for speculative contacts.
+	cpFloat margin;
+	
+#if CP_ENABLE_COUNTERS
+	int gjkIterations, epaIterations;
+#endif
+};
+
+// Effective mass matrix for the normal impulses of a two contact manifold and its inverse.
+struct cpContactBlock {
+	cpBool enabled;
+	cpFloat k11, k12, k22;
+	cpFloat m11, m12, m22;
 };
 
 struct cpArbiter {
@@ -132,10 +250,16 @@ struct cpArbiter {
 	cpBody *body_a, *body_b;
 	struct cpArbiterThread thread_a, thread_b;
 	
+	// Solver body indexes, assigned each step by cpSpaceGatherSolverBodies().
+	int solver_a, solver_b;
+	
 	int count;
 	struct cpContact *contacts;
 	cpVect n;
 	
+	// Only valid when 'enabled' is set by cpArbiterPreStepBlock().
+	struct cpContactBlock block;
+	
 	// Regular, wildcard A and wildcard B collision handlers.
 	cpCollisionHandler *handler, *handlerA, *handlerB;
 	cpBool swapped;
@@ -182,6 +306,9 @@ struct cpShape {
 	struct cpShapeMassInfo massInfo;
 	cpBB bb;
 	
+	// Half the perimeter of 'bb' from before it was swept for speculative contacts.
+	cpFloat extent;
+	
 	cpBool sensor;
 	
 	cpFloat e;
@@ -245,8 +372,20 @@ typedef struct cpConstraintClass {
 	cpConstraintApplyCachedImpulseImpl applyCachedImpulse;
 	cpConstraintApplyImpulseImpl applyImpulse;
 	cpConstraintGetImpulseImpl getImpulse;
+	
+	// True if the impulse functions work on the packed solver bodies, see cpConstraintSolverBodyA().
+	// Classes that leave it false apply their impulses to the cpBody velocities, which are kept in sync around each call.
+	cpBool solverBodies;
 } cpConstraintClass;
 
+// Coefficients of a soft constraint for the current timestep, see cpConstraintSetFrequency().
+struct cpSoftness {
+	// Fraction of the position error to correct per second.
+	cpFloat biasRate;
+	// Scale the effective mass and feed back part of the accumulated impulse each iteration.
+	cpFloat massScale, impulseScale;
+};
+
 struct cpConstraint {
 	const cpConstraintClass *klass;
 	
@@ -255,10 +394,21 @@ struct cpConstraint {
 	cpBody *a, *b;
 	cpConstraint *next_a, *next_b;
 	
+	// Solver body indexes, assigned each step by cpSpaceGatherSolverBodies().
+	int solver_a, solver_b;
+	
 	cpFloat maxForce;
 	cpFloat errorBias;
 	cpFloat maxBias;
 	
+	// Soft constraint parameters, the frequency is 0 when errorBias is used instead.
+	cpFloat frequency;
+	cpFloat dampingRatio;
+	struct cpSoftness soft;
+	
+	// Set each step while the constraint is part of a tree solved by the direct solver.
+	cpBool direct;
+	
 	cpBool collideBodies;
 	
 	cpConstraintPreSolveFunc preSolve;
@@ -336,6 +486,50 @@ struct cpDampedSpring {
 	cpFloat jAcc;
 };
 
+#if CP_USE_DOUBLES
+	#define CP_SPRING_BUNDLE_WIDTH 4
+#else
+	#define CP_SPRING_BUNDLE_WIDTH 8
+#endif
+
+// A group of springs from a spring network that are prestepped and solved together, one per lane.
+// Springs in the same bundle never share a body, so their impulses can be computed at the same time.
+// Unused lanes copy the bodies of the first lane and have no stiffness or damping.
+struct cpSpringBundle {
+	int count;
+	int spring[CP_SPRING_BUNDLE_WIDTH];
+	cpBody *bodyA[CP_SPRING_BUNDLE_WIDTH], *bodyB[CP_SPRING_BUNDLE_WIDTH];
+	
+	// Solver body indexes, assigned each step by cpSpaceGatherSolverBodies().
+	int a[CP_SPRING_BUNDLE_WIDTH], b[CP_SPRING_BUNDLE_WIDTH];
+	
+	cpFloat anchorAx[CP_SPRING_BUNDLE_WIDTH], anchorAy[CP_SPRING_BUNDLE_WIDTH];
+	cpFloat anchorBx[CP_SPRING_BUNDLE_WIDTH], anchorBy[CP_SPRING_BUNDLE_WIDTH];
+	cpFloat restLength[CP_SPRING_BUNDLE_WIDTH], stiffness[CP_SPRING_BUNDLE_WIDTH], damping[CP_SPRING_BUNDLE_WIDTH];
+	
+	cpFloat r1x[CP_SPRING_BUNDLE_WIDTH], r1y[CP_SPRING_BUNDLE_WIDTH];
+	cpFloat r2x[CP_SPRING_BUNDLE_WIDTH], r2y[CP_SPRING_BUNDLE_WIDTH];
+	cpFloat nx[CP_SPRING_BUNDLE_WIDTH], ny[CP_SPRING_BUNDLE_WIDTH];
+	cpFloat nMass[CP_SPRING_BUNDLE_WIDTH], v_coef[CP_SPRING_BUNDLE_WIDTH], target_vrn[CP_SPRING_BUNDLE_WIDTH];
+};
+
+struct cpSpringNetwork {
+	cpSpace *space;
+	
+	struct cpSpringBundle *bundles;
+	int bundleCount, bundleCapacity;
+	// Bundles before this one are full.
+	int firstOpen;
+	
+	// Bundle and lane of each spring as bundle*CP_SPRING_BUNDLE_WIDTH + lane, in the order they were added.
+	int *slots;
+	int count, capacity;
+	
+	cpSpringNetworkForceFunc springForceFunc;
+	
+	cpDataPointer userData;
+};
+
 struct cpDampedRotarySpring {
 	cpConstraint constraint;
 	cpFloat restAngle;
@@ -393,8 +587,17 @@ struct cpSimpleMotor {
 typedef struct cpContactBufferHeader cpContactBufferHeader;
 typedef void (*cpSpaceArbiterApplyImpulseFunc)(cpArbiter *arb);
 
+// Range of the arbiters and constraints of an island, see cpSpaceSetIterationTolerance().
+struct cpSolverIsland {
+	int arbiterStart, arbiterCount;
+	int constraintStart, constraintCount;
+	int directTreeStart, directTreeCount;
+	int iterations;
+};
+
 struct cpSpace {
 	int iterations;
+	cpFloat iterationTolerance;
 	
 	cpVect gravity;
 	cpFloat damping;
@@ -405,28 +608,92 @@ struct cpSpace {
 	cpFloat collisionSlop;
 	cpFloat collisionBias;
 	cpTimestamp collisionPersistence;
+	cpBool speculativeContacts;
+	cpFloat contactFrequency;
+	cpFloat contactDampingRatio;
+	
+	// Fixed step driver, see cpSpaceAdvance().
+	cpFloat fixedTimestep;
+	int maxStepsPerFrame;
+	cpFloat accumulator;
 	
 	cpDataPointer userData;
 	
 	cpTimestamp stamp;
 	cpFloat curr_dt;
+	// Time the speculative contact margins need to cover for the current step, or 0.
+	cpFloat speculativeTime;
 
 	cpArray *dynamicBodies;
 	cpArray *staticBodies;
 	cpArray *rousedBodies;
 	cpArray *sleepingComponents;
+	cpArray *bullets;
+	
+	// When enabled, cpSpaceProcessComponents() numbers the awake components even if sleeping is disabled.
+	cpBool generateIslands;
+	int islandCount;
 	
 	cpHashValue shapeIDCounter;
 	cpSpatialIndex *staticShapes;
 	cpSpatialIndex *dynamicShapes;
 	
 	cpArray *constraints;
+	cpArray *springNetworks;
+	
+	// The bodies each awake body is connected to by spring networks, see cpSpaceProcessComponents().
+	int *networkEdgeStarts;
+	cpBody **networkEdges;
+	int networkEdgeStartCapacity, networkEdgeCapacity;
 	
 	cpArray *arbiters;
 	cpContactBufferHeader *contactBuffersHead;
 	cpHashSet *cachedArbiters;
 	cpArray *pooledArbiters;
 	
+	struct cpSolverBody *solverBodies;
+	cpBody **solverBodyOwners;
+	int solverBodyCount, solverBodyCapacity;
+	
+	// Rotations of the solver bodies before the last substep, see cpSpaceStepSubsteps().
+	cpVect *substepRotations;
+	int substepRotationCapacity;
+	
+	// Arbiters and constraints sorted by island when the iteration tolerance is enabled.
+	struct cpSolverIsland *solverIslands;
+	int solverIslandCount, solverIslandCapacity;
+	cpArbiter **islandArbiters;
+	cpConstraint **islandConstraints;
+	int islandArbiterCapacity, islandConstraintCapacity;
+	// Index of the first node of each direct solver tree, sorted by island.
+	int *islandDirectTrees;
+	int islandDirectTreeCapacity;
+	
+	// Shock propagation, see cpSpaceSetShockIterations().
+	// The supported bodies in order of their levels and the arbiters sorted from the bottom up.
+	int shockIterations;
+	cpBody **shockBodies;
+	int shockBodyCount, shockBodyCapacity;
+	cpArbiter **shockArbiters;
+	int shockArbiterCount, shockArbiterCapacity;
+	
+	// Constraints grouped by class so each group can be solved with a typed loop.
+	cpConstraint **batchedConstraints;
+	int batchedConstraintCapacity;
+	struct cpConstraintBatch *constraintBatches;
+	int constraintBatchCount, constraintBatchCapacity;
+	struct cpPivotJointRow *pivotRows;
+	struct cpDampedSpringRow *springRows;
+	int pivotRowCapacity, springRowCapacity;
+	
+	// Trees of rigid joints that are solved exactly, see cpSpaceSetDirectSolver().
+	cpBool directSolver;
+	struct cpDirectNode *directNodes;
+	int directNodeCount, directNodeCapacity;
+	// Node of each awake body, indexed by its position in the dynamic body array.
+	int *directBodyNodes;
+	int directBodyNodeCapacity;
+	
 	cpArray *allocatedBuffers;
 	unsigned int locked;
 	
@@ -437,6 +704,13 @@ struct cpSpace {
 	cpBool skipPostStep;
 	cpArray *postStepCallbacks;
 	
+	cpBool profilingEnabled;
+	cpSpaceStepProfile stepProfile;
+	
+#if CP_ENABLE_COUNTERS
+	cpSpaceCounters counters;
+#endif
+	
 	cpBody *staticBody;
 	cpBody _staticBody;
 };
@@ -57,6 +57,20 @@
 	#define CP_USE_DOUBLES 1
 #endif
 
+#ifndef CP_ENABLE_COUNTERS
+	// Count collision detection and solver events, see cpSpaceGetCounters().
+	// Disabled by default so the counting is compiled out of the hot paths.
+	// Must match between Chipmunk and any code that includes chipmunk_structs.h.
+	#define CP_ENABLE_COUNTERS 0
+#endif
+
+#ifndef CP_SOLVER_BODY_PADDING
+	// Bytes of padding added to each packed solver body, see struct cpSolverBody.
+	// Padding them out to the size of a cpBody measures what packing them saves in cache misses.
+	// Must match between Chipmunk and any code that includes chipmunk_structs.h.
+	#define CP_SOLVER_BODY_PADDING 0
+#endif
+
 /// @defgroup basicTypes Basic Types
 /// Most of these types can be configured at compile time.
 /// @{
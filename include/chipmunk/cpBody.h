@@ -81,6 +81,19 @@ CP_EXPORT cpBodyType cpBodyGetType(cpBody *body);
 /// Set the type of the body.
 CP_EXPORT void cpBodySetType(cpBody *body, cpBodyType type);
 
+/// Returns true if the body is a bullet.
+CP_EXPORT cpBool cpBodyIsBullet(const cpBody *body);
+/// Bullets are fast moving dynamic bodies that should not tunnel through other shapes.
+/// Each step, the space finds the time of impact of a bullet's shapes against the shapes its movement sweeps over,
+/// and stops the bullet at the earliest one so the collision is found by the regular collision detection.
+/// The other shapes are treated as if they did not move, and the rest of the bullet's movement for that step is lost.
+/// With cpSpaceStepSubsteps(), a bullet that hits something after the first substep also loses its velocity
+/// since collision detection doesn't run again until the next step.
+/// The cost only depends on the number of bullets and the shapes near their paths,
+/// so this is much cheaper than stepping the whole space with a smaller timestep to catch a few fast objects.
+/// Collision handlers are not run for the time of impact, use shape filters to let a bullet pass through other shapes.
+CP_EXPORT void cpBodySetBullet(cpBody *body, cpBool bullet);
+
 /// Get the space this body is added to.
 CP_EXPORT cpSpace* cpBodyGetSpace(const cpBody *body);
 
@@ -132,6 +145,15 @@ CP_EXPORT void cpBodySetTorque(cpBody *body, cpFloat torque);
 /// Get the rotation vector of the body. (The x basis vector of it's transform.)
 CP_EXPORT cpVect cpBodyGetRotation(const cpBody *body);
 
+/// Get the transform of the body blended between the last two steps taken by cpSpaceAdvance().
+/// Renderers should draw bodies with this instead of cpBodyGetTransform() to move smoothly when the frame rate and
+/// the fixed timestep don't match. Bodies that were sleeping, teleported or added since the last step are not blended.
+CP_EXPORT cpTransform cpBodyGetInterpolatedTransform(const cpBody *body);
+/// Get the position of the body blended between the last two steps taken by cpSpaceAdvance().
+CP_EXPORT cpVect cpBodyGetInterpolatedPosition(const cpBody *body);
+/// Get the angle of the body blended between the last two steps taken by cpSpaceAdvance().
+CP_EXPORT cpFloat cpBodyGetInterpolatedAngle(const cpBody *body);
+
 /// Get the user data pointer assigned to the body.
 CP_EXPORT cpDataPointer cpBodyGetUserData(const cpBody *body);
 /// Set the user data pointer assigned to the body.
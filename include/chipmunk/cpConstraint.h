@@ -58,6 +58,22 @@ CP_EXPORT cpFloat cpConstraintGetMaxBias(const cpConstraint *constraint);
 /// Set the maximum rate at which joint error is corrected. (defaults to INFINITY)
 CP_EXPORT void cpConstraintSetMaxBias(cpConstraint *constraint, cpFloat maxBias);
 
+/// Get the natural frequency of the constraint when it's solved as a soft constraint.
+CP_EXPORT cpFloat cpConstraintGetFrequency(const cpConstraint *constraint);
+/// Solve the constraint as a soft constraint that behaves like a damped spring with this natural frequency in Hz.
+/// Unlike the error bias, the stiffness doesn't depend on the masses of the bodies or the number of iterations,
+/// so stiff chains stay together without jittering at low iteration counts.
+/// Frequencies up to about half of the step rate work well, the maximum bias still applies.
+/// Supported by pivot, pin and slide joints and ignored by other constraints.
+/// (defaults to 0, which uses the error bias instead)
+CP_EXPORT void cpConstraintSetFrequency(cpConstraint *constraint, cpFloat frequency);
+
+/// Get the damping ratio of the constraint when it's solved as a soft constraint.
+CP_EXPORT cpFloat cpConstraintGetDampingRatio(const cpConstraint *constraint);
+/// Set the damping ratio of the constraint when it's solved as a soft constraint.
+/// A value of 1 is critically damped, smaller values let the error overshoot and oscillate. (defaults to 1)
+CP_EXPORT void cpConstraintSetDampingRatio(cpConstraint *constraint, cpFloat dampingRatio);
+
 /// Get if the two bodies connected by the constraint are allowed to collide or not.
 CP_EXPORT cpBool cpConstraintGetCollideBodies(const cpConstraint *constraint);
 /// Set if the two bodies connected by the constraint are allowed to collide or not. (defaults to cpFalse)
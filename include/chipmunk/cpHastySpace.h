@@ -2,7 +2,7 @@
 // See http://chipmunk2d.net/legal.php for more information.
 
 /// cpHastySpace is exclusive to Chipmunk Pro
-/// Currently it enables ARM NEON optimizations in the solver, but in the future will include other optimizations such as
+/// Currently it enables ARM NEON and x86 SSE2/AVX2 optimizations in the solver, but in the future will include other optimizations such as
 /// a multi-threaded solver and multi-threaded collision broadphases.
 
 struct cpHastySpace;
@@ -10,18 +10,38 @@ typedef struct cpHastySpace cpHastySpace;
 
 /// Create a new hasty space.
 /// On ARM platforms that support NEON, this will enable the vectorized solver.
-/// cpHastySpace also supports multiple threads, but runs single threaded by default for determinism.
+/// On x86-64 the contact solver is vectorized too, using AVX2 when the CPU supports it and SSE2 otherwise.
+/// cpHastySpace also supports multiple threads, but runs single threaded by default.
+/// The solver deals out independent islands of touching bodies to the threads and splits large islands into colors,
+/// so the results are identical for any number of threads.
+/// Collision detection between the pairs found by the broadphase runs on the threads as well,
+/// while the arbiters are updated and the begin/preSolve callbacks are called from the calling thread in the same order as before.
+/// With the default bounding box tree index and enough dynamic shapes, the broadphase refits the tree and searches it for pairs on the threads too.
 CP_EXPORT cpSpace *cpHastySpaceNew(void);
 CP_EXPORT void cpHastySpaceFree(cpSpace *space);
 
-/// Set the number of threads to use for the solver.
-/// Currently Chipmunk is limited to 2 threads as using more generally provides very minimal performance gains.
-/// Passing 0 as the thread count on iOS or OS X will cause Chipmunk to automatically detect the number of threads it should use.
-/// On other platforms passing 0 for the thread count will set 1 thread.
+/// Set the number of threads to use for the narrowphase and solver.
+/// The threads are kept in a persistent pool and spin briefly between phases of a step before going to sleep.
+/// Passing 0 as the thread count will cause Chipmunk to automatically detect the number of CPUs available to the process.
 CP_EXPORT void cpHastySpaceSetThreads(cpSpace *space, unsigned long threads);
 
 /// Returns the number of threads the solver is using to run.
 CP_EXPORT unsigned long cpHastySpaceGetThreads(cpSpace *space);
 
+/// Pin each of the solver's worker threads to its own CPU core.
+/// Only supported on Linux, ignored on other platforms. Disabled by default.
+CP_EXPORT void cpHastySpaceSetThreadAffinity(cpSpace *space, cpBool pinned);
+
+/// Enable or disable the vectorized contact solver. Enabled by default.
+/// Disabling it solves the contacts one arbiter at a time like cpSpace does, which is mostly useful for checking the vectorized solver against it.
+CP_EXPORT void cpHastySpaceSetVectorized(cpSpace *space, cpBool vectorized);
+
+/// Returns true if the vectorized contact solver is enabled.
+CP_EXPORT cpBool cpHastySpaceGetVectorized(cpSpace *space);
+
 /// When stepping a hasty space, you must use this function.
 CP_EXPORT void cpHastySpaceStep(cpSpace *space, cpFloat dt);
+
+/// Same as cpSpaceAdvance(), but takes the fixed steps with cpHastySpaceStep().
+/// When advancing a hasty space, you must use this function.
+CP_EXPORT int cpHastySpaceAdvance(cpSpace *space, cpFloat frameTime);
@@ -83,6 +83,35 @@ CP_EXPORT void cpSpaceFree(cpSpace *space);
 CP_EXPORT int cpSpaceGetIterations(const cpSpace *space);
 CP_EXPORT void cpSpaceSetIterations(cpSpace *space, int iterations);
 
+/// Lets islands of touching bodies stop iterating once they have converged.
+/// When greater than 0, each island stops as soon as the total impulse applied by its contacts and joints
+/// during an iteration drops below the tolerance, and the number of iterations only sets the maximum.
+/// Piles that are already at rest then only cost a few iterations while the active ones still get all of them.
+/// Joints are measured by the larger of the linear and angular momentum they add to either of their bodies.
+/// The default value of 0 always runs all of the iterations. Ignored by cpHastySpace, which always runs all of the iterations.
+CP_EXPORT cpFloat cpSpaceGetIterationTolerance(const cpSpace *space);
+CP_EXPORT void cpSpaceSetIterationTolerance(cpSpace *space, cpFloat iterationTolerance);
+
+/// Number of the final solver iterations that use shock propagation.
+/// Impulses only travel one body further through a stack each iteration, so tall stacks normally need a lot of them.
+/// Shock propagation solves the contacts from the ground up instead, treating the lower body of each contact as if it had infinite mass.
+/// The weight of the bodies is then fully supported after a single pass, and stacks stay standing with only a few iterations.
+/// Bodies are ordered by the contacts that push them up against gravity, so it has no effect without gravity.
+/// Defaults to 0 which disables it. A single shock iteration is usually enough.
+/// With an iteration tolerance, the shock iterations run after all of the islands stop iterating. Ignored by cpHastySpace.
+CP_EXPORT int cpSpaceGetShockIterations(const cpSpace *space);
+CP_EXPORT void cpSpaceSetShockIterations(cpSpace *space, int shockIterations);
+
+/// Solve tree shaped systems of joints exactly instead of iteratively.
+/// Ropes, chains and ragdolls made of rigid pivot and pin joints are found each step and solved with a sparse factorization
+/// that takes linear time in the number of joints, so they don't stretch no matter how many iterations are used.
+/// Joints that close a loop, soft joints, joints with a max force and other joint types are left to the iterative solver, as are all contacts.
+/// Each tree can only have one joint to a static or kinematic body, so a rope pinned at both ends still iterates on one of its end joints.
+/// With an iteration tolerance, each island solves its own trees and counts their impulses towards its residual.
+/// Defaults to false. Ignored by cpHastySpace.
+CP_EXPORT cpBool cpSpaceGetDirectSolver(const cpSpace *space);
+CP_EXPORT void cpSpaceSetDirectSolver(cpSpace *space, cpBool directSolver);
+
 /// Gravity to pass to rigid bodies when integrating velocity.
 CP_EXPORT cpVect cpSpaceGetGravity(const cpSpace *space);
 CP_EXPORT void cpSpaceSetGravity(cpSpace *space, cpVect gravity);
@@ -123,6 +152,44 @@ CP_EXPORT void cpSpaceSetCollisionBias(cpSpace *space, cpFloat collisionBias);
 CP_EXPORT cpTimestamp cpSpaceGetCollisionPersistence(const cpSpace *space);
 CP_EXPORT void cpSpaceSetCollisionPersistence(cpSpace *space, cpTimestamp collisionPersistence);
 
+/// Generate speculative contacts for shapes that are close enough to touch during the next step.
+/// Fast moving objects won't pass through each other or sink into the ground as long as they
+/// don't move more than their size in a step, allowing larger timesteps.
+/// The margin is based on the relative velocity of the bodies. Contacts with sensors are never speculative.
+/// Collision callbacks are called for shapes that are about to touch, and their contact points may have
+/// a positive separation, see cpArbiterGetDepth().
+/// Defaults to false. cpSpaceStepSubsteps() always generates speculative contacts.
+CP_EXPORT cpBool cpSpaceGetSpeculativeContacts(const cpSpace *space);
+CP_EXPORT void cpSpaceSetSpeculativeContacts(cpSpace *space, cpBool speculativeContacts);
+
+/// Push overlapping shapes apart like a soft constraint with this natural frequency in Hz instead of using the collision bias.
+/// The rate that overlap is fixed at then stays the same when the timestep changes, which makes it easier to tune
+/// together with soft joints, see cpConstraintSetFrequency().
+/// Defaults to 0, which uses the collision bias.
+CP_EXPORT cpFloat cpSpaceGetContactFrequency(const cpSpace *space);
+CP_EXPORT void cpSpaceSetContactFrequency(cpSpace *space, cpFloat contactFrequency);
+
+/// Damping ratio for the soft contacts enabled by cpSpaceSetContactFrequency().
+/// Defaults to 1, which is critically damped.
+CP_EXPORT cpFloat cpSpaceGetContactDampingRatio(const cpSpace *space);
+CP_EXPORT void cpSpaceSetContactDampingRatio(cpSpace *space, cpFloat contactDampingRatio);
+
+/// Length of the steps taken by cpSpaceAdvance().
+/// Defaults to 1/60 of a second.
+CP_EXPORT cpFloat cpSpaceGetFixedTimestep(const cpSpace *space);
+CP_EXPORT void cpSpaceSetFixedTimestep(cpSpace *space, cpFloat fixedTimestep);
+
+/// Maximum number of steps cpSpaceAdvance() takes in a single call.
+/// When the simulation can't keep up, the time it couldn't catch up on is dropped instead of
+/// piling up and making the following frames take even more steps.
+/// Defaults to 5.
+CP_EXPORT int cpSpaceGetMaxStepsPerFrame(const cpSpace *space);
+CP_EXPORT void cpSpaceSetMaxStepsPerFrame(cpSpace *space, int maxStepsPerFrame);
+
+/// How far the time passed to cpSpaceAdvance() is past the last step, as a fraction of the fixed timestep.
+/// This is the amount cpBodyGetInterpolatedTransform() blends the previous poses towards the current ones.
+CP_EXPORT cpFloat cpSpaceGetInterpolationAlpha(const cpSpace *space);
+
 /// User definable data pointer.
 /// Generally this points to your game's controller or game state
 /// class so you can access it when given a cpSpace reference in a callback.
@@ -161,6 +228,8 @@ CP_EXPORT cpShape* cpSpaceAddShape(cpSpace *space, cpShape *shape);
 CP_EXPORT cpBody* cpSpaceAddBody(cpSpace *space, cpBody *body);
 /// Add a constraint to the simulation.
 CP_EXPORT cpConstraint* cpSpaceAddConstraint(cpSpace *space, cpConstraint *constraint);
+/// Add a spring network to the simulation.
+CP_EXPORT cpSpringNetwork* cpSpaceAddSpringNetwork(cpSpace *space, cpSpringNetwork *network);
 
 /// Remove a collision shape from the simulation.
 CP_EXPORT void cpSpaceRemoveShape(cpSpace *space, cpShape *shape);
@@ -168,6 +237,8 @@ CP_EXPORT void cpSpaceRemoveShape(cpSpace *space, cpShape *shape);
 CP_EXPORT void cpSpaceRemoveBody(cpSpace *space, cpBody *body);
 /// Remove a constraint from the simulation.
 CP_EXPORT void cpSpaceRemoveConstraint(cpSpace *space, cpConstraint *constraint);
+/// Remove a spring network from the simulation.
+CP_EXPORT void cpSpaceRemoveSpringNetwork(cpSpace *space, cpSpringNetwork *network);
 
 /// Test if a collision shape has been added to the space.
 CP_EXPORT cpBool cpSpaceContainsShape(cpSpace *space, cpShape *shape);
@@ -175,6 +246,8 @@ CP_EXPORT cpBool cpSpaceContainsShape(cpSpace *space, cpShape *shape);
 CP_EXPORT cpBool cpSpaceContainsBody(cpSpace *space, cpBody *body);
 /// Test if a constraint has been added to the space.
 CP_EXPORT cpBool cpSpaceContainsConstraint(cpSpace *space, cpConstraint *constraint);
+/// Test if a spring network has been added to the space.
+CP_EXPORT cpBool cpSpaceContainsSpringNetwork(cpSpace *space, cpSpringNetwork *network);
 
 //MARK: Post-Step Callbacks
 
@@ -247,6 +320,13 @@ CP_EXPORT void cpSpaceReindexShapesForBody(cpSpace *space, cpBody *body);
 
 /// Switch the space to use a spatial has as it's spatial index.
 CP_EXPORT void cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count);
+/// Switch the space to store its static shapes in a 4-wide bounding volume hierarchy.
+/// It's rebuilt from scratch when the static shapes change, but is faster to query than the default tree.
+/// Best for large levels where the static shapes are set up once and rarely touched afterwards.
+CP_EXPORT void cpSpaceUseStaticBVH4(cpSpace *space);
+/// Switch the space to use a sweep and prune broadphase for its dynamic shapes.
+/// Best for long, thin worlds where the shapes are spread out along one axis.
+CP_EXPORT void cpSpaceUseSweepAndPrune(cpSpace *space);
 
 
 //MARK: Time Stepping
@@ -254,6 +334,109 @@ CP_EXPORT void cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count);
 /// Step the space forward in time by @c dt.
 CP_EXPORT void cpSpaceStep(cpSpace *space, cpFloat dt);
 
+/// Step the space forward in time by @c dt as @c substeps smaller steps.
+/// Collision detection only runs once, generating speculative contacts that cover the whole step.
+/// The substeps then integrate the bodies and run the solver over the same set of contacts,
+/// updating their separations from the new positions of the bodies.
+/// This is much cheaper than calling cpSpaceStep() @c substeps times, and stiff chains and tall stacks are
+/// usually more stable with a few substeps than with more iterations.
+/// Callbacks run once per call. Arbiter and constraint impulses are the ones from the last substep,
+/// and cpSpaceGetCurrentTimeStep() returns the length of a substep.
+/// cpHastySpace uses the single threaded solver when substepping.
+CP_EXPORT void cpSpaceStepSubsteps(cpSpace *space, cpFloat dt, int substeps);
+
+/// Advance the space by the time that has passed since the last frame using steps of the fixed timestep.
+/// Leftover time that doesn't add up to a whole step is carried over to the next call.
+/// The poses of the awake bodies are saved before each step so they can be drawn
+/// between the last two steps with cpBodyGetInterpolatedTransform().
+/// This lets the simulation run at a lower rate than the frame rate while still drawing smoothly.
+/// Returns the number of steps taken, which may be 0.
+/// The steps are taken with cpSpaceStep(), so use cpHastySpaceAdvance() to advance a cpHastySpace.
+CP_EXPORT int cpSpaceAdvance(cpSpace *space, cpFloat frameTime);
+
+
+//MARK: Profiling
+
+/// Time spent in each phase of a step, in seconds.
+/// Time spent in user callbacks is only counted under @c callbacks and not in the phase that called them.
+typedef struct cpSpaceStepProfile {
+	/// Running the body position functions.
+	cpFloat integratePositions;
+	/// Finding the times of impact of the bullet bodies.
+	cpFloat bullets;
+	/// Updating the bounding boxes of the awake shapes.
+	cpFloat updateBBs;
+	/// Updating the spatial index and finding candidate pairs.
+	cpFloat broadphase;
+	/// Colliding the candidate pairs and updating their arbiters.
+	cpFloat narrowphase;
+	/// Building the contact graph and putting bodies to sleep.
+	cpFloat processComponents;
+	/// Throwing away old arbiters.
+	cpFloat filterArbiters;
+	/// Prestepping the arbiters and constraints and setting up the solver.
+	cpFloat preStep;
+	/// Running the body velocity functions.
+	cpFloat integrateVelocities;
+	/// Applying the cached impulses.
+	cpFloat warmStart;
+	/// Running the solver iterations and writing the velocities back to the bodies.
+	cpFloat solve;
+	/// Collision handler, constraint and post-step callbacks.
+	cpFloat callbacks;
+	/// The whole step.
+	cpFloat total;
+} cpSpaceStepProfile;
+
+/// Enable or disable recording a profile of each step. Disabled by default.
+/// Profiling reads a high resolution clock around every phase and user callback, so it makes the step a little slower.
+CP_EXPORT void cpSpaceSetProfilingEnabled(cpSpace *space, cpBool enabled);
+CP_EXPORT cpBool cpSpaceGetProfilingEnabled(const cpSpace *space);
+/// Get the profile of the most recent step. All zeros unless profiling is enabled.
+CP_EXPORT cpSpaceStepProfile cpSpaceGetStepProfile(const cpSpace *space);
+
+/// Number of islands the solver iterated separately during the most recent step.
+/// Always 0 unless the iteration tolerance is enabled, see cpSpaceSetIterationTolerance().
+CP_EXPORT int cpSpaceGetIslandCount(const cpSpace *space);
+/// Number of solver iterations an island used during the most recent step.
+/// With cpSpaceStepSubsteps(), this is the total for all of the substeps.
+CP_EXPORT int cpSpaceGetIslandIterations(const cpSpace *space, int island);
+
+
+//MARK: Counters
+
+/// Counts of events in the collision detection and solver, accumulated since the last call to cpSpaceResetCounters().
+/// Only counted when Chipmunk is built with CP_ENABLE_COUNTERS defined to 1, otherwise they are always zero.
+typedef struct cpSpaceCounters {
+	/// Pairs of shapes with overlapping bounding boxes found by the broadphase.
+	unsigned long candidatePairs;
+	/// Candidate pairs rejected because the shapes' current bounding boxes don't overlap.
+	unsigned long rejectedBB;
+	/// Candidate pairs rejected because both shapes are attached to the same body.
+	unsigned long rejectedSameBody;
+	/// Candidate pairs rejected by the shapes' collision filters.
+	unsigned long rejectedFilter;
+	/// Candidate pairs rejected because the bodies share a constraint that doesn't allow them to collide.
+	unsigned long rejectedConstraint;
+	/// Total GJK iterations, and the number of times GJK gave up after MAX_GJK_ITERATIONS.
+	unsigned long gjkIterations, gjkMaxIterationsHit;
+	/// Total EPA iterations, and the number of times EPA took WARN_EPA_ITERATIONS or more.
+	unsigned long epaIterations, epaWarnIterationsHit;
+	/// Contacts generated by the narrowphase.
+	unsigned long contacts;
+	/// Bins compared while looking up arbiters in the arbiter cache.
+	unsigned long arbiterHashProbes;
+	/// Leaves of the dynamic bounding box tree that had to be reinserted because they moved out of their bounds.
+	unsigned long leafReinsertions;
+	/// Bodies woken up and put to sleep.
+	unsigned long bodiesWoken, bodiesSlept;
+} cpSpaceCounters;
+
+/// Get the counters accumulated since they were last reset.
+CP_EXPORT cpSpaceCounters cpSpaceGetCounters(const cpSpace *space);
+/// Reset the counters to zero, usually once per frame.
+CP_EXPORT void cpSpaceResetCounters(cpSpace *space);
+
 
 //MARK: Debug API
 
@@ -94,6 +94,10 @@ CP_EXPORT cpSpatialIndex* cpBBTreeNew(cpSpatialIndexBBFunc bbfunc, cpSpatialInde
 
 /// Perform a static top down optimization of the tree.
 CP_EXPORT void cpBBTreeOptimize(cpSpatialIndex *index);
+/// Reinsert up to @c passes leaves to improve the tree a little at a time.
+/// Calling this once per step with a small number of passes spreads the work of optimizing a large tree over many steps.
+/// The tree is also rebalanced with rotations as leaves are inserted and removed, so this is only needed for very long running trees.
+CP_EXPORT void cpBBTreeOptimizeIncremental(cpSpatialIndex *index, int passes);
 
 /// Bounding box tree velocity callback function.
 /// This function should return an estimate for the object's velocity.
@@ -112,6 +116,33 @@ CP_EXPORT cpSpatialIndex* cpSweep1DInit(cpSweep1D *sweep, cpSpatialIndexBBFunc b
 /// Allocate and initialize a 1D sort and sweep broadphase.
 CP_EXPORT cpSpatialIndex* cpSweep1DNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
 
+//MARK: Sweep and Prune
+
+typedef struct cpSweepAndPrune cpSweepAndPrune;
+
+/// Allocate a sweep and prune broadphase.
+CP_EXPORT cpSweepAndPrune* cpSweepAndPruneAlloc(void);
+/// Initialize a sweep and prune broadphase.
+/// Unlike cpSweep1D, the sorted endpoints and the overlapping pairs persist between steps,
+/// so a step only does extra work for the objects that moved past their neighbors.
+/// The sweep axis is picked automatically. Well suited to long, thin worlds such as side scrollers.
+CP_EXPORT cpSpatialIndex* cpSweepAndPruneInit(cpSweepAndPrune *sap, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+/// Allocate and initialize a sweep and prune broadphase.
+CP_EXPORT cpSpatialIndex* cpSweepAndPruneNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+
+//MARK: 4-Wide Bounding Volume Hierarchy
+
+typedef struct cpBVH4 cpBVH4;
+
+/// Allocate a 4-wide bounding volume hierarchy.
+CP_EXPORT cpBVH4* cpBVH4Alloc(void);
+/// Initialize a 4-wide bounding volume hierarchy.
+/// The hierarchy is rebuilt whenever it's queried after objects were added, removed or reindexed.
+/// Use it for static objects that rarely change. Queries test all four children of a node at once.
+CP_EXPORT cpSpatialIndex* cpBVH4Init(cpBVH4 *bvh, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+/// Allocate and initialize a 4-wide bounding volume hierarchy.
+CP_EXPORT cpSpatialIndex* cpBVH4New(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex);
+
 //MARK: Spatial Index Implementation
 
 typedef void (*cpSpatialIndexDestroyImpl)(cpSpatialIndex *index);
@@ -0,0 +1,85 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/// @defgroup cpSpringNetwork cpSpringNetwork
+/// Spring networks hold large numbers of damped springs, such as the ones that make up soft bodies.
+/// The springs work the same as cpDampedSpring constraints, but are stored together in one object
+/// and packed so that several of them are prestepped and solved at a time with SIMD code.
+/// Bodies connected by a network fall asleep and wake up together the same as bodies connected by constraints.
+/// Remove the network from the space before removing any of its bodies.
+/// @{
+
+/// Function type used for spring network force callbacks.
+/// @c spring is the index returned by cpSpringNetworkAddSpring().
+typedef cpFloat (*cpSpringNetworkForceFunc)(cpSpringNetwork *network, int spring, cpFloat dist);
+
+/// Allocate a spring network.
+CP_EXPORT cpSpringNetwork* cpSpringNetworkAlloc(void);
+/// Initialize a spring network.
+CP_EXPORT cpSpringNetwork* cpSpringNetworkInit(cpSpringNetwork *network);
+/// Allocate and initialize a spring network.
+CP_EXPORT cpSpringNetwork* cpSpringNetworkNew(void);
+
+/// Destroy a spring network.
+CP_EXPORT void cpSpringNetworkDestroy(cpSpringNetwork *network);
+/// Destroy and free a spring network.
+CP_EXPORT void cpSpringNetworkFree(cpSpringNetwork *network);
+
+/// Add a spring to the network and return its index.
+CP_EXPORT int cpSpringNetworkAddSpring(cpSpringNetwork *network, cpBody *a, cpBody *b, cpVect anchorA, cpVect anchorB, cpFloat restLength, cpFloat stiffness, cpFloat damping);
+/// Get the number of springs in the network.
+CP_EXPORT int cpSpringNetworkGetCount(const cpSpringNetwork *network);
+/// Get the cpSpace this network is added to.
+CP_EXPORT cpSpace* cpSpringNetworkGetSpace(const cpSpringNetwork *network);
+
+/// Get the first body a spring is attached to.
+CP_EXPORT cpBody* cpSpringNetworkGetBodyA(const cpSpringNetwork *network, int spring);
+/// Get the second body a spring is attached to.
+CP_EXPORT cpBody* cpSpringNetworkGetBodyB(const cpSpringNetwork *network, int spring);
+
+/// Get the rest length of a spring.
+CP_EXPORT cpFloat cpSpringNetworkGetRestLength(const cpSpringNetwork *network, int spring);
+/// Set the rest length of a spring.
+CP_EXPORT void cpSpringNetworkSetRestLength(cpSpringNetwork *network, int spring, cpFloat restLength);
+
+/// Get the stiffness of a spring.
+CP_EXPORT cpFloat cpSpringNetworkGetStiffness(const cpSpringNetwork *network, int spring);
+/// Set the stiffness of a spring.
+CP_EXPORT void cpSpringNetworkSetStiffness(cpSpringNetwork *network, int spring, cpFloat stiffness);
+
+/// Get the damping of a spring.
+CP_EXPORT cpFloat cpSpringNetworkGetDamping(const cpSpringNetwork *network, int spring);
+/// Set the damping of a spring.
+CP_EXPORT void cpSpringNetworkSetDamping(cpSpringNetwork *network, int spring, cpFloat damping);
+
+/// Get the force function used by all of the springs in the network.
+CP_EXPORT cpSpringNetworkForceFunc cpSpringNetworkGetSpringForceFunc(const cpSpringNetwork *network);
+/// Set the force function used by all of the springs in the network.
+/// The default of NULL uses the linear force law of cpDampedSpring, which is computed with the SIMD code.
+/// A custom function is called once per spring each step.
+CP_EXPORT void cpSpringNetworkSetSpringForceFunc(cpSpringNetwork *network, cpSpringNetworkForceFunc springForceFunc);
+
+/// Get the user definable data pointer for this network.
+CP_EXPORT cpDataPointer cpSpringNetworkGetUserData(const cpSpringNetwork *network);
+/// Set the user definable data pointer for this network.
+CP_EXPORT void cpSpringNetworkSetUserData(cpSpringNetwork *network, cpDataPointer userData);
+
+/// @}
@@ -328,6 +328,7 @@ cpArbiterInit(cpArbiter *arb, cpShape *a, cpShape *b)
 	
 	arb->count = 0;
 	arb->contacts = NULL;
+	arb->block.enabled = cpFalse;
 	
 	arb->a = a; arb->body_a = a->body;
 	arb->b = b; arb->body_b = b->body;
@@ -413,6 +414,45 @@ cpArbiterUpdate(cpArbiter *arb, struct cpCollisionInfo *info, cpSpace *space)
 	if(arb->state == CP_ARBITER_STATE_CACHED) arb->state = CP_ARBITER_STATE_FIRST_COLLISION;
 }
 
+// Two contact manifolds with a condition number above this are solved one contact at a time.
+// Nearly coincident contact points make the block solve numerically unstable.
+#define BLOCK_MAX_CONDITION 1000.0f
+
+static void
+ContactBlockInit(struct cpContactBlock *block, const cpArbiter *arb, cpFloat m_inv_a, cpFloat i_inv_a, cpFloat m_inv_b, cpFloat i_inv_b)
+{
+	block->enabled = cpFalse;
+	if(arb->count != 2) return;
+	
+	cpVect n = arb->n;
+	struct cpContact *con1 = arb->contacts + 0;
+	struct cpContact *con2 = arb->contacts + 1;
+	
+	cpFloat rn1a = cpvcross(con1->r1, n), rn1b = cpvcross(con1->r2, n);
+	cpFloat rn2a = cpvcross(con2->r1, n), rn2b = cpvcross(con2->r2, n);
+	
+	cpFloat m_sum = m_inv_a + m_inv_b;
+	cpFloat k11 = m_sum + i_inv_a*rn1a*rn1a + i_inv_b*rn1b*rn1b;
+	cpFloat k22 = m_sum + i_inv_a*rn2a*rn2a + i_inv_b*rn2b*rn2b;
+	cpFloat k12 = m_sum + i_inv_a*rn1a*rn2a + i_inv_b*rn1b*rn2b;
+	cpFloat det = k11*k22 - k12*k12;
+	
+	if(k11*k11 < BLOCK_MAX_CONDITION*det){
+		cpFloat det_inv = 1.0f/det;
+		block->enabled = cpTrue;
+		block->k11 = k11; block->k12 = k12; block->k22 = k22;
+		block->m11 = k22*det_inv; block->m12 = -k12*det_inv; block->m22 = k11*det_inv;
+	}
+}
+
+void
+cpArbiterPreStepBlock(cpArbiter *arb)
+{
+	cpBody *a = arb->body_a;
+	cpBody *b = arb->body_b;
+	ContactBlockInit(&arb->block, arb, a->m_inv, a->i_inv, b->m_inv, b->i_inv);
+}
+
 void
 cpArbiterPreStep(cpArbiter *arb, cpFloat dt, cpFloat slop, cpFloat bias)
 {
@@ -434,65 +474,239 @@ cpArbiterPreStep(cpArbiter *arb, cpFloat dt, cpFloat slop, cpFloat bias)
 		con->jBias = 0.0f;
 		
 		// Calculate the target bounce velocity.
-		con->bounce = normal_relative_velocity(a, b, con->r1, con->r2, n)*arb->e;
+		// Contacts with a positive separation are speculative, and cpArbiterApplyImpulse() lets them close the gap.
+		cpFloat vrn = normal_relative_velocity(a, b, con->r1, con->r2, n);
+		con->bounce = cpArbiterBounceVelocity(vrn, arb->e, dist, dt);
 	}
+	
+	cpArbiterPreStepBlock(arb);
 }
 
 void
-cpArbiterApplyCachedImpulse(cpArbiter *arb, cpFloat dt_coef)
+cpArbiterPreSubstep(cpArbiter *arb, cpVect rot_a, cpVect rot_b, cpFloat dt, cpFloat slop, cpFloat bias)
 {
-	if(cpArbiterIsFirstContact(arb)) return;
-	
 	cpBody *a = arb->body_a;
 	cpBody *b = arb->body_b;
 	cpVect n = arb->n;
+	cpVect body_delta = cpvsub(b->p, a->p);
+	
+	for(int i=0; i<arb->count; i++){
+		struct cpContact *con = &arb->contacts[i];
+		
+		// Carry the contact points along with the bodies' rotations since the last substep.
+		cpVect r1 = con->r1 = cpvrotate(con->r1, rot_a);
+		cpVect r2 = con->r2 = cpvrotate(con->r2, rot_b);
+		
+		con->nMass = 1.0f/k_scalar(a, b, r1, r2, n);
+		con->tMass = 1.0f/k_scalar(a, b, r1, r2, cpvperp(n));
+		
+		// The separation changes as the bodies move even though the collision isn't detected again.
+		cpFloat dist = cpvdot(cpvadd(cpvsub(r2, r1), body_delta), n);
+		con->bias = -bias*cpfmin(0.0f, dist + slop)/dt;
+		con->jBias = 0.0f;
+		
+		// Touching contacts keep the bounce velocity from when they started touching.
+		// Recalculating it would bounce off of the velocity the previous substep already solved for.
+		cpFloat vrn = normal_relative_velocity(a, b, r1, r2, n);
+		con->bounce = (dist > 0.0f ? cpArbiterBounceVelocity(vrn, arb->e, dist, dt) : cpfmin(con->bounce, vrn*arb->e));
+	}
+	
+	cpArbiterPreStepBlock(arb);
+}
+
+void
+cpArbiterApplyCachedImpulse(cpArbiter *arb, struct cpSolverBody *bodies, cpFloat dt_coef)
+{
+	if(cpArbiterIsFirstContact(arb)) return;
+	
+	struct cpSolverBody *a = bodies + arb->solver_a;
+	struct cpSolverBody *b = bodies + arb->solver_b;
+	cpVect n = arb->n;
 	
 	for(int i=0; i<arb->count; i++){
 		struct cpContact *con = &arb->contacts[i];
 		cpVect j = cpvrotate(n, cpv(con->jnAcc, con->jtAcc));
-		apply_impulses(a, b, con->r1, con->r2, cpvmult(j, dt_coef));
+		solver_apply_impulses(a, b, con->r1, con->r2, cpvmult(j, dt_coef));
 	}
 }
 
 // TODO: is it worth splitting velocity/position correction?
 
-void
-cpArbiterApplyImpulse(cpArbiter *arb)
+// Solve the 2x2 linear complementarity problem for the new normal impulses of a two contact manifold.
+// 'vn' is the normal velocity error of each contact and 'jn' their old accumulated impulses.
+// Tries each combination of contacts pushing or separating in turn, see Erin Catto's Box2D for details.
+static inline cpVect
+BlockNormalImpulses(const struct cpContactBlock *block, const cpFloat *nMass, cpVect vn, cpVect jn)
+{
+	cpFloat k11 = block->k11, k12 = block->k12, k22 = block->k22;
+	
+	// Velocity error if no impulses were applied.
+	cpFloat b1 = vn.x - (k11*jn.x + k12*jn.y);
+	cpFloat b2 = vn.y - (k12*jn.x + k22*jn.y);
+	
+	// Both contacts pushing.
+	cpFloat x1 = -(block->m11*b1 + block->m12*b2);
+	cpFloat x2 = -(block->m12*b1 + block->m22*b2);
+	if(x1 >= 0.0f && x2 >= 0.0f) return cpv(x1, x2);
+	
+	// Only the first contact pushing.
+	x1 = -b1*nMass[0];
+	if(x1 >= 0.0f && k12*x1 + b2 >= 0.0f) return cpv(x1, 0.0f);
+	
+	// Only the second contact pushing.
+	x2 = -b2*nMass[1];
+	if(x2 >= 0.0f && k12*x2 + b1 >= 0.0f) return cpv(0.0f, x2);
+	
+	// Both contacts separating.
+	if(b1 >= 0.0f && b2 >= 0.0f) return cpvzero;
+	
+	// No solution because of round off, keep the old impulses.
+	return jn;
+}
+
+// Version of cpArbiterApplyImpulse() for arbiters with a block solver.
+// The bias and friction impulses are still solved one contact at a time before the normal impulses are solved together.
+static cpFloat
+ApplyBlockImpulse(cpArbiter *arb, struct cpSolverBody *a, struct cpSolverBody *b, const struct cpContactBlock *block, const cpFloat *nMass, const cpFloat *tMass)
 {
-	cpBody *a = arb->body_a;
-	cpBody *b = arb->body_b;
 	cpVect n = arb->n;
 	cpVect surface_vr = arb->surface_vr;
 	cpFloat friction = arb->u;
-
-	for(int i=0; i<arb->count; i++){
+	cpFloat residual = 0.0f;
+	
+	for(int i=0; i<2; i++){
 		struct cpContact *con = &arb->contacts[i];
-		cpFloat nMass = con->nMass;
 		cpVect r1 = con->r1;
 		cpVect r2 = con->r2;
 		
 		cpVect vb1 = cpvadd(a->v_bias, cpvmult(cpvperp(r1), a->w_bias));
 		cpVect vb2 = cpvadd(b->v_bias, cpvmult(cpvperp(r2), b->w_bias));
-		cpVect vr = cpvadd(relative_velocity(a, b, r1, r2), surface_vr);
+		cpVect vr = cpvadd(solver_relative_velocity(a, b, r1, r2), surface_vr);
 		
 		cpFloat vbn = cpvdot(cpvsub(vb2, vb1), n);
-		cpFloat vrn = cpvdot(vr, n);
 		cpFloat vrt = cpvdot(vr, cpvperp(n));
 		
-		cpFloat jbn = (con->bias - vbn)*nMass;
+		cpFloat jbn = (con->bias - vbn)*nMass[i];
 		cpFloat jbnOld = con->jBias;
 		con->jBias = cpfmax(jbnOld + jbn, 0.0f);
 		
-		cpFloat jn = -(con->bounce + vrn)*nMass;
-		cpFloat jnOld = con->jnAcc;
-		con->jnAcc = cpfmax(jnOld + jn, 0.0f);
-		
 		cpFloat jtMax = friction*con->jnAcc;
-		cpFloat jt = -vrt*con->tMass;
+		cpFloat jt = -vrt*tMass[i];
 		cpFloat jtOld = con->jtAcc;
 		con->jtAcc = cpfclamp(jtOld + jt, -jtMax, jtMax);
 		
-		apply_bias_impulses(a, b, r1, r2, cpvmult(n, con->jBias - jbnOld));
-		apply_impulses(a, b, r1, r2, cpvrotate(n, cpv(con->jnAcc - jnOld, con->jtAcc - jtOld)));
+		solver_apply_bias_impulses(a, b, r1, r2, cpvmult(n, con->jBias - jbnOld));
+		solver_apply_impulses(a, b, r1, r2, cpvmult(cpvperp(n), con->jtAcc - jtOld));
+		
+		residual += cpfabs(con->jBias - jbnOld) + cpfabs(con->jtAcc - jtOld);
+	}
+	
+	struct cpContact *con1 = &arb->contacts[0];
+	struct cpContact *con2 = &arb->contacts[1];
+	cpVect vr1 = cpvadd(solver_relative_velocity(a, b, con1->r1, con1->r2), surface_vr);
+	cpVect vr2 = cpvadd(solver_relative_velocity(a, b, con2->r1, con2->r2), surface_vr);
+	cpVect vn = cpv(cpvdot(vr1, n) + con1->bounce, cpvdot(vr2, n) + con2->bounce);
+	
+	cpVect jnOld = cpv(con1->jnAcc, con2->jnAcc);
+	cpVect jnAcc = BlockNormalImpulses(block, nMass, vn, jnOld);
+	con1->jnAcc = jnAcc.x;
+	con2->jnAcc = jnAcc.y;
+	
+	solver_apply_impulses(a, b, con1->r1, con1->r2, cpvmult(n, jnAcc.x - jnOld.x));
+	solver_apply_impulses(a, b, con2->r1, con2->r2, cpvmult(n, jnAcc.y - jnOld.y));
+	
+	return residual + cpfabs(jnAcc.x - jnOld.x) + cpfabs(jnAcc.y - jnOld.y);
+}
+
+// Solve a single contact using the given effective masses. Returns the change in its impulses.
+static inline cpFloat
+ApplyContactImpulse(cpArbiter *arb, struct cpContact *con, struct cpSolverBody *a, struct cpSolverBody *b, cpFloat nMass, cpFloat tMass)
+{
+	cpVect n = arb->n;
+	cpVect r1 = con->r1;
+	cpVect r2 = con->r2;
+	
+	cpVect vb1 = cpvadd(a->v_bias, cpvmult(cpvperp(r1), a->w_bias));
+	cpVect vb2 = cpvadd(b->v_bias, cpvmult(cpvperp(r2), b->w_bias));
+	cpVect vr = cpvadd(solver_relative_velocity(a, b, r1, r2), arb->surface_vr);
+	
+	cpFloat vbn = cpvdot(cpvsub(vb2, vb1), n);
+	cpFloat vrn = cpvdot(vr, n);
+	cpFloat vrt = cpvdot(vr, cpvperp(n));
+	
+	cpFloat jbn = (con->bias - vbn)*nMass;
+	cpFloat jbnOld = con->jBias;
+	con->jBias = cpfmax(jbnOld + jbn, 0.0f);
+	
+	cpFloat jn = -(con->bounce + vrn)*nMass;
+	cpFloat jnOld = con->jnAcc;
+	con->jnAcc = cpfmax(jnOld + jn, 0.0f);
+	
+	cpFloat jtMax = arb->u*con->jnAcc;
+	cpFloat jt = -vrt*tMass;
+	cpFloat jtOld = con->jtAcc;
+	con->jtAcc = cpfclamp(jtOld + jt, -jtMax, jtMax);
+	
+	solver_apply_bias_impulses(a, b, r1, r2, cpvmult(n, con->jBias - jbnOld));
+	solver_apply_impulses(a, b, r1, r2, cpvrotate(n, cpv(con->jnAcc - jnOld, con->jtAcc - jtOld)));
+	
+	return cpfabs(con->jBias - jbnOld) + cpfabs(con->jnAcc - jnOld) + cpfabs(con->jtAcc - jtOld);
+}
+
+cpFloat
+cpArbiterApplyImpulse(cpArbiter *arb, struct cpSolverBody *bodies)
+{
+	struct cpSolverBody *a = bodies + arb->solver_a;
+	struct cpSolverBody *b = bodies + arb->solver_b;
+	if(arb->block.enabled){
+		struct cpContact *contacts = arb->contacts;
+		cpFloat nMass[] = {contacts[0].nMass, contacts[1].nMass};
+		cpFloat tMass[] = {contacts[0].tMass, contacts[1].tMass};
+		return ApplyBlockImpulse(arb, a, b, &arb->block, nMass, tMass);
+	}
+	
+	cpFloat residual = 0.0f;
+	for(int i=0; i<arb->count; i++){
+		struct cpContact *con = &arb->contacts[i];
+		residual += ApplyContactImpulse(arb, con, a, b, con->nMass, con->tMass);
+	}
+	
+	return residual;
+}
+
+static inline cpFloat
+solver_k_scalar(struct cpSolverBody *a, struct cpSolverBody *b, cpVect r1, cpVect r2, cpVect n)
+{
+	cpFloat rcn = cpvcross(r1, n);
+	cpFloat rcn2 = cpvcross(r2, n);
+	return a->m_inv + b->m_inv + a->i_inv*rcn*rcn + b->i_inv*rcn2*rcn2;
+}
+
+void
+cpArbiterApplyShockImpulse(cpArbiter *arb, struct cpSolverBody *bodies, cpBool freezeA)
+{
+	struct cpSolverBody *a = bodies + arb->solver_a;
+	struct cpSolverBody *b = bodies + arb->solver_b;
+	
+	// Solve against a copy of the supporting body with infinite mass so the impulses can't push it back down.
+	struct cpSolverBody frozen = *(freezeA ? a : b);
+	frozen.m_inv = frozen.i_inv = 0.0f;
+	if(freezeA) a = &frozen; else b = &frozen;
+	
+	cpVect n = arb->n;
+	cpFloat nMass[CP_MAX_CONTACTS_PER_ARBITER], tMass[CP_MAX_CONTACTS_PER_ARBITER];
+	for(int i=0; i<arb->count; i++){
+		struct cpContact *con = &arb->contacts[i];
+		nMass[i] = 1.0f/solver_k_scalar(a, b, con->r1, con->r2, n);
+		tMass[i] = 1.0f/solver_k_scalar(a, b, con->r1, con->r2, cpvperp(n));
+	}
+	
+	// Solving the two contacts of a manifold one at a time would tip the upper body over.
+	struct cpContactBlock block;
+	ContactBlockInit(&block, arb, a->m_inv, a->i_inv, b->m_inv, b->i_inv);
+	if(block.enabled){
+		ApplyBlockImpulse(arb, a, b, &block, nMass, tMass);
+	} else {
+		for(int i=0; i<arb->count; i++) ApplyContactImpulse(arb, arb->contacts + i, a, b, nMass[i], tMass[i]);
 	}
 }
@@ -21,54 +21,84 @@
 
 #include "stdlib.h"
 #include "stdio.h"
+#include "string.h"
+#include "stdint.h"
 
 #include "chipmunk/chipmunk_private.h"
 
 static inline cpSpatialIndexClass *Klass(void);
 
 typedef struct Node Node;
+typedef struct Leaf Leaf;
 typedef struct Pair Pair;
+typedef struct LeafRefit LeafRefit;
+typedef struct MarkQueue MarkQueue;
 
 struct cpBBTree {
 	cpSpatialIndex spatialIndex;
 	cpBBTreeVelocityFunc velocityFunc;
 	
 	cpHashSet *leaves;
-	Node *root;
 	
-	Node *pooledNodes;
+	// Nodes are allocated in pairs of siblings from a single array and addressed by index.
+	// 'nodes' is aligned to a cache line inside of 'nodeBuffer'.
+	Node *nodes;
+	void *nodeBuffer;
+	int nodeCount, nodeCapacity;
+	int freePairs;
+	int root;
+	
+	// Number of node moves since the array was last put into depth first order.
+	int churn;
+	
+	Leaf *pooledLeaves;
 	Pair *pooledPairs;
 	cpArray *allocatedBuffers;
 	
 	cpTimestamp stamp;
+	
+	// Scratch space for cpBBTreeReindexQueryThreaded().
+	LeafRefit *refits;
+	int refitsCapacity;
+	int *subtrees;
+	int subtreeCount, subtreesCapacity;
+	MarkQueue *queues;
+	int queueCount;
+	
+	// Steers the walk down the tree to pick the next leaf to reinsert when optimizing incrementally.
+	unsigned int opath;
+
+#if CP_ENABLE_COUNTERS
+	unsigned long reinsertions;
+#endif
 };
 
+// The children of an internal node are always stored next to each other at 'children' and 'children + 1'.
+// The first of the pair is the even index so a node's sibling is always at 'index^1'.
+// With floats on a 64 bit platform a node is 32 bytes, so each pair fills exactly one cache line of the aligned array.
+// With doubles a node is 48 bytes and a pair is 96, so every other pair straddles a line boundary.
+// A pair touches two lines either way, so padding the nodes out to 64 bytes would only use more memory.
 struct Node {
-	void *obj;
 	cpBB bb;
-	Node *parent;
-	
-	union {
-		// Internal nodes
-		struct { Node *a, *b; } children;
-		
-		// Leaves
-		struct {
-			cpTimestamp stamp;
-			Pair *pairs;
-		} leaf;
-	} node;
+	
+	// NULL for internal nodes.
+	Leaf *leaf;
+	
+	int parent;
+	int children;
 };
 
-// Can't use anonymous unions and still get good x-compiler compatability
-#define A node.children.a
-#define B node.children.b
-#define STAMP node.leaf.stamp
-#define PAIRS node.leaf.pairs
+// Leaves are kept out of the node array so their addresses don't change when it's resized or compacted.
+struct Leaf {
+	void *obj;
+	Pair *pairs;
+	cpTimestamp stamp;
+	int node;
+};
 
 typedef struct Thread {
 	Pair *prev;
-	Node *leaf;
+	Leaf *leaf;
 	Pair *next;
 } Thread;
 
@@ -103,11 +133,6 @@ GetTree(cpSpatialIndex *index)
 	return (index && index->klass == Klass() ? (cpBBTree *)index : NULL);
 }
 
-static inline Node *
-GetRootIfTree(cpSpatialIndex *index){
-	return (index && index->klass == Klass() ? ((cpBBTree *)index)->root : NULL);
-}
-
 static inline cpBBTree *
 GetMasterTree(cpBBTree *tree)
 {
@@ -178,15 +203,15 @@ ThreadUnlink(Thread thread)
 	if(prev){
 		if(prev->a.leaf == thread.leaf) prev->a.next = next; else prev->b.next = next;
 	} else {
-		thread.leaf->PAIRS = next;
+		thread.leaf->pairs = next;
 	}
 }
 
 static void
-PairsClear(Node *leaf, cpBBTree *tree)
+PairsClear(Leaf *leaf, cpBBTree *tree)
 {
-	Pair *pair = leaf->PAIRS;
-	leaf->PAIRS = NULL;
+	Pair *pair = leaf->pairs;
+	leaf->pairs = NULL;
 	
 	while(pair){
 		if(pair->a.leaf == leaf){
@@ -204,13 +229,13 @@ PairsClear(Node *leaf, cpBBTree *tree)
 }
 
 static void
-PairInsert(Node *a, Node *b, cpBBTree *tree)
+PairInsert(Leaf *a, Leaf *b, cpBBTree *tree)
 {
-	Pair *nextA = a->PAIRS, *nextB = b->PAIRS;
+	Pair *nextA = a->pairs, *nextB = b->pairs;
 	Pair *pair = PairFromPool(tree);
 	Pair temp = {{NULL, a, nextA},{NULL, b, nextB}, 0};
 	
-	a->PAIRS = b->PAIRS = pair;
+	a->pairs = b->pairs = pair;
 	*pair = temp;
 	
 	if(nextA){
@@ -222,96 +247,137 @@ PairInsert(Node *a, Node *b, cpBBTree *tree)
 	}
 }
 
+//MARK: Node Storage Functions
 
-//MARK: Node Functions
+static Node *
+NodesAlloc(int capacity, void **buffer)
+{
+	(*buffer) = cpcalloc(1, capacity*sizeof(Node) + CP_CACHE_LINE_BYTES);
+	
+	uintptr_t align = CP_CACHE_LINE_BYTES - 1;
+	return (Node *)(((uintptr_t)(*buffer) + align)&~align);
+}
 
 static void
-NodeRecycle(cpBBTree *tree, Node *node)
+NodesSetBuffer(cpBBTree *tree, Node *nodes, void *buffer, int capacity)
 {
-	node->parent = tree->pooledNodes;
-	tree->pooledNodes = node;
+	cpfree(tree->nodeBuffer);
+	
+	tree->nodes = nodes;
+	tree->nodeBuffer = buffer;
+	tree->nodeCapacity = capacity;
 }
 
-static Node *
-NodeFromPool(cpBBTree *tree)
+// Returns the index of the first node of a free pair.
+// Can resize the node array, so any Node pointers must be fetched again afterwards.
+static int
+PairAlloc(cpBBTree *tree)
 {
-	Node *node = tree->pooledNodes;
+	int pair = tree->freePairs;
 	
-	if(node){
-		tree->pooledNodes = node->parent;
-		return node;
+	if(pair >= 0){
+		tree->freePairs = tree->nodes[pair].parent;
 	} else {
-		// Pool is exhausted, make more
-		int count = CP_BUFFER_BYTES/sizeof(Node);
-		cpAssertHard(count, "Internal Error: Buffer size is too small.");
-		
-		Node *buffer = (Node *)cpcalloc(1, CP_BUFFER_BYTES);
-		cpArrayPush(tree->allocatedBuffers, buffer);
+		if(tree->nodeCount == tree->nodeCapacity){
+			int capacity = 2*(3*(tree->nodeCapacity/2 + 1)/2);
+			
+			void *buffer = NULL;
+			Node *nodes = NodesAlloc(capacity, &buffer);
+			if(tree->nodes) memcpy(nodes, tree->nodes, tree->nodeCount*sizeof(Node));
+			NodesSetBuffer(tree, nodes, buffer, capacity);
+		}
 		
-		// push all but the first one, return the first instead
-		for(int i=1; i<count; i++) NodeRecycle(tree, buffer + i);
-		return buffer;
+		pair = tree->nodeCount;
+		tree->nodeCount += 2;
 	}
+	
+	tree->churn++;
+	return pair;
 }
 
+static void
+PairFree(cpBBTree *tree, int pair)
+{
+	tree->nodes[pair].parent = tree->freePairs;
+	tree->freePairs = pair;
+	
+	tree->churn++;
+}
+
+//MARK: Node Functions
+
 static inline void
-NodeSetA(Node *node, Node *value)
+NodeFixLinks(Node *nodes, int index)
 {
-	node->A = value;
-	value->parent = node;
+	// Point the children or the leaf of a node that was moved back at it.
+	Node *node = nodes + index;
+	if(node->leaf){
+		node->leaf->node = index;
+	} else {
+		nodes[node->children + 0].parent = index;
+		nodes[node->children + 1].parent = index;
+	}
 }
 
 static inline void
-NodeSetB(Node *node, Node *value)
+NodeRefit(Node *nodes, int index)
 {
-	node->B = value;
-	value->parent = node;
+	int children = nodes[index].children;
+	nodes[index].bb = cpBBMerge(nodes[children].bb, nodes[children + 1].bb);
 }
 
-static Node *
-NodeNew(cpBBTree *tree, Node *a, Node *b)
+static inline void
+NodeSwap(cpBBTree *tree, int child, int grandchild)
 {
-	Node *node = NodeFromPool(tree);
+	// Swap a child of a node with a child of its sibling.
+	// Only the contents of the slots move, the parent indexes stay with the slots.
+	Node *nodes = tree->nodes;
+	int childParent = nodes[child].parent, grandchildParent = nodes[grandchild].parent;
 	
-	node->obj = NULL;
-	node->bb = cpBBMerge(a->bb, b->bb);
-	node->parent = NULL;
+	Node temp = nodes[child];
+	nodes[child] = nodes[grandchild];
+	nodes[grandchild] = temp;
 	
-	NodeSetA(node, a);
-	NodeSetB(node, b);
+	nodes[child].parent = childParent;
+	nodes[grandchild].parent = grandchildParent;
+	NodeFixLinks(nodes, child);
+	NodeFixLinks(nodes, grandchild);
 	
-	return node;
-}
-
-static inline cpBool
-NodeIsLeaf(Node *node)
-{
-	return (node->obj != NULL);
-}
-
-static inline Node *
-NodeOther(Node *node, Node *child)
-{
-	return (node->A == child ? node->B : node->A);
+	NodeRefit(nodes, grandchildParent);
+	tree->churn++;
 }
 
-static inline void
-NodeReplaceChild(Node *parent, Node *child, Node *value, cpBBTree *tree)
+// Rotate one of the node's children with a grandchild from the other side if it shrinks the area of the subtree that changes.
+// This keeps the tree balanced as leaves are inserted and removed.
+static void
+NodeRotate(cpBBTree *tree, int index)
 {
-	cpAssertSoft(!NodeIsLeaf(parent), "Internal Error: Cannot replace child of a leaf.");
-	cpAssertSoft(child == parent->A || child == parent->B, "Internal Error: Node is not a child of parent.");
+	Node *nodes = tree->nodes;
+	int a = nodes[index].children, b = a + 1;
+	int child = -1, grandchild = -1;
+	cpFloat best = 0.0f;
 	
-	if(parent->A == child){
-		NodeRecycle(tree, parent->A);
-		NodeSetA(parent, value);
-	} else {
-		NodeRecycle(tree, parent->B);
-		NodeSetB(parent, value);
+	if(!nodes[b].leaf){
+		int ba = nodes[b].children, bb = ba + 1;
+		cpFloat area = cpBBArea(nodes[b].bb);
+		cpFloat gain_a = area - cpBBMergedArea(nodes[a].bb, nodes[bb].bb);
+		cpFloat gain_b = area - cpBBMergedArea(nodes[a].bb, nodes[ba].bb);
+		
+		if(gain_a > best){best = gain_a; child = a; grandchild = ba;}
+		if(gain_b > best){best = gain_b; child = a; grandchild = bb;}
 	}
 	
-	for(Node *node=parent; node; node = node->parent){
-		node->bb = cpBBMerge(node->A->bb, node->B->bb);
+	if(!nodes[a].leaf){
+		int aa = nodes[a].children, ab = aa + 1;
+		cpFloat area = cpBBArea(nodes[a].bb);
+		cpFloat gain_a = area - cpBBMergedArea(nodes[b].bb, nodes[ab].bb);
+		cpFloat gain_b = area - cpBBMergedArea(nodes[b].bb, nodes[aa].bb);
+		
+		if(gain_a > best){best = gain_a; child = b; grandchild = aa;}
+		if(gain_b > best){best = gain_b; child = b; grandchild = ab;}
 	}
+	
+	if(child >= 0) NodeSwap(tree, child, grandchild);
 }
 
 //MARK: Subtree Functions
@@ -322,144 +388,305 @@ cpBBProximity(cpBB a, cpBB b)
 	return cpfabs(a.l + a.r - b.l - b.r) + cpfabs(a.b + a.t - b.b - b.t);
 }
 
-static Node *
-SubtreeInsert(Node *subtree, Node *leaf, cpBBTree *tree)
+static void
+SubtreeInsert(cpBBTree *tree, Leaf *leaf, cpBB bb)
 {
-	if(subtree == NULL){
-		return leaf;
-	} else if(NodeIsLeaf(subtree)){
-		return NodeNew(tree, leaf, subtree);
-	} else {
-		cpFloat cost_a = cpBBArea(subtree->B->bb) + cpBBMergedArea(subtree->A->bb, leaf->bb);
-		cpFloat cost_b = cpBBArea(subtree->A->bb) + cpBBMergedArea(subtree->B->bb, leaf->bb);
+	if(tree->root < 0){
+		int root = PairAlloc(tree);
+		Node node = {bb, leaf, -1, -1};
+		tree->nodes[root] = node;
+		
+		tree->root = leaf->node = root;
+		return;
+	}
+	
+	Node *nodes = tree->nodes;
+	int index = tree->root;
+	
+	while(!nodes[index].leaf){
+		Node *subtree = nodes + index;
+		int a = subtree->children, b = a + 1;
+		
+		cpFloat cost_a = cpBBArea(nodes[b].bb) + cpBBMergedArea(nodes[a].bb, bb);
+		cpFloat cost_b = cpBBArea(nodes[a].bb) + cpBBMergedArea(nodes[b].bb, bb);
 		
 		if(cost_a == cost_b){
-			cost_a = cpBBProximity(subtree->A->bb, leaf->bb);
-			cost_b = cpBBProximity(subtree->B->bb, leaf->bb);
+			cost_a = cpBBProximity(nodes[a].bb, bb);
+			cost_b = cpBBProximity(nodes[b].bb, bb);
 		}
 		
-		if(cost_b < cost_a){
-			NodeSetB(subtree, SubtreeInsert(subtree->B, leaf, tree));
-		} else {
-			NodeSetA(subtree, SubtreeInsert(subtree->A, leaf, tree));
-		}
+		subtree->bb = cpBBMerge(subtree->bb, bb);
+		index = (cost_b < cost_a ? b : a);
+	}
+	
+	// Move the leaf that was found down into a new pair along with the new leaf.
+	// Its old slot becomes their parent.
+	int pair = PairAlloc(tree);
+	nodes = tree->nodes;
+	
+	Node *node = nodes + index;
+	Node sibling = {node->bb, node->leaf, index, -1};
+	Node inserted = {bb, leaf, index, -1};
+	nodes[pair + 0] = inserted;
+	nodes[pair + 1] = sibling;
+	leaf->node = pair + 0;
+	sibling.leaf->node = pair + 1;
+	
+	node->bb = cpBBMerge(node->bb, bb);
+	node->leaf = NULL;
+	node->children = pair;
+	
+	for(int i = node->parent; i >= 0; i = tree->nodes[i].parent) NodeRotate(tree, i);
+}
+
+static void
+SubtreeRemove(cpBBTree *tree, Leaf *leaf)
+{
+	Node *nodes = tree->nodes;
+	int index = leaf->node;
+	int parent = nodes[index].parent;
+	
+	if(parent < 0){
+		PairFree(tree, index);
+		tree->root = -1;
+	} else {
+		// Move the sibling up into the parent's slot.
+		int grandparent = nodes[parent].parent;
+		nodes[parent] = nodes[index^1];
+		nodes[parent].parent = grandparent;
+		NodeFixLinks(nodes, parent);
 		
-		subtree->bb = cpBBMerge(subtree->bb, leaf->bb);
-		return subtree;
+		PairFree(tree, index&~1);
+		
+		for(int i = grandparent; i >= 0; i = nodes[i].parent){
+			cpBB bb = nodes[i].bb;
+			NodeRefit(nodes, i);
+			NodeRotate(tree, i);
+			
+			// The ancestors don't need to be refit if the bounding box didn't shrink.
+			if(cpBBContainsBB(nodes[i].bb, bb)) break;
+		}
 	}
+	
+	leaf->node = -1;
 }
 
 static void
-SubtreeQuery(Node *subtree, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
+SubtreeQuery(Node *nodes, int subtree, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
 {
-	if(cpBBIntersects(subtree->bb, bb)){
-		if(NodeIsLeaf(subtree)){
-			func(obj, subtree->obj, 0, data);
+	Node *node = nodes + subtree;
+	if(cpBBIntersects(node->bb, bb)){
+		if(node->leaf){
+			func(obj, node->leaf->obj, 0, data);
 		} else {
-			SubtreeQuery(subtree->A, obj, bb, func, data);
-			SubtreeQuery(subtree->B, obj, bb, func, data);
+			SubtreeQuery(nodes, node->children + 0, obj, bb, func, data);
+			SubtreeQuery(nodes, node->children + 1, obj, bb, func, data);
 		}
 	}
 }
 
 
 static cpFloat
-SubtreeSegmentQuery(Node *subtree, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+SubtreeSegmentQuery(Node *nodes, int subtree, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
 {
-	if(NodeIsLeaf(subtree)){
-		return func(obj, subtree->obj, data);
+	Node *node = nodes + subtree;
+	if(node->leaf){
+		return func(obj, node->leaf->obj, data);
 	} else {
-		cpFloat t_a = cpBBSegmentQuery(subtree->A->bb, a, b);
-		cpFloat t_b = cpBBSegmentQuery(subtree->B->bb, a, b);
+		int child_a = node->children, child_b = child_a + 1;
+		cpFloat t_a = cpBBSegmentQuery(nodes[child_a].bb, a, b);
+		cpFloat t_b = cpBBSegmentQuery(nodes[child_b].bb, a, b);
 		
 		if(t_a < t_b){
-			if(t_a < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(subtree->A, obj, a, b, t_exit, func, data));
-			if(t_b < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(subtree->B, obj, a, b, t_exit, func, data));
+			if(t_a < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(nodes, child_a, obj, a, b, t_exit, func, data));
+			if(t_b < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(nodes, child_b, obj, a, b, t_exit, func, data));
 		} else {
-			if(t_b < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(subtree->B, obj, a, b, t_exit, func, data));
-			if(t_a < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(subtree->A, obj, a, b, t_exit, func, data));
+			if(t_b < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(nodes, child_b, obj, a, b, t_exit, func, data));
+			if(t_a < t_exit) t_exit = cpfmin(t_exit, SubtreeSegmentQuery(nodes, child_a, obj, a, b, t_exit, func, data));
 		}
 		
 		return t_exit;
 	}
 }
 
-static void
-SubtreeRecycle(cpBBTree *tree, Node *node)
+//MARK: Compaction
+
+static int
+SubtreeCompact(Node *src, Node *dst, int index, int count)
 {
-	if(!NodeIsLeaf(node)){
-		SubtreeRecycle(tree, node->A);
-		SubtreeRecycle(tree, node->B);
-		NodeRecycle(tree, node);
+	// dst[index] was already copied, but still refers to its children by their old indexes.
+	Node *node = dst + index;
+	if(node->leaf){
+		node->leaf->node = index;
+	} else {
+		int children = node->children;
+		node->children = count;
+		
+		dst[count + 0] = src[children + 0];
+		dst[count + 0].parent = index;
+		dst[count + 1] = src[children + 1];
+		dst[count + 1].parent = index;
+		
+		int a = count;
+		count = SubtreeCompact(src, dst, a + 0, count + 2);
+		count = SubtreeCompact(src, dst, a + 1, count);
 	}
+	
+	return count;
 }
 
-static inline Node *
-SubtreeRemove(Node *subtree, Node *leaf, cpBBTree *tree)
+// Rewrite the node array in depth first order to put each subtree in one contiguous run of memory.
+// The shape of the tree doesn't change.
+static void
+TreeCompact(cpBBTree *tree)
 {
-	if(leaf == subtree){
-		return NULL;
-	} else {
-		Node *parent = leaf->parent;
-		if(parent == subtree){
-			Node *other = NodeOther(subtree, leaf);
-			other->parent = subtree->parent;
-			NodeRecycle(tree, subtree);
-			return other;
-		} else {
-			NodeReplaceChild(parent->parent, parent, NodeOther(parent, leaf), tree);
-			return subtree;
-		}
-	}
+	tree->churn = 0;
+	
+	int root = tree->root;
+	if(root < 0) return;
+	
+	// The root's pair and one pair for each internal node. Any slack left over from growing or removing is dropped.
+	int capacity = 2*cpHashSetCount(tree->leaves);
+	void *buffer = NULL;
+	Node *nodes = NodesAlloc(capacity, &buffer);
+	
+	nodes[0] = tree->nodes[root];
+	tree->nodeCount = SubtreeCompact(tree->nodes, nodes, 0, 2);
+	tree->freePairs = -1;
+	tree->root = 0;
+	
+	NodesSetBuffer(tree, nodes, buffer, capacity);
+}
+
+static inline void
+TreeCompactIfNeeded(cpBBTree *tree)
+{
+	// Every leaf has moved at least once on average, so the traversal order has scattered.
+	if(tree->churn > cpHashSetCount(tree->leaves)) TreeCompact(tree);
 }
 
 //MARK: Marking Functions
 
+// When marking on a worker thread, the pairs can't be modified and the query function can't be called.
+// The steps are queued instead and replayed on the calling thread in the same order the serial traversal takes them.
+enum MarkEventType {
+	// Insert a new pair for the leaves.
+	MARK_PAIR_INSERT,
+	// Call the query function for the leaves.
+	MARK_QUERY,
+	// Call the query function for the pairs added to 'a' since it was queued, up to 'pair'.
+	MARK_NEW_PAIRS,
+	// Call the query function for an existing pair and update its id.
+	MARK_PAIR_QUERY,
+};
+
+typedef struct MarkEvent {
+	enum MarkEventType type;
+	Leaf *a, *b;
+	Pair *pair;
+} MarkEvent;
+
+struct MarkQueue {
+	MarkEvent *events;
+	int count, capacity;
+};
+
+static void
+MarkQueuePush(MarkQueue *queue, enum MarkEventType type, Leaf *a, Leaf *b, Pair *pair)
+{
+	if(queue->count == queue->capacity){
+		queue->capacity = 3*(queue->capacity + 1)/2;
+		queue->events = (MarkEvent *)cprealloc(queue->events, queue->capacity*sizeof(MarkEvent));
+	}
+	
+	MarkEvent event = {type, a, b, pair};
+	queue->events[queue->count++] = event;
+}
+
 typedef struct MarkContext {
 	cpBBTree *tree;
-	Node *staticRoot;
+	Node *staticNodes;
+	int staticRoot;
 	cpSpatialIndexQueryFunc func;
 	void *data;
+	
+	// Set when running on a worker thread.
+	MarkQueue *queue;
 } MarkContext;
 
+static inline void
+MarkPairInsert(Leaf *a, Leaf *b, MarkContext *context)
+{
+	if(context->queue){
+		MarkQueuePush(context->queue, MARK_PAIR_INSERT, a, b, NULL);
+	} else {
+		PairInsert(a, b, context->tree);
+	}
+}
+
+static inline void
+MarkQuery(Leaf *a, Leaf *b, MarkContext *context)
+{
+	if(context->queue){
+		MarkQueuePush(context->queue, MARK_QUERY, a, b, NULL);
+	} else {
+		context->func(a->obj, b->obj, 0, context->data);
+	}
+}
+
 static void
-MarkLeafQuery(Node *subtree, Node *leaf, cpBool left, MarkContext *context)
+MarkLeafQuery(Node *nodes, int subtree, Leaf *leaf, cpBB bb, cpBool left, MarkContext *context)
 {
-	if(cpBBIntersects(leaf->bb, subtree->bb)){
-		if(NodeIsLeaf(subtree)){
+	Node *node = nodes + subtree;
+	if(cpBBIntersects(bb, node->bb)){
+		Leaf *other = node->leaf;
+		if(other){
 			if(left){
-				PairInsert(leaf, subtree, context->tree);
+				MarkPairInsert(leaf, other, context);
 			} else {
-				if(subtree->STAMP < leaf->STAMP) PairInsert(subtree, leaf, context->tree);
-				context->func(leaf->obj, subtree->obj, 0, context->data);
+				if(other->stamp < leaf->stamp) MarkPairInsert(other, leaf, context);
+				MarkQuery(leaf, other, context);
 			}
 		} else {
-			MarkLeafQuery(subtree->A, leaf, left, context);
-			MarkLeafQuery(subtree->B, leaf, left, context);
+			MarkLeafQuery(nodes, node->children + 0, leaf, bb, left, context);
+			MarkLeafQuery(nodes, node->children + 1, leaf, bb, left, context);
 		}
 	}
 }
 
 static void
-MarkLeaf(Node *leaf, MarkContext *context)
+MarkLeaf(Leaf *leaf, MarkContext *context)
 {
 	cpBBTree *tree = context->tree;
-	if(leaf->STAMP == GetMasterTree(tree)->stamp){
-		Node *staticRoot = context->staticRoot;
-		if(staticRoot) MarkLeafQuery(staticRoot, leaf, cpFalse, context);
+	if(leaf->stamp == GetMasterTree(tree)->stamp){
+		Node *nodes = tree->nodes;
+		cpBB bb = nodes[leaf->node].bb;
+		
+		int staticRoot = context->staticRoot;
+		if(staticRoot >= 0) MarkLeafQuery(context->staticNodes, staticRoot, leaf, bb, cpFalse, context);
 		
-		for(Node *node = leaf; node->parent; node = node->parent){
-			if(node == node->parent->A){
-				MarkLeafQuery(node->parent->B, leaf, cpTrue, context);
+		for(int node = leaf->node; nodes[node].parent >= 0; node = nodes[node].parent){
+			if((node&1) == 0){
+				MarkLeafQuery(nodes, node + 1, leaf, bb, cpTrue, context);
 			} else {
-				MarkLeafQuery(node->parent->A, leaf, cpFalse, context);
+				MarkLeafQuery(nodes, node - 1, leaf, bb, cpFalse, context);
 			}
 		}
 	} else {
-		Pair *pair = leaf->PAIRS;
+		MarkQueue *queue = context->queue;
+		
+		// Leaves marked earlier by other workers may still add pairs to the front of the list.
+		if(queue) MarkQueuePush(queue, MARK_NEW_PAIRS, leaf, NULL, leaf->pairs);
+		
+		Pair *pair = leaf->pairs;
 		while(pair){
 			if(leaf == pair->b.leaf){
-				pair->id = context->func(pair->a.leaf->obj, leaf->obj, pair->id, context->data);
+				if(queue){
+					MarkQueuePush(queue, MARK_PAIR_QUERY, NULL, NULL, pair);
+				} else {
+					pair->id = context->func(pair->a.leaf->obj, leaf->obj, pair->id, context->data);
+				}
+				
 				pair = pair->b.next;
 			} else {
 				pair = pair->a.next;
@@ -469,47 +696,79 @@ MarkLeaf(Node *leaf, MarkContext *context)
 }
 
 static void
-MarkSubtree(Node *subtree, MarkContext *context)
+MarkSubtree(Node *nodes, int subtree, MarkContext *context)
 {
-	if(NodeIsLeaf(subtree)){
-		MarkLeaf(subtree, context);
+	Node *node = nodes + subtree;
+	if(node->leaf){
+		MarkLeaf(node->leaf, context);
 	} else {
-		MarkSubtree(subtree->A, context);
-		MarkSubtree(subtree->B, context); // TODO: Force TCO here?
+		MarkSubtree(nodes, node->children + 0, context);
+		MarkSubtree(nodes, node->children + 1, context); // TODO: Force TCO here?
 	}
 }
 
 //MARK: Leaf Functions
 
-static Node *
-LeafNew(cpBBTree *tree, void *obj, cpBB bb)
+static void
+LeafRecycle(cpBBTree *tree, Leaf *leaf)
 {
-	Node *node = NodeFromPool(tree);
-	node->obj = obj;
-	node->bb = GetBB(tree, obj);
+	leaf->obj = tree->pooledLeaves;
+	tree->pooledLeaves = leaf;
+}
+
+static Leaf *
+LeafFromPool(cpBBTree *tree)
+{
+	Leaf *leaf = tree->pooledLeaves;
 	
-	node->parent = NULL;
-	node->STAMP = 0;
-	node->PAIRS = NULL;
+	if(leaf){
+		tree->pooledLeaves = (Leaf *)leaf->obj;
+		return leaf;
+	} else {
+		// Pool is exhausted, make more
+		int count = CP_BUFFER_BYTES/sizeof(Leaf);
+		cpAssertHard(count, "Internal Error: Buffer size is too small.");
+		
+		Leaf *buffer = (Leaf *)cpcalloc(1, CP_BUFFER_BYTES);
+		cpArrayPush(tree->allocatedBuffers, buffer);
+		
+		// push all but the first one, return the first instead
+		for(int i=1; i<count; i++) LeafRecycle(tree, buffer + i);
+		return buffer;
+	}
+}
+
+static Leaf *
+LeafNew(cpBBTree *tree, void *obj)
+{
+	Leaf *leaf = LeafFromPool(tree);
+	leaf->obj = obj;
+	leaf->pairs = NULL;
+	leaf->stamp = 0;
+	leaf->node = -1;
 	
-	return node;
+	return leaf;
+}
+
+static void
+LeafReinsert(Leaf *leaf, cpBBTree *tree, cpBB bb)
+{
+	SubtreeRemove(tree, leaf);
+	SubtreeInsert(tree, leaf, bb);
+	
+	PairsClear(leaf, tree);
+	leaf->stamp = GetMasterTree(tree)->stamp;
+	
+	CP_COUNTER_ADD(tree->reinsertions, 1);
 }
 
 static cpBool
-LeafUpdate(Node *leaf, cpBBTree *tree)
+LeafUpdate(Leaf *leaf, cpBBTree *tree)
 {
-	Node *root = tree->root;
 	cpBB bb = tree->spatialIndex.bbfunc(leaf->obj);
 	
-	if(!cpBBContainsBB(leaf->bb, bb)){
-		leaf->bb = GetBB(tree, leaf->obj);
-		
-		root = SubtreeRemove(root, leaf, tree);
-		tree->root = SubtreeInsert(root, leaf, tree);
-		
-		PairsClear(leaf, tree);
-		leaf->STAMP = GetMasterTree(tree)->stamp;
-		
+	if(!cpBBContainsBB(tree->nodes[leaf->node].bb, bb)){
+		LeafReinsert(leaf, tree, GetBB(tree, leaf->obj));
 		return cpTrue;
 	} else {
 		return cpFalse;
@@ -519,19 +778,23 @@ LeafUpdate(Node *leaf, cpBBTree *tree)
 static cpCollisionID VoidQueryFunc(void *obj1, void *obj2, cpCollisionID id, void *data){return id;}
 
 static void
-LeafAddPairs(Node *leaf, cpBBTree *tree)
+LeafAddPairs(Leaf *leaf, cpBBTree *tree)
 {
 	cpSpatialIndex *dynamicIndex = tree->spatialIndex.dynamicIndex;
 	if(dynamicIndex){
-		Node *dynamicRoot = GetRootIfTree(dynamicIndex);
-		if(dynamicRoot){
-			cpBBTree *dynamicTree = GetTree(dynamicIndex);
-			MarkContext context = {dynamicTree, NULL, NULL, NULL};
-			MarkLeafQuery(dynamicRoot, leaf, cpTrue, &context);
+		cpBBTree *dynamicTree = GetTree(dynamicIndex);
+		if(dynamicTree && dynamicTree->root >= 0){
+			MarkContext context = {dynamicTree, NULL, -1, NULL, NULL, NULL};
+			MarkLeafQuery(dynamicTree->nodes, dynamicTree->root, leaf, tree->nodes[leaf->node].bb, cpTrue, &context);
 		}
 	} else {
-		Node *staticRoot = GetRootIfTree(tree->spatialIndex.staticIndex);
-		MarkContext context = {tree, staticRoot, VoidQueryFunc, NULL};
+		cpBBTree *staticTree = GetTree(tree->spatialIndex.staticIndex);
+		MarkContext context = {tree, NULL, -1, VoidQueryFunc, NULL, NULL};
+		if(staticTree){
+			context.staticNodes = staticTree->nodes;
+			context.staticRoot = staticTree->root;
+		}
+		
 		MarkLeaf(leaf, &context);
 	}
 }
@@ -545,15 +808,15 @@ cpBBTreeAlloc(void)
 }
 
 static int
-leafSetEql(void *obj, Node *node)
+leafSetEql(void *obj, Leaf *leaf)
 {
-	return (obj == node->obj);
+	return (obj == leaf->obj);
 }
 
 static void *
 leafSetTrans(void *obj, cpBBTree *tree)
 {
-	return LeafNew(tree, obj, tree->spatialIndex.bbfunc(obj));
+	return LeafNew(tree, obj);
 }
 
 cpSpatialIndex *
@@ -564,12 +827,26 @@ cpBBTreeInit(cpBBTree *tree, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *static
 	tree->velocityFunc = NULL;
 	
 	tree->leaves = cpHashSetNew(0, (cpHashSetEqlFunc)leafSetEql);
-	tree->root = NULL;
 	
-	tree->pooledNodes = NULL;
+	tree->nodes = NULL;
+	tree->nodeBuffer = NULL;
+	tree->nodeCount = tree->nodeCapacity = 0;
+	tree->freePairs = -1;
+	tree->root = -1;
+	tree->churn = 0;
+	
+	tree->pooledLeaves = NULL;
 	tree->allocatedBuffers = cpArrayNew(0);
 	
+	tree->refits = NULL;
+	tree->refitsCapacity = 0;
+	tree->subtrees = NULL;
+	tree->subtreeCount = tree->subtreesCapacity = 0;
+	tree->queues = NULL;
+	tree->queueCount = 0;
+	
 	tree->stamp = 0;
+	tree->opath = 0;
 	
 	return (cpSpatialIndex *)tree;
 }
@@ -595,6 +872,12 @@ static void
 cpBBTreeDestroy(cpBBTree *tree)
 {
 	cpHashSetFree(tree->leaves);
+	cpfree(tree->nodeBuffer);
+	
+	cpfree(tree->refits);
+	cpfree(tree->subtrees);
+	for(int i=0; i<tree->queueCount; i++) cpfree(tree->queues[i].events);
+	cpfree(tree->queues);
 	
 	if(tree->allocatedBuffers) cpArrayFreeEach(tree->allocatedBuffers, cpfree);
 	cpArrayFree(tree->allocatedBuffers);
@@ -605,24 +888,26 @@ cpBBTreeDestroy(cpBBTree *tree)
 static void
 cpBBTreeInsert(cpBBTree *tree, void *obj, cpHashValue hashid)
 {
-	Node *leaf = (Node *)cpHashSetInsert(tree->leaves, hashid, obj, (cpHashSetTransFunc)leafSetTrans, tree);
-	
-	Node *root = tree->root;
-	tree->root = SubtreeInsert(root, leaf, tree);
+	Leaf *leaf = (Leaf *)cpHashSetInsert(tree->leaves, hashid, obj, (cpHashSetTransFunc)leafSetTrans, tree);
+	SubtreeInsert(tree, leaf, GetBB(tree, obj));
 	
-	leaf->STAMP = GetMasterTree(tree)->stamp;
+	leaf->stamp = GetMasterTree(tree)->stamp;
 	LeafAddPairs(leaf, tree);
 	IncrementStamp(tree);
+	
+	TreeCompactIfNeeded(tree);
 }
 
 static void
 cpBBTreeRemove(cpBBTree *tree, void *obj, cpHashValue hashid)
 {
-	Node *leaf = (Node *)cpHashSetRemove(tree->leaves, hashid, obj);
+	Leaf *leaf = (Leaf *)cpHashSetRemove(tree->leaves, hashid, obj);
 	
-	tree->root = SubtreeRemove(tree->root, leaf, tree);
+	SubtreeRemove(tree, leaf);
 	PairsClear(leaf, tree);
-	NodeRecycle(tree, leaf);
+	LeafRecycle(tree, leaf);
+	
+	TreeCompactIfNeeded(tree);
 }
 
 static cpBool
@@ -633,22 +918,28 @@ cpBBTreeContains(cpBBTree *tree, void *obj, cpHashValue hashid)
 
 //MARK: Reindex
 
-static void LeafUpdateWrap(Node *leaf, cpBBTree *tree) {LeafUpdate(leaf, tree);}
+static void LeafUpdateWrap(Leaf *leaf, cpBBTree *tree) {LeafUpdate(leaf, tree);}
 
 static void
 cpBBTreeReindexQuery(cpBBTree *tree, cpSpatialIndexQueryFunc func, void *data)
 {
-	if(!tree->root) return;
+	if(tree->root < 0) return;
 	
-	// LeafUpdate() may modify tree->root. Don't cache it.
+	// LeafUpdate() may modify tree->root and tree->nodes. Don't cache them.
 	cpHashSetEach(tree->leaves, (cpHashSetIteratorFunc)LeafUpdateWrap, tree);
+	TreeCompactIfNeeded(tree);
 	
 	cpSpatialIndex *staticIndex = tree->spatialIndex.staticIndex;
-	Node *staticRoot = (staticIndex && staticIndex->klass == Klass() ? ((cpBBTree *)staticIndex)->root : NULL);
+	cpBBTree *staticTree = GetTree(staticIndex);
+	
+	MarkContext context = {tree, NULL, -1, func, data, NULL};
+	if(staticTree){
+		context.staticNodes = staticTree->nodes;
+		context.staticRoot = staticTree->root;
+	}
 	
-	MarkContext context = {tree, staticRoot, func, data};
-	MarkSubtree(tree->root, &context);
-	if(staticIndex && !staticRoot) cpSpatialIndexCollideStatic((cpSpatialIndex *)tree, staticIndex, func, data);
+	MarkSubtree(tree->nodes, tree->root, &context);
+	if(staticIndex && !staticTree) cpSpatialIndexCollideStatic((cpSpatialIndex *)tree, staticIndex, func, data);
 	
 	IncrementStamp(tree);
 }
@@ -662,26 +953,213 @@ cpBBTreeReindex(cpBBTree *tree)
 static void
 cpBBTreeReindexObject(cpBBTree *tree, void *obj, cpHashValue hashid)
 {
-	Node *leaf = (Node *)cpHashSetFind(tree->leaves, hashid, obj);
+	Leaf *leaf = (Leaf *)cpHashSetFind(tree->leaves, hashid, obj);
 	if(leaf){
 		if(LeafUpdate(leaf, tree)) LeafAddPairs(leaf, tree);
 		IncrementStamp(tree);
 	}
 }
 
+//MARK: Threaded Reindex
+
+struct LeafRefit {
+	Leaf *leaf;
+	cpBB bb;
+	cpBool reinsert;
+};
+
+typedef struct ThreadedReindexContext {
+	cpBBTree *tree;
+	int leafCount;
+	Node *staticNodes;
+	int staticRoot;
+} ThreadedReindexContext;
+
+// The range of items in a list that a worker is responsible for.
+static inline void
+WorkerRange(int count, unsigned long worker, unsigned long worker_count, int *start, int *end)
+{
+	*start = (int)(count*worker/worker_count);
+	*end = (int)(count*(worker + 1)/worker_count);
+}
+
+static void
+fillRefitArray(Leaf *leaf, LeafRefit **cursor){
+	(**cursor).leaf = leaf;
+	(*cursor)++;
+}
+
+// Decide which of a worker's share of the leaves no longer fit in their bounding boxes.
+static void
+RefitLeaves(ThreadedReindexContext *context, unsigned long worker, unsigned long worker_count)
+{
+	cpBBTree *tree = context->tree;
+	Node *nodes = tree->nodes;
+	
+	int start, end;
+	WorkerRange(context->leafCount, worker, worker_count, &start, &end);
+	
+	for(int i=start; i<end; i++){
+		LeafRefit *refit = tree->refits + i;
+		void *obj = refit->leaf->obj;
+		
+		refit->reinsert = !cpBBContainsBB(nodes[refit->leaf->node].bb, tree->spatialIndex.bbfunc(obj));
+		if(refit->reinsert) refit->bb = GetBB(tree, obj);
+	}
+}
+
+static void
+SubtreesPush(cpBBTree *tree, int subtree)
+{
+	if(tree->subtreeCount == tree->subtreesCapacity){
+		tree->subtreesCapacity = 3*(tree->subtreesCapacity + 1)/2;
+		tree->subtrees = (int *)cprealloc(tree->subtrees, tree->subtreesCapacity*sizeof(int));
+	}
+	
+	tree->subtrees[tree->subtreeCount++] = subtree;
+}
+
+// Collect the subtrees at the given depth, and any leaves above it, in depth first order.
+static void
+SubtreesCollect(cpBBTree *tree, int subtree, int depth)
+{
+	Node *node = tree->nodes + subtree;
+	if(depth == 0 || node->leaf){
+		SubtreesPush(tree, subtree);
+	} else {
+		SubtreesCollect(tree, node->children + 0, depth - 1);
+		SubtreesCollect(tree, node->children + 1, depth - 1);
+	}
+}
+
+static void
+MarkSubtrees(ThreadedReindexContext *context, unsigned long worker, unsigned long worker_count)
+{
+	cpBBTree *tree = context->tree;
+	MarkQueue *queue = tree->queues + worker;
+	queue->count = 0;
+	
+	MarkContext mark = {tree, context->staticNodes, context->staticRoot, NULL, NULL, queue};
+	
+	int start, end;
+	WorkerRange(tree->subtreeCount, worker, worker_count, &start, &end);
+	for(int i=start; i<end; i++) MarkSubtree(tree->nodes, tree->subtrees[i], &mark);
+}
+
+static void
+MarkQueueReplay(MarkQueue *queue, cpBBTree *tree, cpSpatialIndexQueryFunc func, void *data)
+{
+	for(int i=0; i<queue->count; i++){
+		MarkEvent *event = queue->events + i;
+		
+		switch(event->type){
+			case MARK_PAIR_INSERT:
+				PairInsert(event->a, event->b, tree);
+				break;
+			case MARK_QUERY:
+				func(event->a->obj, event->b->obj, 0, data);
+				break;
+			case MARK_NEW_PAIRS: {
+				// New pairs are only ever added to the front of the list.
+				Leaf *leaf = event->a;
+				for(Pair *pair = leaf->pairs; pair != event->pair;){
+					if(leaf == pair->b.leaf){
+						pair->id = func(pair->a.leaf->obj, leaf->obj, pair->id, data);
+						pair = pair->b.next;
+					} else {
+						pair = pair->a.next;
+					}
+				}
+				break;
+			}
+			case MARK_PAIR_QUERY: {
+				Pair *pair = event->pair;
+				pair->id = func(pair->a.leaf->obj, pair->b.leaf->obj, pair->id, data);
+				break;
+			}
+		}
+	}
+}
+
+void
+cpBBTreeReindexQueryThreaded(cpSpatialIndex *index, cpThreadPool *pool, cpSpatialIndexQueryFunc func, void *data)
+{
+	cpBBTree *tree = GetTree(index);
+	unsigned long worker_count = cpThreadPoolGetThreads(pool);
+	
+	if(!tree || worker_count == 1){
+		cpSpatialIndexReindexQuery(index, func, data);
+		return;
+	}
+	
+	if(tree->root < 0) return;
+	
+	// Find the leaves that moved out of their bounding boxes on the workers.
+	// Reinserting them modifies the tree, so that's done afterwards in the same order as cpBBTreeReindexQuery().
+	int count = cpHashSetCount(tree->leaves);
+	if(count > tree->refitsCapacity){
+		tree->refitsCapacity = count;
+		tree->refits = (LeafRefit *)cprealloc(tree->refits, count*sizeof(LeafRefit));
+	}
+	
+	LeafRefit *cursor = tree->refits;
+	cpHashSetEach(tree->leaves, (cpHashSetIteratorFunc)fillRefitArray, &cursor);
+	
+	ThreadedReindexContext context = {tree, count, NULL, -1};
+	cpThreadPoolRun(pool, (cpThreadPoolFunc)RefitLeaves, &context);
+	
+	for(int i=0; i<count; i++){
+		LeafRefit *refit = tree->refits + i;
+		if(refit->reinsert) LeafReinsert(refit->leaf, tree, refit->bb);
+	}
+	
+	TreeCompactIfNeeded(tree);
+	
+	// Split the tree into several subtrees per worker so the work evens out.
+	int depth = 0;
+	while((1ul<<depth) < 8*worker_count) depth++;
+	
+	tree->subtreeCount = 0;
+	SubtreesCollect(tree, tree->root, depth);
+	
+	if((int)worker_count > tree->queueCount){
+		tree->queues = (MarkQueue *)cprealloc(tree->queues, worker_count*sizeof(MarkQueue));
+		memset(tree->queues + tree->queueCount, 0, (worker_count - tree->queueCount)*sizeof(MarkQueue));
+		tree->queueCount = (int)worker_count;
+	}
+	
+	cpSpatialIndex *staticIndex = tree->spatialIndex.staticIndex;
+	cpBBTree *staticTree = GetTree(staticIndex);
+	if(staticTree){
+		context.staticNodes = staticTree->nodes;
+		context.staticRoot = staticTree->root;
+	}
+	
+	cpThreadPoolRun(pool, (cpThreadPoolFunc)MarkSubtrees, &context);
+	
+	// Each worker marked a contiguous run of the subtrees.
+	// Replaying the queues in worker order matches the order MarkSubtree() visits the leaves in.
+	for(unsigned long worker=0; worker<worker_count; worker++){
+		MarkQueueReplay(tree->queues + worker, tree, func, data);
+	}
+	
+	if(staticIndex && !staticTree) cpSpatialIndexCollideStatic((cpSpatialIndex *)tree, staticIndex, func, data);
+	
+	IncrementStamp(tree);
+}
+
 //MARK: Query
 
 static void
 cpBBTreeSegmentQuery(cpBBTree *tree, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
 {
-	Node *root = tree->root;
-	if(root) SubtreeSegmentQuery(root, obj, a, b, t_exit, func, data);
+	if(tree->root >= 0) SubtreeSegmentQuery(tree->nodes, tree->root, obj, a, b, t_exit, func, data);
 }
 
 static void
 cpBBTreeQuery(cpBBTree *tree, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
 {
-	if(tree->root) SubtreeQuery(tree->root, obj, bb, func, data);
+	if(tree->root >= 0) SubtreeQuery(tree->nodes, tree->root, obj, bb, func, data);
 }
 
 //MARK: Misc
@@ -697,7 +1175,7 @@ typedef struct eachContext {
 	void *data;
 } eachContext;
 
-static void each_helper(Node *node, eachContext *context){context->func(node->obj, context->data);}
+static void each_helper(Leaf *leaf, eachContext *context){context->func(leaf->obj, context->data);}
 
 static void
 cpBBTreeEach(cpBBTree *tree, cpSpatialIndexIteratorFunc func, void *data)
@@ -726,6 +1204,26 @@ static cpSpatialIndexClass klass = {
 
 static inline cpSpatialIndexClass *Klass(){return &klass;}
 
+unsigned long
+cpBBTreeGetReinsertionCount(cpSpatialIndex *index)
+{
+#if CP_ENABLE_COUNTERS
+	cpBBTree *tree = GetTree(index);
+	return (tree ? tree->reinsertions : 0);
+#else
+	return 0;
+#endif
+}
+
+void
+cpBBTreeResetReinsertionCount(cpSpatialIndex *index)
+{
+#if CP_ENABLE_COUNTERS
+	cpBBTree *tree = GetTree(index);
+	if(tree) tree->reinsertions = 0;
+#endif
+}
+
 
 //MARK: Tree Optimization
 
@@ -735,94 +1233,124 @@ cpfcompare(const cpFloat *a, const cpFloat *b){
 }
 
 static void
-fillNodeArray(Node *node, Node ***cursor){
-	(**cursor) = node;
+fillLeafArray(Leaf *leaf, Leaf ***cursor){
+	(**cursor) = leaf;
 	(*cursor)++;
 }
 
-static Node *
-partitionNodes(cpBBTree *tree, Node **nodes, int count)
+// Builds the subtree for the leaves into the node at 'index'.
+// The leaves' bounding boxes are read from the old node array 'src'.
+static void
+partitionNodes(cpBBTree *tree, Node *src, Leaf **leaves, int count, int index)
 {
 	if(count == 1){
-		return nodes[0];
-	} else if(count == 2) {
-		return NodeNew(tree, nodes[0], nodes[1]);
+		Leaf *leaf = leaves[0];
+		Node *node = tree->nodes + index;
+		node->bb = src[leaf->node].bb;
+		node->leaf = leaf;
+		node->children = -1;
+		
+		leaf->node = index;
+		return;
 	}
 	
-	// Find the AABB for these nodes
-	cpBB bb = nodes[0]->bb;
-	for(int i=1; i<count; i++) bb = cpBBMerge(bb, nodes[i]->bb);
-	
-	// Split it on it's longest axis
-	cpBool splitWidth = (bb.r - bb.l > bb.t - bb.b);
-	
-	// Sort the bounds and use the median as the splitting point
-	cpFloat *bounds = (cpFloat *)cpcalloc(count*2, sizeof(cpFloat));
-	if(splitWidth){
-		for(int i=0; i<count; i++){
-			bounds[2*i + 0] = nodes[i]->bb.l;
-			bounds[2*i + 1] = nodes[i]->bb.r;
+	int right = 1;
+	if(count > 2){
+		// Find the AABB for these nodes
+		cpBB bb = src[leaves[0]->node].bb;
+		for(int i=1; i<count; i++) bb = cpBBMerge(bb, src[leaves[i]->node].bb);
+		
+		// Split it on it's longest axis
+		cpBool splitWidth = (bb.r - bb.l > bb.t - bb.b);
+		
+		// Sort the bounds and use the median as the splitting point
+		cpFloat *bounds = (cpFloat *)cpcalloc(count*2, sizeof(cpFloat));
+		if(splitWidth){
+			for(int i=0; i<count; i++){
+				bounds[2*i + 0] = src[leaves[i]->node].bb.l;
+				bounds[2*i + 1] = src[leaves[i]->node].bb.r;
+			}
+		} else {
+			for(int i=0; i<count; i++){
+				bounds[2*i + 0] = src[leaves[i]->node].bb.b;
+				bounds[2*i + 1] = src[leaves[i]->node].bb.t;
+			}
 		}
-	} else {
-		for(int i=0; i<count; i++){
-			bounds[2*i + 0] = nodes[i]->bb.b;
-			bounds[2*i + 1] = nodes[i]->bb.t;
+		
+		qsort(bounds, count*2, sizeof(cpFloat), (int (*)(const void *, const void *))cpfcompare);
+		cpFloat split = (bounds[count - 1] + bounds[count])*0.5f; // use the medain as the split
+		cpfree(bounds);
+		
+		// Generate the child BBs
+		cpBB a = bb, b = bb;
+		if(splitWidth) a.r = b.l = split; else a.t = b.b = split;
+		
+		// Partition the nodes
+		right = count;
+		for(int left=0; left < right;){
+			Leaf *leaf = leaves[left];
+			cpBB leafBB = src[leaf->node].bb;
+			if(cpBBMergedArea(leafBB, b) < cpBBMergedArea(leafBB, a)){
+				right--;
+				leaves[left] = leaves[right];
+				leaves[right] = leaf;
+			} else {
+				left++;
+			}
 		}
+		
+		// Everything landed on one side, split the leaves evenly instead.
+		if(right == count || right == 0) right = count/2;
 	}
 	
-	qsort(bounds, count*2, sizeof(cpFloat), (int (*)(const void *, const void *))cpfcompare);
-	cpFloat split = (bounds[count - 1] + bounds[count])*0.5f; // use the medain as the split
-	cpfree(bounds);
-
-	// Generate the child BBs
-	cpBB a = bb, b = bb;
-	if(splitWidth) a.r = b.l = split; else a.t = b.b = split;
+	// Allocate the children before recursing so the nodes come out in depth first order.
+	int children = PairAlloc(tree);
+	Node *nodes = tree->nodes;
+	nodes[index].leaf = NULL;
+	nodes[index].children = children;
+	nodes[children + 0].parent = index;
+	nodes[children + 1].parent = index;
 	
-	// Partition the nodes
-	int right = count;
-	for(int left=0; left < right;){
-		Node *node = nodes[left];
-		if(cpBBMergedArea(node->bb, b) < cpBBMergedArea(node->bb, a)){
-//		if(cpBBProximity(node->bb, b) < cpBBProximity(node->bb, a)){
-			right--;
-			nodes[left] = nodes[right];
-			nodes[right] = node;
-		} else {
-			left++;
+	// Recurse and build the node!
+	partitionNodes(tree, src, leaves, right, children + 0);
+	partitionNodes(tree, src, leaves + right, count - right, children + 1);
+	NodeRefit(tree->nodes, index);
+}
+
+static void
+OptimizeIncremental(cpBBTree *tree, int passes)
+{
+	for(int i=0; i<passes; i++){
+		Node *nodes = tree->nodes;
+		int node = tree->root;
+		if(node < 0 || nodes[node].leaf) return;
+		
+		// Each bit of the counter picks a side at one level of the tree so the passes spread out over all of it.
+		unsigned int path = tree->opath++;
+		for(int bit=0; !nodes[node].leaf; bit = (bit + 1)&(sizeof(unsigned int)*8 - 1)){
+			node = nodes[node].children + (path&(1u<<bit) ? 0 : 1);
 		}
+		
+		// The leaf keeps its bounding box and pairs, only its place in the tree changes.
+		Leaf *leaf = nodes[node].leaf;
+		cpBB bb = nodes[node].bb;
+		SubtreeRemove(tree, leaf);
+		SubtreeInsert(tree, leaf, bb);
 	}
 	
-	if(right == count){
-		Node *node = NULL;
-		for(int i=0; i<count; i++) node = SubtreeInsert(node, nodes[i], tree);
-		return node;
+	TreeCompactIfNeeded(tree);
+}
+
+void
+cpBBTreeOptimizeIncremental(cpSpatialIndex *index, int passes)
+{
+	if(index->klass != &klass){
+		cpAssertWarn(cpFalse, "Ignoring cpBBTreeOptimizeIncremental() call to non-tree spatial index.");
+		return;
 	}
 	
-	// Recurse and build the node!
-	return NodeNew(tree,
-		partitionNodes(tree, nodes, right),
-		partitionNodes(tree, nodes + right, count - right)
-	);
-}
-
-//static void
-//cpBBTreeOptimizeIncremental(cpBBTree *tree, int passes)
-//{
-//	for(int i=0; i<passes; i++){
-//		Node *root = tree->root;
-//		Node *node = root;
-//		int bit = 0;
-//		unsigned int path = tree->opath;
-//		
-//		while(!NodeIsLeaf(node)){
-//			node = (path&(1<<bit) ? node->a : node->b);
-//			bit = (bit + 1)&(sizeof(unsigned int)*8 - 1);
-//		}
-//		
-//		root = subtreeRemove(root, node, tree);
-//		tree->root = subtreeInsert(root, node, tree);
-//	}
-//}
+	OptimizeIncremental((cpBBTree *)index, passes);
+}
 
 void
 cpBBTreeOptimize(cpSpatialIndex *index)
@@ -833,18 +1361,30 @@ cpBBTreeOptimize(cpSpatialIndex *index)
 	}
 	
 	cpBBTree *tree = (cpBBTree *)index;
-	Node *root = tree->root;
-	if(!root) return;
+	if(tree->root < 0) return;
 	
 	int count = cpBBTreeCount(tree);
-	Node **nodes = (Node **)cpcalloc(count, sizeof(Node *));
-	Node **cursor = nodes;
+	Leaf **leaves = (Leaf **)cpcalloc(count, sizeof(Leaf *));
+	Leaf **cursor = leaves;
+	
+	cpHashSetEach(tree->leaves, (cpHashSetIteratorFunc)fillLeafArray, &cursor);
+	
+	// Build into a fresh array, the old one still holds the leaves' bounding boxes.
+	Node *src = tree->nodes;
+	void *srcBuffer = tree->nodeBuffer;
+	
+	tree->nodeCapacity = 2*count;
+	tree->nodes = NodesAlloc(tree->nodeCapacity, &tree->nodeBuffer);
+	tree->nodeCount = 0;
+	tree->freePairs = -1;
 	
-	cpHashSetEach(tree->leaves, (cpHashSetIteratorFunc)fillNodeArray, &cursor);
+	tree->root = PairAlloc(tree);
+	tree->nodes[tree->root].parent = -1;
+	partitionNodes(tree, src, leaves, count, tree->root);
+	tree->churn = 0;
 	
-	SubtreeRecycle(tree, root);
-	tree->root = partitionNodes(tree, nodes, count);
-	cpfree(nodes);
+	cpfree(srcBuffer);
+	cpfree(leaves);
 }
 
 //MARK: Debug Draw
@@ -856,11 +1396,12 @@ cpBBTreeOptimize(cpSpatialIndex *index)
 #include <GLUT/glut.h>
 
 static void
-NodeRender(Node *node, int depth)
+NodeRender(Node *nodes, int index, int depth)
 {
-	if(!NodeIsLeaf(node) && depth <= 10){
-		NodeRender(node->a, depth + 1);
-		NodeRender(node->b, depth + 1);
+	Node *node = nodes + index;
+	if(!node->leaf && depth <= 10){
+		NodeRender(nodes, node->children + 0, depth + 1);
+		NodeRender(nodes, node->children + 1, depth + 1);
 	}
 	
 	cpBB bb = node->bb;
@@ -891,6 +1432,6 @@ cpBBTreeRenderDebug(cpSpatialIndex *index){
 	}
 	
 	cpBBTree *tree = (cpBBTree *)index;
-	if(tree->root) NodeRender(tree->root, 0);
+	if(tree->root >= 0) NodeRender(tree->nodes, tree->root, 0);
 }
 #endif
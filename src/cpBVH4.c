@@ -0,0 +1,683 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stdlib.h"
+#include "string.h"
+#include "stdint.h"
+
+#include "chipmunk/chipmunk_private.h"
+
+static inline cpSpatialIndexClass *Klass(void);
+
+// Number of bins the surface area heuristic evaluates split planes between.
+#define CP_BVH4_BINS 16
+
+// Ranges split deeper than this use the median instead of the SAH so the depth of the tree stays bounded.
+#define CP_BVH4_SAH_DEPTH 32
+
+// Every node pushes at most 3 more entries than it pops.
+// Median splits take at most 31 more levels to get down to single objects, which bounds the stack.
+#define CP_BVH4_STACK_SIZE (3*(CP_BVH4_SAH_DEPTH + 32) + 1)
+
+typedef struct Node Node;
+typedef struct BuildItem BuildItem;
+
+typedef void (*TreeQueryFunc)(cpBVH4 *bvh, void *obj, cpBB bb, int first, cpSpatialIndexQueryFunc func, void *data);
+typedef void (*TreeSegmentQueryFunc)(cpBVH4 *bvh, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data);
+
+struct cpBVH4 {
+	cpSpatialIndex spatialIndex;
+	
+	cpHashSet *objects;
+	
+	// Set when objects were added, removed or reindexed since the tree was built.
+	cpBool dirty;
+	
+	// 'nodes' is aligned to a cache line inside of 'nodeBuffer'.
+	Node *nodes;
+	void *nodeBuffer;
+	int nodeCount, nodeCapacity;
+	
+	// The objects in the order the leaves reference them, and their bounding boxes.
+	BuildItem *items;
+	int itemCount, itemsCapacity;
+	
+	// Traversal kernels picked for the CPU when the index is created.
+	TreeQueryFunc treeQuery;
+	TreeSegmentQueryFunc treeSegmentQuery;
+};
+
+// Each node has up to four children, stored in the first 'count' lanes.
+// The bounding boxes are stored as one array per side so all four can be tested at once.
+struct Node {
+	cpFloat l[4], b[4], r[4], t[4];
+	
+	// Index of a child node, or ~index of an item for leaves.
+	int children[4];
+	int count;
+};
+
+struct BuildItem {
+	cpBB bb;
+	void *obj;
+};
+
+static inline cpBB
+NodeGetBB(const Node *node, int i)
+{
+	return cpBBNew(node->l[i], node->b[i], node->r[i], node->t[i]);
+}
+
+static inline void
+NodeSetBB(Node *node, int i, cpBB bb)
+{
+	node->l[i] = bb.l;
+	node->b[i] = bb.b;
+	node->r[i] = bb.r;
+	node->t[i] = bb.t;
+}
+
+//MARK: Child Tests
+
+// Bitmask of the children whose bounding boxes intersect bb.
+static inline int
+NodeQueryMask(const Node *node, cpBB bb)
+{
+	int mask = 0;
+	for(int i=0; i<node->count; i++){
+		if(cpBBIntersects(NodeGetBB(node, i), bb)) mask |= 1<<i;
+	}
+	
+	return mask;
+}
+
+// Same as cpBBSegmentQuery() for each of the children.
+static inline void
+NodeSegmentQuery(const Node *node, cpVect a, cpVect b, cpFloat *t)
+{
+	for(int i=0; i<node->count; i++) t[i] = cpBBSegmentQuery(NodeGetBB(node, i), a, b);
+}
+
+// The vectorized tests are written with GCC vector extensions like the hasty space's solver.
+// Only the AVX2 build tests all four children with single instructions.
+// Split into SSE2 halves they were slower than the loops above, so those are used otherwise.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__ARM_NEON__)
+#define CP_BVH4_X86_SIMD 1
+
+#if CP_USE_DOUBLES
+	typedef int64_t cpMask4 __attribute__((vector_size(32)));
+#else
+	typedef int32_t cpMask4 __attribute__((vector_size(16)));
+#endif
+
+typedef cpFloat cpFloat4 __attribute__((vector_size(4*sizeof(cpFloat))));
+
+// All the helpers passing vectors by value are force inlined into the kernels, so the ABI warning doesn't apply.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+#define CP_SIMD_INLINE static inline __attribute__((always_inline))
+
+CP_SIMD_INLINE cpFloat4 v4ld(const cpFloat *p){cpFloat4 v; memcpy(&v, p, sizeof(v)); return v;}
+CP_SIMD_INLINE cpFloat4 v4dup(cpFloat f){return (cpFloat4){} + f;}
+
+CP_SIMD_INLINE cpFloat4
+v4select(cpMask4 mask, cpFloat4 a, cpFloat4 b)
+{
+	return (cpFloat4)(((cpMask4)a & mask) | ((cpMask4)b & ~mask));
+}
+
+CP_SIMD_INLINE int
+v4movemask(cpMask4 mask)
+{
+	return (int)((mask[0]&1) | (mask[1]&2) | (mask[2]&4) | (mask[3]&8));
+}
+
+// Vectorized version of NodeQueryMask().
+CP_SIMD_INLINE int
+NodeQueryMask4(const Node *node, cpBB bb)
+{
+	cpMask4 hit = (
+		(v4ld(node->l) <= v4dup(bb.r)) & (v4dup(bb.l) <= v4ld(node->r)) &
+		(v4ld(node->b) <= v4dup(bb.t)) & (v4dup(bb.b) <= v4ld(node->t))
+	);
+	
+	return v4movemask(hit) & ((1<<node->count) - 1);
+}
+
+// Vectorized version of NodeSegmentQuery().
+CP_SIMD_INLINE void
+NodeSegmentQuery4(const Node *node, cpVect a, cpVect b, cpFloat *t)
+{
+	cpVect delta = cpvsub(b, a);
+	cpFloat4 tmin = v4dup(-INFINITY), tmax = v4dup(INFINITY);
+	cpMask4 hit = (tmin < tmax);
+	
+	if(delta.x == 0.0f){
+		hit &= (v4ld(node->l) <= v4dup(a.x)) & (v4dup(a.x) <= v4ld(node->r));
+	} else {
+		cpFloat4 t1 = (v4ld(node->l) - a.x)/delta.x;
+		cpFloat4 t2 = (v4ld(node->r) - a.x)/delta.x;
+		cpMask4 order = (t1 < t2);
+		tmin = v4select(order, t1, t2);
+		tmax = v4select(order, t2, t1);
+	}
+	
+	if(delta.y == 0.0f){
+		hit &= (v4ld(node->b) <= v4dup(a.y)) & (v4dup(a.y) <= v4ld(node->t));
+	} else {
+		cpFloat4 t1 = (v4ld(node->b) - a.y)/delta.y;
+		cpFloat4 t2 = (v4ld(node->t) - a.y)/delta.y;
+		cpMask4 order = (t1 < t2);
+		cpFloat4 near = v4select(order, t1, t2), far = v4select(order, t2, t1);
+		tmin = v4select(tmin > near, tmin, near);
+		tmax = v4select(tmax < far, tmax, far);
+	}
+	
+	hit &= (tmin <= tmax) & (v4dup(0.0f) <= tmax) & (tmin <= v4dup(1.0f));
+	tmin = v4select(tmin > v4dup(0.0f), tmin, v4dup(0.0f));
+	
+	cpFloat4 result = v4select(hit, tmin, v4dup(INFINITY));
+	memcpy(t, &result, sizeof(result));
+}
+#else
+#define CP_SIMD_INLINE static inline
+#define NodeQueryMask4 NodeQueryMask
+#define NodeSegmentQuery4 NodeSegmentQuery
+#endif
+
+//MARK: Building
+
+static inline cpFloat
+cpBBPerimeter(cpBB bb)
+{
+	return (bb.r - bb.l) + (bb.t - bb.b);
+}
+
+static inline cpFloat
+ItemCenter(BuildItem *item, cpBool splitWidth)
+{
+	cpBB bb = item->bb;
+	return (splitWidth ? bb.l + bb.r : bb.b + bb.t);
+}
+
+static cpBB
+RangeBB(BuildItem *items, int start, int end)
+{
+	cpBB bb = items[start].bb;
+	for(int i=start + 1; i<end; i++) bb = cpBBMerge(bb, items[i].bb);
+	
+	return bb;
+}
+
+static int
+ItemCompareX(const BuildItem *a, const BuildItem *b)
+{
+	cpFloat ca = ItemCenter((BuildItem *)a, cpTrue), cb = ItemCenter((BuildItem *)b, cpTrue);
+	return (ca < cb ? -1 : (cb < ca ? 1 : 0));
+}
+
+static int
+ItemCompareY(const BuildItem *a, const BuildItem *b)
+{
+	cpFloat ca = ItemCenter((BuildItem *)a, cpFalse), cb = ItemCenter((BuildItem *)b, cpFalse);
+	return (ca < cb ? -1 : (cb < ca ? 1 : 0));
+}
+
+static inline int
+ItemBin(BuildItem *item, cpBool splitWidth, cpFloat min, cpFloat scale)
+{
+	int bin = (int)((ItemCenter(item, splitWidth) - min)*scale);
+	return (bin < CP_BVH4_BINS - 1 ? bin : CP_BVH4_BINS - 1);
+}
+
+// Split the items in a range in two and return the index of the first item in the second half.
+// Chooses the plane with the lowest surface area heuristic cost among evenly spaced bins along the longest axis.
+// Perimeters are used instead of areas since level geometry is often made of axis aligned segments with no area.
+static int
+SplitRange(BuildItem *items, int start, int end, int depth)
+{
+	int count = end - start;
+	if(count == 2) return start + 1;
+	
+	// Bounds of the item centers. (Actually twice the centers)
+	cpBB bounds = cpBBNew(items[start].bb.l + items[start].bb.r, items[start].bb.b + items[start].bb.t, 0.0f, 0.0f);
+	bounds.r = bounds.l;
+	bounds.t = bounds.b;
+	for(int i=start + 1; i<end; i++){
+		cpBB bb = items[i].bb;
+		bounds = cpBBExpand(bounds, cpv(bb.l + bb.r, bb.b + bb.t));
+	}
+	
+	cpBool splitWidth = (bounds.r - bounds.l > bounds.t - bounds.b);
+	cpFloat min = (splitWidth ? bounds.l : bounds.b);
+	cpFloat extent = (splitWidth ? bounds.r - bounds.l : bounds.t - bounds.b);
+	
+	// All of the centers are in the same spot.
+	if(extent <= 0.0f) return start + count/2;
+	
+	if(depth < CP_BVH4_SAH_DEPTH){
+		cpFloat scale = CP_BVH4_BINS/extent;
+		
+		int binCounts[CP_BVH4_BINS] = {0};
+		cpBB binBBs[CP_BVH4_BINS];
+		for(int i=start; i<end; i++){
+			int bin = ItemBin(items + i, splitWidth, min, scale);
+			binBBs[bin] = (binCounts[bin] ? cpBBMerge(binBBs[bin], items[i].bb) : items[i].bb);
+			binCounts[bin]++;
+		}
+		
+		// Sweep from the right to find the cost of everything past each plane.
+		cpFloat rightCosts[CP_BVH4_BINS];
+		cpBB bb = cpBBNew(0.0f, 0.0f, 0.0f, 0.0f);
+		int right = 0;
+		for(int i=CP_BVH4_BINS - 1; i>0; i--){
+			if(binCounts[i]){
+				bb = (right ? cpBBMerge(bb, binBBs[i]) : binBBs[i]);
+				right += binCounts[i];
+			}
+			
+			rightCosts[i] = (right ? cpBBPerimeter(bb)*right : 0.0f);
+		}
+		
+		// Then from the left to find the best plane.
+		int split = -1, left = 0;
+		cpFloat best = INFINITY;
+		for(int i=0; i<CP_BVH4_BINS - 1; i++){
+			if(binCounts[i]){
+				bb = (left ? cpBBMerge(bb, binBBs[i]) : binBBs[i]);
+				left += binCounts[i];
+			}
+			
+			cpFloat cost = cpBBPerimeter(bb)*left + rightCosts[i + 1];
+			if(left && left < count && cost < best){
+				best = cost;
+				split = i;
+			}
+		}
+		
+		if(split >= 0){
+			// Partition the items
+			int mid = end;
+			for(int i=start; i < mid;){
+				if(ItemBin(items + i, splitWidth, min, scale) > split){
+					mid--;
+					BuildItem item = items[i];
+					items[i] = items[mid];
+					items[mid] = item;
+				} else {
+					i++;
+				}
+			}
+			
+			return mid;
+		}
+	}
+	
+	// Sort the items along the axis and split at the median.
+	int (*compare)(const BuildItem *, const BuildItem *) = (splitWidth ? ItemCompareX : ItemCompareY);
+	qsort(items + start, count, sizeof(BuildItem), (int (*)(const void *, const void *))compare);
+	return start + count/2;
+}
+
+static void
+BuildNode(cpBVH4 *bvh, int index, int start, int end, int depth)
+{
+	BuildItem *items = bvh->items;
+	
+	// Split the range into up to four pieces, always splitting the piece with the largest bounds next.
+	int starts[4] = {start}, ends[4] = {end}, depths[4] = {depth};
+	cpBB bbs[4] = {RangeBB(items, start, end)};
+	int count = 1;
+	
+	while(count < 4){
+		int best = -1;
+		cpFloat bestPerimeter = -1.0f;
+		for(int i=0; i<count; i++){
+			if(ends[i] - starts[i] > 1 && cpBBPerimeter(bbs[i]) > bestPerimeter){
+				best = i;
+				bestPerimeter = cpBBPerimeter(bbs[i]);
+			}
+		}
+		
+		if(best < 0) break;
+		
+		// Shift the pieces over to keep them in order.
+		for(int i=count; i>best + 1; i--){
+			starts[i] = starts[i - 1];
+			ends[i] = ends[i - 1];
+			depths[i] = depths[i - 1];
+			bbs[i] = bbs[i - 1];
+		}
+		
+		int mid = SplitRange(items, starts[best], ends[best], depths[best]);
+		starts[best + 1] = mid;
+		ends[best + 1] = ends[best];
+		ends[best] = mid;
+		depths[best] = depths[best + 1] = depths[best] + 1;
+		bbs[best] = RangeBB(items, starts[best], ends[best]);
+		bbs[best + 1] = RangeBB(items, starts[best + 1], ends[best + 1]);
+		count++;
+	}
+	
+	Node *node = bvh->nodes + index;
+	node->count = count;
+	
+	// Children are allocated just before recursing to lay the nodes out in depth first order.
+	for(int i=0; i<count; i++){
+		NodeSetBB(node, i, bbs[i]);
+		
+		if(ends[i] - starts[i] == 1){
+			node->children[i] = ~starts[i];
+		} else {
+			int child = bvh->nodeCount++;
+			node->children[i] = child;
+			BuildNode(bvh, child, starts[i], ends[i], depths[i]);
+		}
+	}
+}
+
+static void
+fillItemArray(void *obj, cpBVH4 *bvh){
+	BuildItem item = {bvh->spatialIndex.bbfunc(obj), obj};
+	bvh->items[bvh->itemCount++] = item;
+}
+
+static void
+Build(cpBVH4 *bvh)
+{
+	int count = cpHashSetCount(bvh->objects);
+	if(count > bvh->itemsCapacity){
+		bvh->itemsCapacity = count;
+		bvh->items = (BuildItem *)cprealloc(bvh->items, count*sizeof(BuildItem));
+	}
+	
+	bvh->itemCount = 0;
+	cpHashSetEach(bvh->objects, (cpHashSetIteratorFunc)fillItemArray, bvh);
+	
+	// Each node splits its items at least in two, so there is never more than one node per item.
+	if(count > bvh->nodeCapacity){
+		cpfree(bvh->nodeBuffer);
+		bvh->nodeCapacity = count;
+		bvh->nodeBuffer = cpcalloc(1, count*sizeof(Node) + CP_CACHE_LINE_BYTES);
+		
+		uintptr_t align = CP_CACHE_LINE_BYTES - 1;
+		bvh->nodes = (Node *)(((uintptr_t)bvh->nodeBuffer + align)&~align);
+	}
+	
+	bvh->nodeCount = 0;
+	if(count > 0){
+		bvh->nodeCount = 1;
+		BuildNode(bvh, 0, 0, count, 0);
+	}
+	
+	bvh->dirty = cpFalse;
+}
+
+static inline void
+BuildIfDirty(cpBVH4 *bvh)
+{
+	if(bvh->dirty) Build(bvh);
+}
+
+//MARK: Query Functions
+
+// Call func for the objects that overlap bb, skipping items before 'first'.
+CP_SIMD_INLINE void
+TreeQuery(cpBVH4 *bvh, void *obj, cpBB bb, int first, cpSpatialIndexQueryFunc func, void *data, cpBool simd)
+{
+	if(bvh->nodeCount == 0) return;
+	
+	Node *nodes = bvh->nodes;
+	BuildItem *items = bvh->items;
+	
+	int stack[CP_BVH4_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	
+	while(top > 0){
+		Node *node = nodes + stack[--top];
+		
+		int mask = (simd ? NodeQueryMask4(node, bb) : NodeQueryMask(node, bb));
+		for(int i=0; i<node->count; i++){
+			if(!(mask & (1<<i))) continue;
+			int child = node->children[i];
+			
+			if(child >= 0){
+				stack[top++] = child;
+			} else if(~child >= first){
+				func(obj, items[~child].obj, 0, data);
+			}
+		}
+	}
+}
+
+typedef struct SegmentStackEntry {
+	int child;
+	cpFloat t;
+} SegmentStackEntry;
+
+CP_SIMD_INLINE void
+TreeSegmentQuery(cpBVH4 *bvh, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data, cpBool simd)
+{
+	if(bvh->nodeCount == 0) return;
+	
+	Node *nodes = bvh->nodes;
+	BuildItem *items = bvh->items;
+	
+	SegmentStackEntry stack[CP_BVH4_STACK_SIZE];
+	int top = 0;
+	SegmentStackEntry root = {0, 0.0f};
+	stack[top++] = root;
+	
+	while(top > 0){
+		SegmentStackEntry entry = stack[--top];
+		if(!(entry.t < t_exit)) continue;
+		
+		if(entry.child < 0){
+			t_exit = cpfmin(t_exit, func(obj, items[~entry.child].obj, data));
+			continue;
+		}
+		
+		Node *node = nodes + entry.child;
+		cpFloat t[4];
+		if(simd){
+			NodeSegmentQuery4(node, a, b, t);
+		} else {
+			NodeSegmentQuery(node, a, b, t);
+		}
+		
+		// Push the children farthest first so the nearest ones are visited first.
+		int order[4], count = 0;
+		for(int i=0; i<node->count; i++){
+			if(t[i] < t_exit){
+				int j = count++;
+				for(; j > 0 && t[order[j - 1]] < t[i]; j--) order[j] = order[j - 1];
+				order[j] = i;
+			}
+		}
+		
+		for(int i=0; i<count; i++){
+			SegmentStackEntry child = {node->children[order[i]], t[order[i]]};
+			stack[top++] = child;
+		}
+	}
+}
+
+static void TreeQuery_Scalar(cpBVH4 *bvh, void *obj, cpBB bb, int first, cpSpatialIndexQueryFunc func, void *data){TreeQuery(bvh, obj, bb, first, func, data, cpFalse);}
+static void TreeSegmentQuery_Scalar(cpBVH4 *bvh, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data){TreeSegmentQuery(bvh, obj, a, b, t_exit, func, data, cpFalse);}
+
+#if CP_BVH4_X86_SIMD
+#define CP_AVX2 __attribute__((target("avx2")))
+static CP_AVX2 void TreeQuery_AVX2(cpBVH4 *bvh, void *obj, cpBB bb, int first, cpSpatialIndexQueryFunc func, void *data){TreeQuery(bvh, obj, bb, first, func, data, cpTrue);}
+static CP_AVX2 void TreeSegmentQuery_AVX2(cpBVH4 *bvh, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data){TreeSegmentQuery(bvh, obj, a, b, t_exit, func, data, cpTrue);}
+#endif
+
+static void
+cpBVH4Query(cpBVH4 *bvh, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
+{
+	BuildIfDirty(bvh);
+	bvh->treeQuery(bvh, obj, bb, 0, func, data);
+}
+
+static void
+cpBVH4SegmentQuery(cpBVH4 *bvh, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+{
+	BuildIfDirty(bvh);
+	bvh->treeSegmentQuery(bvh, obj, a, b, t_exit, func, data);
+}
+
+//MARK: Memory Management Functions
+
+cpBVH4 *
+cpBVH4Alloc(void)
+{
+	return (cpBVH4 *)cpcalloc(1, sizeof(cpBVH4));
+}
+
+static cpBool objectSetEql(void *ptr, void *elt){return (ptr == elt);}
+
+cpSpatialIndex *
+cpBVH4Init(cpBVH4 *bvh, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	cpSpatialIndexInit((cpSpatialIndex *)bvh, Klass(), bbfunc, staticIndex);
+	
+	bvh->objects = cpHashSetNew(0, (cpHashSetEqlFunc)objectSetEql);
+	bvh->dirty = cpFalse;
+	
+	bvh->nodes = NULL;
+	bvh->nodeBuffer = NULL;
+	bvh->nodeCount = bvh->nodeCapacity = 0;
+	
+	bvh->items = NULL;
+	bvh->itemCount = bvh->itemsCapacity = 0;
+	
+	bvh->treeQuery = TreeQuery_Scalar;
+	bvh->treeSegmentQuery = TreeSegmentQuery_Scalar;
+	
+#if CP_BVH4_X86_SIMD
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		bvh->treeQuery = TreeQuery_AVX2;
+		bvh->treeSegmentQuery = TreeSegmentQuery_AVX2;
+	}
+#endif
+	
+	return (cpSpatialIndex *)bvh;
+}
+
+cpSpatialIndex *
+cpBVH4New(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	return cpBVH4Init(cpBVH4Alloc(), bbfunc, staticIndex);
+}
+
+static void
+cpBVH4Destroy(cpBVH4 *bvh)
+{
+	cpHashSetFree(bvh->objects);
+	cpfree(bvh->nodeBuffer);
+	cpfree(bvh->items);
+}
+
+//MARK: Misc
+
+static int
+cpBVH4Count(cpBVH4 *bvh)
+{
+	return cpHashSetCount(bvh->objects);
+}
+
+static void
+cpBVH4Each(cpBVH4 *bvh, cpSpatialIndexIteratorFunc func, void *data)
+{
+	cpHashSetEach(bvh->objects, (cpHashSetIteratorFunc)func, data);
+}
+
+static cpBool
+cpBVH4Contains(cpBVH4 *bvh, void *obj, cpHashValue hashid)
+{
+	return (cpHashSetFind(bvh->objects, hashid, obj) != NULL);
+}
+
+//MARK: Basic Operations
+
+// The tree is rebuilt the next time it's queried instead of after every change.
+// Adding a whole level's worth of objects only builds it once.
+
+static void
+cpBVH4Insert(cpBVH4 *bvh, void *obj, cpHashValue hashid)
+{
+	cpHashSetInsert(bvh->objects, hashid, obj, NULL, obj);
+	bvh->dirty = cpTrue;
+}
+
+static void
+cpBVH4Remove(cpBVH4 *bvh, void *obj, cpHashValue hashid)
+{
+	if(cpHashSetRemove(bvh->objects, hashid, obj)) bvh->dirty = cpTrue;
+}
+
+//MARK: Reindexing Functions
+
+static void
+cpBVH4Reindex(cpBVH4 *bvh)
+{
+	Build(bvh);
+}
+
+static void
+cpBVH4ReindexObject(cpBVH4 *bvh, void *obj, cpHashValue hashid)
+{
+	if(cpHashSetFind(bvh->objects, hashid, obj)) bvh->dirty = cpTrue;
+}
+
+static void
+cpBVH4ReindexQuery(cpBVH4 *bvh, cpSpatialIndexQueryFunc func, void *data)
+{
+	Build(bvh);
+	
+	// Each pair is reported once by the object that comes first in the item order.
+	BuildItem *items = bvh->items;
+	for(int i=0; i<bvh->itemCount; i++) bvh->treeQuery(bvh, items[i].obj, items[i].bb, i + 1, func, data);
+	
+	// Reindex query is also responsible for colliding against the static index.
+	cpSpatialIndexCollideStatic((cpSpatialIndex *)bvh, bvh->spatialIndex.staticIndex, func, data);
+}
+
+static cpSpatialIndexClass klass = {
+	(cpSpatialIndexDestroyImpl)cpBVH4Destroy,
+	
+	(cpSpatialIndexCountImpl)cpBVH4Count,
+	(cpSpatialIndexEachImpl)cpBVH4Each,
+	
+	(cpSpatialIndexContainsImpl)cpBVH4Contains,
+	(cpSpatialIndexInsertImpl)cpBVH4Insert,
+	(cpSpatialIndexRemoveImpl)cpBVH4Remove,
+	
+	(cpSpatialIndexReindexImpl)cpBVH4Reindex,
+	(cpSpatialIndexReindexObjectImpl)cpBVH4ReindexObject,
+	(cpSpatialIndexReindexQueryImpl)cpBVH4ReindexQuery,
+	
+	(cpSpatialIndexQueryImpl)cpBVH4Query,
+	(cpSpatialIndexSegmentQueryImpl)cpBVH4SegmentQuery,
+};
+
+static inline cpSpatialIndexClass *Klass(){return &klass;}
@@ -45,6 +45,14 @@ cpBodyInit(cpBody *body, cpFloat mass, cpFloat moment)
 	body->sleeping.next = NULL;
 	body->sleeping.idleTime = 0.0f;
 	
+	body->bullet.enabled = cpFalse;
+	body->bullet.p = cpvzero;
+	body->bullet.a = 0.0f;
+	
+	body->interpolation.p = cpvzero;
+	body->interpolation.a = 0.0f;
+	body->interpolation.stamp = 0;
+	
 	body->p = cpvzero;
 	body->v = cpvzero;
 	body->f = cpvzero;
@@ -54,6 +62,9 @@ cpBodyInit(cpBody *body, cpFloat mass, cpFloat moment)
 	
 	body->v_bias = cpvzero;
 	body->w_bias = 0.0f;
+	body->solverIndex = 0;
+	body->island = 0;
+	body->shockLevel = 0;
 	
 	body->userData = NULL;
 	
@@ -200,6 +211,31 @@ cpBodySetType(cpBody *body, cpBodyType type)
 	}
 }
 
+cpBool
+cpBodyIsBullet(const cpBody *body)
+{
+	return body->bullet.enabled;
+}
+
+void
+cpBodySetBullet(cpBody *body, cpBool bullet)
+{
+	if(body->bullet.enabled == bullet) return;
+	body->bullet.enabled = bullet;
+	
+	// Keep the space's list of bullets up to date.
+	cpSpace *space = cpBodyGetSpace(body);
+	if(space != NULL){
+		cpAssertSpaceUnlocked(space);
+		
+		if(bullet){
+			cpArrayPush(space->bullets, body);
+		} else {
+			cpArrayDeleteObj(space->bullets, body);
+		}
+	}
+}
+
 
 
 // Should *only* be called when shapes with mass info are modified, added or removed.
@@ -285,6 +321,35 @@ cpBodyGetRotation(const cpBody *body)
 	return cpv(body->transform.a, body->transform.b);
 }
 
+cpTransform
+cpBodyGetInterpolatedTransform(const cpBody *body)
+{
+	cpSpace *space = body->space;
+	
+	// Bodies that didn't move during the last step are drawn where they are.
+	if(space == NULL || body->interpolation.stamp != space->stamp) return body->transform;
+	
+	cpFloat alpha = cpSpaceGetInterpolationAlpha(space);
+	cpVect p = cpvlerp(body->interpolation.p, body->p, alpha);
+	cpFloat a = cpflerp(body->interpolation.a, body->a, alpha);
+	return cpBodyTransformAt(body, p, a);
+}
+
+cpVect
+cpBodyGetInterpolatedPosition(const cpBody *body)
+{
+	return cpTransformPoint(cpBodyGetInterpolatedTransform(body), cpvzero);
+}
+
+cpFloat
+cpBodyGetInterpolatedAngle(const cpBody *body)
+{
+	cpSpace *space = body->space;
+	if(space == NULL || body->interpolation.stamp != space->stamp) return body->a;
+	
+	return cpflerp(body->interpolation.a, body->a, cpSpaceGetInterpolationAlpha(space));
+}
+
 void
 cpBodyAddShape(cpBody *body, cpShape *shape)
 {
@@ -343,11 +408,10 @@ cpBodyRemoveConstraint(cpBody *body, cpConstraint *constraint)
 	body->constraintList = filterConstraints(body->constraintList, body, constraint);
 }
 
-// 'p' is the position of the CoG
-static void
-SetTransform(cpBody *body, cpVect p, cpFloat a)
+// 'p' is the position of the CoG, 'rot' is the unit vector for the body's angle.
+static inline void
+SetTransformRotation(cpBody *body, cpVect p, cpVect rot)
 {
-	cpVect rot = cpvforangle(a);
 	cpVect c = body->cog;
 	
 	body->transform = cpTransformNewTranspose(
@@ -356,6 +420,25 @@ SetTransform(cpBody *body, cpVect p, cpFloat a)
 	);
 }
 
+cpTransform
+cpBodyTransformAt(const cpBody *body, cpVect p, cpFloat a)
+{
+	cpVect c = body->cog;
+	cpVect rot = cpvforangle(a);
+	
+	return cpTransformNewTranspose(
+		rot.x, -rot.y, p.x - (c.x*rot.x - c.y*rot.y),
+		rot.y,  rot.x, p.y - (c.x*rot.y + c.y*rot.x)
+	);
+}
+
+// 'p' is the position of the CoG
+static void
+SetTransform(cpBody *body, cpVect p, cpFloat a)
+{
+	SetTransformRotation(body, p, cpvforangle(a));
+}
+
 static inline cpFloat
 SetAngle(cpBody *body, cpFloat a)
 {
@@ -378,6 +461,9 @@ cpBodySetPosition(cpBody *body, cpVect position)
 	cpVect p = body->p = cpvadd(cpTransformVect(body->transform, body->cog), position);
 	cpAssertSaneBody(body);
 	
+	// Don't interpolate across a teleport.
+	body->interpolation.p = p;
+	
 	SetTransform(body, p, body->a);
 }
 
@@ -434,6 +520,7 @@ cpBodySetAngle(cpBody *body, cpFloat angle)
 {
 	cpBodyActivate(body);
 	SetAngle(body, angle);
+	body->interpolation.a = angle;
 	
 	SetTransform(body, body->p, angle);
 }
@@ -490,8 +577,8 @@ cpBodySetPositionUpdateFunc(cpBody *body, cpBodyPositionFunc positionFunc)
 	body->position_func = positionFunc;
 }
 
-void
-cpBodyUpdateVelocity(cpBody *body, cpVect gravity, cpFloat damping, cpFloat dt)
+static inline void
+UpdateVelocity(cpBody *body, cpVect gravity, cpFloat damping, cpFloat dt)
 {
 	// Skip kinematic bodies.
 	if(cpBodyGetType(body) == CP_BODY_TYPE_KINEMATIC) return;
@@ -509,11 +596,42 @@ cpBodyUpdateVelocity(cpBody *body, cpVect gravity, cpFloat damping, cpFloat dt)
 }
 
 void
-cpBodyUpdatePosition(cpBody *body, cpFloat dt)
+cpBodyUpdateVelocity(cpBody *body, cpVect gravity, cpFloat damping, cpFloat dt)
+{
+	UpdateVelocity(body, gravity, damping, dt);
+}
+
+// Largest angle a body can turn in a single step and still be rotated incrementally.
+// The series in RotateIncremental() are accurate to well below the precision of a double up to this angle.
+#define CP_INCREMENTAL_ROTATION_LIMIT 0.1f
+
+// Rotate the unit vector 'rot' by the small angle 'da' using truncated Taylor series instead of cos()/sin().
+static inline cpVect
+RotateIncremental(cpVect rot, cpFloat da)
+{
+	cpFloat x2 = da*da;
+	cpFloat c = 1.0f - x2/2.0f*(1.0f - x2/12.0f*(1.0f - x2/30.0f*(1.0f - x2/56.0f*(1.0f - x2/90.0f))));
+	cpFloat s = da*(1.0f - x2/6.0f*(1.0f - x2/20.0f*(1.0f - x2/42.0f*(1.0f - x2/72.0f))));
+	cpVect r = cpvrotate(rot, cpv(c, s));
+	
+	// One Newton step keeps the length from drifting away from 1.
+	return cpvmult(r, (3.0f - cpvlengthsq(r))*0.5f);
+}
+
+static inline void
+UpdatePosition(cpBody *body, cpFloat dt)
 {
 	cpVect p = body->p = cpvadd(body->p, cpvmult(cpvadd(body->v, body->v_bias), dt));
-	cpFloat a = SetAngle(body, body->a + (body->w + body->w_bias)*dt);
-	SetTransform(body, p, a);
+	cpFloat da = (body->w + body->w_bias)*dt;
+	cpFloat a = SetAngle(body, body->a + da);
+	
+	if(cpfabs(da) <= CP_INCREMENTAL_ROTATION_LIMIT){
+		// The current rotation is the first column of the transform.
+		cpTransform t = body->transform;
+		SetTransformRotation(body, p, RotateIncremental(cpv(t.a, t.b), da));
+	} else {
+		SetTransform(body, p, a);
+	}
 	
 	body->v_bias = cpvzero;
 	body->w_bias = 0.0f;
@@ -521,6 +639,42 @@ cpBodyUpdatePosition(cpBody *body, cpFloat dt)
 	cpAssertSaneBody(body);
 }
 
+void
+cpBodyUpdatePosition(cpBody *body, cpFloat dt)
+{
+	UpdatePosition(body, dt);
+}
+
+void
+cpBodyIntegrateVelocities(cpBody **bodies, int count, cpVect gravity, cpFloat damping, cpFloat dt)
+{
+	for(int i=0; i<count; i++){
+		cpBody *body = bodies[i];
+		cpBodyVelocityFunc velocity_func = body->velocity_func;
+		
+		if(velocity_func == cpBodyUpdateVelocity){
+			UpdateVelocity(body, gravity, damping, dt);
+		} else {
+			velocity_func(body, gravity, damping, dt);
+		}
+	}
+}
+
+void
+cpBodyIntegratePositions(cpBody **bodies, int count, cpFloat dt)
+{
+	for(int i=0; i<count; i++){
+		cpBody *body = bodies[i];
+		cpBodyPositionFunc position_func = body->position_func;
+		
+		if(position_func == cpBodyUpdatePosition){
+			UpdatePosition(body, dt);
+		} else {
+			position_func(body, dt);
+		}
+	}
+}
+
 cpVect
 cpBodyLocalToWorld(const cpBody *body, const cpVect point)
 {
@@ -221,6 +221,11 @@ struct ClosestPoints {
 	cpFloat d;
 	// Concatenation of the id's of the minkoski points.
 	cpCollisionID id;
+	
+#if CP_ENABLE_COUNTERS
+	// Iterations taken to find the points.
+	int gjkIterations, epaIterations;
+#endif
 };
 
 // Calculate the closest points on two shapes given the closest edge on their minkowski difference to (0, 0)
@@ -327,7 +332,9 @@ EPARecurse(const struct SupportContext *ctx, const int count, const struct Minko
 	} else {
 		// Could not find a new point to insert, so we have found the closest edge of the minkowski difference.
 		cpAssertWarn(iteration < WARN_EPA_ITERATIONS, "High EPA iterations: %d", iteration);
-		return ClosestPointsNew(v0, v1);
+		struct ClosestPoints points = ClosestPointsNew(v0, v1);
+		CP_COUNTER_ADD(points.epaIterations, iteration);
+		return points;
 	}
 }
 
@@ -350,7 +357,9 @@ GJKRecurse(const struct SupportContext *ctx, const struct MinkowskiPoint v0, con
 {
 	if(iteration > MAX_GJK_ITERATIONS){
 		cpAssertWarn(iteration < WARN_GJK_ITERATIONS, "High GJK iterations: %d", iteration);
-		return ClosestPointsNew(v0, v1);
+		struct ClosestPoints points = ClosestPointsNew(v0, v1);
+		CP_COUNTER_ADD(points.gjkIterations, iteration);
+		return points;
 	}
 	
 	if(cpCheckPointGreater(v1.ab, v0.ab, cpvzero)){
@@ -372,12 +381,16 @@ GJKRecurse(const struct SupportContext *ctx, const struct MinkowskiPoint v0, con
 		if(cpCheckPointGreater(p.ab, v0.ab, cpvzero) && cpCheckPointGreater(v1.ab, p.ab, cpvzero)){
 			// The triangle v0, p, v1 contains the origin. Use EPA to find the MSA.
 			cpAssertWarn(iteration < WARN_GJK_ITERATIONS, "High GJK->EPA iterations: %d", iteration);
-			return EPA(ctx, v0, p, v1);
+			struct ClosestPoints points = EPA(ctx, v0, p, v1);
+			CP_COUNTER_ADD(points.gjkIterations, iteration);
+			return points;
 		} else {
 			if(cpCheckAxis(v0.ab, v1.ab, p.ab, n)){
 				// The edge v0, v1 that we already have is the closest to (0, 0) since p was not closer.
 				cpAssertWarn(iteration < WARN_GJK_ITERATIONS, "High GJK iterations: %d", iteration);
-				return ClosestPointsNew(v0, v1);
+				struct ClosestPoints points = ClosestPointsNew(v0, v1);
+				CP_COUNTER_ADD(points.gjkIterations, iteration);
+				return points;
 			} else {
 				// p was closer to the origin than our existing edge.
 				// Need to figure out which existing point to drop.
@@ -414,7 +427,7 @@ ShapePoint(const cpShape *shape, const int i)
 
 // Find the closest points between two shapes using the GJK algorithm.
 static struct ClosestPoints
-GJK(const struct SupportContext *ctx, cpCollisionID *id)
+GJK(const struct SupportContext *ctx, struct cpCollisionInfo *info)
 {
 #if DRAW_GJK || DRAW_EPA
 	int count1 = 1;
@@ -454,6 +467,7 @@ GJK(const struct SupportContext *ctx, cpCollisionID *id)
 	ChipmunkDebugDrawPolygon(hullCount, hullVerts, 0.0, RGBAColor(1, 0, 0, 1), RGBAColor(1, 0, 0, 0.25));
 #endif
 	
+	cpCollisionID *id = &info->id;
 	struct MinkowskiPoint v0, v1;
 	if(*id){
 		// Use the minkowski points from the last frame as a starting point using the cached indexes.
@@ -468,6 +482,9 @@ GJK(const struct SupportContext *ctx, cpCollisionID *id)
 	
 	struct ClosestPoints points = GJKRecurse(ctx, v0, v1, 1);
 	*id = points.id;
+	
+	CP_COUNTER_ADD(info->gjkIterations, points.gjkIterations);
+	CP_COUNTER_ADD(info->epaIterations, points.epaIterations);
 	return points;
 }
 
@@ -477,8 +494,8 @@ GJK(const struct SupportContext *ctx, cpCollisionID *id)
 static inline void
 ContactPoints(const struct Edge e1, const struct Edge e2, const struct ClosestPoints points, struct cpCollisionInfo *info)
 {
-	cpFloat mindist = e1.r + e2.r;
-	if(points.d <= mindist){
+	cpFloat margin = info->margin;
+	if(points.d <= e1.r + e2.r + margin){
 #ifdef DRAW_CLIP
 	ChipmunkDebugDrawFatSegment(e1.a.p, e1.b.p, e1.r, RGBAColor(0, 1, 0, 1), LAColor(0, 0));
 	ChipmunkDebugDrawFatSegment(e2.a.p, e2.b.p, e2.r, RGBAColor(1, 0, 0, 1), LAColor(0, 0));
@@ -501,7 +518,7 @@ ContactPoints(const struct Edge e1, const struct Edge e2, const struct ClosestPo
 			cpVect p1 = cpvadd(cpvmult(n,  e1.r), cpvlerp(e1.a.p, e1.b.p, cpfclamp01((d_e2_b - d_e1_a)*e1_denom)));
 			cpVect p2 = cpvadd(cpvmult(n, -e2.r), cpvlerp(e2.a.p, e2.b.p, cpfclamp01((d_e1_a - d_e2_a)*e2_denom)));
 			cpFloat dist = cpvdot(cpvsub(p2, p1), n);
-			if(dist <= 0.0f){
+			if(dist <= margin){
 				cpHashValue hash_1a2b = CP_HASH_PAIR(e1.a.hash, e2.b.hash);
 				cpCollisionInfoPushContact(info, p1, p2, hash_1a2b);
 			}
@@ -509,7 +526,7 @@ ContactPoints(const struct Edge e1, const struct Edge e2, const struct ClosestPo
 			cpVect p1 = cpvadd(cpvmult(n,  e1.r), cpvlerp(e1.a.p, e1.b.p, cpfclamp01((d_e2_a - d_e1_a)*e1_denom)));
 			cpVect p2 = cpvadd(cpvmult(n, -e2.r), cpvlerp(e2.a.p, e2.b.p, cpfclamp01((d_e1_b - d_e2_a)*e2_denom)));
 			cpFloat dist = cpvdot(cpvsub(p2, p1), n);
-			if(dist <= 0.0f){
+			if(dist <= margin){
 				cpHashValue hash_1b2a = CP_HASH_PAIR(e1.b.hash, e2.a.hash);
 				cpCollisionInfoPushContact(info, p1, p2, hash_1b2a);
 			}
@@ -525,7 +542,7 @@ typedef void (*CollisionFunc)(const cpShape *a, const cpShape *b, struct cpColli
 static void
 CircleToCircle(const cpCircleShape *c1, const cpCircleShape *c2, struct cpCollisionInfo *info)
 {
-	cpFloat mindist = c1->r + c2->r;
+	cpFloat mindist = c1->r + c2->r + info->margin;
 	cpVect delta = cpvsub(c2->tc, c1->tc);
 	cpFloat distsq = cpvlengthsq(delta);
 	
@@ -549,7 +566,7 @@ CircleToSegment(const cpCircleShape *circle, const cpSegmentShape *segment, stru
 	cpVect closest = cpvadd(seg_a, cpvmult(seg_delta, closest_t));
 	
 	// Compare the radii of the two shapes to see if they are colliding.
-	cpFloat mindist = circle->r + segment->r;
+	cpFloat mindist = circle->r + segment->r + info->margin;
 	cpVect delta = cpvsub(closest, center);
 	cpFloat distsq = cpvlengthsq(delta);
 	if(distsq < mindist*mindist){
@@ -572,7 +589,7 @@ static void
 SegmentToSegment(const cpSegmentShape *seg1, const cpSegmentShape *seg2, struct cpCollisionInfo *info)
 {
 	struct SupportContext context = {(cpShape *)seg1, (cpShape *)seg2, (SupportPointFunc)SegmentSupportPoint, (SupportPointFunc)SegmentSupportPoint};
-	struct ClosestPoints points = GJK(&context, &info->id);
+	struct ClosestPoints points = GJK(&context, info);
 	
 #if DRAW_CLOSEST
 #if PRINT_LOG
@@ -591,7 +608,7 @@ SegmentToSegment(const cpSegmentShape *seg1, const cpSegmentShape *seg2, struct
 	
 	// If the closest points are nearer than the sum of the radii...
 	if(
-		points.d <= (seg1->r + seg2->r) && (
+		points.d <= (seg1->r + seg2->r + info->margin) && (
 			// Reject endcap collisions if tangents are provided.
 			(!cpveql(points.a, seg1->ta) || cpvdot(n, cpvrotate(seg1->a_tangent, rot1)) <= 0.0) &&
 			(!cpveql(points.a, seg1->tb) || cpvdot(n, cpvrotate(seg1->b_tangent, rot1)) <= 0.0) &&
@@ -607,7 +624,7 @@ static void
 PolyToPoly(const cpPolyShape *poly1, const cpPolyShape *poly2, struct cpCollisionInfo *info)
 {
 	struct SupportContext context = {(cpShape *)poly1, (cpShape *)poly2, (SupportPointFunc)PolySupportPoint, (SupportPointFunc)PolySupportPoint};
-	struct ClosestPoints points = GJK(&context, &info->id);
+	struct ClosestPoints points = GJK(&context, info);
 	
 #if DRAW_CLOSEST
 #if PRINT_LOG
@@ -621,7 +638,7 @@ PolyToPoly(const cpPolyShape *poly1, const cpPolyShape *poly2, struct cpCollisio
 #endif
 	
 	// If the closest points are nearer than the sum of the radii...
-	if(points.d - poly1->r - poly2->r <= 0.0){
+	if(points.d - poly1->r - poly2->r <= info->margin){
 		ContactPoints(SupportEdgeForPoly(poly1, points.n), SupportEdgeForPoly(poly2, cpvneg(points.n)), points, info);
 	}
 }
@@ -630,7 +647,7 @@ static void
 SegmentToPoly(const cpSegmentShape *seg, const cpPolyShape *poly, struct cpCollisionInfo *info)
 {
 	struct SupportContext context = {(cpShape *)seg, (cpShape *)poly, (SupportPointFunc)SegmentSupportPoint, (SupportPointFunc)PolySupportPoint};
-	struct ClosestPoints points = GJK(&context, &info->id);
+	struct ClosestPoints points = GJK(&context, info);
 	
 #if DRAW_CLOSEST
 #if PRINT_LOG
@@ -648,7 +665,7 @@ SegmentToPoly(const cpSegmentShape *seg, const cpPolyShape *poly, struct cpColli
 	
 	if(
 		// If the closest points are nearer than the sum of the radii...
-		points.d - seg->r - poly->r <= 0.0 && (
+		points.d - seg->r - poly->r <= info->margin && (
 			// Reject endcap collisions if tangents are provided.
 			(!cpveql(points.a, seg->ta) || cpvdot(n, cpvrotate(seg->a_tangent, rot)) <= 0.0) &&
 			(!cpveql(points.a, seg->tb) || cpvdot(n, cpvrotate(seg->b_tangent, rot)) <= 0.0)
@@ -662,7 +679,7 @@ static void
 CircleToPoly(const cpCircleShape *circle, const cpPolyShape *poly, struct cpCollisionInfo *info)
 {
 	struct SupportContext context = {(cpShape *)circle, (cpShape *)poly, (SupportPointFunc)CircleSupportPoint, (SupportPointFunc)PolySupportPoint};
-	struct ClosestPoints points = GJK(&context, &info->id);
+	struct ClosestPoints points = GJK(&context, info);
 	
 #if DRAW_CLOSEST
 	ChipmunkDebugDrawDot(3.0, points.a, RGBAColor(1, 1, 1, 1));
@@ -672,7 +689,7 @@ CircleToPoly(const cpCircleShape *circle, const cpPolyShape *poly, struct cpColl
 #endif
 	
 	// If the closest points are nearer than the sum of the radii...
-	if(points.d <= circle->r + poly->r){
+	if(points.d <= circle->r + poly->r + info->margin){
 		cpVect n = info->n = points.n;
 		cpCollisionInfoPushContact(info, cpvadd(points.a, cpvmult(n, circle->r)), cpvadd(points.b, cpvmult(n, -poly->r)), 0);
 	}
@@ -699,9 +716,9 @@ static const CollisionFunc BuiltinCollisionFuncs[9] = {
 static const CollisionFunc *CollisionFuncs = BuiltinCollisionFuncs;
 
 struct cpCollisionInfo
-cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, struct cpContact *contacts)
+cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, cpFloat margin, struct cpContact *contacts)
 {
-	struct cpCollisionInfo info = {a, b, id, cpvzero, 0, contacts};
+	struct cpCollisionInfo info = {a, b, id, cpvzero, 0, contacts, margin};
 	
 	// Make sure the shape types are in order.
 	if(a->klass->type > b->klass->type){
@@ -724,3 +741,45 @@ cpCollide(const cpShape *a, const cpShape *b, cpCollisionID id, struct cpContact
 	
 	return info;
 }
+
+//MARK: Distance
+
+static const SupportPointFunc SupportPointFuncs[CP_NUM_SHAPES] = {
+	(SupportPointFunc)CircleSupportPoint,
+	(SupportPointFunc)SegmentSupportPoint,
+	(SupportPointFunc)PolySupportPoint,
+};
+
+static inline cpFloat
+ShapeRadius(const cpShape *shape)
+{
+	switch(shape->klass->type){
+		case CP_CIRCLE_SHAPE: return ((cpCircleShape *)shape)->r;
+		case CP_SEGMENT_SHAPE: return ((cpSegmentShape *)shape)->r;
+		case CP_POLY_SHAPE: return ((cpPolyShape *)shape)->r;
+		default: return 0.0f;
+	}
+}
+
+cpFloat
+cpShapesDistance(const cpShape *a, const cpShape *b)
+{
+	struct SupportContext context = {a, b, SupportPointFuncs[a->klass->type], SupportPointFuncs[b->klass->type]};
+	struct cpCollisionInfo info = {a, b, 0, cpvzero, 0, NULL, 0.0f};
+	struct ClosestPoints points = GJK(&context, &info);
+	
+	return points.d - ShapeRadius(a) - ShapeRadius(b);
+}
+
+#if CP_ENABLE_COUNTERS
+void
+cpSpaceCountCollision(cpSpace *space, const struct cpCollisionInfo *info)
+{
+	cpSpaceCounters *counters = &space->counters;
+	counters->gjkIterations += info->gjkIterations;
+	counters->gjkMaxIterationsHit += (info->gjkIterations > MAX_GJK_ITERATIONS);
+	counters->epaIterations += info->epaIterations;
+	counters->epaWarnIterationsHit += (info->epaIterations >= WARN_EPA_ITERATIONS);
+	counters->contacts += info->count;
+}
+#endif
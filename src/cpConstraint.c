@@ -50,12 +50,68 @@ cpConstraintInit(cpConstraint *constraint, const cpConstraintClass *klass, cpBod
 	constraint->errorBias = cpfpow(1.0f - 0.1f, 60.0f);
 	constraint->maxBias = (cpFloat)INFINITY;
 	
+	constraint->frequency = 0.0f;
+	constraint->dampingRatio = 1.0f;
+	cpConstraintUpdateSoftness(constraint, 0.0f);
+	constraint->direct = cpFalse;
+	
 	constraint->collideBodies = cpTrue;
 	
 	constraint->preSolve = NULL;
 	constraint->postSolve = NULL;
 }
 
+// Constraint classes from before the solver bodies were packed read and write the cpBody velocities.
+// Copy the solver bodies' velocities to the cpBodies and back around their callbacks.
+// Only the dynamic bodies are copied since static and kinematic bodies can be shared by constraints solved on other threads.
+static void
+LoadBodyVelocity(cpBody *body, struct cpSolverBody *solverBody)
+{
+	if(cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC){
+		body->v = solverBody->v;
+		body->w = solverBody->w;
+		body->v_bias = solverBody->v_bias;
+		body->w_bias = solverBody->w_bias;
+	}
+}
+
+static void
+StoreBodyVelocity(cpBody *body, struct cpSolverBody *solverBody)
+{
+	if(cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC){
+		solverBody->v = body->v;
+		solverBody->w = body->w;
+		solverBody->v_bias = body->v_bias;
+		solverBody->w_bias = body->w_bias;
+	}
+}
+
+void
+cpConstraintApplyBodyImpulse(cpConstraint *constraint, cpFloat dt)
+{
+	struct cpSolverBody *a = cpConstraintSolverBodyA(constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(constraint);
+	
+	LoadBodyVelocity(constraint->a, a);
+	LoadBodyVelocity(constraint->b, b);
+	constraint->klass->applyImpulse(constraint, dt);
+	StoreBodyVelocity(constraint->a, a);
+	StoreBodyVelocity(constraint->b, b);
+}
+
+void
+cpConstraintApplyCachedBodyImpulse(cpConstraint *constraint, cpFloat dt_coef)
+{
+	struct cpSolverBody *a = cpConstraintSolverBodyA(constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(constraint);
+	
+	LoadBodyVelocity(constraint->a, a);
+	LoadBodyVelocity(constraint->b, b);
+	constraint->klass->applyCachedImpulse(constraint, dt_coef);
+	StoreBodyVelocity(constraint->a, a);
+	StoreBodyVelocity(constraint->b, b);
+}
+
 cpSpace *
 cpConstraintGetSpace(const cpConstraint *constraint)
 {
@@ -116,6 +172,34 @@ cpConstraintSetMaxBias(cpConstraint *constraint, cpFloat maxBias)
 	constraint->maxBias = maxBias;
 }
 
+cpFloat
+cpConstraintGetFrequency(const cpConstraint *constraint)
+{
+	return constraint->frequency;
+}
+
+void
+cpConstraintSetFrequency(cpConstraint *constraint, cpFloat frequency)
+{
+	cpAssertHard(frequency >= 0.0f, "frequency must be positive.");
+	cpConstraintActivateBodies(constraint);
+	constraint->frequency = frequency;
+}
+
+cpFloat
+cpConstraintGetDampingRatio(const cpConstraint *constraint)
+{
+	return constraint->dampingRatio;
+}
+
+void
+cpConstraintSetDampingRatio(cpConstraint *constraint, cpFloat dampingRatio)
+{
+	cpAssertHard(dampingRatio >= 0.0f, "dampingRatio must be positive.");
+	cpConstraintActivateBodies(constraint);
+	constraint->dampingRatio = dampingRatio;
+}
+
 cpBool
 cpConstraintGetCollideBodies(const cpConstraint *constraint)
 {
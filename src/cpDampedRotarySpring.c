@@ -52,18 +52,18 @@ static void applyCachedImpulse(cpDampedRotarySpring *spring, cpFloat dt_coef){}
 static void
 applyImpulse(cpDampedRotarySpring *spring, cpFloat dt)
 {
-	cpBody *a = spring->constraint.a;
-	cpBody *b = spring->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&spring->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&spring->constraint);
 	
 	// compute relative velocity
-	cpFloat wrn = a->w - b->w;//normal_relative_velocity(a, b, r1, r2, n) - spring->target_vrn;
+	cpFloat wrn = a->w - b->w;//solver_normal_relative_velocity(a, b, r1, r2, n) - spring->target_vrn;
 	
 	// compute velocity loss from drag
 	// not 100% certain this is derived correctly, though it makes sense
 	cpFloat w_damp = (spring->target_wrn - wrn)*spring->w_coef;
 	spring->target_wrn = wrn + w_damp;
 	
-	//apply_impulses(a, b, spring->r1, spring->r2, cpvmult(spring->n, v_damp*spring->nMass));
+	//solver_apply_impulses(a, b, spring->r1, spring->r2, cpvmult(spring->n, v_damp*spring->nMass));
 	cpFloat j_damp = w_damp*spring->iSum;
 	spring->jAcc += j_damp;
 	
@@ -82,6 +82,7 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
 cpDampedRotarySpring *
@@ -54,26 +54,29 @@ preStep(cpDampedSpring *spring, cpFloat dt)
 
 static void applyCachedImpulse(cpDampedSpring *spring, cpFloat dt_coef){}
 
-static void
-applyImpulse(cpDampedSpring *spring, cpFloat dt)
+// Shared by applyImpulse() and the batched solver. Returns the damping impulse.
+static inline cpFloat
+SolveSpring(struct cpSolverBody *a, struct cpSolverBody *b, cpVect r1, cpVect r2, cpVect n, cpFloat nMass, cpFloat v_coef, cpFloat *target_vrn)
 {
-	cpBody *a = spring->constraint.a;
-	cpBody *b = spring->constraint.b;
-	
-	cpVect n = spring->n;
-	cpVect r1 = spring->r1;
-	cpVect r2 = spring->r2;
-
 	// compute relative velocity
-	cpFloat vrn = normal_relative_velocity(a, b, r1, r2, n);
+	cpFloat vrn = solver_normal_relative_velocity(a, b, r1, r2, n);
 	
 	// compute velocity loss from drag
-	cpFloat v_damp = (spring->target_vrn - vrn)*spring->v_coef;
-	spring->target_vrn = vrn + v_damp;
+	cpFloat v_damp = (*target_vrn - vrn)*v_coef;
+	*target_vrn = vrn + v_damp;
 	
-	cpFloat j_damp = v_damp*spring->nMass;
-	spring->jAcc += j_damp;
-	apply_impulses(a, b, spring->r1, spring->r2, cpvmult(spring->n, j_damp));
+	cpFloat j_damp = v_damp*nMass;
+	solver_apply_impulses(a, b, r1, r2, cpvmult(n, j_damp));
+	return j_damp;
+}
+
+static void
+applyImpulse(cpDampedSpring *spring, cpFloat dt)
+{
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&spring->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&spring->constraint);
+	
+	spring->jAcc += SolveSpring(a, b, spring->r1, spring->r2, spring->n, spring->nMass, spring->v_coef, &spring->target_vrn);
 }
 
 static cpFloat
@@ -87,8 +90,55 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
+//MARK: Batched Solver
+
+void
+cpDampedSpringPreStepBatch(cpConstraint **springs, int count, cpFloat dt)
+{
+	for(int i=0; i<count; i++) preStep((cpDampedSpring *)springs[i], dt);
+}
+
+void
+cpDampedSpringLoadRows(cpConstraint **springs, int count, struct cpDampedSpringRow *rows)
+{
+	for(int i=0; i<count; i++){
+		cpDampedSpring *spring = (cpDampedSpring *)springs[i];
+		struct cpDampedSpringRow *row = rows + i;
+		
+		row->a = spring->constraint.solver_a;
+		row->b = spring->constraint.solver_b;
+		row->r1 = spring->r1;
+		row->r2 = spring->r2;
+		row->n = spring->n;
+		row->nMass = spring->nMass;
+		row->v_coef = spring->v_coef;
+		row->target_vrn = spring->target_vrn;
+		row->jAcc = spring->jAcc;
+	}
+}
+
+void
+cpDampedSpringApplyImpulseRows(struct cpDampedSpringRow *rows, int count, struct cpSolverBody *bodies)
+{
+	for(int i=0; i<count; i++){
+		struct cpDampedSpringRow *row = rows + i;
+		row->jAcc += SolveSpring(bodies + row->a, bodies + row->b, row->r1, row->r2, row->n, row->nMass, row->v_coef, &row->target_vrn);
+	}
+}
+
+void
+cpDampedSpringStoreRows(cpConstraint **springs, int count, struct cpDampedSpringRow *rows)
+{
+	for(int i=0; i<count; i++){
+		cpDampedSpring *spring = (cpDampedSpring *)springs[i];
+		spring->target_vrn = rows[i].target_vrn;
+		spring->jAcc = rows[i].jAcc;
+	}
+}
+
 cpDampedSpring *
 cpDampedSpringAlloc(void)
 {
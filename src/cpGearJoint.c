@@ -38,8 +38,8 @@ preStep(cpGearJoint *joint, cpFloat dt)
 static void
 applyCachedImpulse(cpGearJoint *joint, cpFloat dt_coef)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	cpFloat j = joint->jAcc*dt_coef;
 	a->w -= j*a->i_inv*joint->ratio_inv;
@@ -49,8 +49,8 @@ applyCachedImpulse(cpGearJoint *joint, cpFloat dt_coef)
 static void
 applyImpulse(cpGearJoint *joint, cpFloat dt)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	// compute relative rotational velocity
 	cpFloat wr = b->w*joint->ratio - a->w;
@@ -79,6 +79,7 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
 cpGearJoint *
@@ -63,10 +63,10 @@ preStep(cpGrooveJoint *joint, cpFloat dt)
 static void
 applyCachedImpulse(cpGrooveJoint *joint, cpFloat dt_coef)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 		
-	apply_impulses(a, b, joint->r1, joint->r2, cpvmult(joint->jAcc, dt_coef));
+	solver_apply_impulses(a, b, joint->r1, joint->r2, cpvmult(joint->jAcc, dt_coef));
 }
 
 static inline cpVect
@@ -79,14 +79,14 @@ grooveConstrain(cpGrooveJoint *joint, cpVect j, cpFloat dt){
 static void
 applyImpulse(cpGrooveJoint *joint, cpFloat dt)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	cpVect r1 = joint->r1;
 	cpVect r2 = joint->r2;
 	
 	// compute impulse
-	cpVect vr = relative_velocity(a, b, r1, r2);
+	cpVect vr = solver_relative_velocity(a, b, r1, r2);
 
 	cpVect j = cpMat2x2Transform(joint->k, cpvsub(joint->bias, vr));
 	cpVect jOld = joint->jAcc;
@@ -94,7 +94,7 @@ applyImpulse(cpGrooveJoint *joint, cpFloat dt)
 	j = cpvsub(joint->jAcc, jOld);
 	
 	// apply impulse
-	apply_impulses(a, b, joint->r1, joint->r2, j);
+	solver_apply_impulses(a, b, joint->r1, joint->r2, j);
 }
 
 static cpFloat
@@ -108,6 +108,7 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
 cpGrooveJoint *
@@ -38,6 +38,10 @@ struct cpHashSet {
 	cpHashSetBin *pooledBins;
 	
 	cpArray *allocatedBuffers;
+	
+#if CP_ENABLE_COUNTERS
+	unsigned long probes;
+#endif
 };
 
 void
@@ -143,6 +147,13 @@ getUnusedBin(cpHashSet *set)
 	}
 }
 
+static inline cpBool
+binMatches(cpHashSet *set, const void *ptr, cpHashSetBin *bin)
+{
+	CP_COUNTER_ADD(set->probes, 1);
+	return set->eql(ptr, bin->elt);
+}
+
 int
 cpHashSetCount(cpHashSet *set)
 {
@@ -156,7 +167,7 @@ cpHashSetInsert(cpHashSet *set, cpHashValue hash, const void *ptr, cpHashSetTran
 	
 	// Find the bin with the matching element.
 	cpHashSetBin *bin = set->table[idx];
-	while(bin && !set->eql(ptr, bin->elt))
+	while(bin && !binMatches(set, ptr, bin))
 		bin = bin->next;
 	
 	// Create it if necessary.
@@ -184,7 +195,7 @@ cpHashSetRemove(cpHashSet *set, cpHashValue hash, const void *ptr)
 	cpHashSetBin *bin = set->table[idx];
 	
 	// Find the bin
-	while(bin && !set->eql(ptr, bin->elt)){
+	while(bin && !binMatches(set, ptr, bin)){
 		prev_ptr = &bin->next;
 		bin = bin->next;
 	}
@@ -209,7 +220,7 @@ cpHashSetFind(cpHashSet *set, cpHashValue hash, const void *ptr)
 {	
 	cpHashValue idx = hash%set->size;
 	cpHashSetBin *bin = set->table[idx];
-	while(bin && !set->eql(ptr, bin->elt))
+	while(bin && !binMatches(set, ptr, bin))
 		bin = bin->next;
 		
 	return (bin ? bin->elt : set->default_value);
@@ -251,3 +262,21 @@ cpHashSetFilter(cpHashSet *set, cpHashSetFilterFunc func, void *data)
 		}
 	}
 }
+
+unsigned long
+cpHashSetGetProbeCount(cpHashSet *set)
+{
+#if CP_ENABLE_COUNTERS
+	return set->probes;
+#else
+	return 0;
+#endif
+}
+
+void
+cpHashSetResetProbeCount(cpHashSet *set)
+{
+#if CP_ENABLE_COUNTERS
+	set->probes = 0;
+#endif
+}
@@ -3,218 +3,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-
-//TODO: Move all the thread stuff to another file
-
-//#include <sys/param.h >
-
-#ifdef __APPLE__
-#include <sys/sysctl.h>
-#endif
-
-#ifndef _WIN32
-#include <pthread.h>
-#elif defined(__MINGW32__)
-#include <pthread.h>
-#else
-#ifndef WIN32_LEAN_AND_MEAN
-#define WIN32_LEAN_AND_MEAN
-#endif
-
-#ifndef NOMINMAX
-#define NOMINMAX
-#endif
-
-#include <process.h> // _beginthreadex
-#include <windows.h>
-
-#ifndef ETIMEDOUT
-#define ETIMEDOUT 1
-#endif
-
-// Simple pthread implementation for Windows
-// Made from scratch to avoid the LGPL licence from pthread-win32
-enum {
-	SIGNAL = 0,
-	BROADCAST = 1,
-	MAX_EVENTS = 2
-};
-
-typedef HANDLE pthread_t;
-typedef struct
-{
-	// Based on http://www.cs.wustl.edu/~schmidt/win32-cv-1.html since Windows has no condition variable until NT6
-	UINT waiters_count;
-	// Count of the number of waiters.
-
-	CRITICAL_SECTION waiters_count_lock;
-	// Serialize access to <waiters_count_>.
-
-	HANDLE events[MAX_EVENTS];
-} pthread_cond_t;
-typedef CRITICAL_SECTION pthread_mutex_t;
-
-typedef struct {} pthread_condattr_t; // Dummy;
-
-int pthread_cond_destroy(pthread_cond_t* cv)
-{
-	CloseHandle(cv->events[BROADCAST]);
-	CloseHandle(cv->events[SIGNAL]);
-
-	DeleteCriticalSection(&cv->waiters_count_lock);
-
-	return 0;
-}
-
-int pthread_cond_init(pthread_cond_t* cv, const pthread_condattr_t* attr)
-{
-	// Initialize the count to 0.
-	cv->waiters_count = 0;
-
-	// Create an auto-reset event.
-	cv->events[SIGNAL] = CreateEvent(NULL,  // no security
-	                                 FALSE, // auto-reset event
-	                                 FALSE, // non-signaled initially
-	                                 NULL); // unnamed
-
-	// Create a manual-reset event.
-	cv->events[BROADCAST] = CreateEvent(NULL,  // no security
-	                                    TRUE,  // manual-reset
-	                                    FALSE, // non-signaled initially
-	                                    NULL); // unnamed
-
-	InitializeCriticalSection(&cv->waiters_count_lock);
-
-	return 0;
-}
-
-int pthread_cond_broadcast(pthread_cond_t *cv)
-{
-	// Avoid race conditions.
-	EnterCriticalSection(&cv->waiters_count_lock);
-	int have_waiters = cv->waiters_count > 0;
-	LeaveCriticalSection(&cv->waiters_count_lock);
-
-	if (have_waiters)
-		SetEvent(cv->events[BROADCAST]);
-
-	return 0;
-}
-
-int pthread_cond_signal(pthread_cond_t* cv)
-{
-	// Avoid race conditions.
-	EnterCriticalSection(&cv->waiters_count_lock);
-	int have_waiters = cv->waiters_count > 0;
-	LeaveCriticalSection(&cv->waiters_count_lock);
-
-	if (have_waiters)
-		SetEvent(cv->events[SIGNAL]);
-
-	return 0;
-}
-
-int pthread_cond_wait(pthread_cond_t* cv, pthread_mutex_t* external_mutex)
-{
-	// Avoid race conditions.
-	EnterCriticalSection(&cv->waiters_count_lock);
-	cv->waiters_count++;
-	LeaveCriticalSection(&cv->waiters_count_lock);
-
-	// It's ok to release the <external_mutex> here since Win32
-	// manual-reset events maintain state when used with
-	// <SetEvent>.  This avoids the "lost wakeup" bug...
-	LeaveCriticalSection(external_mutex);
-
-	// Wait for either event to become signaled due to <pthread_cond_signal>
-	// being called or <pthread_cond_broadcast> being called.
-	int result = WaitForMultipleObjects(2, cv->events, FALSE, INFINITE);
-
-	EnterCriticalSection(&cv->waiters_count_lock);
-	cv->waiters_count--;
-	int last_waiter =
-		result == WAIT_OBJECT_0 + BROADCAST
-		&& cv->waiters_count == 0;
-	LeaveCriticalSection(&cv->waiters_count_lock);
-
-	// Some thread called <pthread_cond_broadcast>.
-	if (last_waiter)
-		// We're the last waiter to be notified or to stop waiting, so
-		// reset the manual event. 
-		ResetEvent(cv->events[BROADCAST]);
-
-	// Reacquire the <external_mutex>.
-	EnterCriticalSection(external_mutex);
-
-	return result == WAIT_TIMEOUT ? ETIMEDOUT : 0;
-}
-
-typedef struct {} pthread_mutexattr_t; //< Dummy
-
-int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr)
-{
-	InitializeCriticalSection(mutex);
-	return 0;
-}
-
-int pthread_mutex_destroy(pthread_mutex_t* mutex)
-{
-	DeleteCriticalSection(mutex);
-	return 0;
-}
-
-int pthread_mutex_lock(pthread_mutex_t* mutex)
-{
-	EnterCriticalSection(mutex);
-	return 0;
-}
-
-int pthread_mutex_unlock(pthread_mutex_t* mutex)
-{
-	LeaveCriticalSection(mutex);
-	return 0;
-}
-
-typedef struct {} pthread_attr_t;
-
-typedef struct
-{
-	void *(*start_routine) (void *);
-	void* arg;
-} pthread_internal_thread;
-
-unsigned int __stdcall ThreadProc(void* userdata)
-{
-	pthread_internal_thread* ud = (pthread_internal_thread*) userdata;
-	ud->start_routine(ud->arg);
-
-	free(ud);
-
-	return 0;
-}
-
-int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void *(*start_routine) (void *), void *arg)
-{
-	pthread_internal_thread* ud = (pthread_internal_thread*) malloc(sizeof(pthread_internal_thread));
-	ud->start_routine = start_routine;
-	ud->arg = arg;
-
-	*thread = (HANDLE) (_beginthreadex(NULL, 0, &ThreadProc, ud, 0, NULL));
-	if (!*thread)
-		return 1;
-
-	return 0;
-}
-
-int pthread_join(pthread_t thread, void **value_ptr)
-{
-	WaitForSingleObject(thread, INFINITE);
-	CloseHandle(thread);
-
-	return 0;
-}
-
-#endif
+#include <string.h>
 
 #include "chipmunk/chipmunk_private.h"
 #include "chipmunk/cpHastySpace.h"
@@ -290,10 +79,10 @@ vmake(cpFloat_t x, cpFloat_t y)
 }
 
 static void
-cpArbiterApplyImpulse_NEON(cpArbiter *arb)
+cpArbiterApplyImpulse_NEON(cpArbiter *arb, struct cpSolverBody *bodies)
 {
-	cpBody *a = arb->body_a;
-	cpBody *b = arb->body_b;
+	struct cpSolverBody *a = bodies + arb->solver_a;
+	struct cpSolverBody *b = bodies + arb->solver_b;
 	cpFloatx2_t surface_vr = vld((cpFloat_t *)&arb->surface_vr);
 	cpFloatx2_t n = vld((cpFloat_t *)&arb->n);
 	cpFloat_t friction = arb->u;
@@ -380,136 +169,1063 @@ cpArbiterApplyImpulse_NEON(cpArbiter *arb)
 
 #endif
 
-//MARK: PThreads
+//MARK: x86 SIMD Solver
+
+// The SSE2 and AVX2 kernels share one implementation written with GCC vector extensions.
+// Vectors are always 256 bits wide so the bundles look the same on every machine.
+// The AVX2 build runs each bundle op as a single instruction; the SSE2 build splits it into two.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__ARM_NEON__)
+#define CP_HASTY_X86_SIMD 1
+
+#include <stdint.h>
+
+#if CP_USE_DOUBLES
+	#define CP_BUNDLE_WIDTH 4
+	typedef int64_t cpMaskv __attribute__((vector_size(32)));
+#else
+	#define CP_BUNDLE_WIDTH 8
+	typedef int32_t cpMaskv __attribute__((vector_size(32)));
+#endif
+
+typedef cpFloat cpFloatv __attribute__((vector_size(32)));
+
+// All the helpers passing vectors by value are force inlined into the kernels, so the ABI warning doesn't apply.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+#define CP_SIMD_INLINE static inline __attribute__((always_inline))
+
+// Each lane of a bundle holds one arbiter and up to CP_MAX_CONTACTS_PER_ARBITER contacts.
+// Arbiters in the same bundle never share a body that can move.
+// Fields are stored as plain arrays so bundles don't require aligned allocations.
+struct cpContactLanes {
+	struct cpContact *contacts[CP_BUNDLE_WIDTH];
+	
+	cpFloat r1x[CP_BUNDLE_WIDTH], r1y[CP_BUNDLE_WIDTH];
+	cpFloat r2x[CP_BUNDLE_WIDTH], r2y[CP_BUNDLE_WIDTH];
+	cpFloat nMass[CP_BUNDLE_WIDTH], tMass[CP_BUNDLE_WIDTH];
+	cpFloat bias[CP_BUNDLE_WIDTH], bounce[CP_BUNDLE_WIDTH];
+	cpFloat jnAcc[CP_BUNDLE_WIDTH], jtAcc[CP_BUNDLE_WIDTH], jBias[CP_BUNDLE_WIDTH];
+};
+
+struct cpContactBundle {
+	// Number of lanes in use, the highest contact count of any lane, and the number of block solved lanes.
+	int count, contactCount, blockCount;
+	int a[CP_BUNDLE_WIDTH], b[CP_BUNDLE_WIDTH];
+	
+	cpFloat nx[CP_BUNDLE_WIDTH], ny[CP_BUNDLE_WIDTH];
+	cpFloat svrx[CP_BUNDLE_WIDTH], svry[CP_BUNDLE_WIDTH];
+	cpFloat friction[CP_BUNDLE_WIDTH];
+	// 1.0 when the arbiter's cached impulses should be applied, 0.0 for first contacts.
+	cpFloat cached[CP_BUNDLE_WIDTH];
+	
+	// 1.0 when the normal impulses of the first two contacts are block solved, see cpArbiterPreStepBlock().
+	cpFloat block[CP_BUNDLE_WIDTH];
+	cpFloat k11[CP_BUNDLE_WIDTH], k12[CP_BUNDLE_WIDTH], k22[CP_BUNDLE_WIDTH];
+	cpFloat m11[CP_BUNDLE_WIDTH], m12[CP_BUNDLE_WIDTH], m22[CP_BUNDLE_WIDTH];
+	
+	struct cpContactLanes slots[CP_MAX_CONTACTS_PER_ARBITER];
+};
+
+typedef void (*cpContactPreStepFunc)(cpArbiter **arbs, struct cpContact **contacts, int count, cpFloat dt, cpFloat slop, cpFloat bias);
+typedef void (*cpContactBundleCachedFunc)(struct cpContactBundle *bundles, int count, struct cpSolverBody *bodies, cpFloat dt_coef);
+typedef void (*cpContactBundleSolveFunc)(struct cpContactBundle *bundles, int count, struct cpSolverBody *bodies);
+
+CP_SIMD_INLINE cpFloatv vld(const cpFloat *p){cpFloatv v; memcpy(&v, p, sizeof(v)); return v;}
+CP_SIMD_INLINE void vst(cpFloat *p, cpFloatv v){memcpy(p, &v, sizeof(v));}
+CP_SIMD_INLINE cpFloatv vdup(cpFloat f){return (cpFloatv){} + f;}
+
+CP_SIMD_INLINE cpFloatv
+vmax(cpFloatv a, cpFloatv b)
+{
+	cpMaskv mask = (a > b);
+	return (cpFloatv)(((cpMaskv)a & mask) | ((cpMaskv)b & ~mask));
+}
+
+CP_SIMD_INLINE cpFloatv
+vmin(cpFloatv a, cpFloatv b)
+{
+	cpMaskv mask = (a < b);
+	return (cpFloatv)(((cpMaskv)a & mask) | ((cpMaskv)b & ~mask));
+}
+
+CP_SIMD_INLINE cpFloatv
+vselect(cpMaskv mask, cpFloatv a, cpFloatv b)
+{
+	return (cpFloatv)(((cpMaskv)a & mask) | ((cpMaskv)b & ~mask));
+}
+
+// Vectorized version of cpArbiterPreStep() for up to CP_BUNDLE_WIDTH contacts at a time.
+CP_SIMD_INLINE void
+PreStepContacts(cpArbiter **arbs, struct cpContact **contacts, int count, cpFloat dt, cpFloat slop, cpFloat biasCoef)
+{
+	cpFloatv am = {}, ai = {}, apx = {}, apy = {}, avx = {}, avy = {}, aw = {};
+	cpFloatv bm = {}, bi = {}, bpx = {}, bpy = {}, bvx = {}, bvy = {}, bw = {};
+	cpFloatv nx = {}, ny = {}, e = {}, r1x = {}, r1y = {}, r2x = {}, r2y = {};
+	
+	for(int l=0; l<count; l++){
+		cpArbiter *arb = arbs[l];
+		cpBody *a = arb->body_a, *b = arb->body_b;
+		struct cpContact *con = contacts[l];
+		
+		am[l] = a->m_inv; ai[l] = a->i_inv; apx[l] = a->p.x; apy[l] = a->p.y; avx[l] = a->v.x; avy[l] = a->v.y; aw[l] = a->w;
+		bm[l] = b->m_inv; bi[l] = b->i_inv; bpx[l] = b->p.x; bpy[l] = b->p.y; bvx[l] = b->v.x; bvy[l] = b->v.y; bw[l] = b->w;
+		nx[l] = arb->n.x; ny[l] = arb->n.y; e[l] = arb->e;
+		r1x[l] = con->r1.x; r1y[l] = con->r1.y; r2x[l] = con->r2.x; r2y[l] = con->r2.y;
+	}
+	
+	// Fill the unused lanes with a solvable dummy to avoid dividing by zero.
+	for(int l=count; l<CP_BUNDLE_WIDTH; l++){am[l] = 1.0f; nx[l] = 1.0f;}
+	
+	cpFloatv rn1 = r1x*ny - r1y*nx, rt1 = r1x*nx + r1y*ny;
+	cpFloatv rn2 = r2x*ny - r2y*nx, rt2 = r2x*nx + r2y*ny;
+	cpFloatv nMass = 1.0f/((am + ai*rn1*rn1) + (bm + bi*rn2*rn2));
+	cpFloatv tMass = 1.0f/((am + ai*rt1*rt1) + (bm + bi*rt2*rt2));
+	
+	cpFloatv dist = ((r2x - r1x) + (bpx - apx))*nx + ((r2y - r1y) + (bpy - apy))*ny;
+	cpFloatv bias = -biasCoef*vmin(vdup(0.0f), dist + slop)/dt;
+	
+	cpFloatv vrx = (bvx - r2y*bw) - (avx - r1y*aw);
+	cpFloatv vry = (bvy + r2x*bw) - (avy + r1x*aw);
+	cpFloatv vrn = vrx*nx + vry*ny;
+	
+	// Speculative contacts only stop the shapes from closing the gap, see cpArbiterBounceVelocity().
+	cpMaskv speculative = (dist > 0.0f) & ((e == 0.0f) | (vrn*dt + dist > 0.0f));
+	cpFloatv bounce = vselect(speculative, dist/dt, vrn*e);
+	
+	for(int l=0; l<count; l++){
+		struct cpContact *con = contacts[l];
+		con->nMass = nMass[l];
+		con->tMass = tMass[l];
+		con->bias = bias[l];
+		con->jBias = 0.0f;
+		con->bounce = bounce[l];
+	}
+}
+
+struct SolverLanes {
+	cpFloatv vx, vy, w, vbx, vby, wb, m, i;
+};
+
+CP_SIMD_INLINE struct SolverLanes
+LoadSolverLanes(struct cpSolverBody *bodies, const int *indexes)
+{
+	// Go through plain arrays, GCC warns that vectors accessed one element at a time may be uninitialized.
+	cpFloat vx[CP_BUNDLE_WIDTH], vy[CP_BUNDLE_WIDTH], w[CP_BUNDLE_WIDTH];
+	cpFloat vbx[CP_BUNDLE_WIDTH], vby[CP_BUNDLE_WIDTH], wb[CP_BUNDLE_WIDTH];
+	cpFloat m[CP_BUNDLE_WIDTH], i[CP_BUNDLE_WIDTH];
+	
+	for(int l=0; l<CP_BUNDLE_WIDTH; l++){
+		struct cpSolverBody *body = bodies + indexes[l];
+		vx[l] = body->v.x; vy[l] = body->v.y; w[l] = body->w;
+		vbx[l] = body->v_bias.x; vby[l] = body->v_bias.y; wb[l] = body->w_bias;
+		m[l] = body->m_inv; i[l] = body->i_inv;
+	}
+	
+	struct SolverLanes lanes = {vld(vx), vld(vy), vld(w), vld(vbx), vld(vby), vld(wb), vld(m), vld(i)};
+	return lanes;
+}
+
+CP_SIMD_INLINE void
+StoreSolverLanes(struct cpSolverBody *bodies, const int *indexes, int count, struct SolverLanes lanes)
+{
+	cpFloat vx[CP_BUNDLE_WIDTH], vy[CP_BUNDLE_WIDTH], w[CP_BUNDLE_WIDTH];
+	cpFloat vbx[CP_BUNDLE_WIDTH], vby[CP_BUNDLE_WIDTH], wb[CP_BUNDLE_WIDTH];
+	vst(vx, lanes.vx); vst(vy, lanes.vy); vst(w, lanes.w);
+	vst(vbx, lanes.vbx); vst(vby, lanes.vby); vst(wb, lanes.wb);
+	
+	for(int l=0; l<count; l++){
+		struct cpSolverBody *body = bodies + indexes[l];
+		body->v.x = vx[l]; body->v.y = vy[l]; body->w = w[l];
+		body->v_bias.x = vbx[l]; body->v_bias.y = vby[l]; body->w_bias = wb[l];
+	}
+}
+
+// Vectorized version of cpArbiterApplyCachedImpulse().
+CP_SIMD_INLINE void
+ApplyCachedBundles(struct cpContactBundle *bundles, int count, struct cpSolverBody *bodies, cpFloat dt_coef)
+{
+	for(int i=0; i<count; i++){
+		struct cpContactBundle *bundle = bundles + i;
+		struct SolverLanes a = LoadSolverLanes(bodies, bundle->a);
+		struct SolverLanes b = LoadSolverLanes(bodies, bundle->b);
+		
+		cpFloatv nx = vld(bundle->nx), ny = vld(bundle->ny);
+		cpFloatv coef = vld(bundle->cached)*dt_coef;
+		
+		for(int k=0; k<bundle->contactCount; k++){
+			struct cpContactLanes *slot = bundle->slots + k;
+			cpFloatv r1x = vld(slot->r1x), r1y = vld(slot->r1y);
+			cpFloatv r2x = vld(slot->r2x), r2y = vld(slot->r2y);
+			cpFloatv jn = vld(slot->jnAcc), jt = vld(slot->jtAcc);
+			
+			cpFloatv jx = (nx*jn - ny*jt)*coef;
+			cpFloatv jy = (nx*jt + ny*jn)*coef;
+			
+			a.vx -= jx*a.m; a.vy -= jy*a.m; a.w += a.i*(r1y*jx - r1x*jy);
+			b.vx += jx*b.m; b.vy += jy*b.m; b.w += b.i*(r2x*jy - r2y*jx);
+		}
+		
+		StoreSolverLanes(bodies, bundle->a, bundle->count, a);
+		StoreSolverLanes(bodies, bundle->b, bundle->count, b);
+	}
+}
+
+// Vectorized version of the block solver in cpArbiterApplyImpulse().
+// Lanes without a block solver keep their normal impulses.
+CP_SIMD_INLINE void
+ApplyBlockLanes(struct cpContactBundle *bundle, struct SolverLanes *a, struct SolverLanes *b, cpFloatv nx, cpFloatv ny, cpFloatv svrx, cpFloatv svry)
+{
+	struct cpContactLanes *slot1 = bundle->slots + 0, *slot2 = bundle->slots + 1;
+	cpFloatv r11x = vld(slot1->r1x), r11y = vld(slot1->r1y), r12x = vld(slot1->r2x), r12y = vld(slot1->r2y);
+	cpFloatv r21x = vld(slot2->r1x), r21y = vld(slot2->r1y), r22x = vld(slot2->r2x), r22y = vld(slot2->r2y);
+	
+	cpFloatv vr1x = (b->vx - r12y*b->w) - (a->vx - r11y*a->w) + svrx;
+	cpFloatv vr1y = (b->vy + r12x*b->w) - (a->vy + r11x*a->w) + svry;
+	cpFloatv vr2x = (b->vx - r22y*b->w) - (a->vx - r21y*a->w) + svrx;
+	cpFloatv vr2y = (b->vy + r22x*b->w) - (a->vy + r21x*a->w) + svry;
+	cpFloatv vn1 = vr1x*nx + vr1y*ny + vld(slot1->bounce);
+	cpFloatv vn2 = vr2x*nx + vr2y*ny + vld(slot2->bounce);
+	
+	cpFloatv k11 = vld(bundle->k11), k12 = vld(bundle->k12), k22 = vld(bundle->k22);
+	cpFloatv jn1Old = vld(slot1->jnAcc), jn2Old = vld(slot2->jnAcc);
+	cpFloatv b1 = vn1 - (k11*jn1Old + k12*jn2Old);
+	cpFloatv b2 = vn2 - (k12*jn1Old + k22*jn2Old);
+	
+	// Pick the first combination of pushing and separating contacts that works, see BlockNormalImpulses().
+	cpFloatv both1 = -(vld(bundle->m11)*b1 + vld(bundle->m12)*b2);
+	cpFloatv both2 = -(vld(bundle->m12)*b1 + vld(bundle->m22)*b2);
+	cpFloatv first = -b1*vld(slot1->nMass);
+	cpFloatv second = -b2*vld(slot2->nMass);
+	
+	cpFloatv zero = vdup(0.0f);
+	cpMaskv block = (vld(bundle->block) != 0.0f);
+	cpMaskv useBoth = block & (both1 >= 0.0f) & (both2 >= 0.0f);
+	cpMaskv useFirst = block & ~useBoth & (first >= 0.0f) & (k12*first + b2 >= 0.0f);
+	cpMaskv useSecond = block & ~useBoth & ~useFirst & (second >= 0.0f) & (k12*second + b1 >= 0.0f);
+	cpMaskv useNone = block & ~useBoth & ~useFirst & ~useSecond & (b1 >= 0.0f) & (b2 >= 0.0f);
+	
+	cpFloatv jn1Acc = vselect(useBoth, both1, vselect(useFirst, first, vselect(useSecond | useNone, zero, jn1Old)));
+	cpFloatv jn2Acc = vselect(useBoth, both2, vselect(useSecond, second, vselect(useFirst | useNone, zero, jn2Old)));
+	vst(slot1->jnAcc, jn1Acc);
+	vst(slot2->jnAcc, jn2Acc);
+	
+	cpFloatv j1 = jn1Acc - jn1Old, j2 = jn2Acc - jn2Old;
+	cpFloatv j1x = nx*j1, j1y = ny*j1, j2x = nx*j2, j2y = ny*j2;
+	a->vx -= (j1x + j2x)*a->m; a->vy -= (j1y + j2y)*a->m;
+	a->w += a->i*((r11y*j1x - r11x*j1y) + (r21y*j2x - r21x*j2y));
+	b->vx += (j1x + j2x)*b->m; b->vy += (j1y + j2y)*b->m;
+	b->w += b->i*((r12x*j1y - r12y*j1x) + (r22x*j2y - r22y*j2x));
+}
+
+// Vectorized version of cpArbiterApplyImpulse().
+CP_SIMD_INLINE void
+ApplyBundles(struct cpContactBundle *bundles, int count, struct cpSolverBody *bodies)
+{
+	for(int i=0; i<count; i++){
+		struct cpContactBundle *bundle = bundles + i;
+		struct SolverLanes a = LoadSolverLanes(bodies, bundle->a);
+		struct SolverLanes b = LoadSolverLanes(bodies, bundle->b);
+		
+		cpFloatv nx = vld(bundle->nx), ny = vld(bundle->ny);
+		cpFloatv svrx = vld(bundle->svrx), svry = vld(bundle->svry);
+		cpFloatv friction = vld(bundle->friction);
+		cpMaskv block = (vld(bundle->block) != 0.0f);
+		
+		for(int k=0; k<bundle->contactCount; k++){
+			struct cpContactLanes *slot = bundle->slots + k;
+			cpFloatv r1x = vld(slot->r1x), r1y = vld(slot->r1y);
+			cpFloatv r2x = vld(slot->r2x), r2y = vld(slot->r2y);
+			cpFloatv nMass = vld(slot->nMass);
+			
+			cpFloatv vbx = (b.vbx - r2y*b.wb) - (a.vbx - r1y*a.wb);
+			cpFloatv vby = (b.vby + r2x*b.wb) - (a.vby + r1x*a.wb);
+			cpFloatv vrx = (b.vx - r2y*b.w) - (a.vx - r1y*a.w) + svrx;
+			cpFloatv vry = (b.vy + r2x*b.w) - (a.vy + r1x*a.w) + svry;
+			
+			cpFloatv vbn = vbx*nx + vby*ny;
+			cpFloatv vrn = vrx*nx + vry*ny;
+			cpFloatv vrt = vry*nx - vrx*ny;
+			
+			cpFloatv jbnOld = vld(slot->jBias);
+			cpFloatv jBias = vmax(jbnOld + (vld(slot->bias) - vbn)*nMass, vdup(0.0f));
+			
+			// Block solved lanes only apply the bias and friction impulses here.
+			cpFloatv jnOld = vld(slot->jnAcc);
+			cpFloatv jnAcc = vselect(block, jnOld, vmax(jnOld - (vld(slot->bounce) + vrn)*nMass, vdup(0.0f)));
+			
+			cpFloatv jtMax = friction*jnAcc;
+			cpFloatv jtOld = vld(slot->jtAcc);
+			cpFloatv jtAcc = vmin(vmax(jtOld - vrt*vld(slot->tMass), -jtMax), jtMax);
+			
+			vst(slot->jBias, jBias);
+			vst(slot->jnAcc, jnAcc);
+			vst(slot->jtAcc, jtAcc);
+			
+			cpFloatv jb = jBias - jbnOld;
+			cpFloatv jbx = nx*jb, jby = ny*jb;
+			a.vbx -= jbx*a.m; a.vby -= jby*a.m; a.wb += a.i*(r1y*jbx - r1x*jby);
+			b.vbx += jbx*b.m; b.vby += jby*b.m; b.wb += b.i*(r2x*jby - r2y*jbx);
+			
+			cpFloatv jn = jnAcc - jnOld, jt = jtAcc - jtOld;
+			cpFloatv jx = nx*jn - ny*jt;
+			cpFloatv jy = nx*jt + ny*jn;
+			a.vx -= jx*a.m; a.vy -= jy*a.m; a.w += a.i*(r1y*jx - r1x*jy);
+			b.vx += jx*b.m; b.vy += jy*b.m; b.w += b.i*(r2x*jy - r2y*jx);
+		}
+		
+		if(bundle->blockCount > 0) ApplyBlockLanes(bundle, &a, &b, nx, ny, svrx, svry);
+		
+		StoreSolverLanes(bodies, bundle->a, bundle->count, a);
+		StoreSolverLanes(bodies, bundle->b, bundle->count, b);
+	}
+}
+
+static void PreStepContacts_SSE2(cpArbiter **arbs, struct cpContact **contacts, int count, cpFloat dt, cpFloat slop, cpFloat bias){PreStepContacts(arbs, contacts, count, dt, slop, bias);}
+static void ApplyCachedBundles_SSE2(struct cpContactBundle *bundles, int count, struct cpSolverBody *bodies, cpFloat dt_coef){ApplyCachedBundles(bundles, count, bodies, dt_coef);}
+static void ApplyBundles_SSE2(struct cpContactBundle *bundles, int count, struct cpSolverBody *bodies){ApplyBundles(bundles, count, bodies);}
+
+#define CP_AVX2 __attribute__((target("avx2,fma")))
+static CP_AVX2 void PreStepContacts_AVX2(cpArbiter **arbs, struct cpContact **contacts, int count, cpFloat dt, cpFloat slop, cpFloat bias){PreStepContacts(arbs, contacts, count, dt, slop, bias);}
+static CP_AVX2 void ApplyCachedBundles_AVX2(struct cpContactBundle *bundles, int count, struct cpSolverBody *bodies, cpFloat dt_coef){ApplyCachedBundles(bundles, count, bodies, dt_coef);}
+static CP_AVX2 void ApplyBundles_AVX2(struct cpContactBundle *bundles, int count, struct cpSolverBody *bodies){ApplyBundles(bundles, count, bodies);}
+
+#endif
+
+//MARK: Hasty Space
+
+// Maximum number of colors the solver work is partitioned into.
+// Anything left over is solved serially after the last color.
+#define CP_HASTY_MAX_COLORS 64
+typedef uint64_t cpColorMask;
 
-// Right now using more than 2 threads probably wont help your performance any.
-// If you are using a ridiculous number of iterations it could help though.
-#define MAX_THREADS 2
+struct cpSolverColor {
+	int arbiterStart, arbiterCount;
+	int constraintStart, constraintCount;
+	int bundleStart, bundleCount;
+};
 
-struct ThreadContext {
-	pthread_t thread;
-	cpHastySpace *space;
-	unsigned long thread_num;
+struct cpSolverGroup {
+	// Number of colors in use, not counting the overflow color.
+	int colorCount;
+	// Worker that solves the group on its own, or -1 when it's shared by all of the workers.
+	int worker;
 };
 
 typedef	void (*cpHastySpaceWorkFunction)(cpSpace *space, unsigned long worker, unsigned long worker_count);
 
+// A pair of shapes found by the broadphase and the result of colliding them.
+struct cpCollisionPair {
+	cpShape *a, *b;
+	struct cpCollisionInfo info;
+	int contactIndex;
+	
+#if CP_ENABLE_COUNTERS
+	// Why cpSpaceQueryReject() rejected the pair, or 0.
+	int reject;
+#endif
+};
+
+struct cpContactScratch {
+	struct cpContact *contacts;
+	int count, capacity;
+};
+
 struct cpHastySpace {
 	cpSpace space;
 	
-	// Number of worker threads (including the main thread)
-	unsigned long num_threads;
+	// Worker threads (including the main thread)
+	cpThreadPool *pool;
+	cpBool pinned;
 	
-	// Number of worker threads currently executing. (also including the main thread)
-	unsigned long num_working;
+	// Use the vectorized contact solver when one is available, see cpHastySpaceSetVectorized().
+	cpBool vectorized;
+	
+	// Only warn about the unsupported iteration tolerance once.
+	cpBool warnedIterationTolerance;
 	
 	// Number of constraints (plus contacts) that must exist per step to start the worker threads.
 	unsigned long constraint_count_threshold;
+	// Number of broadphase pairs that must exist per step to run the narrowphase on the worker threads.
+	unsigned long pair_count_threshold;
+	// Number of dynamic shapes that must exist to run the broadphase on the worker threads.
+	unsigned long shape_count_threshold;
+	
+	// Broadphase pairs for this step and the last, and a contact buffer for each worker to collide them into.
+	struct cpCollisionPair *pairs, *prevPairs;
+	int pairCount, pairsCapacity;
+	int prevPairCount, prevPairsCapacity;
+	struct cpContactScratch *contactScratch;
+	int contactScratchCount;
 	
-	pthread_mutex_t mutex;
-	pthread_cond_t cond_work, cond_resume;
+	// Arbiters and constraints partitioned into groups of islands, rebuilt every step.
+	// Each group has CP_HASTY_MAX_COLORS + 1 colors, the last one holding the items that didn't fit into any color.
+	struct cpSolverGroup *groups;
+	int groupCount, groupsCapacity;
+	struct cpSolverColor *colors;
+	int colorsCapacity;
 	
-	// Work function to invoke.
-	cpHastySpaceWorkFunction work;
+	cpArbiter **colorArbiters;
+	int colorArbitersCapacity;
+	cpConstraint **colorConstraints;
+	int colorConstraintsCapacity;
 	
-	struct ThreadContext workers[MAX_THREADS - 1];
+	// Scratch space used while picking colors.
+	cpColorMask *bodyColors;
+	int bodyColorsCapacity;
+	int *itemColors;
+	int itemColorsCapacity;
+	int *islandGroups;
+	int islandGroupsCapacity;
+	
+	cpFloat dt_coef;
+	
+#if CP_HASTY_X86_SIMD
+	// Contact bundles for the vectorized solver, rebuilt every step.
+	struct cpContactBundle *bundles;
+	int bundleCount, bundleCapacity;
+	
+	// Kernels picked at runtime based on the CPU's features.
+	cpContactPreStepFunc preStepContacts;
+	cpContactBundleCachedFunc applyCachedBundles;
+	cpContactBundleSolveFunc applyBundles;
+#endif
 };
 
+static inline void
+RunWorkers(cpHastySpace *hasty, cpHastySpaceWorkFunction func)
+{
+	cpThreadPoolRun(hasty->pool, (cpThreadPoolFunc)func, hasty);
+}
+
+// Block until all of the workers running the current work function have reached the barrier.
+static inline void
+Barrier(cpHastySpace *hasty, unsigned long worker_count)
+{
+	cpThreadPoolBarrier(hasty->pool, worker_count);
+}
+
 static void *
-WorkerThreadLoop(struct ThreadContext *context)
+GrowArray(void *arr, int *capacity, int count, size_t size)
 {
-	cpHastySpace *hasty = context->space;
+	if(count > *capacity){
+		int grow = 3*(*capacity + 1)/2;
+		*capacity = (count > grow ? count : grow);
+		arr = cprealloc(arr, (*capacity)*size);
+	}
 	
-	unsigned long thread = context->thread_num;
-	unsigned long num_threads = hasty->num_threads;
+	return arr;
+}
+
+// The range of items in a list that a worker is responsible for.
+static inline void
+WorkerRange(int count, unsigned long worker, unsigned long worker_count, int *start, int *end)
+{
+	*start = (int)(count*worker/worker_count);
+	*end = (int)(count*(worker + 1)/worker_count);
+}
+
+//MARK: Narrowphase
+
+// The spatial index keeps whatever the query callback returns for a pair and passes it back on the next step.
+// Pairs are only queued during the query, so their index in the queue is returned instead of the collision id.
+// The id that cpCollide() produces is then looked up from the previous step's queue using that index.
+static cpCollisionID
+QueueCollisionPair(cpShape *a, cpShape *b, cpCollisionID index, cpHastySpace *hasty)
+{
+	cpCollisionID id = 0;
+	if(0 < index && index <= (cpCollisionID)hasty->prevPairCount){
+		struct cpCollisionPair *prev = hasty->prevPairs + (index - 1);
+		if(prev->a == a && prev->b == b) id = prev->info.id;
+	}
 	
-	for(;;){
-		pthread_mutex_lock(&hasty->mutex); {
-			if(--hasty->num_working == 0){
-				pthread_cond_signal(&hasty->cond_resume);
-			}
+	hasty->pairs = (struct cpCollisionPair *)GrowArray(hasty->pairs, &hasty->pairsCapacity, hasty->pairCount + 1, sizeof(struct cpCollisionPair));
+	struct cpCollisionPair *pair = hasty->pairs + hasty->pairCount;
+	pair->a = a;
+	pair->b = b;
+	pair->info.id = id;
+	
+	return (cpCollisionID)(++hasty->pairCount);
+}
+
+// Run the broadphase and fill the collision pair queue.
+static void
+QueueCollisionPairs(cpHastySpace *hasty)
+{
+	// Swap the queues so the collision ids from the last step can be found.
+	struct cpCollisionPair *pairs = hasty->pairs;
+	int capacity = hasty->pairsCapacity;
+	
+	hasty->pairs = hasty->prevPairs;
+	hasty->pairsCapacity = hasty->prevPairsCapacity;
+	hasty->prevPairs = pairs;
+	hasty->prevPairsCapacity = capacity;
+	hasty->prevPairCount = hasty->pairCount;
+	hasty->pairCount = 0;
+	
+	cpSpatialIndex *index = hasty->space.dynamicShapes;
+	if((unsigned long)cpSpatialIndexCount(index) > hasty->shape_count_threshold){
+		// The pairs are still queued from this thread in the same order as the serial broadphase.
+		cpBBTreeReindexQueryThreaded(index, hasty->pool, (cpSpatialIndexQueryFunc)QueueCollisionPair, hasty);
+	} else {
+		cpSpatialIndexReindexQuery(index, (cpSpatialIndexQueryFunc)QueueCollisionPair, hasty);
+	}
+}
+
+// Collide a worker's share of the queued pairs.
+// Contacts are written to a buffer owned by the worker and copied into the space when the results are merged.
+static void
+Narrowphase(cpSpace *space, unsigned long worker, unsigned long worker_count)
+{
+	cpHastySpace *hasty = (cpHastySpace *)space;
+	struct cpContactScratch *scratch = hasty->contactScratch + worker;
+	scratch->count = 0;
+	
+	int start, end;
+	WorkerRange(hasty->pairCount, worker, worker_count, &start, &end);
+	
+	for(int i=start; i<end; i++){
+		struct cpCollisionPair *pair = hasty->pairs + i;
+		
+		int reject = cpSpaceQueryReject(pair->a, pair->b);
+#if CP_ENABLE_COUNTERS
+		pair->reject = reject;
+#endif
+		
+		if(reject){
+			// Keep the collision id around for when the pair stops being rejected.
+			pair->info.count = 0;
+			continue;
+		}
+		
+		scratch->contacts = (struct cpContact *)GrowArray(scratch->contacts, &scratch->capacity, scratch->count + CP_MAX_CONTACTS_PER_ARBITER, sizeof(struct cpContact));
+		cpFloat margin = cpSpaceSpeculativeMargin(space, pair->a, pair->b);
+		pair->info = cpCollide(pair->a, pair->b, pair->info.id, margin, scratch->contacts + scratch->count);
+		pair->contactIndex = scratch->count;
+		scratch->count += pair->info.count;
+	}
+}
+
+// Copy the contacts into the space and update the arbiters in the order the broadphase found the pairs.
+// The arbiters and callbacks end up in the same order no matter how many workers ran the narrowphase.
+static void
+MergeCollisions(cpHastySpace *hasty, unsigned long worker_count)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	
+	for(unsigned long worker=0; worker<worker_count; worker++){
+		struct cpContactScratch *scratch = hasty->contactScratch + worker;
+		
+		int start, end;
+		WorkerRange(hasty->pairCount, worker, worker_count, &start, &end);
+		
+		for(int i=start; i<end; i++){
+			struct cpCollisionInfo *info = &hasty->pairs[i].info;
 			
-			pthread_cond_wait(&hasty->cond_work, &hasty->mutex);
-		} pthread_mutex_unlock(&hasty->mutex);
+#if CP_ENABLE_COUNTERS
+			int reject = hasty->pairs[i].reject;
+			cpSpaceCountQueryReject(space, reject);
+			if(!reject) cpSpaceCountCollision(space, info);
+#endif
+			
+			if(info->count == 0) continue;
+			
+			struct cpContact *contacts = cpContactBufferGetArray(space);
+			memcpy(contacts, scratch->contacts + hasty->pairs[i].contactIndex, info->count*sizeof(struct cpContact));
+			info->arr = contacts;
+			cpSpacePushContacts(space, info->count);
+			
+			cpSpaceProcessCollision(space, info);
+		}
+	}
+}
+
+static void
+CollidePairs(cpHastySpace *hasty)
+{
+	cpBool threaded = ((unsigned long)hasty->pairCount > hasty->pair_count_threshold);
+	unsigned long worker_count = (threaded ? cpThreadPoolGetThreads(hasty->pool) : 1);
+	
+	if((int)worker_count > hasty->contactScratchCount){
+		hasty->contactScratch = (struct cpContactScratch *)cprealloc(hasty->contactScratch, worker_count*sizeof(struct cpContactScratch));
+		memset(hasty->contactScratch + hasty->contactScratchCount, 0, (worker_count - hasty->contactScratchCount)*sizeof(struct cpContactScratch));
+		hasty->contactScratchCount = (int)worker_count;
+	}
+	
+	if(threaded){
+		RunWorkers(hasty, Narrowphase);
+	} else {
+		Narrowphase((cpSpace *)hasty, 0, 1);
+	}
+	
+	MergeCollisions(hasty, worker_count);
+}
+
+//MARK: Solver Coloring
+
+static inline cpBool
+SolverBodyCanMove(struct cpSolverBody *body)
+{
+	return (body->m_inv != 0.0f || body->i_inv != 0.0f);
+}
+
+// Returns the lowest color not used yet by either body, or CP_HASTY_MAX_COLORS if they are all used.
+// Bodies that can't move don't need to be synchronized and never use up colors.
+static int
+PickColor(cpHastySpace *hasty, int a, int b)
+{
+	struct cpSolverBody *solverBodies = hasty->space.solverBodies;
+	cpColorMask *bodyColors = hasty->bodyColors;
+	
+	cpBool moveA = SolverBodyCanMove(solverBodies + a);
+	cpBool moveB = SolverBodyCanMove(solverBodies + b);
+	cpColorMask used = (moveA ? bodyColors[a] : 0) | (moveB ? bodyColors[b] : 0);
+	
+	for(int color=0; color<CP_HASTY_MAX_COLORS; color++){
+		cpColorMask bit = (cpColorMask)1 << color;
 		
-		cpHastySpaceWorkFunction func = hasty->work;
-		if(func){
-			hasty->work(&hasty->space, thread, num_threads);
+		if(!(used & bit)){
+			if(moveA) bodyColors[a] |= bit;
+			if(moveB) bodyColors[b] |= bit;
+			return color;
+		}
+	}
+	
+	return CP_HASTY_MAX_COLORS;
+}
+
+// Islands are solved on their own by a single worker when they are small enough.
+// Large islands are split into colors that are shared by all of the workers.
+static int
+ItemIsland(cpHastySpace *hasty, int a, int b)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	struct cpSolverBody *solverBodies = space->solverBodies;
+	cpBody **owners = space->solverBodyOwners;
+	
+	// Items that don't touch any movable bodies can't conflict with anything, island 0 is as good as any.
+	int island = 0;
+	if(SolverBodyCanMove(solverBodies + a)){
+		island = owners[a]->island;
+	} else if(SolverBodyCanMove(solverBodies + b)){
+		island = owners[b]->island;
+	}
+	
+	cpAssertSoft(island == 0 || island < space->islandCount, "Internal Error: Solver item has no island.");
+	return island;
+}
+
+static inline struct cpSolverColor *
+GroupColor(cpHastySpace *hasty, int group, int color)
+{
+	return hasty->colors + group*(CP_HASTY_MAX_COLORS + 1) + color;
+}
+
+// Partition the arbiters and constraints into groups of islands, and the groups into colors.
+// No two items in a color share a body that can move, and items keep their relative order within a color.
+// An item's color only depends on the items before it in the same island,
+// so the order impulses are applied to a body never depends on the number of workers.
+static void
+BuildSolverGroups(cpHastySpace *hasty, unsigned long worker_count)
+{
+	cpSpace *space = (cpSpace *)hasty;
+	cpArray *arbiters = space->arbiters;
+	cpArray *constraints = space->constraints;
+	int arbiterCount = arbiters->num, constraintCount = constraints->num;
+	int itemCount = arbiterCount + constraintCount;
+	int islandCount = (space->islandCount > 0 ? space->islandCount : 1);
+	
+	hasty->bodyColors = (cpColorMask *)GrowArray(hasty->bodyColors, &hasty->bodyColorsCapacity, space->solverBodyCount, sizeof(cpColorMask));
+	hasty->itemColors = (int *)GrowArray(hasty->itemColors, &hasty->itemColorsCapacity, 2*itemCount, sizeof(int));
+	hasty->islandGroups = (int *)GrowArray(hasty->islandGroups, &hasty->islandGroupsCapacity, 2*islandCount, sizeof(int));
+	hasty->colorArbiters = (cpArbiter **)GrowArray(hasty->colorArbiters, &hasty->colorArbitersCapacity, arbiterCount, sizeof(cpArbiter *));
+	hasty->colorConstraints = (cpConstraint **)GrowArray(hasty->colorConstraints, &hasty->colorConstraintsCapacity, constraintCount, sizeof(cpConstraint *));
+	
+	memset(hasty->bodyColors, 0, space->solverBodyCount*sizeof(cpColorMask));
+	
+	// Find the color and island of each item.
+	int *itemColors = hasty->itemColors;
+	int *itemIslands = hasty->itemColors + itemCount;
+	int *islandSizes = hasty->islandGroups + islandCount;
+	memset(islandSizes, 0, islandCount*sizeof(int));
+	
+	for(int i=0; i<arbiterCount; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		itemColors[i] = PickColor(hasty, arb->solver_a, arb->solver_b);
+		islandSizes[itemIslands[i] = ItemIsland(hasty, arb->solver_a, arb->solver_b)]++;
+	}
+	
+	for(int i=0; i<constraintCount; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		itemColors[arbiterCount + i] = PickColor(hasty, constraint->solver_a, constraint->solver_b);
+		islandSizes[itemIslands[arbiterCount + i] = ItemIsland(hasty, constraint->solver_a, constraint->solver_b)]++;
+	}
+	
+	// Islands larger than an even share of the work are split between all of the workers.
+	// The rest are dealt out to the workers in contiguous runs of roughly equal size.
+	int *islandGroups = hasty->islandGroups;
+	int sharedCount = 0, smallItems = 0;
+	for(int i=0; i<islandCount; i++){
+		if(worker_count > 1 && (unsigned long)islandSizes[i]*worker_count > (unsigned long)itemCount){
+			islandGroups[i] = -1;
+			sharedCount++;
 		} else {
-			break;
+			islandGroups[i] = 0;
+			smallItems += islandSizes[i];
 		}
 	}
 	
-	return NULL;
+	hasty->groupCount = (int)worker_count + sharedCount;
+	hasty->groups = (struct cpSolverGroup *)GrowArray(hasty->groups, &hasty->groupsCapacity, hasty->groupCount, sizeof(struct cpSolverGroup));
+	hasty->colors = (struct cpSolverColor *)GrowArray(hasty->colors, &hasty->colorsCapacity, hasty->groupCount*(CP_HASTY_MAX_COLORS + 1), sizeof(struct cpSolverColor));
+	memset(hasty->colors, 0, hasty->groupCount*(CP_HASTY_MAX_COLORS + 1)*sizeof(struct cpSolverColor));
+	
+	for(int i=0, shared=(int)worker_count, smallStart=0; i<islandCount; i++){
+		if(islandGroups[i] < 0){
+			islandGroups[i] = shared;
+			hasty->groups[shared].worker = -1;
+			shared++;
+		} else {
+			islandGroups[i] = (int)((unsigned long)smallStart*worker_count/(smallItems > 0 ? smallItems : 1));
+			smallStart += islandSizes[i];
+		}
+	}
+	
+	for(int i=0; i<(int)worker_count; i++){
+		hasty->groups[i].worker = i;
+	}
+	
+	// Count the items in each group and color.
+	for(int i=0; i<hasty->groupCount; i++) hasty->groups[i].colorCount = 0;
+	
+	for(int i=0; i<itemCount; i++){
+		int group = islandGroups[itemIslands[i]], color = itemColors[i];
+		struct cpSolverGroup *solverGroup = hasty->groups + group;
+		if(color < CP_HASTY_MAX_COLORS && color >= solverGroup->colorCount) solverGroup->colorCount = color + 1;
+		
+		struct cpSolverColor *solverColor = GroupColor(hasty, group, color);
+		if(i < arbiterCount){
+			solverColor->arbiterCount++;
+		} else {
+			solverColor->constraintCount++;
+		}
+		
+		// Reuse the island slot to remember the item's group.
+		itemIslands[i] = group;
+	}
+	
+	// Lay the colors out contiguously, group by group, with each group's overflow items last.
+	int arbiterStart = 0, constraintStart = 0;
+	for(int i=0, count=hasty->groupCount*(CP_HASTY_MAX_COLORS + 1); i<count; i++){
+		struct cpSolverColor *color = hasty->colors + i;
+		color->arbiterStart = arbiterStart; arbiterStart += color->arbiterCount;
+		color->constraintStart = constraintStart; constraintStart += color->constraintCount;
+		color->arbiterCount = color->constraintCount = 0;
+	}
+	
+	for(int i=0; i<arbiterCount; i++){
+		struct cpSolverColor *color = GroupColor(hasty, itemIslands[i], itemColors[i]);
+		hasty->colorArbiters[color->arbiterStart + color->arbiterCount++] = (cpArbiter *)arbiters->arr[i];
+	}
+	
+	for(int i=0; i<constraintCount; i++){
+		struct cpSolverColor *color = GroupColor(hasty, itemIslands[arbiterCount + i], itemColors[arbiterCount + i]);
+		hasty->colorConstraints[color->constraintStart + color->constraintCount++] = (cpConstraint *)constraints->arr[i];
+	}
 }
 
+//MARK: Contact Bundles
+
+#if CP_HASTY_X86_SIMD
+
 static void
-RunWorkers(cpHastySpace *hasty, cpHastySpaceWorkFunction func)
+PreStepArbiters(cpHastySpace *hasty, cpArray *arbiters, cpFloat dt, cpFloat slop, cpFloat biasCoef)
 {
-	hasty->num_working = hasty->num_threads - 1;
-	hasty->work = func;
+	cpArbiter *arbs[CP_BUNDLE_WIDTH];
+	struct cpContact *contacts[CP_BUNDLE_WIDTH];
+	int count = 0;
 	
-	if(hasty->num_working > 0){
-		pthread_mutex_lock(&hasty->mutex); {
-			pthread_cond_broadcast(&hasty->cond_work);
-		} pthread_mutex_unlock(&hasty->mutex);
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		cpArbiterPreStepBlock(arb);
 		
-		func((cpSpace *)hasty, 0, hasty->num_threads);
+		for(int j=0; j<arb->count; j++){
+			arbs[count] = arb;
+			contacts[count] = arb->contacts + j;
 			
-		pthread_mutex_lock(&hasty->mutex); {
-			if(hasty->num_working > 0){
-				pthread_cond_wait(&hasty->cond_resume, &hasty->mutex);
+			if(++count == CP_BUNDLE_WIDTH){
+				hasty->preStepContacts(arbs, contacts, count, dt, slop, biasCoef);
+				count = 0;
 			}
-		} pthread_mutex_unlock(&hasty->mutex);
-	} else {
-		func((cpSpace *)hasty, 0, hasty->num_threads);
+		}
+	}
+	
+	if(count > 0) hasty->preStepContacts(arbs, contacts, count, dt, slop, biasCoef);
+}
+
+static struct cpContactBundle *
+PushContactBundle(cpHastySpace *hasty)
+{
+	if(hasty->bundleCount == hasty->bundleCapacity){
+		hasty->bundleCapacity = 3*(hasty->bundleCapacity + 1)/2;
+		hasty->bundles = (struct cpContactBundle *)cprealloc(hasty->bundles, hasty->bundleCapacity*sizeof(struct cpContactBundle));
 	}
 	
-	hasty->work = NULL;
+	// Unused lanes and contact slots are left zeroed. They read solver body 0, apply no impulse and are never written back.
+	struct cpContactBundle *bundle = hasty->bundles + hasty->bundleCount++;
+	memset(bundle, 0, sizeof(struct cpContactBundle));
+	
+	return bundle;
 }
 
+// Pack the arbiters of each color into bundles.
 static void
-Solver(cpSpace *space, unsigned long worker, unsigned long worker_count)
+BuildContactBundles(cpHastySpace *hasty)
 {
-	cpArray *constraints = space->constraints;
-	cpArray *arbiters = space->arbiters;
+	hasty->bundleCount = 0;
 	
-	cpFloat dt = space->curr_dt;
-	unsigned long iterations = (space->iterations + worker_count - 1)/worker_count;
-	
-	for(unsigned long i=0; i<iterations; i++){
-		for(int j=0; j<arbiters->num; j++){
-			cpArbiter *arb = (cpArbiter *)arbiters->arr[j];
-			#ifdef __ARM_NEON__
-				cpArbiterApplyImpulse_NEON(arb);
-			#else
-				cpArbiterApplyImpulse(arb);
-			#endif
+	for(int c=0, count=hasty->groupCount*(CP_HASTY_MAX_COLORS + 1); c<count; c++){
+		// The overflow colors are solved by the scalar solver.
+		if(c%(CP_HASTY_MAX_COLORS + 1) == CP_HASTY_MAX_COLORS) continue;
+		
+		struct cpSolverColor *color = hasty->colors + c;
+		color->bundleStart = hasty->bundleCount;
+		
+		for(int i=0; i<color->arbiterCount; i++){
+			cpArbiter *arb = hasty->colorArbiters[color->arbiterStart + i];
+			
+			struct cpContactBundle *bundle = (i%CP_BUNDLE_WIDTH == 0 ? PushContactBundle(hasty) : hasty->bundles + hasty->bundleCount - 1);
+			int l = bundle->count++;
+			
+			bundle->a[l] = arb->solver_a; bundle->b[l] = arb->solver_b;
+			bundle->nx[l] = arb->n.x; bundle->ny[l] = arb->n.y;
+			bundle->svrx[l] = arb->surface_vr.x; bundle->svry[l] = arb->surface_vr.y;
+			bundle->friction[l] = arb->u;
+			bundle->cached[l] = (arb->state == CP_ARBITER_STATE_FIRST_COLLISION ? 0.0f : 1.0f);
+			
+			if(arb->block.enabled){
+				bundle->blockCount++;
+				bundle->block[l] = 1.0f;
+				bundle->k11[l] = arb->block.k11; bundle->k12[l] = arb->block.k12; bundle->k22[l] = arb->block.k22;
+				bundle->m11[l] = arb->block.m11; bundle->m12[l] = arb->block.m12; bundle->m22[l] = arb->block.m22;
+			}
+			
+			if(arb->count > bundle->contactCount) bundle->contactCount = arb->count;
+			for(int k=0; k<arb->count; k++){
+				struct cpContact *con = arb->contacts + k;
+				struct cpContactLanes *slot = bundle->slots + k;
+				
+				slot->contacts[l] = con;
+				slot->r1x[l] = con->r1.x; slot->r1y[l] = con->r1.y;
+				slot->r2x[l] = con->r2.x; slot->r2y[l] = con->r2.y;
+				slot->nMass[l] = con->nMass; slot->tMass[l] = con->tMass;
+				slot->bias[l] = con->bias; slot->bounce[l] = con->bounce;
+				slot->jnAcc[l] = con->jnAcc; slot->jtAcc[l] = con->jtAcc; slot->jBias[l] = con->jBias;
+			}
 		}
+		
+		color->bundleCount = hasty->bundleCount - color->bundleStart;
+	}
+}
+
+// Copy the accumulated impulses back to the contacts so they can be cached for the next step.
+static void
+StoreContactBundles(cpHastySpace *hasty)
+{
+	for(int i=0; i<hasty->bundleCount; i++){
+		struct cpContactBundle *bundle = hasty->bundles + i;
+		
+		for(int k=0; k<bundle->contactCount; k++){
+			struct cpContactLanes *slot = bundle->slots + k;
 			
-		for(int j=0; j<constraints->num; j++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[j];
-			constraint->klass->applyImpulse(constraint, dt);
+			for(int l=0; l<bundle->count; l++){
+				struct cpContact *con = slot->contacts[l];
+				if(con == NULL) continue;
+				
+				con->jnAcc = slot->jnAcc[l];
+				con->jtAcc = slot->jtAcc[l];
+				con->jBias = slot->jBias[l];
+			}
 		}
 	}
 }
 
-//MARK: Thread Management Functions
+#endif
 
+//MARK: Solver
+
+// Solve each color of a group in parallel followed by a barrier.
+// Items in the same color never touch the same body, so the results don't depend on the number of workers.
+// Items that didn't fit in any color are solved by the first worker afterwards.
 static void
-HaltThreads(cpHastySpace *hasty)
+SolveColors(cpHastySpace *hasty, int group, cpBool cached, unsigned long worker, unsigned long worker_count)
 {
-	pthread_mutex_t *mutex = &hasty->mutex;
-	pthread_mutex_lock(mutex); {
-		hasty->work = NULL; // NULL work function means break and exit
-		pthread_cond_broadcast(&hasty->cond_work);
-	} pthread_mutex_unlock(mutex);
+	cpSpace *space = (cpSpace *)hasty;
+	struct cpSolverBody *solverBodies = space->solverBodies;
+	cpFloat dt = space->curr_dt;
+	cpFloat dt_coef = hasty->dt_coef;
+	int start, end;
 	
-	for(unsigned long i=0; i<(hasty->num_threads-1); i++){
-		pthread_join(hasty->workers[i].thread, NULL);
+	for(int c=0; c<hasty->groups[group].colorCount; c++){
+		struct cpSolverColor *color = GroupColor(hasty, group, c);
+		
+	#if CP_HASTY_X86_SIMD
+		if(hasty->vectorized){
+			WorkerRange(color->bundleCount, worker, worker_count, &start, &end);
+			struct cpContactBundle *bundles = hasty->bundles + color->bundleStart;
+			if(cached){
+				hasty->applyCachedBundles(bundles + start, end - start, solverBodies, dt_coef);
+			} else {
+				hasty->applyBundles(bundles + start, end - start, solverBodies);
+			}
+		} else
+	#endif
+		{
+			WorkerRange(color->arbiterCount, worker, worker_count, &start, &end);
+			cpArbiter **arbs = hasty->colorArbiters + color->arbiterStart;
+			for(int i=start; i<end; i++){
+				if(cached){
+					cpArbiterApplyCachedImpulse(arbs[i], solverBodies, dt_coef);
+				} else {
+					#ifdef __ARM_NEON__
+						// The NEON version doesn't have a block solver.
+						if(arbs[i]->block.enabled || !hasty->vectorized){
+							cpArbiterApplyImpulse(arbs[i], solverBodies);
+						} else {
+							cpArbiterApplyImpulse_NEON(arbs[i], solverBodies);
+						}
+					#else
+						cpArbiterApplyImpulse(arbs[i], solverBodies);
+					#endif
+				}
+			}
+		}
+		
+		WorkerRange(color->constraintCount, worker, worker_count, &start, &end);
+		cpConstraint **constraints = hasty->colorConstraints + color->constraintStart;
+		for(int i=start; i<end; i++){
+			cpConstraint *constraint = constraints[i];
+			
+			if(cached){
+				cpConstraintApplyCachedImpulse(constraint, dt_coef);
+			} else {
+				cpConstraintApplyImpulse(constraint, dt);
+			}
+		}
+		
+		Barrier(hasty, worker_count);
 	}
+	
+	struct cpSolverColor *overflow = GroupColor(hasty, group, CP_HASTY_MAX_COLORS);
+	if(overflow->arbiterCount + overflow->constraintCount > 0){
+		if(worker == 0){
+			for(int i=0; i<overflow->arbiterCount; i++){
+				cpArbiter *arb = hasty->colorArbiters[overflow->arbiterStart + i];
+				
+				if(cached){
+					cpArbiterApplyCachedImpulse(arb, solverBodies, dt_coef);
+				} else {
+					cpArbiterApplyImpulse(arb, solverBodies);
+				}
+			}
+			
+			for(int i=0; i<overflow->constraintCount; i++){
+				cpConstraint *constraint = hasty->colorConstraints[overflow->constraintStart + i];
+				
+				if(cached){
+					cpConstraintApplyCachedImpulse(constraint, dt_coef);
+				} else {
+					cpConstraintApplyImpulse(constraint, dt);
+				}
+			}
+		}
+		
+		Barrier(hasty, worker_count);
+	}
+}
+
+static void
+SolveGroup(cpHastySpace *hasty, int group, cpBool cached, cpBool iterate, unsigned long worker, unsigned long worker_count)
+{
+	if(cached) SolveColors(hasty, group, cpTrue, worker, worker_count);
+	
+	if(iterate){
+		for(int i=0; i<hasty->space.iterations; i++){
+			SolveColors(hasty, group, cpFalse, worker, worker_count);
+		}
+	}
+}
+
+// Solve one pass over all of the groups.
+static inline void
+SolveGroupColors(cpHastySpace *hasty, cpBool cached, unsigned long worker, unsigned long worker_count)
+{
+	SolveColors(hasty, (int)worker, cached, 0, 1);
+	for(int i=(int)worker_count; i<hasty->groupCount; i++) SolveColors(hasty, i, cached, worker, worker_count);
 }
 
+static inline void
+SolveGroups(cpHastySpace *hasty, cpBool cached, cpBool iterate, unsigned long worker, unsigned long worker_count)
+{
+	cpArray *networks = hasty->space.springNetworks;
+	
+	if(iterate && networks->num > 0){
+		// Spring networks aren't split into the groups and can connect bodies in any of them,
+		// so the groups are iterated in lockstep with the first worker solving the networks after each pass.
+		if(cached) SolveGroupColors(hasty, cpTrue, worker, worker_count);
+		
+		for(int i=0; i<hasty->space.iterations; i++){
+			SolveGroupColors(hasty, cpFalse, worker, worker_count);
+			Barrier(hasty, worker_count);
+			
+			if(worker == 0){
+				for(int j=0; j<networks->num; j++) cpSpringNetworkApplyImpulse((cpSpringNetwork *)networks->arr[j], hasty->space.solverBodies);
+			}
+			
+			Barrier(hasty, worker_count);
+		}
+	} else {
+		// Each worker first solves its own islands without synchronizing with the others.
+		SolveGroup(hasty, (int)worker, cached, iterate, 0, 1);
+		
+		// Then the large islands are solved together.
+		for(int i=(int)worker_count; i<hasty->groupCount; i++){
+			SolveGroup(hasty, i, cached, iterate, worker, worker_count);
+		}
+	}
+}
+
+static void
+Solver(cpSpace *space, unsigned long worker, unsigned long worker_count)
+{
+	SolveGroups((cpHastySpace *)space, cpTrue, cpTrue, worker, worker_count);
+}
+
+// The groups never share a movable body, so applying all of the cached impulses first doesn't change the results.
+// Splitting the solver like this costs an extra dispatch, so it's only done to time the two halves when profiling.
+static void
+WarmStartSolver(cpSpace *space, unsigned long worker, unsigned long worker_count)
+{
+	SolveGroups((cpHastySpace *)space, cpTrue, cpFalse, worker, worker_count);
+}
+
+static void
+IterateSolver(cpSpace *space, unsigned long worker, unsigned long worker_count)
+{
+	SolveGroups((cpHastySpace *)space, cpFalse, cpTrue, worker, worker_count);
+}
+
+static void
+RunSolver(cpHastySpace *hasty, cpHastySpaceWorkFunction func, cpBool threaded)
+{
+	if(threaded){
+		RunWorkers(hasty, func);
+	} else {
+		func((cpSpace *)hasty, 0, 1);
+	}
+}
+
+//MARK: Thread Management Functions
+
 void
 cpHastySpaceSetThreads(cpSpace *space, unsigned long threads)
 {
@@ -520,39 +1236,41 @@ cpHastySpaceSetThreads(cpSpace *space, unsigned long threads)
 #endif	
 	
 	cpHastySpace *hasty = (cpHastySpace *)space;
-	HaltThreads(hasty);
-	
-#ifdef __APPLE__
-	if(threads == 0){
-		size_t size = sizeof(threads);
-		sysctlbyname("hw.ncpu", &threads, &size, NULL, 0);
-	}
-#else
-	if(threads == 0) threads = 1;
-#endif
+	if(threads == 0) threads = cpThreadPoolDetectThreads();
 	
-	hasty->num_threads = (threads < MAX_THREADS ? threads : MAX_THREADS);
-	hasty->num_working = hasty->num_threads - 1;
+	cpThreadPoolFree(hasty->pool);
+	hasty->pool = cpThreadPoolNew(threads, hasty->pinned);
+}
+
+unsigned long
+cpHastySpaceGetThreads(cpSpace *space)
+{
+	return cpThreadPoolGetThreads(((cpHastySpace *)space)->pool);
+}
+
+void
+cpHastySpaceSetThreadAffinity(cpSpace *space, cpBool pinned)
+{
+	cpHastySpace *hasty = (cpHastySpace *)space;
 	
-	// Create the worker threads and wait for them to signal ready.
-	if(hasty->num_working > 0){
-		pthread_mutex_lock(&hasty->mutex);
-		for(unsigned long i=0; i<(hasty->num_threads-1); i++){
-			hasty->workers[i].space = hasty;
-			hasty->workers[i].thread_num = i + 1;
-			
-			pthread_create(&hasty->workers[i].thread, NULL, (void*(*)(void*))WorkerThreadLoop, &hasty->workers[i]);
-		}
+	if(hasty->pinned != pinned){
+		hasty->pinned = pinned;
 		
-		pthread_cond_wait(&hasty->cond_resume, &hasty->mutex);
-		pthread_mutex_unlock(&hasty->mutex);
+		// Restart the threads so they pick up the new affinity.
+		cpHastySpaceSetThreads(space, cpHastySpaceGetThreads(space));
 	}
 }
 
-unsigned long
-cpHastySpaceGetThreads(cpSpace *space)
+void
+cpHastySpaceSetVectorized(cpSpace *space, cpBool vectorized)
+{
+	((cpHastySpace *)space)->vectorized = vectorized;
+}
+
+cpBool
+cpHastySpaceGetVectorized(cpSpace *space)
 {
-	return ((cpHastySpace *)space)->num_threads;
+	return ((cpHastySpace *)space)->vectorized;
 }
 
 //MARK: Overriden cpSpace Functions.
@@ -563,16 +1281,31 @@ cpHastySpaceNew(void)
 	cpHastySpace *hasty = (cpHastySpace *)cpcalloc(1, sizeof(cpHastySpace));
 	cpSpaceInit((cpSpace *)hasty);
 	
-	pthread_mutex_init(&hasty->mutex, NULL);
-	pthread_cond_init(&hasty->cond_work, NULL);
-	pthread_cond_init(&hasty->cond_resume, NULL);
+	// Keep the awake components of the contact graph around to use as the solver's work units.
+	hasty->space.generateIslands = cpTrue;
 	
 	// TODO magic number, should test this more thoroughly.
 	hasty->constraint_count_threshold = 50;
+	hasty->pair_count_threshold = 50;
+	hasty->shape_count_threshold = 500;
 	
-	// Default to 1 thread for determinism.
-	hasty->num_threads = 1;
+	hasty->vectorized = cpTrue;
+	
+	// Default to 1 thread.
 	cpHastySpaceSetThreads((cpSpace *)hasty, 1);
+	
+#if CP_HASTY_X86_SIMD
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+		hasty->preStepContacts = PreStepContacts_AVX2;
+		hasty->applyCachedBundles = ApplyCachedBundles_AVX2;
+		hasty->applyBundles = ApplyBundles_AVX2;
+	} else {
+		hasty->preStepContacts = PreStepContacts_SSE2;
+		hasty->applyCachedBundles = ApplyCachedBundles_SSE2;
+		hasty->applyBundles = ApplyBundles_SSE2;
+	}
+#endif
 
 	return (cpSpace *)hasty;
 }
@@ -582,11 +1315,24 @@ cpHastySpaceFree(cpSpace *space)
 {
 	cpHastySpace *hasty = (cpHastySpace *)space;
 	
-	HaltThreads(hasty);
+	cpThreadPoolFree(hasty->pool);
+	
+	cpfree(hasty->colorArbiters);
+	cpfree(hasty->colorConstraints);
+	cpfree(hasty->bodyColors);
+	cpfree(hasty->itemColors);
+	cpfree(hasty->islandGroups);
+	cpfree(hasty->groups);
+	cpfree(hasty->colors);
+	
+	for(int i=0; i<hasty->contactScratchCount; i++) cpfree(hasty->contactScratch[i].contacts);
+	cpfree(hasty->contactScratch);
+	cpfree(hasty->pairs);
+	cpfree(hasty->prevPairs);
 	
-	pthread_mutex_destroy(&hasty->mutex);
-	pthread_cond_destroy(&hasty->cond_work);
-	pthread_cond_destroy(&hasty->cond_resume);
+#if CP_HASTY_X86_SIMD
+	cpfree(hasty->bundles);
+#endif
 	
 	cpSpaceFree(space);
 }
@@ -597,15 +1343,31 @@ cpHastySpaceStep(cpSpace *space, cpFloat dt)
 	// don't step if the timestep is 0!
 	if(dt == 0.0f) return;
 	
+	cpSpaceProfileReset(space);
+	cpSpaceStepProfile *profile = &space->stepProfile;
+	cpProfileTimer stepTimer = cpSpaceProfileStart(space), timer;
+	
+	cpHastySpace *hasty = (cpHastySpace *)space;
 	space->stamp++;
 	
 	cpFloat prev_dt = space->curr_dt;
 	space->curr_dt = dt;
+	
+	// The threaded solver always runs all of the iterations.
+	// The vectorized contact solver doesn't measure the impulses it applies, and the shared groups would need to agree on when to stop.
+	if(space->iterationTolerance > 0.0f && !hasty->warnedIterationTolerance){
+		cpAssertWarn(cpFalse, "Ignoring the iteration tolerance, cpHastySpace always runs all of the iterations.");
+		hasty->warnedIterationTolerance = cpTrue;
+	}
+	space->solverIslandCount = 0;
 		
 	cpArray *bodies = space->dynamicBodies;
 	cpArray *constraints = space->constraints;
 	cpArray *arbiters = space->arbiters;
 	
+	// Speculative contacts need to cover the movement until collision detection runs again.
+	cpFloat sweep = space->speculativeTime = (space->speculativeContacts ? dt : 0.0f);
+	
 	// Reset and empty the arbiter list.
 	for(int i=0; i<arbiters->num; i++){
 		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
@@ -620,81 +1382,133 @@ cpHastySpaceStep(cpSpace *space, cpFloat dt)
 	
 	cpSpaceLock(space); {
 		// Integrate positions
-		for(int i=0; i<bodies->num; i++){
-			cpBody *body = (cpBody *)bodies->arr[i];
-			body->position_func(body, dt);
-		}
+		timer = cpSpaceProfileStart(space);
+		cpSpaceBeginBullets(space);
+		cpBodyIntegratePositions((cpBody **)bodies->arr, bodies->num, dt);
+		cpSpaceProfileStop(space, &profile->integratePositions, timer);
 		
 		// Find colliding pairs.
+		timer = cpSpaceProfileStart(space);
 		cpSpacePushFreshContactBuffer(space);
-		cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)cpShapeUpdateFunc, NULL);
-		cpSpatialIndexReindexQuery(space->dynamicShapes, (cpSpatialIndexQueryFunc)cpSpaceCollideShapes, space);
+		cpShapeCacheBBsForBodies((cpBody **)bodies->arr, bodies->num);
+		cpSpaceProfileStop(space, &profile->updateBBs, timer);
+		
+		// Stop the bullets before they pass through anything.
+		timer = cpSpaceProfileStart(space);
+		cpSpaceSweepBullets(space, cpFalse);
+		cpSpaceProfileStop(space, &profile->bullets, timer);
+		
+		timer = cpSpaceProfileStart(space);
+		if(sweep > 0.0f) cpShapeSweepBBsForBodies((cpBody **)bodies->arr, bodies->num, sweep);
+		cpSpaceProfileStop(space, &profile->updateBBs, timer);
+		
+		timer = cpSpaceProfileStart(space);
+		QueueCollisionPairs(hasty);
+		cpSpaceProfileStop(space, &profile->broadphase, timer);
+		
+		timer = cpSpaceProfileStart(space);
+		CollidePairs(hasty);
+		cpSpaceProfileStop(space, &profile->narrowphase, timer);
 	} cpSpaceUnlock(space, cpFalse);
 	
 	// Rebuild the contact graph (and detect sleeping components if sleeping is enabled)
+	timer = cpSpaceProfileStart(space);
 	cpSpaceProcessComponents(space, dt);
+	cpSpaceProfileStop(space, &profile->processComponents, timer);
 	
 	cpSpaceLock(space); {
 		// Clear out old cached arbiters and call separate callbacks
+		timer = cpSpaceProfileStart(space);
 		cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc)cpSpaceArbiterSetFilter, space);
+		cpSpaceProfileStop(space, &profile->filterArbiters, timer);
+		
+		// Shrink the swept bounding boxes back down to fit the shapes.
+		if(sweep > 0.0f){
+			timer = cpSpaceProfileStart(space);
+			cpShapeCacheBBsForBodies((cpBody **)bodies->arr, bodies->num);
+			cpSpaceProfileStop(space, &profile->updateBBs, timer);
+		}
 
 		// Prestep the arbiters and constraints.
+		timer = cpSpaceProfileStart(space);
 		cpFloat slop = space->collisionSlop;
-		cpFloat biasCoef = 1.0f - cpfpow(space->collisionBias, dt);
-		for(int i=0; i<arbiters->num; i++){
-			cpArbiterPreStep((cpArbiter *)arbiters->arr[i], dt, slop, biasCoef);
+		cpFloat biasCoef = cpSpaceContactBiasCoef(space, dt);
+	#if CP_HASTY_X86_SIMD
+		if(hasty->vectorized){
+			PreStepArbiters(hasty, arbiters, dt, slop, biasCoef);
+		} else
+	#endif
+		{
+			for(int i=0; i<arbiters->num; i++){
+				cpArbiterPreStep((cpArbiter *)arbiters->arr[i], dt, slop, biasCoef);
+			}
 		}
 
+		// Run all of the pre-solve callbacks first since they might change the constraints, the same as cpSpaceStep().
+		for(int i=0; i<constraints->num; i++){
+			cpSpaceRunConstraintPreSolve(space, (cpConstraint *)constraints->arr[i]);
+		}
+		
 		for(int i=0; i<constraints->num; i++){
 			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			
-			cpConstraintPreSolveFunc preSolve = constraint->preSolve;
-			if(preSolve) preSolve(constraint, space);
-			
 			constraint->klass->preStep(constraint, dt);
 		}
+		
+		cpArray *networks = space->springNetworks;
+		for(int i=0; i<networks->num; i++) cpSpringNetworkPreStep((cpSpringNetwork *)networks->arr[i], dt);
+		cpSpaceProfileStop(space, &profile->preStep, timer);
 	
 		// Integrate velocities.
+		timer = cpSpaceProfileStart(space);
 		cpFloat damping = cpfpow(space->damping, dt);
 		cpVect gravity = space->gravity;
-		for(int i=0; i<bodies->num; i++){
-			cpBody *body = (cpBody *)bodies->arr[i];
-			body->velocity_func(body, gravity, damping, dt);
-		}
+		cpBodyIntegrateVelocities((cpBody **)bodies->arr, bodies->num, gravity, damping, dt);
+		cpSpaceProfileStop(space, &profile->integrateVelocities, timer);
 		
-		// Apply cached impulses
-		cpFloat dt_coef = (prev_dt == 0.0f ? 0.0f : dt/prev_dt);
-		for(int i=0; i<arbiters->num; i++){
-			cpArbiterApplyCachedImpulse((cpArbiter *)arbiters->arr[i], dt_coef);
-		}
+		// Copy the velocities into the packed solver bodies.
+		timer = cpSpaceProfileStart(space);
+		cpSpaceGatherSolverBodies(space);
 		
-		for(int i=0; i<constraints->num; i++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			constraint->klass->applyCachedImpulse(constraint, dt_coef);
-		}
+		// Partition the solver work into islands and colors that can be solved in parallel.
+		cpBool threaded = ((unsigned long)(arbiters->num + constraints->num) > hasty->constraint_count_threshold);
+		BuildSolverGroups(hasty, threaded ? cpThreadPoolGetThreads(hasty->pool) : 1);
+	#if CP_HASTY_X86_SIMD
+		if(hasty->vectorized) BuildContactBundles(hasty);
+	#endif
+		cpSpaceProfileStop(space, &profile->preStep, timer);
 		
-		// Run the impulse solver.
-		cpHastySpace *hasty = (cpHastySpace *)space;
-		if((unsigned long)(arbiters->num + constraints->num) > hasty->constraint_count_threshold){
-			RunWorkers(hasty, Solver);
+		// Apply cached impulses and run the impulse solver.
+		hasty->dt_coef = (prev_dt == 0.0f ? 0.0f : dt/prev_dt);
+		if(space->profilingEnabled){
+			timer = cpSpaceProfileStart(space);
+			RunSolver(hasty, WarmStartSolver, threaded);
+			cpSpaceProfileStop(space, &profile->warmStart, timer);
+			
+			timer = cpSpaceProfileStart(space);
+			RunSolver(hasty, IterateSolver, threaded);
 		} else {
-			Solver(space, 0, 1);
+			RunSolver(hasty, Solver, threaded);
 		}
 		
-		// Run the constraint post-solve callbacks
-		for(int i=0; i<constraints->num; i++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			
-			cpConstraintPostSolveFunc postSolve = constraint->postSolve;
-			if(postSolve) postSolve(constraint, space);
-		}
+	#if CP_HASTY_X86_SIMD
+		if(hasty->vectorized) StoreContactBundles(hasty);
+	#endif
 		
-		// run the post-solve callbacks
-		for(int i=0; i<arbiters->num; i++){
-			cpArbiter *arb = (cpArbiter *) arbiters->arr[i];
-			
-			cpCollisionHandler *handler = arb->handler;
-			handler->postSolveFunc(arb, space, handler->userData);
-		}
+		// Write the solved velocities back to the bodies.
+		cpSpaceScatterSolverBodies(space);
+		cpSpaceProfileStop(space, &profile->solve, timer);
+		
+		cpSpaceRunPostSolveCallbacks(space);
+		timer = cpSpaceProfileStart(space);
 	} cpSpaceUnlock(space, cpTrue);
+	
+	// Post-step callbacks run when the space is unlocked.
+	cpSpaceProfileStop(space, &profile->callbacks, timer);
+	cpSpaceProfileStopTotal(space, stepTimer);
+}
+
+int
+cpHastySpaceAdvance(cpSpace *space, cpFloat frameTime)
+{
+	return cpSpaceAdvanceWithStepFunc(space, frameTime, cpHastySpaceStep);
 }
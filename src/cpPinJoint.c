@@ -39,39 +39,44 @@ preStep(cpPinJoint *joint, cpFloat dt)
 	
 	// calculate bias velocity
 	cpFloat maxBias = joint->constraint.maxBias;
-	joint->bias = cpfclamp(-bias_coef(joint->constraint.errorBias, dt)*(dist - joint->dist)/dt, -maxBias, maxBias);
+	if(cpConstraintUpdateSoftness(&joint->constraint, dt)){
+		joint->bias = cpfclamp(-joint->constraint.soft.biasRate*(dist - joint->dist), -maxBias, maxBias);
+	} else {
+		joint->bias = cpfclamp(-bias_coef(joint->constraint.errorBias, dt)*(dist - joint->dist)/dt, -maxBias, maxBias);
+	}
 }
 
 static void
 applyCachedImpulse(cpPinJoint *joint, cpFloat dt_coef)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	cpVect j = cpvmult(joint->n, joint->jnAcc*dt_coef);
-	apply_impulses(a, b, joint->r1, joint->r2, j);
+	solver_apply_impulses(a, b, joint->r1, joint->r2, j);
 }
 
 static void
 applyImpulse(cpPinJoint *joint, cpFloat dt)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	cpVect n = joint->n;
 
 	// compute relative velocity
-	cpFloat vrn = normal_relative_velocity(a, b, joint->r1, joint->r2, n);
+	cpFloat vrn = solver_normal_relative_velocity(a, b, joint->r1, joint->r2, n);
 	
 	cpFloat jnMax = joint->constraint.maxForce*dt;
 	
 	// compute normal impulse
-	cpFloat jn = (joint->bias - vrn)*joint->nMass;
+	struct cpSoftness soft = joint->constraint.soft;
 	cpFloat jnOld = joint->jnAcc;
+	cpFloat jn = soft.massScale*(joint->bias - vrn)*joint->nMass - soft.impulseScale*jnOld;
 	joint->jnAcc = cpfclamp(jnOld + jn, -jnMax, jnMax);
 	jn = joint->jnAcc - jnOld;
 	
 	// apply impulse
-	apply_impulses(a, b, joint->r1, joint->r2, cpvmult(n, jn));
+	solver_apply_impulses(a, b, joint->r1, joint->r2, cpvmult(n, jn));
 }
 
 static cpFloat
@@ -85,6 +90,7 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
 
@@ -35,38 +35,45 @@ preStep(cpPivotJoint *joint, cpFloat dt)
 	
 	// calculate bias velocity
 	cpVect delta = cpvsub(cpvadd(b->p, joint->r2), cpvadd(a->p, joint->r1));
-	joint->bias = cpvclamp(cpvmult(delta, -bias_coef(joint->constraint.errorBias, dt)/dt), joint->constraint.maxBias);
+	if(cpConstraintUpdateSoftness(&joint->constraint, dt)){
+		joint->bias = cpvclamp(cpvmult(delta, -joint->constraint.soft.biasRate), joint->constraint.maxBias);
+	} else {
+		joint->bias = cpvclamp(cpvmult(delta, -bias_coef(joint->constraint.errorBias, dt)/dt), joint->constraint.maxBias);
+	}
 }
 
 static void
 applyCachedImpulse(cpPivotJoint *joint, cpFloat dt_coef)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
-	apply_impulses(a, b, joint->r1, joint->r2, cpvmult(joint->jAcc, dt_coef));
+	solver_apply_impulses(a, b, joint->r1, joint->r2, cpvmult(joint->jAcc, dt_coef));
 }
 
-static void
-applyImpulse(cpPivotJoint *joint, cpFloat dt)
+// Shared by applyImpulse() and the batched solver. Returns the new accumulated impulse.
+static inline cpVect
+SolvePivot(struct cpSolverBody *a, struct cpSolverBody *b, cpVect r1, cpVect r2, cpMat2x2 k, cpVect bias, cpVect jAcc, cpFloat jMax, struct cpSoftness soft)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
-	
-	cpVect r1 = joint->r1;
-	cpVect r2 = joint->r2;
-		
 	// compute relative velocity
-	cpVect vr = relative_velocity(a, b, r1, r2);
+	cpVect vr = solver_relative_velocity(a, b, r1, r2);
 	
 	// compute normal impulse
-	cpVect j = cpMat2x2Transform(joint->k, cpvsub(joint->bias, vr));
-	cpVect jOld = joint->jAcc;
-	joint->jAcc = cpvclamp(cpvadd(joint->jAcc, j), joint->constraint.maxForce*dt);
-	j = cpvsub(joint->jAcc, jOld);
+	cpVect j = cpvsub(cpvmult(cpMat2x2Transform(k, cpvsub(bias, vr)), soft.massScale), cpvmult(jAcc, soft.impulseScale));
+	cpVect jNew = cpvclamp(cpvadd(jAcc, j), jMax);
 	
 	// apply impulse
-	apply_impulses(a, b, joint->r1, joint->r2, j);
+	solver_apply_impulses(a, b, r1, r2, cpvsub(jNew, jAcc));
+	return jNew;
+}
+
+static void
+applyImpulse(cpPivotJoint *joint, cpFloat dt)
+{
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
+	
+	joint->jAcc = SolvePivot(a, b, joint->r1, joint->r2, joint->k, joint->bias, joint->jAcc, joint->constraint.maxForce*dt, joint->constraint.soft);
 }
 
 static cpFloat
@@ -80,8 +87,62 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
+//MARK: Batched Solver
+
+void
+cpPivotJointPreStepBatch(cpConstraint **joints, int count, cpFloat dt)
+{
+	for(int i=0; i<count; i++) preStep((cpPivotJoint *)joints[i], dt);
+}
+
+void
+cpPivotJointLoadRows(cpConstraint **joints, int count, struct cpPivotJointRow *rows, cpFloat dt)
+{
+	for(int i=0; i<count; i++){
+		cpPivotJoint *joint = (cpPivotJoint *)joints[i];
+		struct cpPivotJointRow *row = rows + i;
+		
+		row->a = joint->constraint.solver_a;
+		row->b = joint->constraint.solver_b;
+		row->r1 = joint->r1;
+		row->r2 = joint->r2;
+		row->k = joint->k;
+		row->bias = joint->bias;
+		row->jAcc = joint->jAcc;
+		row->jMax = joint->constraint.maxForce*dt;
+		row->massScale = joint->constraint.soft.massScale;
+		row->impulseScale = joint->constraint.soft.impulseScale;
+	}
+}
+
+void
+cpPivotJointApplyCachedImpulseRows(struct cpPivotJointRow *rows, int count, struct cpSolverBody *bodies, cpFloat dt_coef)
+{
+	for(int i=0; i<count; i++){
+		struct cpPivotJointRow *row = rows + i;
+		solver_apply_impulses(bodies + row->a, bodies + row->b, row->r1, row->r2, cpvmult(row->jAcc, dt_coef));
+	}
+}
+
+void
+cpPivotJointApplyImpulseRows(struct cpPivotJointRow *rows, int count, struct cpSolverBody *bodies)
+{
+	for(int i=0; i<count; i++){
+		struct cpPivotJointRow *row = rows + i;
+		struct cpSoftness soft = {0.0f, row->massScale, row->impulseScale};
+		row->jAcc = SolvePivot(bodies + row->a, bodies + row->b, row->r1, row->r2, row->k, row->bias, row->jAcc, row->jMax, soft);
+	}
+}
+
+void
+cpPivotJointStoreRows(cpConstraint **joints, int count, struct cpPivotJointRow *rows)
+{
+	for(int i=0; i<count; i++) ((cpPivotJoint *)joints[i])->jAcc = rows[i].jAcc;
+}
+
 cpPivotJoint *
 cpPivotJointAlloc(void)
 {
@@ -36,7 +36,7 @@ cpPolyShapeDestroy(cpPolyShape *poly)
 	}
 }
 
-static cpBB
+cpBB
 cpPolyShapeCacheData(cpPolyShape *poly, cpTransform transform)
 {
 	int count = poly->count;
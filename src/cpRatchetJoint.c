@@ -55,8 +55,8 @@ preStep(cpRatchetJoint *joint, cpFloat dt)
 static void
 applyCachedImpulse(cpRatchetJoint *joint, cpFloat dt_coef)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	cpFloat j = joint->jAcc*dt_coef;
 	a->w -= j*a->i_inv;
@@ -68,8 +68,8 @@ applyImpulse(cpRatchetJoint *joint, cpFloat dt)
 {
 	if(!joint->bias) return; // early exit
 
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	// compute relative rotational velocity
 	cpFloat wr = b->w - a->w;
@@ -99,6 +99,7 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
 cpRatchetJoint *
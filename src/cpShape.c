@@ -35,6 +35,7 @@ cpShapeInit(cpShape *shape, const cpShapeClass *klass, cpBody *body, struct cpSh
 	
 	shape->body = body;
 	shape->massInfo = massInfo;
+	shape->extent = 0.0f;
 	
 	shape->sensor = 0;
 	
@@ -219,6 +220,43 @@ cpShapeUpdate(cpShape *shape, cpTransform transform)
 	return (shape->bb = shape->klass->cacheData(shape, transform));
 }
 
+static cpBB cpCircleShapeCacheData(cpCircleShape *circle, cpTransform transform);
+static cpBB cpSegmentShapeCacheData(cpSegmentShape *seg, cpTransform transform);
+
+void
+cpShapeCacheBBsForBodies(cpBody **bodies, int count)
+{
+	for(int i=0; i<count; i++){
+		cpBody *body = bodies[i];
+		cpTransform transform = body->transform;
+		
+		CP_BODY_FOREACH_SHAPE(body, shape){
+			// Call the built in types directly instead of through their classes.
+			switch(shape->klass->type){
+				case CP_CIRCLE_SHAPE: shape->bb = cpCircleShapeCacheData((cpCircleShape *)shape, transform); break;
+				case CP_SEGMENT_SHAPE: shape->bb = cpSegmentShapeCacheData((cpSegmentShape *)shape, transform); break;
+				case CP_POLY_SHAPE: cpPolyShapeCacheData((cpPolyShape *)shape, transform); break;
+				default: cpShapeUpdate(shape, transform); break;
+			}
+		}
+	}
+}
+
+void
+cpShapeSweepBBsForBodies(cpBody **bodies, int count, cpFloat dt)
+{
+	for(int i=0; i<count; i++){
+		cpBody *body = bodies[i];
+		cpVect d = cpvmult(body->v, dt);
+		
+		CP_BODY_FOREACH_SHAPE(body, shape){
+			cpBB bb = shape->bb;
+			shape->extent = 0.5f*((bb.r - bb.l) + (bb.t - bb.b));
+			shape->bb = cpBBNew(bb.l + cpfmin(d.x, 0.0f), bb.b + cpfmin(d.y, 0.0f), bb.r + cpfmax(d.x, 0.0f), bb.t + cpfmax(d.y, 0.0f));
+		}
+	}
+}
+
 cpFloat
 cpShapePointQuery(const cpShape *shape, cpVect p, cpPointQueryInfo *info)
 {
@@ -260,7 +298,7 @@ cpContactPointSet
 cpShapesCollide(const cpShape *a, const cpShape *b)
 {
 	struct cpContact contacts[CP_MAX_CONTACTS_PER_ARBITER];
-	struct cpCollisionInfo info = cpCollide(a, b, 0, contacts);
+	struct cpCollisionInfo info = cpCollide(a, b, 0, 0.0f, contacts);
 	
 	cpContactPointSet set;
 	set.count = info.count;
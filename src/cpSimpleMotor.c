@@ -34,8 +34,8 @@ preStep(cpSimpleMotor *joint, cpFloat dt)
 static void
 applyCachedImpulse(cpSimpleMotor *joint, cpFloat dt_coef)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	cpFloat j = joint->jAcc*dt_coef;
 	a->w -= j*a->i_inv;
@@ -45,8 +45,8 @@ applyCachedImpulse(cpSimpleMotor *joint, cpFloat dt_coef)
 static void
 applyImpulse(cpSimpleMotor *joint, cpFloat dt)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	// compute relative rotational velocity
 	cpFloat wr = b->w - a->w + joint->rate;
@@ -75,6 +75,7 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
 cpSimpleMotor *
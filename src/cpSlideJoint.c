@@ -49,17 +49,21 @@ preStep(cpSlideJoint *joint, cpFloat dt)
 	
 	// calculate bias velocity
 	cpFloat maxBias = joint->constraint.maxBias;
-	joint->bias = cpfclamp(-bias_coef(joint->constraint.errorBias, dt)*pdist/dt, -maxBias, maxBias);
+	if(cpConstraintUpdateSoftness(&joint->constraint, dt)){
+		joint->bias = cpfclamp(-joint->constraint.soft.biasRate*pdist, -maxBias, maxBias);
+	} else {
+		joint->bias = cpfclamp(-bias_coef(joint->constraint.errorBias, dt)*pdist/dt, -maxBias, maxBias);
+	}
 }
 
 static void
 applyCachedImpulse(cpSlideJoint *joint, cpFloat dt_coef)
 {
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	cpVect j = cpvmult(joint->n, joint->jnAcc*dt_coef);
-	apply_impulses(a, b, joint->r1, joint->r2, j);
+	solver_apply_impulses(a, b, joint->r1, joint->r2, j);
 }
 
 static void
@@ -67,25 +71,26 @@ applyImpulse(cpSlideJoint *joint, cpFloat dt)
 {
 	if(cpveql(joint->n, cpvzero)) return;  // early exit
 
-	cpBody *a = joint->constraint.a;
-	cpBody *b = joint->constraint.b;
+	struct cpSolverBody *a = cpConstraintSolverBodyA(&joint->constraint);
+	struct cpSolverBody *b = cpConstraintSolverBodyB(&joint->constraint);
 	
 	cpVect n = joint->n;
 	cpVect r1 = joint->r1;
 	cpVect r2 = joint->r2;
 		
 	// compute relative velocity
-	cpVect vr = relative_velocity(a, b, r1, r2);
+	cpVect vr = solver_relative_velocity(a, b, r1, r2);
 	cpFloat vrn = cpvdot(vr, n);
 	
 	// compute normal impulse
-	cpFloat jn = (joint->bias - vrn)*joint->nMass;
+	struct cpSoftness soft = joint->constraint.soft;
 	cpFloat jnOld = joint->jnAcc;
+	cpFloat jn = soft.massScale*(joint->bias - vrn)*joint->nMass - soft.impulseScale*jnOld;
 	joint->jnAcc = cpfclamp(jnOld + jn, -joint->constraint.maxForce*dt, 0.0f);
 	jn = joint->jnAcc - jnOld;
 	
 	// apply impulse
-	apply_impulses(a, b, joint->r1, joint->r2, cpvmult(n, jn));
+	solver_apply_impulses(a, b, joint->r1, joint->r2, cpvmult(n, jn));
 }
 
 static cpFloat
@@ -99,6 +104,7 @@ static const cpConstraintClass klass = {
 	(cpConstraintApplyCachedImpulseImpl)applyCachedImpulse,
 	(cpConstraintApplyImpulseImpl)applyImpulse,
 	(cpConstraintGetImpulseImpl)getImpulse,
+	cpTrue,
 };
 
 cpSlideJoint *
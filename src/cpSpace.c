@@ -129,6 +129,7 @@ cpSpaceInit(cpSpace *space)
 #endif
 
 	space->iterations = 10;
+	space->iterationTolerance = 0.0f;
 	
 	space->gravity = cpvzero;
 	space->damping = 1.0f;
@@ -136,6 +137,14 @@ cpSpaceInit(cpSpace *space)
 	space->collisionSlop = 0.1f;
 	space->collisionBias = cpfpow(1.0f - 0.1f, 60.0f);
 	space->collisionPersistence = 3;
+	space->speculativeContacts = cpFalse;
+	space->speculativeTime = 0.0f;
+	space->contactFrequency = 0.0f;
+	space->contactDampingRatio = 1.0f;
+	
+	space->fixedTimestep = 1.0f/60.0f;
+	space->maxStepsPerFrame = 5;
+	space->accumulator = 0.0f;
 	
 	space->locked = 0;
 	space->stamp = 0;
@@ -150,7 +159,10 @@ cpSpaceInit(cpSpace *space)
 	space->dynamicBodies = cpArrayNew(0);
 	space->staticBodies = cpArrayNew(0);
 	space->sleepingComponents = cpArrayNew(0);
+	space->generateIslands = cpFalse;
+	space->islandCount = 0;
 	space->rousedBodies = cpArrayNew(0);
+	space->bullets = cpArrayNew(0);
 	
 	space->sleepTimeThreshold = INFINITY;
 	space->idleSpeedThreshold = 0.0f;
@@ -162,6 +174,45 @@ cpSpaceInit(cpSpace *space)
 	space->cachedArbiters = cpHashSetNew(0, (cpHashSetEqlFunc)arbiterSetEql);
 	
 	space->constraints = cpArrayNew(0);
+	space->springNetworks = cpArrayNew(0);
+	space->networkEdgeStarts = NULL;
+	space->networkEdges = NULL;
+	space->networkEdgeStartCapacity = space->networkEdgeCapacity = 0;
+	
+	space->solverBodies = NULL;
+	space->solverBodyOwners = NULL;
+	space->solverBodyCount = space->solverBodyCapacity = 0;
+	
+	space->substepRotations = NULL;
+	space->substepRotationCapacity = 0;
+	
+	space->solverIslands = NULL;
+	space->solverIslandCount = space->solverIslandCapacity = 0;
+	space->islandArbiters = NULL;
+	space->islandConstraints = NULL;
+	space->islandArbiterCapacity = space->islandConstraintCapacity = 0;
+	space->islandDirectTrees = NULL;
+	space->islandDirectTreeCapacity = 0;
+	
+	space->shockIterations = 0;
+	space->shockBodies = NULL;
+	space->shockBodyCount = space->shockBodyCapacity = 0;
+	space->shockArbiters = NULL;
+	space->shockArbiterCount = space->shockArbiterCapacity = 0;
+	
+	space->batchedConstraints = NULL;
+	space->batchedConstraintCapacity = 0;
+	space->constraintBatches = NULL;
+	space->constraintBatchCount = space->constraintBatchCapacity = 0;
+	space->pivotRows = NULL;
+	space->springRows = NULL;
+	space->pivotRowCapacity = space->springRowCapacity = 0;
+	
+	space->directSolver = cpFalse;
+	space->directNodes = NULL;
+	space->directNodeCount = space->directNodeCapacity = 0;
+	space->directBodyNodes = NULL;
+	space->directBodyNodeCapacity = 0;
 	
 	space->usesWildcards = cpFalse;
 	memcpy(&space->defaultHandler, &cpCollisionHandlerDoNothing, sizeof(cpCollisionHandler));
@@ -170,6 +221,13 @@ cpSpaceInit(cpSpace *space)
 	space->postStepCallbacks = cpArrayNew(0);
 	space->skipPostStep = cpFalse;
 	
+	space->profilingEnabled = cpFalse;
+	memset(&space->stepProfile, 0, sizeof(cpSpaceStepProfile));
+	
+#if CP_ENABLE_COUNTERS
+	memset(&space->counters, 0, sizeof(cpSpaceCounters));
+#endif
+	
 	cpBody *staticBody = cpBodyInit(&space->_staticBody, 0.0f, 0.0f);
 	cpBodySetType(staticBody, CP_BODY_TYPE_STATIC);
 	cpSpaceSetStaticBody(space, staticBody);
@@ -197,14 +255,34 @@ cpSpaceDestroy(cpSpace *space)
 	cpArrayFree(space->staticBodies);
 	cpArrayFree(space->sleepingComponents);
 	cpArrayFree(space->rousedBodies);
+	cpArrayFree(space->bullets);
 	
 	cpArrayFree(space->constraints);
+	cpArrayFree(space->springNetworks);
+	cpfree(space->networkEdgeStarts);
+	cpfree(space->networkEdges);
 	
 	cpHashSetFree(space->cachedArbiters);
 	
 	cpArrayFree(space->arbiters);
 	cpArrayFree(space->pooledArbiters);
 	
+	cpfree(space->solverBodies);
+	cpfree(space->solverBodyOwners);
+	cpfree(space->substepRotations);
+	cpfree(space->solverIslands);
+	cpfree(space->islandArbiters);
+	cpfree(space->islandConstraints);
+	cpfree(space->islandDirectTrees);
+	cpfree(space->shockBodies);
+	cpfree(space->shockArbiters);
+	cpfree(space->batchedConstraints);
+	cpfree(space->constraintBatches);
+	cpfree(space->pivotRows);
+	cpfree(space->springRows);
+	cpfree(space->directNodes);
+	cpfree(space->directBodyNodes);
+	
 	if(space->allocatedBuffers){
 		cpArrayFreeEach(space->allocatedBuffers, cpfree);
 		cpArrayFree(space->allocatedBuffers);
@@ -244,6 +322,44 @@ cpSpaceSetIterations(cpSpace *space, int iterations)
 	space->iterations = iterations;
 }
 
+cpFloat
+cpSpaceGetIterationTolerance(const cpSpace *space)
+{
+	return space->iterationTolerance;
+}
+
+void
+cpSpaceSetIterationTolerance(cpSpace *space, cpFloat iterationTolerance)
+{
+	cpAssertHard(iterationTolerance >= 0.0f, "Iteration tolerance must be positive.");
+	space->iterationTolerance = iterationTolerance;
+}
+
+int
+cpSpaceGetShockIterations(const cpSpace *space)
+{
+	return space->shockIterations;
+}
+
+void
+cpSpaceSetShockIterations(cpSpace *space, int shockIterations)
+{
+	cpAssertHard(shockIterations >= 0, "Shock iterations cannot be negative.");
+	space->shockIterations = shockIterations;
+}
+
+cpBool
+cpSpaceGetDirectSolver(const cpSpace *space)
+{
+	return space->directSolver;
+}
+
+void
+cpSpaceSetDirectSolver(cpSpace *space, cpBool directSolver)
+{
+	space->directSolver = directSolver;
+}
+
 cpVect
 cpSpaceGetGravity(const cpSpace *space)
 {
@@ -335,6 +451,76 @@ cpSpaceSetCollisionPersistence(cpSpace *space, cpTimestamp collisionPersistence)
 	space->collisionPersistence = collisionPersistence;
 }
 
+cpBool
+cpSpaceGetSpeculativeContacts(const cpSpace *space)
+{
+	return space->speculativeContacts;
+}
+
+void
+cpSpaceSetSpeculativeContacts(cpSpace *space, cpBool speculativeContacts)
+{
+	space->speculativeContacts = speculativeContacts;
+}
+
+cpFloat
+cpSpaceGetContactFrequency(const cpSpace *space)
+{
+	return space->contactFrequency;
+}
+
+void
+cpSpaceSetContactFrequency(cpSpace *space, cpFloat contactFrequency)
+{
+	cpAssertHard(contactFrequency >= 0.0f, "Contact frequency must be positive.");
+	space->contactFrequency = contactFrequency;
+}
+
+cpFloat
+cpSpaceGetContactDampingRatio(const cpSpace *space)
+{
+	return space->contactDampingRatio;
+}
+
+void
+cpSpaceSetContactDampingRatio(cpSpace *space, cpFloat contactDampingRatio)
+{
+	cpAssertHard(contactDampingRatio >= 0.0f, "Contact damping ratio must be positive.");
+	space->contactDampingRatio = contactDampingRatio;
+}
+
+cpFloat
+cpSpaceGetFixedTimestep(const cpSpace *space)
+{
+	return space->fixedTimestep;
+}
+
+void
+cpSpaceSetFixedTimestep(cpSpace *space, cpFloat fixedTimestep)
+{
+	cpAssertHard(fixedTimestep > 0.0f, "Fixed timestep must be positive.");
+	space->fixedTimestep = fixedTimestep;
+}
+
+int
+cpSpaceGetMaxStepsPerFrame(const cpSpace *space)
+{
+	return space->maxStepsPerFrame;
+}
+
+void
+cpSpaceSetMaxStepsPerFrame(cpSpace *space, int maxStepsPerFrame)
+{
+	cpAssertHard(maxStepsPerFrame > 0, "Must allow at least one step per frame.");
+	space->maxStepsPerFrame = maxStepsPerFrame;
+}
+
+cpFloat
+cpSpaceGetInterpolationAlpha(const cpSpace *space)
+{
+	return cpfclamp01(space->accumulator/space->fixedTimestep);
+}
+
 cpDataPointer
 cpSpaceGetUserData(const cpSpace *space)
 {
@@ -377,6 +563,62 @@ cpSpaceIsLocked(cpSpace *space)
 	return (space->locked > 0);
 }
 
+void
+cpSpaceSetProfilingEnabled(cpSpace *space, cpBool enabled)
+{
+	space->profilingEnabled = enabled;
+	memset(&space->stepProfile, 0, sizeof(cpSpaceStepProfile));
+}
+
+cpBool
+cpSpaceGetProfilingEnabled(const cpSpace *space)
+{
+	return space->profilingEnabled;
+}
+
+cpSpaceStepProfile
+cpSpaceGetStepProfile(const cpSpace *space)
+{
+	return space->stepProfile;
+}
+
+int
+cpSpaceGetIslandCount(const cpSpace *space)
+{
+	return space->solverIslandCount;
+}
+
+int
+cpSpaceGetIslandIterations(const cpSpace *space, int island)
+{
+	cpAssertHard(0 <= island && island < space->solverIslandCount, "Island index is out of range.");
+	return space->solverIslands[island].iterations;
+}
+
+cpSpaceCounters
+cpSpaceGetCounters(const cpSpace *space)
+{
+#if CP_ENABLE_COUNTERS
+	cpSpaceCounters counters = space->counters;
+	counters.arbiterHashProbes = cpHashSetGetProbeCount(space->cachedArbiters);
+	counters.leafReinsertions = cpBBTreeGetReinsertionCount(space->dynamicShapes);
+	return counters;
+#else
+	cpSpaceCounters counters = {0};
+	return counters;
+#endif
+}
+
+void
+cpSpaceResetCounters(cpSpace *space)
+{
+#if CP_ENABLE_COUNTERS
+	memset(&space->counters, 0, sizeof(cpSpaceCounters));
+	cpHashSetResetProbeCount(space->cachedArbiters);
+	cpBBTreeResetReinsertionCount(space->dynamicShapes);
+#endif
+}
+
 //MARK: Collision Handler Function Management
 
 static void
@@ -445,8 +687,13 @@ cpSpaceAddBody(cpSpace *space, cpBody *body)
 	cpAssertSpaceUnlocked(space);
 	
 	cpArrayPush(cpSpaceArrayForBodyType(space, cpBodyGetType(body)), body);
+	if(body->bullet.enabled) cpArrayPush(space->bullets, body);
 	body->space = space;
 	
+	// Start interpolating from where the body was added.
+	body->interpolation.p = body->p;
+	body->interpolation.a = body->a;
+	
 	return body;
 }
 
@@ -473,6 +720,33 @@ cpSpaceAddConstraint(cpSpace *space, cpConstraint *constraint)
 	return constraint;
 }
 
+static void
+ActivateSpringNetworkBodies(cpSpringNetwork *network)
+{
+	for(int i=0; i<network->bundleCount; i++){
+		struct cpSpringBundle *bundle = network->bundles + i;
+		
+		for(int l=0; l<bundle->count; l++){
+			cpBodyActivate(bundle->bodyA[l]);
+			cpBodyActivate(bundle->bodyB[l]);
+		}
+	}
+}
+
+cpSpringNetwork *
+cpSpaceAddSpringNetwork(cpSpace *space, cpSpringNetwork *network)
+{
+	cpAssertHard(network->space != space, "You have already added this spring network to this space. You must not add it a second time.");
+	cpAssertHard(!network->space, "You have already added this spring network to another space. You cannot add it to a second.");
+	cpAssertSpaceUnlocked(space);
+	
+	ActivateSpringNetworkBodies(network);
+	cpArrayPush(space->springNetworks, network);
+	network->space = space;
+	
+	return network;
+}
+
 struct arbiterFilterContext {
 	cpSpace *space;
 	cpBody *body;
@@ -552,6 +826,7 @@ cpSpaceRemoveBody(cpSpace *space, cpBody *body)
 	cpBodyActivate(body);
 //	cpSpaceFilterArbiters(space, body, NULL);
 	cpArrayDeleteObj(cpSpaceArrayForBodyType(space, cpBodyGetType(body)), body);
+	if(body->bullet.enabled) cpArrayDeleteObj(space->bullets, body);
 	body->space = NULL;
 }
 
@@ -570,6 +845,17 @@ cpSpaceRemoveConstraint(cpSpace *space, cpConstraint *constraint)
 	constraint->space = NULL;
 }
 
+void
+cpSpaceRemoveSpringNetwork(cpSpace *space, cpSpringNetwork *network)
+{
+	cpAssertHard(cpSpaceContainsSpringNetwork(space, network), "Cannot remove a spring network that was not added to the space. (Removed twice maybe?)");
+	cpAssertSpaceUnlocked(space);
+	
+	ActivateSpringNetworkBodies(network);
+	cpArrayDeleteObj(space->springNetworks, network);
+	network->space = NULL;
+}
+
 cpBool cpSpaceContainsShape(cpSpace *space, cpShape *shape)
 {
 	return (shape->space == space);
@@ -585,6 +871,11 @@ cpBool cpSpaceContainsConstraint(cpSpace *space, cpConstraint *constraint)
 	return (constraint->space == space);
 }
 
+cpBool cpSpaceContainsSpringNetwork(cpSpace *space, cpSpringNetwork *network)
+{
+	return (network->space == space);
+}
+
 //MARK: Iteration
 
 void
@@ -699,3 +990,37 @@ cpSpaceUseSpatialHash(cpSpace *space, cpFloat dim, int count)
 	space->staticShapes = staticShapes;
 	space->dynamicShapes = dynamicShapes;
 }
+
+void
+cpSpaceUseStaticBVH4(cpSpace *space)
+{
+	cpSpatialIndex *staticShapes = cpBVH4New((cpSpatialIndexBBFunc)cpShapeGetBB, NULL);
+	cpSpatialIndex *dynamicShapes = cpBBTreeNew((cpSpatialIndexBBFunc)cpShapeGetBB, staticShapes);
+	cpBBTreeSetVelocityFunc(dynamicShapes, (cpBBTreeVelocityFunc)ShapeVelocityFunc);
+	
+	cpSpatialIndexEach(space->staticShapes, (cpSpatialIndexIteratorFunc)copyShapes, staticShapes);
+	cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)copyShapes, dynamicShapes);
+	
+	cpSpatialIndexFree(space->staticShapes);
+	cpSpatialIndexFree(space->dynamicShapes);
+	
+	space->staticShapes = staticShapes;
+	space->dynamicShapes = dynamicShapes;
+}
+
+void
+cpSpaceUseSweepAndPrune(cpSpace *space)
+{
+	// The static tree is replaced too since the pairs in the old dynamic tree reference its leaves.
+	cpSpatialIndex *staticShapes = cpBBTreeNew((cpSpatialIndexBBFunc)cpShapeGetBB, NULL);
+	cpSpatialIndex *dynamicShapes = cpSweepAndPruneNew((cpSpatialIndexBBFunc)cpShapeGetBB, staticShapes);
+	
+	cpSpatialIndexEach(space->staticShapes, (cpSpatialIndexIteratorFunc)copyShapes, staticShapes);
+	cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)copyShapes, dynamicShapes);
+	
+	cpSpatialIndexFree(space->staticShapes);
+	cpSpatialIndexFree(space->dynamicShapes);
+	
+	space->staticShapes = staticShapes;
+	space->dynamicShapes = dynamicShapes;
+}
@@ -0,0 +1,167 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "chipmunk/chipmunk_private.h"
+
+// Bullets are stopped when they are this far inside of another shape (as a fraction of the collision slop)
+// so that the regular collision detection finds a contact without the solver pushing them apart.
+#define TOI_TARGET_DEPTH 0.5f
+// How close to the target depth the conservative advancement needs to get.
+#define TOI_TOLERANCE 0.25f
+// If the advancement hasn't converged after this many iterations, the bullet is stopped early.
+#define MAX_TOI_ITERATIONS 20
+
+struct BulletContext {
+	cpBody *body;
+	cpShape *shape;
+	
+	// Movement of the body's center of gravity and angle during the step.
+	cpVect p0, p1;
+	cpFloat a0, a1;
+	
+	// Upper bound on how fast the shape can approach another shape per unit of 't'.
+	cpFloat bound;
+	cpFloat target, tolerance;
+	
+	// Earliest time of impact found so far.
+	cpFloat toi;
+};
+
+void
+cpSpaceBeginBullets(cpSpace *space)
+{
+	cpArray *bullets = space->bullets;
+	for(int i=0; i<bullets->num; i++){
+		cpBody *body = (cpBody *)bullets->arr[i];
+		body->bullet.p = body->p;
+		body->bullet.a = body->a;
+	}
+}
+
+// Update the bullet's shape to where it was at time 't' during the step.
+static inline void
+MoveShape(struct BulletContext *ctx, cpFloat t)
+{
+	cpVect p = cpvlerp(ctx->p0, ctx->p1, t);
+	cpFloat a = cpflerp(ctx->a0, ctx->a1, t);
+	cpShapeUpdate(ctx->shape, cpBodyTransformAt(ctx->body, p, a));
+}
+
+// Conservative advancement, the other shape is treated as stationary.
+// The distance can't shrink by more than 'bound' per unit of 't',
+// so it's always safe to advance by the remaining distance divided by the bound.
+static cpFloat
+TimeOfImpact(struct BulletContext *ctx, cpShape *other)
+{
+	cpShape *shape = ctx->shape;
+	
+	MoveShape(ctx, 0.0f);
+	cpFloat d = cpShapesDistance(shape, other);
+	
+	// Already touching at the start of the step, the regular collision detection will handle it.
+	if(d <= 0.0f) return 1.0f;
+	
+	cpFloat t = 0.0f;
+	for(int i=0; i<MAX_TOI_ITERATIONS; i++){
+		t += (d - ctx->target)/ctx->bound;
+		
+		// Can't hit before the earliest impact that was already found.
+		if(t >= ctx->toi) return 1.0f;
+		
+		MoveShape(ctx, t);
+		d = cpShapesDistance(shape, other);
+		if(d <= ctx->target + ctx->tolerance) break;
+	}
+	
+	return t;
+}
+
+static cpCollisionID
+BulletQuery(cpShape *shape, cpShape *other, cpCollisionID id, struct BulletContext *ctx)
+{
+	if(
+		shape->body == other->body ||
+		other->sensor ||
+		cpShapeFilterReject(shape->filter, other->filter)
+	) return id;
+	
+	ctx->toi = cpfmin(ctx->toi, TimeOfImpact(ctx, other));
+	return id;
+}
+
+static void
+SweepBullet(cpSpace *space, cpBody *body, cpBool stop)
+{
+	cpVect p0 = body->bullet.p, p1 = body->p;
+	cpFloat a0 = body->bullet.a, a1 = body->a;
+	cpVect delta = cpvsub(p0, p1);
+	cpFloat slop = space->collisionSlop;
+	
+	struct BulletContext ctx = {body, NULL, p0, p1, a0, a1, 0.0f, -TOI_TARGET_DEPTH*slop, TOI_TOLERANCE*slop, 1.0f};
+	cpBool moved = cpFalse;
+	
+	CP_BODY_FOREACH_SHAPE(body, shape){
+		if(shape->sensor) continue;
+		
+		// Distance from the center of gravity to the farthest corner of the shape's bounding box.
+		cpBB bb = shape->bb;
+		cpFloat rx = cpfmax(cpfabs(bb.l - p1.x), cpfabs(bb.r - p1.x));
+		cpFloat ry = cpfmax(cpfabs(bb.b - p1.y), cpfabs(bb.t - p1.y));
+		cpFloat r = cpfsqrt(rx*rx + ry*ry);
+		
+		ctx.bound = cpvlength(delta) + cpfabs(a1 - a0)*r;
+		// The shape can't tunnel if it barely moved.
+		if(ctx.bound <= ctx.tolerance) continue;
+		
+		// Bounding box covering everything the shape passed through during the step.
+		cpBB swept = cpBBMerge(bb, cpBBOffset(bb, delta));
+		if(a0 != a1) swept = cpBBMerge(swept, cpBBMerge(cpBBNewForCircle(p0, r), cpBBNewForCircle(p1, r)));
+		
+		ctx.shape = shape;
+		cpSpatialIndexQuery(space->staticShapes, shape, swept, (cpSpatialIndexQueryFunc)BulletQuery, &ctx);
+		cpSpatialIndexQuery(space->dynamicShapes, shape, swept, (cpSpatialIndexQueryFunc)BulletQuery, &ctx);
+		moved = cpTrue;
+	}
+	
+	if(ctx.toi < 1.0f){
+		body->p = cpvlerp(p0, p1, ctx.toi);
+		body->a = cpflerp(a0, a1, ctx.toi);
+		body->transform = cpBodyTransformAt(body, body->p, body->a);
+		
+		if(stop){
+			body->v = cpvzero;
+			body->w = 0.0f;
+		}
+	}
+	
+	// Put the shapes back where the body ended up.
+	if(moved) cpShapeCacheBBsForBodies(&body, 1);
+}
+
+void
+cpSpaceSweepBullets(cpSpace *space, cpBool stop)
+{
+	cpArray *bullets = space->bullets;
+	for(int i=0; i<bullets->num; i++){
+		cpBody *body = (cpBody *)bullets->arr[i];
+		if(cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC && !cpBodyIsSleeping(body)) SweepBullet(space, body, stop);
+	}
+}
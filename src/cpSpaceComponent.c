@@ -36,6 +36,7 @@ cpSpaceActivateBody(cpSpace *space, cpBody *body)
 	} else {
 		cpAssertSoft(body->sleeping.root == NULL && body->sleeping.next == NULL, "Internal error: Activating body non-NULL node pointers.");
 		cpArrayPush(space->dynamicBodies, body);
+		CP_COUNTER_ADD(space->counters.bodiesWoken, 1);
 
 		CP_BODY_FOREACH_SHAPE(body, shape){
 			cpSpatialIndexRemove(space->staticShapes, shape, shape->hashid);
@@ -85,6 +86,7 @@ cpSpaceDeactivateBody(cpSpace *space, cpBody *body)
 	cpAssertHard(cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC, "Internal error: Attempting to deactivate a non-dynamic body.");
 	
 	cpArrayDeleteObj(space->dynamicBodies, body);
+	CP_COUNTER_ADD(space->counters.bodiesSlept, 1);
 	
 	CP_BODY_FOREACH_SHAPE(body, shape){
 		cpSpatialIndexRemove(space->dynamicShapes, shape, shape->hashid);
@@ -201,12 +203,197 @@ FloodFillComponent(cpBody *root, cpBody *body)
 			ComponentAdd(root, body);
 			CP_BODY_FOREACH_ARBITER(body, arb) FloodFillComponent(root, (body == arb->body_a ? arb->body_b : arb->body_a));
 			CP_BODY_FOREACH_CONSTRAINT(body, constraint) FloodFillComponent(root, (body == constraint->a ? constraint->b : constraint->a));
+			
+			cpSpace *space = body->space;
+			if(space->springNetworks->num > 0){
+				int *starts = space->networkEdgeStarts;
+				int index = body->solverIndex;
+				for(int i=starts[index]; i<starts[index + 1]; i++) FloodFillComponent(root, space->networkEdges[i]);
+			}
 		} else {
 			cpAssertSoft(other_root == root, "Internal Error: Inconsistency dectected in the contact graph.");
 		}
 	}
 }
 
+// Index of an awake dynamic body in the network edge lists, or -1.
+static inline int
+NetworkBodyIndex(cpSpace *space, cpBody *body)
+{
+	cpArray *bodies = space->dynamicBodies;
+	int index = body->solverIndex;
+	
+	cpBool awake = (0 <= index && index < bodies->num && bodies->arr[index] == body);
+	return (awake && cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC ? index : -1);
+}
+
+// Spring networks don't thread their springs onto the bodies like constraints,
+// so gather the bodies each awake body is connected to for FloodFillComponent() to follow.
+static void
+BuildNetworkEdges(cpSpace *space)
+{
+	cpArray *bodies = space->dynamicBodies;
+	cpArray *networks = space->springNetworks;
+	int count = bodies->num;
+	
+	if(count + 1 > space->networkEdgeStartCapacity){
+		space->networkEdgeStartCapacity = 3*(count + 2)/2;
+		space->networkEdgeStarts = (int *)cprealloc(space->networkEdgeStarts, space->networkEdgeStartCapacity*sizeof(int));
+	}
+	
+	// The solver body indexes are reassigned when the solver runs, so borrow them to index the edge lists.
+	int *starts = space->networkEdgeStarts;
+	memset(starts, 0, (count + 1)*sizeof(int));
+	for(int i=0; i<count; i++) ((cpBody *)bodies->arr[i])->solverIndex = i;
+	
+	// Count the edges of each body, offset by one so the counts sum into the start of the next body.
+	for(int i=0; i<networks->num; i++){
+		cpSpringNetwork *network = (cpSpringNetwork *)networks->arr[i];
+		
+		for(int j=0; j<network->bundleCount; j++){
+			struct cpSpringBundle *bundle = network->bundles + j;
+			
+			for(int l=0; l<bundle->count; l++){
+				int a = NetworkBodyIndex(space, bundle->bodyA[l]), b = NetworkBodyIndex(space, bundle->bodyB[l]);
+				if(a >= 0 && b >= 0){
+					starts[a + 1]++;
+					starts[b + 1]++;
+				}
+			}
+		}
+	}
+	
+	for(int i=0; i<count; i++) starts[i + 1] += starts[i];
+	
+	if(starts[count] > space->networkEdgeCapacity){
+		space->networkEdgeCapacity = 3*(starts[count] + 1)/2;
+		space->networkEdges = (cpBody **)cprealloc(space->networkEdges, space->networkEdgeCapacity*sizeof(cpBody *));
+	}
+	
+	// Filling in the edges advances each start to the start of the next body, so shift them back afterwards.
+	cpBody **edges = space->networkEdges;
+	for(int i=0; i<networks->num; i++){
+		cpSpringNetwork *network = (cpSpringNetwork *)networks->arr[i];
+		
+		for(int j=0; j<network->bundleCount; j++){
+			struct cpSpringBundle *bundle = network->bundles + j;
+			
+			for(int l=0; l<bundle->count; l++){
+				cpBody *bodyA = bundle->bodyA[l], *bodyB = bundle->bodyB[l];
+				int a = NetworkBodyIndex(space, bodyA), b = NetworkBodyIndex(space, bodyB);
+				if(a >= 0 && b >= 0){
+					edges[starts[a]++] = bodyB;
+					edges[starts[b]++] = bodyA;
+				}
+			}
+		}
+	}
+	
+	for(int i=count; i>0; i--) starts[i] = starts[i - 1];
+	starts[0] = 0;
+}
+
+//MARK: Shock Propagation
+
+// Contacts closer than this to horizontal (as the cosine of the angle of the normal from vertical) don't support a body.
+#define SHOCK_MIN_SUPPORT 0.25f
+
+static inline int
+ShockLevel(cpBody *body)
+{
+	return (cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC ? body->shockLevel : 0);
+}
+
+// Returns true if 'body' is holding up the other body of the arbiter.
+static inline cpBool
+ShockSupports(cpArbiter *arb, cpBody *body, cpVect up)
+{
+	// The normal points from body_a to body_b.
+	cpFloat d = cpvdot(arb->n, up);
+	return (body == arb->body_a ? d : -d) > SHOCK_MIN_SUPPORT;
+}
+
+static void
+ShockPushBody(cpSpace *space, cpBody *body, int level)
+{
+	body->shockLevel = level;
+	space->shockBodies[space->shockBodyCount++] = body;
+}
+
+// Breadth first search up the contact graph from the static and kinematic bodies to number the bodies by level.
+// Then sort the arbiters by the lower level of their bodies so the solver can work from the bottom up.
+static void
+ShockPropagationOrder(cpSpace *space)
+{
+	cpArray *bodies = space->dynamicBodies;
+	cpArray *arbiters = space->arbiters;
+	cpVect up = cpvnormalize(cpvneg(space->gravity));
+	
+	if(bodies->num > space->shockBodyCapacity){
+		space->shockBodyCapacity = 3*(bodies->num + 1)/2;
+		space->shockBodies = (cpBody **)cprealloc(space->shockBodies, space->shockBodyCapacity*sizeof(cpBody *));
+	}
+	
+	if(arbiters->num > space->shockArbiterCapacity){
+		space->shockArbiterCapacity = 3*(arbiters->num + 1)/2;
+		space->shockArbiters = (cpArbiter **)cprealloc(space->shockArbiters, space->shockArbiterCapacity*sizeof(cpArbiter *));
+	}
+	
+	for(int i=0; i<bodies->num; i++) ((cpBody *)bodies->arr[i])->shockLevel = 0;
+	
+	// The first level rests directly on static or kinematic bodies.
+	space->shockBodyCount = 0;
+	for(int i=0; i<bodies->num; i++){
+		cpBody *body = (cpBody *)bodies->arr[i];
+		if(cpBodyGetType(body) != CP_BODY_TYPE_DYNAMIC) continue;
+		
+		CP_BODY_FOREACH_ARBITER(body, arb){
+			cpBody *other = (body == arb->body_a ? arb->body_b : arb->body_a);
+			if(cpBodyGetType(other) != CP_BODY_TYPE_DYNAMIC && ShockSupports(arb, other, up)){
+				ShockPushBody(space, body, 1);
+				break;
+			}
+		}
+	}
+	
+	// Each following level rests on the one before it.
+	for(int i=0; i<space->shockBodyCount; i++){
+		cpBody *body = space->shockBodies[i];
+		
+		CP_BODY_FOREACH_ARBITER(body, arb){
+			cpBody *other = (body == arb->body_a ? arb->body_b : arb->body_a);
+			if(ShockLevel(other) == 0 && cpBodyGetType(other) == CP_BODY_TYPE_DYNAMIC && ShockSupports(arb, body, up)){
+				ShockPushBody(space, other, body->shockLevel + 1);
+			}
+		}
+	}
+	
+	// Arbiters touching the ground or unsupported bodies go first, the rest in the order their lower bodies were found.
+	space->shockArbiterCount = 0;
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		if(ShockLevel(arb->body_a) == 0 || ShockLevel(arb->body_b) == 0){
+			space->shockArbiters[space->shockArbiterCount++] = arb;
+		}
+	}
+	
+	for(int i=0; i<space->shockBodyCount; i++){
+		cpBody *body = space->shockBodies[i];
+		
+		CP_BODY_FOREACH_ARBITER(body, arb){
+			cpBody *other = (body == arb->body_a ? arb->body_b : arb->body_a);
+			int level = ShockLevel(other);
+			
+			// Arbiters between bodies on the same level are added by body_a.
+			if(level > body->shockLevel || (level == body->shockLevel && body == arb->body_a)){
+				space->shockArbiters[space->shockArbiterCount++] = arb;
+			}
+		}
+	}
+	
+	cpAssertSoft(space->shockArbiterCount == arbiters->num, "Internal Error: Shock propagation lost track of an arbiter.");
+}
+
 static inline cpBool
 ComponentActive(cpBody *root, cpFloat threshold)
 {
@@ -221,6 +408,7 @@ void
 cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 {
 	cpBool sleep = (space->sleepTimeThreshold != INFINITY);
+	cpBool islands = (space->generateIslands || space->iterationTolerance > 0.0f);
 	cpArray *bodies = space->dynamicBodies;
 	
 #ifndef NDEBUG
@@ -277,17 +465,42 @@ cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 			if(cpBodyGetType(a) == CP_BODY_TYPE_KINEMATIC) cpBodyActivate(b);
 		}
 		
+		// Same for the springs in networks, which also wake a body up if it was put to sleep by itself.
+		cpArray *networks = space->springNetworks;
+		for(int i=0; i<networks->num; i++){
+			cpSpringNetwork *network = (cpSpringNetwork *)networks->arr[i];
+			
+			for(int j=0; j<network->bundleCount; j++){
+				struct cpSpringBundle *bundle = network->bundles + j;
+				
+				for(int l=0; l<bundle->count; l++){
+					cpBody *a = bundle->bodyA[l], *b = bundle->bodyB[l];
+					cpBodyType typeA = cpBodyGetType(a), typeB = cpBodyGetType(b);
+					
+					if(typeB == CP_BODY_TYPE_KINEMATIC || (typeB == CP_BODY_TYPE_DYNAMIC && cpBodyIsSleeping(a) && !cpBodyIsSleeping(b))) cpBodyActivate(a);
+					if(typeA == CP_BODY_TYPE_KINEMATIC || (typeA == CP_BODY_TYPE_DYNAMIC && cpBodyIsSleeping(b) && !cpBodyIsSleeping(a))) cpBodyActivate(b);
+				}
+			}
+		}
+	}
+	
+	space->islandCount = 0;
+	
+	if(sleep || islands){
+		// Springs in networks connect bodies in the contact graph the same as constraints.
+		if(space->springNetworks->num > 0) BuildNetworkEdges(space);
+		
 		// Generate components and deactivate sleeping ones
 		for(int i=0; i<bodies->num;){
 			cpBody *body = (cpBody*)bodies->arr[i];
 			
-			if(ComponentRoot(body) == NULL){
+			if(ComponentRoot(body) == NULL && cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC){
 				// Body not in a component yet. Perform a DFS to flood fill mark 
 				// the component in the contact graph using this body as the root.
 				FloodFillComponent(body, body);
 				
 				// Check if the component should be put to sleep.
-				if(!ComponentActive(body, space->sleepTimeThreshold)){
+				if(sleep && !ComponentActive(body, space->sleepTimeThreshold)){
 					cpArrayPush(space->sleepingComponents, body);
 					CP_BODY_FOREACH_COMPONENT(body, other) cpSpaceDeactivateBody(space, other);
 					
@@ -295,6 +508,12 @@ cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 					// Skip incrementing the index counter.
 					continue;
 				}
+				
+				// The component is staying awake, number it as an island.
+				if(islands){
+					int island = space->islandCount++;
+					CP_BODY_FOREACH_COMPONENT(body, other) other->island = island;
+				}
 			}
 			
 			i++;
@@ -304,6 +523,11 @@ cpSpaceProcessComponents(cpSpace *space, cpFloat dt)
 			body->sleeping.next = NULL;
 		}
 	}
+	
+	space->shockBodyCount = space->shockArbiterCount = 0;
+	if(space->shockIterations > 0 && cpvlengthsq(space->gravity) > 0.0f){
+		ShockPropagationOrder(space);
+	}
 }
 
 void
@@ -161,6 +161,23 @@ cpSpaceDebugDraw(cpSpace *space, cpSpaceDebugDrawOptions *options)
 	
 	if(options->flags & CP_SPACE_DEBUG_DRAW_CONSTRAINTS){
 		cpSpaceEachConstraint(space, (cpSpaceConstraintIteratorFunc)cpSpaceDebugDrawConstraint, options);
+		
+		cpArray *networks = space->springNetworks;
+		cpSpaceDebugColor color = options->constraintColor;
+		
+		for(int i=0; i<networks->num; i++){
+			cpSpringNetwork *network = (cpSpringNetwork *)networks->arr[i];
+			
+			for(int j=0; j<network->bundleCount; j++){
+				struct cpSpringBundle *bundle = network->bundles + j;
+				
+				for(int l=0; l<bundle->count; l++){
+					cpVect a = cpTransformPoint(bundle->bodyA[l]->transform, cpv(bundle->anchorAx[l], bundle->anchorAy[l]));
+					cpVect b = cpTransformPoint(bundle->bodyB[l]->transform, cpv(bundle->anchorBx[l], bundle->anchorBy[l]));
+					options->drawSegment(a, b, color, options->data);
+				}
+			}
+		}
 	}
 	
 	if(options->flags & CP_SPACE_DEBUG_DRAW_COLLISION_POINTS){
@@ -0,0 +1,394 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "chipmunk/chipmunk_private.h"
+
+// The direct solver uses Baraff's linear time factorization for tree shaped systems of joints.
+// Bodies and joints are the nodes of a tree, each joint connected to the one or two bodies it attaches.
+// The matrix [M -J^T; -J 0] then has the same sparsity as the tree,
+// and eliminating the nodes from the leaves up factors it without any fill in.
+// See "Linear-Time Dynamics using Lagrange Multipliers" by David Baraff.
+
+//MARK: Block Helpers
+
+// Blocks are 3x3 row major matrices padded with zeros.
+
+static inline void
+BlockMult(const cpFloat *a, const cpFloat *b, cpFloat *out)
+{
+	for(int i=0; i<3; i++){
+		for(int j=0; j<3; j++){
+			out[3*i + j] = a[3*i + 0]*b[0 + j] + a[3*i + 1]*b[3 + j] + a[3*i + 2]*b[6 + j];
+		}
+	}
+}
+
+// out = a^T*b
+static inline void
+BlockMultT(const cpFloat *a, const cpFloat *b, cpFloat *out)
+{
+	for(int i=0; i<3; i++){
+		for(int j=0; j<3; j++){
+			out[3*i + j] = a[0 + i]*b[0 + j] + a[3 + i]*b[3 + j] + a[6 + i]*b[6 + j];
+		}
+	}
+}
+
+static inline void
+BlockTranspose(const cpFloat *a, cpFloat *out)
+{
+	for(int i=0; i<3; i++){
+		for(int j=0; j<3; j++) out[3*i + j] = a[3*j + i];
+	}
+}
+
+// Invert the first 'dim' rows and columns in place.
+// Singular blocks (a pin joint with both anchors in the same place) are replaced with 0 so their rows are ignored.
+static void
+BlockInvert(cpFloat *m, int dim)
+{
+	if(dim == 1){
+		m[0] = (m[0] != 0.0f ? 1.0f/m[0] : 0.0f);
+	} else if(dim == 2){
+		cpFloat a = m[0], b = m[1], c = m[3], d = m[4];
+		cpFloat det = a*d - b*c;
+		cpFloat det_inv = (det != 0.0f ? 1.0f/det : 0.0f);
+		
+		m[0] =  d*det_inv; m[1] = -b*det_inv;
+		m[3] = -c*det_inv; m[4] =  a*det_inv;
+	} else {
+		cpFloat a = m[0], b = m[1], c = m[2];
+		cpFloat d = m[3], e = m[4], f = m[5];
+		cpFloat g = m[6], h = m[7], i = m[8];
+		
+		cpFloat A = e*i - f*h, B = f*g - d*i, C = d*h - e*g;
+		cpFloat det = a*A + b*B + c*C;
+		cpFloat det_inv = (det != 0.0f ? 1.0f/det : 0.0f);
+		
+		m[0] = A*det_inv; m[1] = (c*h - b*i)*det_inv; m[2] = (b*f - c*e)*det_inv;
+		m[3] = B*det_inv; m[4] = (a*i - c*g)*det_inv; m[5] = (c*d - a*f)*det_inv;
+		m[6] = C*det_inv; m[7] = (b*g - a*h)*det_inv; m[8] = (a*e - b*d)*det_inv;
+	}
+}
+
+//MARK: Building Trees
+
+// Only rigid equality constraints can be solved exactly.
+static inline cpBool
+IsDirectJoint(cpConstraint *constraint)
+{
+	return (
+		(cpConstraintIsPivotJoint(constraint) || cpConstraintIsPinJoint(constraint)) &&
+		constraint->frequency == 0.0f && constraint->maxForce == (cpFloat)INFINITY
+	);
+}
+
+// Entry for the body in the node map, or NULL if the body can't be part of a tree.
+static inline int *
+BodyNodeRef(cpSpace *space, cpBody *body)
+{
+	cpArray *bodies = space->dynamicBodies;
+	int index = body->solverIndex;
+	
+	cpBool awake = (0 <= index && index < bodies->num && bodies->arr[index] == body);
+	cpBool finite = (body->m_inv > 0.0f && body->i_inv > 0.0f);
+	return (awake && finite ? space->directBodyNodes + index : NULL);
+}
+
+static int
+PushNode(cpSpace *space, int parent, cpBody *body, cpConstraint *constraint)
+{
+	if(space->directNodeCount == space->directNodeCapacity){
+		space->directNodeCapacity = 3*(space->directNodeCapacity + 1)/2;
+		space->directNodes = (struct cpDirectNode *)cprealloc(space->directNodes, space->directNodeCapacity*sizeof(struct cpDirectNode));
+	}
+	
+	int index = space->directNodeCount++;
+	struct cpDirectNode *node = space->directNodes + index;
+	node->parent = parent;
+	node->dim = (body ? 3 : 0);
+	node->body = body;
+	node->constraint = constraint;
+	
+	return index;
+}
+
+static inline cpBool
+IsAnchor(cpBody *body)
+{
+	// Static and kinematic bodies have infinite mass and don't couple the joints attached to them, so they aren't part of the trees.
+	return (cpBodyGetType(body) != CP_BODY_TYPE_DYNAMIC);
+}
+
+// Add the joints and bodies reachable from the nodes after 'start' breadth first, the node array doubles as the queue.
+static void
+GrowTree(cpSpace *space, int start)
+{
+	for(int i=start; i<space->directNodeCount; i++){
+		cpBody *body = space->directNodes[i].body;
+		if(body == NULL) continue;
+		
+		CP_BODY_FOREACH_CONSTRAINT(body, constraint){
+			if(constraint->direct || !IsDirectJoint(constraint)) continue;
+			
+			// A joint to an anchor would be a leaf with nothing to eliminate it against.
+			// Only the root of a tree can be anchored, joints to other anchors are left to the iterative solver.
+			cpBody *other = (constraint->a == body ? constraint->b : constraint->a);
+			if(IsAnchor(other)) continue;
+			
+			// A body that is already in a tree means the joint closes a loop, leave it to the iterative solver too.
+			int *otherRef = BodyNodeRef(space, other);
+			if(otherRef == NULL || *otherRef >= 0) continue;
+			
+			constraint->direct = cpTrue;
+			int joint = PushNode(space, i, NULL, constraint);
+			*otherRef = PushNode(space, joint, other, NULL);
+		}
+	}
+}
+
+void
+cpSpaceBuildDirectTrees(cpSpace *space)
+{
+	cpArray *constraints = space->constraints;
+	for(int i=0; i<constraints->num; i++) ((cpConstraint *)constraints->arr[i])->direct = cpFalse;
+	
+	space->directNodeCount = 0;
+	if(!space->directSolver || constraints->num == 0) return;
+	
+	cpArray *bodies = space->dynamicBodies;
+	if(bodies->num > space->directBodyNodeCapacity){
+		space->directBodyNodeCapacity = 3*(bodies->num + 1)/2;
+		space->directBodyNodes = (int *)cprealloc(space->directBodyNodes, space->directBodyNodeCapacity*sizeof(int));
+	}
+	
+	// The solver body indexes aren't assigned until the solver runs, so borrow them to map the bodies to their nodes.
+	// Gathering the solver bodies gives the awake bodies the same indexes again.
+	for(int i=0; i<bodies->num; i++){
+		((cpBody *)bodies->arr[i])->solverIndex = i;
+		space->directBodyNodes[i] = -1;
+	}
+	
+	// Start with the trees hanging from an anchor, rooted at the joint to the anchor.
+	for(int i=0; i<constraints->num; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		if(constraint->direct || !IsDirectJoint(constraint)) continue;
+		
+		cpBool anchorA = IsAnchor(constraint->a), anchorB = IsAnchor(constraint->b);
+		if(anchorA == anchorB) continue;
+		
+		cpBody *body = (anchorA ? constraint->b : constraint->a);
+		int *bodyRef = BodyNodeRef(space, body);
+		if(bodyRef == NULL || *bodyRef >= 0) continue;
+		
+		int start = space->directNodeCount;
+		constraint->direct = cpTrue;
+		int root = PushNode(space, -1, NULL, constraint);
+		*bodyRef = PushNode(space, root, body, NULL);
+		GrowTree(space, start);
+	}
+	
+	// Then the free floating ones, rooted at a body.
+	for(int i=0; i<bodies->num; i++){
+		cpBody *body = (cpBody *)bodies->arr[i];
+		int *bodyRef = BodyNodeRef(space, body);
+		if(bodyRef == NULL || *bodyRef >= 0) continue;
+		
+		int start = space->directNodeCount;
+		*bodyRef = PushNode(space, -1, body, NULL);
+		GrowTree(space, start);
+		
+		// Drop bodies without any joints.
+		if(space->directNodeCount == start + 1) space->directNodeCount = start;
+	}
+}
+
+//MARK: Factoring and Solving
+
+// Copy the rows of a prestepped joint.
+static void
+LoadJoint(struct cpDirectNode *node)
+{
+	cpConstraint *constraint = node->constraint;
+	
+	if(cpConstraintIsPivotJoint(constraint)){
+		cpPivotJoint *joint = (cpPivotJoint *)constraint;
+		node->dim = 2;
+		node->r1 = joint->r1;
+		node->r2 = joint->r2;
+		node->n[0] = cpv(1.0f, 0.0f); node->bias[0] = joint->bias.x;
+		node->n[1] = cpv(0.0f, 1.0f); node->bias[1] = joint->bias.y;
+	} else {
+		cpPinJoint *joint = (cpPinJoint *)constraint;
+		node->dim = 1;
+		node->r1 = joint->r1;
+		node->r2 = joint->r2;
+		node->n[0] = joint->n; node->bias[0] = joint->bias;
+		node->n[1] = cpvzero; node->bias[1] = 0.0f;
+	}
+}
+
+// The block of -J that couples a joint to one of its bodies.
+static void
+CouplingBlock(const struct cpDirectNode *joint, cpBody *body, cpFloat *block)
+{
+	cpBool isA = (joint->constraint->a == body);
+	cpVect r = (isA ? joint->r1 : joint->r2);
+	cpFloat sign = (isA ? 1.0f : -1.0f);
+	
+	memset(block, 0, 9*sizeof(cpFloat));
+	for(int k=0; k<joint->dim; k++){
+		cpVect n = joint->n[k];
+		block[3*k + 0] = sign*n.x;
+		block[3*k + 1] = sign*n.y;
+		block[3*k + 2] = sign*cpvcross(r, n);
+	}
+}
+
+void
+cpSpaceFactorDirectTrees(cpSpace *space)
+{
+	struct cpDirectNode *nodes = space->directNodes;
+	int count = space->directNodeCount;
+	
+	// Fill in the blocks.
+	for(int i=0; i<count; i++){
+		struct cpDirectNode *node = nodes + i;
+		memset(node->d, 0, 9*sizeof(cpFloat));
+		
+		cpBody *body = node->body;
+		if(body){
+			node->d[0] = node->d[4] = body->m;
+			node->d[8] = body->i;
+			
+			if(node->parent >= 0){
+				cpFloat block[9];
+				CouplingBlock(nodes + node->parent, body, block);
+				BlockTranspose(block, node->l);
+			}
+		} else {
+			LoadJoint(node);
+			if(node->parent >= 0) CouplingBlock(node, nodes[node->parent].body, node->l);
+		}
+	}
+	
+	// Eliminate the nodes from the leaves up.
+	for(int i=count-1; i>=0; i--){
+		struct cpDirectNode *node = nodes + i;
+		BlockInvert(node->d, node->dim);
+		
+		if(node->parent >= 0){
+			cpFloat *d = nodes[node->parent].d;
+			cpFloat l[9], update[9];
+			BlockMult(node->d, node->l, l);
+			BlockMultT(node->l, l, update);
+			
+			for(int k=0; k<9; k++) d[k] -= update[k];
+			memcpy(node->l, l, 9*sizeof(cpFloat));
+		}
+	}
+}
+
+// Solve the nodes in [start, end), which must only contain whole trees.
+static cpFloat
+SolveNodes(cpSpace *space, int start, int end)
+{
+	struct cpDirectNode *nodes = space->directNodes;
+	struct cpSolverBody *bodies = space->solverBodies;
+	
+	// The right hand side is 0 for the bodies and the velocity error for the joints.
+	for(int i=start; i<end; i++){
+		struct cpDirectNode *node = nodes + i;
+		node->x[0] = node->x[1] = node->x[2] = 0.0f;
+		
+		cpConstraint *constraint = node->constraint;
+		if(constraint){
+			cpVect vr = solver_relative_velocity(bodies + constraint->solver_a, bodies + constraint->solver_b, node->r1, node->r2);
+			for(int k=0; k<node->dim; k++) node->x[k] = cpvdot(vr, node->n[k]) - node->bias[k];
+		}
+	}
+	
+	// Forward substitution from the leaves up.
+	for(int i=end-1; i>=start; i--){
+		struct cpDirectNode *node = nodes + i;
+		if(node->parent < 0) continue;
+		
+		cpFloat *x = node->x, *l = node->l, *px = nodes[node->parent].x;
+		for(int k=0; k<3; k++) px[k] -= l[0 + k]*x[0] + l[3 + k]*x[1] + l[6 + k]*x[2];
+	}
+	
+	// Back substitution from the roots down.
+	for(int i=start; i<end; i++){
+		struct cpDirectNode *node = nodes + i;
+		cpFloat *x = node->x, *d = node->d;
+		
+		cpFloat y[3];
+		for(int k=0; k<3; k++) y[k] = d[3*k + 0]*x[0] + d[3*k + 1]*x[1] + d[3*k + 2]*x[2];
+		
+		if(node->parent >= 0){
+			cpFloat *l = node->l, *px = nodes[node->parent].x;
+			for(int k=0; k<3; k++) y[k] -= l[3*k + 0]*px[0] + l[3*k + 1]*px[1] + l[3*k + 2]*px[2];
+		}
+		
+		x[0] = y[0]; x[1] = y[1]; x[2] = y[2];
+	}
+	
+	// The solution for the joints is their impulses.
+	cpFloat applied = 0.0f;
+	for(int i=start; i<end; i++){
+		struct cpDirectNode *node = nodes + i;
+		cpConstraint *constraint = node->constraint;
+		if(constraint == NULL) continue;
+		
+		cpVect j = cpvadd(cpvmult(node->n[0], node->x[0]), cpvmult(node->n[1], node->x[1]));
+		solver_apply_impulses(bodies + constraint->solver_a, bodies + constraint->solver_b, node->r1, node->r2, j);
+		applied += cpvlength(j);
+		
+		if(node->dim == 2){
+			cpPivotJoint *joint = (cpPivotJoint *)constraint;
+			joint->jAcc = cpvadd(joint->jAcc, j);
+		} else {
+			cpPinJoint *joint = (cpPinJoint *)constraint;
+			joint->jnAcc += node->x[0];
+		}
+	}
+	
+	return applied;
+}
+
+void
+cpSpaceSolveDirectTrees(cpSpace *space)
+{
+	SolveNodes(space, 0, space->directNodeCount);
+}
+
+cpFloat
+cpSpaceSolveDirectTree(cpSpace *space, int root)
+{
+	// The tree ends where the next one starts.
+	struct cpDirectNode *nodes = space->directNodes;
+	int end = root + 1;
+	while(end < space->directNodeCount && nodes[end].parent >= 0) end++;
+	
+	return SolveNodes(space, root, end);
+}
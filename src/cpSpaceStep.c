@@ -19,6 +19,16 @@
  * SOFTWARE.
  */
 
+#if defined(_WIN32)
+	#include <windows.h>
+#elif defined(__APPLE__)
+	#include <mach/mach_time.h>
+#else
+	#include <time.h>
+#endif
+
+#include <string.h>
+
 #include "chipmunk/chipmunk_private.h"
 
 //MARK: Post Step Callback Functions
@@ -182,6 +192,100 @@ cpSpacePopContacts(cpSpace *space, int count){
 	space->contactBuffersHead->numContacts -= count;
 }
 
+//MARK: Solver Body Functions
+
+static int
+cpSpacePushSolverBody(cpSpace *space, cpBody *body)
+{
+	if(space->solverBodyCount == space->solverBodyCapacity){
+		space->solverBodyCapacity = 3*(space->solverBodyCapacity + 1)/2;
+		space->solverBodies = (struct cpSolverBody *)cprealloc(space->solverBodies, space->solverBodyCapacity*sizeof(struct cpSolverBody));
+		space->solverBodyOwners = (cpBody **)cprealloc(space->solverBodyOwners, space->solverBodyCapacity*sizeof(cpBody *));
+	}
+	
+	int index = body->solverIndex = space->solverBodyCount++;
+	space->solverBodyOwners[index] = body;
+	
+	struct cpSolverBody *solverBody = space->solverBodies + index;
+	solverBody->v = body->v;
+	solverBody->w = body->w;
+	solverBody->v_bias = body->v_bias;
+	solverBody->w_bias = body->w_bias;
+	solverBody->m_inv = body->m_inv;
+	solverBody->i_inv = body->i_inv;
+	
+	return index;
+}
+
+static inline int
+cpSpaceSolverBodyIndex(cpSpace *space, cpBody *body)
+{
+	// Awake bodies are gathered up front, static bodies are gathered the first time they are referenced.
+	int index = body->solverIndex;
+	if(index < space->solverBodyCount && space->solverBodyOwners[index] == body){
+		return index;
+	} else {
+		return cpSpacePushSolverBody(space, body);
+	}
+}
+
+void
+cpSpaceGatherSolverBodies(cpSpace *space)
+{
+	space->solverBodyCount = 0;
+	
+	cpArray *bodies = space->dynamicBodies;
+	for(int i=0; i<bodies->num; i++){
+		cpSpacePushSolverBody(space, (cpBody *)bodies->arr[i]);
+	}
+	
+	cpArray *arbiters = space->arbiters;
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		arb->solver_a = cpSpaceSolverBodyIndex(space, arb->body_a);
+		arb->solver_b = cpSpaceSolverBodyIndex(space, arb->body_b);
+	}
+	
+	cpArray *constraints = space->constraints;
+	for(int i=0; i<constraints->num; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		constraint->solver_a = cpSpaceSolverBodyIndex(space, constraint->a);
+		constraint->solver_b = cpSpaceSolverBodyIndex(space, constraint->b);
+	}
+	
+	// Empty lanes repeat the bodies of the first lane, so every lane gets a valid index.
+	cpArray *networks = space->springNetworks;
+	for(int i=0; i<networks->num; i++){
+		cpSpringNetwork *network = (cpSpringNetwork *)networks->arr[i];
+		
+		for(int j=0; j<network->bundleCount; j++){
+			struct cpSpringBundle *bundle = network->bundles + j;
+			
+			for(int l=0; l<CP_SPRING_BUNDLE_WIDTH; l++){
+				bundle->a[l] = cpSpaceSolverBodyIndex(space, bundle->bodyA[l]);
+				bundle->b[l] = cpSpaceSolverBodyIndex(space, bundle->bodyB[l]);
+			}
+		}
+	}
+}
+
+void
+cpSpaceScatterSolverBodies(cpSpace *space)
+{
+	struct cpSolverBody *solverBodies = space->solverBodies;
+	cpBody **owners = space->solverBodyOwners;
+	
+	for(int i=0, count=space->solverBodyCount; i<count; i++){
+		struct cpSolverBody *solverBody = solverBodies + i;
+		cpBody *body = owners[i];
+		
+		body->v = solverBody->v;
+		body->w = solverBody->w;
+		body->v_bias = solverBody->v_bias;
+		body->w_bias = solverBody->w_bias;
+	}
+}
+
 //MARK: Collision Detection Functions
 
 static void *
@@ -216,53 +320,59 @@ QueryRejectConstraint(cpBody *a, cpBody *b)
 	return cpFalse;
 }
 
-static inline cpBool
+static inline int
 QueryReject(cpShape *a, cpShape *b)
 {
-	return (
-		// BBoxes must overlap
-		!cpBBIntersects(a->bb, b->bb)
-		// Don't collide shapes attached to the same body.
-		|| a->body == b->body
-		// Don't collide shapes that are filtered.
-		|| cpShapeFilterReject(a->filter, b->filter)
-		// Don't collide bodies if they have a constraint with collideBodies == cpFalse.
-		|| QueryRejectConstraint(a->body, b->body)
-	);
+	// BBoxes must overlap
+	if(!cpBBIntersects(a->bb, b->bb)) return CP_QUERY_REJECT_BB;
+	// Don't collide shapes attached to the same body.
+	if(a->body == b->body) return CP_QUERY_REJECT_SAME_BODY;
+	// Don't collide shapes that are filtered.
+	if(cpShapeFilterReject(a->filter, b->filter)) return CP_QUERY_REJECT_FILTER;
+	// Don't collide bodies if they have a constraint with collideBodies == cpFalse.
+	if(QueryRejectConstraint(a->body, b->body)) return CP_QUERY_REJECT_CONSTRAINT;
+	
+	return 0;
 }
 
-// Callback from the spatial hash.
-cpCollisionID
-cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
+int
+cpSpaceQueryReject(cpShape *a, cpShape *b)
 {
-	// Reject any of the simple cases
-	if(QueryReject(a,b)) return id;
-	
-	// Narrow-phase collision detection.
-	struct cpCollisionInfo info = cpCollide(a, b, id, cpContactBufferGetArray(space));
-	
-	if(info.count == 0) return info.id; // Shapes are not colliding.
-	cpSpacePushContacts(space, info.count);
+	return QueryReject(a, b);
+}
+
+// Find the arbiter for a colliding pair of shapes whose contacts were just pushed and run its callbacks.
+void
+cpSpaceProcessCollision(cpSpace *space, struct cpCollisionInfo *info)
+{
+	const cpShape *a = info->a, *b = info->b;
 	
 	// Get an arbiter from space->arbiterSet for the two shapes.
 	// This is where the persistant contact magic comes from.
-	const cpShape *shape_pair[] = {info.a, info.b};
-	cpHashValue arbHashID = CP_HASH_PAIR((cpHashValue)info.a, (cpHashValue)info.b);
+	const cpShape *shape_pair[] = {a, b};
+	cpHashValue arbHashID = CP_HASH_PAIR((cpHashValue)a, (cpHashValue)b);
 	cpArbiter *arb = (cpArbiter *)cpHashSetInsert(space->cachedArbiters, arbHashID, shape_pair, (cpHashSetTransFunc)cpSpaceArbiterSetTrans, space);
-	cpArbiterUpdate(arb, &info, space);
+	cpArbiterUpdate(arb, info, space);
 	
 	cpCollisionHandler *handler = arb->handler;
+	cpProfileTimer timer = cpSpaceProfileStart(space);
 	
 	// Call the begin function first if it's the first step
 	if(arb->state == CP_ARBITER_STATE_FIRST_COLLISION && !handler->beginFunc(arb, space, handler->userData)){
 		cpArbiterIgnore(arb); // permanently ignore the collision until separation
 	}
 	
-	if(
+	cpBool accepted = (
 		// Ignore the arbiter if it has been flagged
 		(arb->state != CP_ARBITER_STATE_IGNORE) && 
 		// Call preSolve
-		handler->preSolveFunc(arb, space, handler->userData) &&
+		handler->preSolveFunc(arb, space, handler->userData)
+	);
+	
+	cpSpaceProfileStop(space, &space->stepProfile.callbacks, timer);
+	
+	if(
+		accepted &&
 		// Check (again) in case the pre-solve() callback called cpArbiterIgnored().
 		arb->state != CP_ARBITER_STATE_IGNORE &&
 		// Process, but don't add collisions for sensors.
@@ -273,7 +383,7 @@ cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
 	){
 		cpArrayPush(space->arbiters, arb);
 	} else {
-		cpSpacePopContacts(space, info.count);
+		cpSpacePopContacts(space, info->count);
 		
 		arb->contacts = NULL;
 		arb->count = 0;
@@ -285,6 +395,31 @@ cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
 	
 	// Time stamp the arbiter so we know it was used recently.
 	arb->stamp = space->stamp;
+}
+
+// Callback from the spatial hash.
+cpCollisionID
+cpSpaceCollideShapes(cpShape *a, cpShape *b, cpCollisionID id, cpSpace *space)
+{
+	// Reject any of the simple cases
+	int reject = QueryReject(a,b);
+	cpSpaceCountQueryReject(space, reject);
+	if(reject) return id;
+	
+	cpProfileTimer timer = cpSpaceProfileStart(space);
+	
+	// Narrow-phase collision detection.
+	cpFloat margin = cpSpaceSpeculativeMargin(space, a, b);
+	struct cpCollisionInfo info = cpCollide(a, b, id, margin, cpContactBufferGetArray(space));
+	cpSpaceCountCollision(space, &info);
+	
+	// Shapes that aren't colliding don't need an arbiter.
+	if(info.count > 0){
+		cpSpacePushContacts(space, info.count);
+		cpSpaceProcessCollision(space, &info);
+	}
+	
+	cpSpaceProfileStop(space, &space->stepProfile.narrowphase, timer);
 	return info.id;
 }
 
@@ -310,7 +445,10 @@ cpSpaceArbiterSetFilter(cpArbiter *arb, cpSpace *space)
 	if(ticks >= 1 && arb->state != CP_ARBITER_STATE_CACHED){
 		arb->state = CP_ARBITER_STATE_CACHED;
 		cpCollisionHandler *handler = arb->handler;
+		
+		cpProfileTimer timer = cpSpaceProfileStart(space);
 		handler->separateFunc(arb, space, handler->userData);
+		cpSpaceProfileStop(space, &space->stepProfile.callbacks, timer);
 	}
 	
 	if(ticks >= space->collisionPersistence){
@@ -332,22 +470,85 @@ cpShapeUpdateFunc(cpShape *shape, void *unused)
 	cpShapeCacheBB(shape);
 }
 
+double
+cpProfileTime(void)
+{
+#if defined(_WIN32)
+	static LARGE_INTEGER frequency = {0};
+	if(frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+	
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart/(double)frequency.QuadPart;
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t timebase = {0, 0};
+	if(timebase.denom == 0) mach_timebase_info(&timebase);
+	
+	return (double)mach_absolute_time()*timebase.numer/timebase.denom*1e-9;
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec*1e-9;
+#endif
+}
+
 void
-cpSpaceStep(cpSpace *space, cpFloat dt)
+cpSpaceRunConstraintPreSolve(cpSpace *space, cpConstraint *constraint)
 {
-	// don't step if the timestep is 0!
-	if(dt == 0.0f) return;
+	cpConstraintPreSolveFunc preSolve = constraint->preSolve;
 	
-	space->stamp++;
+	if(preSolve){
+		cpProfileTimer timer = cpSpaceProfileStart(space);
+		preSolve(constraint, space);
+		cpSpaceProfileStop(space, &space->stepProfile.callbacks, timer);
+	}
+}
+
+void
+cpSpaceRunPostSolveCallbacks(cpSpace *space)
+{
+	cpProfileTimer timer = cpSpaceProfileStart(space);
 	
-	cpFloat prev_dt = space->curr_dt;
-	space->curr_dt = dt;
-		
-	cpArray *bodies = space->dynamicBodies;
+	// Run the constraint post-solve callbacks
 	cpArray *constraints = space->constraints;
+	for(int i=0; i<constraints->num; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		
+		cpConstraintPostSolveFunc postSolve = constraint->postSolve;
+		if(postSolve) postSolve(constraint, space);
+	}
+	
+	// run the post-solve callbacks
 	cpArray *arbiters = space->arbiters;
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *) arbiters->arr[i];
+		
+		cpCollisionHandler *handler = arb->handler;
+		handler->postSolveFunc(arb, space, handler->userData);
+	}
 	
-	// Reset and empty the arbiter lists.
+	cpSpaceProfileStop(space, &space->stepProfile.callbacks, timer);
+}
+
+// Fraction of the overlap contacts try to remove each step.
+cpFloat
+cpSpaceContactBiasCoef(cpSpace *space, cpFloat dt)
+{
+	if(space->contactFrequency > 0.0f){
+		// Overlap is only ever removed with pseudo-velocities that are thrown away after the step.
+		// A soft constraint converges to a bias velocity of massScale*biasRate*error, so that's all that's left of it.
+		struct cpSoftness soft = cpSoftnessForFrequency(space->contactFrequency, space->contactDampingRatio, dt);
+		return cpfmin(soft.massScale*soft.biasRate*dt, 1.0f);
+	} else {
+		return 1.0f - cpfpow(space->collisionBias, dt);
+	}
+}
+
+// Empty the arbiter list before running collision detection again.
+static void
+ResetArbiters(cpSpace *space)
+{
+	cpArray *arbiters = space->arbiters;
 	for(int i=0; i<arbiters->num; i++){
 		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
 		arb->state = CP_ARBITER_STATE_NORMAL;
@@ -358,88 +559,785 @@ cpSpaceStep(cpSpace *space, cpFloat dt)
 		}
 	}
 	arbiters->num = 0;
+}
 
+// Integrate the positions of the bodies and find the colliding pairs.
+// For speculative contacts, the bounding boxes and contact margins cover another 'sweep' seconds of movement.
+static void
+Collide(cpSpace *space, cpFloat dt, cpFloat sweep)
+{
+	cpSpaceStepProfile *profile = &space->stepProfile;
+	cpArray *bodies = space->dynamicBodies;
+	space->speculativeTime = sweep;
+	
 	cpSpaceLock(space); {
 		// Integrate positions
-		for(int i=0; i<bodies->num; i++){
-			cpBody *body = (cpBody *)bodies->arr[i];
-			body->position_func(body, dt);
-		}
+		cpProfileTimer timer = cpSpaceProfileStart(space);
+		cpSpaceBeginBullets(space);
+		cpBodyIntegratePositions((cpBody **)bodies->arr, bodies->num, dt);
+		cpSpaceProfileStop(space, &profile->integratePositions, timer);
 		
 		// Find colliding pairs.
+		timer = cpSpaceProfileStart(space);
 		cpSpacePushFreshContactBuffer(space);
-		cpSpatialIndexEach(space->dynamicShapes, (cpSpatialIndexIteratorFunc)cpShapeUpdateFunc, NULL);
+		cpShapeCacheBBsForBodies((cpBody **)bodies->arr, bodies->num);
+		cpSpaceProfileStop(space, &profile->updateBBs, timer);
+		
+		// Stop the bullets before they pass through anything.
+		timer = cpSpaceProfileStart(space);
+		cpSpaceSweepBullets(space, cpFalse);
+		cpSpaceProfileStop(space, &profile->bullets, timer);
+		
+		timer = cpSpaceProfileStart(space);
+		if(sweep > 0.0f) cpShapeSweepBBsForBodies((cpBody **)bodies->arr, bodies->num, sweep);
+		cpSpaceProfileStop(space, &profile->updateBBs, timer);
+		
+		// The narrowphase runs from inside the query, so take its time back out of the broadphase afterwards.
+		timer = cpSpaceProfileStart(space);
+		cpFloat narrowphase = profile->narrowphase;
 		cpSpatialIndexReindexQuery(space->dynamicShapes, (cpSpatialIndexQueryFunc)cpSpaceCollideShapes, space);
+		cpSpaceProfileStop(space, &profile->broadphase, timer);
+		profile->broadphase -= profile->narrowphase - narrowphase;
 	} cpSpaceUnlock(space, cpFalse);
+}
+
+static inline int
+ItemIsland(cpSpace *space, cpBody *a, cpBody *b)
+{
+	// Items that don't touch any dynamic bodies can go in any island.
+	int island = 0;
+	if(cpBodyGetType(a) == CP_BODY_TYPE_DYNAMIC){
+		island = a->island;
+	} else if(cpBodyGetType(b) == CP_BODY_TYPE_DYNAMIC){
+		island = b->island;
+	}
+	
+	return (island < space->solverIslandCount ? island : 0);
+}
+
+//MARK: Constraint Batches
+
+static struct cpConstraintBatch *
+PushConstraintBatch(cpSpace *space, const cpConstraintClass *klass, enum cpConstraintBatchType type)
+{
+	if(space->constraintBatchCount == space->constraintBatchCapacity){
+		space->constraintBatchCapacity = 3*(space->constraintBatchCapacity + 1)/2;
+		space->constraintBatches = (struct cpConstraintBatch *)cprealloc(space->constraintBatches, space->constraintBatchCapacity*sizeof(struct cpConstraintBatch));
+	}
+	
+	struct cpConstraintBatch *batch = space->constraintBatches + space->constraintBatchCount++;
+	batch->klass = klass;
+	batch->type = type;
+	batch->count = 0;
+	
+	return batch;
+}
+
+// Group the constraints by class so each group can be prestepped and solved with a single typed loop.
+// Classes are kept in the order they first appear in, and constraints keep their relative order within a class.
+// Joints picked for the direct solver go in a batch of their own at the end so they are solved last.
+static void
+SortConstraints(cpSpace *space)
+{
+	cpArray *constraints = space->constraints;
+	int count = constraints->num;
+	
+	if(count > space->batchedConstraintCapacity){
+		space->batchedConstraintCapacity = 3*(count + 1)/2;
+		space->batchedConstraints = (cpConstraint **)cprealloc(space->batchedConstraints, space->batchedConstraintCapacity*sizeof(cpConstraint *));
+	}
+	
+	cpSpaceBuildDirectTrees(space);
+	int directCount = 0;
+	
+	// Count the constraints of each class. There are only ever a handful of classes so a linear search is fine.
+	space->constraintBatchCount = 0;
+	for(int i=0; i<count; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		if(constraint->direct){
+			directCount++;
+			continue;
+		}
+		
+		struct cpConstraintBatch *batch = space->constraintBatches;
+		struct cpConstraintBatch *end = batch + space->constraintBatchCount;
+		while(batch < end && batch->klass != constraint->klass) batch++;
+		
+		if(batch == end){
+			enum cpConstraintBatchType type = CP_CONSTRAINT_BATCH_GENERIC;
+			if(cpConstraintIsPivotJoint(constraint)){
+				type = CP_CONSTRAINT_BATCH_PIVOT_JOINT;
+			} else if(cpConstraintIsDampedSpring(constraint)){
+				type = CP_CONSTRAINT_BATCH_DAMPED_SPRING;
+			}
+			
+			batch = PushConstraintBatch(space, constraint->klass, type);
+		}
+		
+		batch->count++;
+	}
+	
+	if(directCount > 0) PushConstraintBatch(space, NULL, CP_CONSTRAINT_BATCH_DIRECT)->count = directCount;
+	
+	for(int i=0, start=0; i<space->constraintBatchCount; i++){
+		struct cpConstraintBatch *batch = space->constraintBatches + i;
+		batch->start = start; start += batch->count;
+		batch->count = 0;
+	}
+	
+	for(int i=0; i<count; i++){
+		cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
+		
+		struct cpConstraintBatch *batch = space->constraintBatches;
+		if(constraint->direct){
+			batch += space->constraintBatchCount - 1;
+		} else {
+			while(batch->klass != constraint->klass) batch++;
+		}
+		
+		space->batchedConstraints[batch->start + batch->count++] = constraint;
+	}
+}
+
+static void
+PreStepConstraints(cpSpace *space, cpFloat dt)
+{
+	for(int i=0; i<space->constraintBatchCount; i++){
+		struct cpConstraintBatch *batch = space->constraintBatches + i;
+		cpConstraint **constraints = space->batchedConstraints + batch->start;
+		
+		switch(batch->type){
+			case CP_CONSTRAINT_BATCH_PIVOT_JOINT: cpPivotJointPreStepBatch(constraints, batch->count, dt); break;
+			case CP_CONSTRAINT_BATCH_DAMPED_SPRING: cpDampedSpringPreStepBatch(constraints, batch->count, dt); break;
+			case CP_CONSTRAINT_BATCH_DIRECT: {
+				for(int j=0; j<batch->count; j++) constraints[j]->klass->preStep(constraints[j], dt);
+				cpSpaceFactorDirectTrees(space);
+			} break;
+			default: {
+				cpConstraintPreStepImpl preStep = batch->klass->preStep;
+				for(int j=0; j<batch->count; j++) preStep(constraints[j], dt);
+			}
+		}
+	}
+	
+	cpArray *networks = space->springNetworks;
+	for(int i=0; i<networks->num; i++) cpSpringNetworkPreStep((cpSpringNetwork *)networks->arr[i], dt);
+}
+
+// Copy the hot fields of the typed batches into their packed rows.
+static void
+LoadConstraintRows(cpSpace *space, cpFloat dt)
+{
+	for(int i=0; i<space->constraintBatchCount; i++){
+		struct cpConstraintBatch *batch = space->constraintBatches + i;
+		cpConstraint **constraints = space->batchedConstraints + batch->start;
+		int count = batch->count;
+		
+		switch(batch->type){
+			case CP_CONSTRAINT_BATCH_PIVOT_JOINT:
+				if(count > space->pivotRowCapacity){
+					space->pivotRowCapacity = 3*(count + 1)/2;
+					space->pivotRows = (struct cpPivotJointRow *)cprealloc(space->pivotRows, space->pivotRowCapacity*sizeof(struct cpPivotJointRow));
+				}
+				
+				cpPivotJointLoadRows(constraints, count, space->pivotRows, dt);
+				break;
+			case CP_CONSTRAINT_BATCH_DAMPED_SPRING:
+				if(count > space->springRowCapacity){
+					space->springRowCapacity = 3*(count + 1)/2;
+					space->springRows = (struct cpDampedSpringRow *)cprealloc(space->springRows, space->springRowCapacity*sizeof(struct cpDampedSpringRow));
+				}
+				
+				cpDampedSpringLoadRows(constraints, count, space->springRows);
+				break;
+			default: break;
+		}
+	}
+}
+
+// Copy the accumulated impulses back out of the packed rows.
+static void
+StoreConstraintRows(cpSpace *space)
+{
+	for(int i=0; i<space->constraintBatchCount; i++){
+		struct cpConstraintBatch *batch = space->constraintBatches + i;
+		cpConstraint **constraints = space->batchedConstraints + batch->start;
+		
+		switch(batch->type){
+			case CP_CONSTRAINT_BATCH_PIVOT_JOINT: cpPivotJointStoreRows(constraints, batch->count, space->pivotRows); break;
+			case CP_CONSTRAINT_BATCH_DAMPED_SPRING: cpDampedSpringStoreRows(constraints, batch->count, space->springRows); break;
+			default: break;
+		}
+	}
+}
+
+static void
+WarmStartConstraintBatches(cpSpace *space, cpFloat dt_coef)
+{
+	for(int i=0; i<space->constraintBatchCount; i++){
+		struct cpConstraintBatch *batch = space->constraintBatches + i;
+		cpConstraint **constraints = space->batchedConstraints + batch->start;
+		
+		switch(batch->type){
+			case CP_CONSTRAINT_BATCH_PIVOT_JOINT: cpPivotJointApplyCachedImpulseRows(space->pivotRows, batch->count, space->solverBodies, dt_coef); break;
+			// Damped springs don't have a cached impulse.
+			case CP_CONSTRAINT_BATCH_DAMPED_SPRING: break;
+			case CP_CONSTRAINT_BATCH_DIRECT: {
+				for(int j=0; j<batch->count; j++) constraints[j]->klass->applyCachedImpulse(constraints[j], dt_coef);
+			} break;
+			default: {
+				for(int j=0; j<batch->count; j++) cpConstraintApplyCachedImpulse(constraints[j], dt_coef);
+			}
+		}
+	}
+}
+
+static void
+SolveSpringNetworks(cpSpace *space)
+{
+	cpArray *networks = space->springNetworks;
+	for(int i=0; i<networks->num; i++) cpSpringNetworkApplyImpulse((cpSpringNetwork *)networks->arr[i], space->solverBodies);
+}
+
+static void
+SolveConstraintBatches(cpSpace *space, cpFloat dt)
+{
+	for(int i=0; i<space->constraintBatchCount; i++){
+		struct cpConstraintBatch *batch = space->constraintBatches + i;
+		cpConstraint **constraints = space->batchedConstraints + batch->start;
+		
+		switch(batch->type){
+			case CP_CONSTRAINT_BATCH_PIVOT_JOINT: cpPivotJointApplyImpulseRows(space->pivotRows, batch->count, space->solverBodies); break;
+			case CP_CONSTRAINT_BATCH_DAMPED_SPRING: cpDampedSpringApplyImpulseRows(space->springRows, batch->count, space->solverBodies); break;
+			case CP_CONSTRAINT_BATCH_DIRECT: cpSpaceSolveDirectTrees(space); break;
+			default: {
+				for(int j=0; j<batch->count; j++) cpConstraintApplyImpulse(constraints[j], dt);
+			}
+		}
+	}
+	
+	SolveSpringNetworks(space);
+}
+
+//MARK: Solver
+
+// Solve the arbiters from the bottom up, freezing the lower body of each contact between two stacked bodies.
+static void
+SolveShockArbiters(cpSpace *space)
+{
+	struct cpSolverBody *solverBodies = space->solverBodies;
+	cpArbiter **arbiters = space->shockArbiters;
+	
+	for(int i=0; i<space->shockArbiterCount; i++){
+		cpArbiter *arb = arbiters[i];
+		cpBody *a = arb->body_a, *b = arb->body_b;
+		
+		// Static and kinematic bodies already have infinite mass.
+		int level_a = (cpBodyGetType(a) == CP_BODY_TYPE_DYNAMIC ? a->shockLevel : 0);
+		int level_b = (cpBodyGetType(b) == CP_BODY_TYPE_DYNAMIC ? b->shockLevel : 0);
+		
+		if(level_a == 0 || level_b == 0 || level_a == level_b){
+			cpArbiterApplyImpulse(arb, solverBodies);
+		} else {
+			cpArbiterApplyShockImpulse(arb, solverBodies, level_a < level_b);
+		}
+	}
+}
+
+// Island of the tree starting at direct solver node 'root'.
+static inline int
+DirectTreeIsland(cpSpace *space, int root)
+{
+	// Anchored trees start with the joint to the anchor, and the body follows it.
+	struct cpDirectNode *nodes = space->directNodes;
+	cpBody *body = (nodes[root].body ? nodes[root].body : nodes[root + 1].body);
+	return ItemIsland(space, body, body);
+}
+
+// Sort the arbiters, constraints and direct solver trees by island so each island can iterate until it converges.
+// Items keep their relative order, so an island is solved exactly the same as when the whole space is iterated together.
+static void
+PartitionIslands(cpSpace *space)
+{
+	if(space->iterationTolerance == 0.0f){
+		space->solverIslandCount = 0;
+		return;
+	}
+	
+	cpArray *arbiters = space->arbiters;
+	cpConstraint **constraints = space->batchedConstraints;
+	int constraintCount = space->constraints->num;
+	
+	int count = space->solverIslandCount = (space->islandCount > 0 ? space->islandCount : 1);
+	if(count > space->solverIslandCapacity){
+		space->solverIslandCapacity = 3*(count + 1)/2;
+		space->solverIslands = (struct cpSolverIsland *)cprealloc(space->solverIslands, space->solverIslandCapacity*sizeof(struct cpSolverIsland));
+	}
+	
+	if(arbiters->num > space->islandArbiterCapacity){
+		space->islandArbiterCapacity = 3*(arbiters->num + 1)/2;
+		space->islandArbiters = (cpArbiter **)cprealloc(space->islandArbiters, space->islandArbiterCapacity*sizeof(cpArbiter *));
+	}
+	
+	if(constraintCount > space->islandConstraintCapacity){
+		space->islandConstraintCapacity = 3*(constraintCount + 1)/2;
+		space->islandConstraints = (cpConstraint **)cprealloc(space->islandConstraints, space->islandConstraintCapacity*sizeof(cpConstraint *));
+	}
+	
+	// There are never more trees than nodes.
+	int nodeCount = space->directNodeCount;
+	if(nodeCount > space->islandDirectTreeCapacity){
+		space->islandDirectTreeCapacity = 3*(nodeCount + 1)/2;
+		space->islandDirectTrees = (int *)cprealloc(space->islandDirectTrees, space->islandDirectTreeCapacity*sizeof(int));
+	}
+	
+	// Count the items in each island.
+	struct cpSolverIsland *islands = space->solverIslands;
+	memset(islands, 0, count*sizeof(struct cpSolverIsland));
+	
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		islands[ItemIsland(space, arb->body_a, arb->body_b)].arbiterCount++;
+	}
+	
+	// Joints in the direct solver's trees are solved with their tree instead.
+	for(int i=0; i<constraintCount; i++){
+		cpConstraint *constraint = constraints[i];
+		if(!constraint->direct) islands[ItemIsland(space, constraint->a, constraint->b)].constraintCount++;
+	}
+	
+	struct cpDirectNode *nodes = space->directNodes;
+	for(int i=0; i<nodeCount; i++){
+		if(nodes[i].parent < 0) islands[DirectTreeIsland(space, i)].directTreeCount++;
+	}
+	
+	// Lay out the islands one after another and then fill them in.
+	for(int i=0, arbiterStart=0, constraintStart=0, directTreeStart=0; i<count; i++){
+		islands[i].arbiterStart = arbiterStart; arbiterStart += islands[i].arbiterCount;
+		islands[i].constraintStart = constraintStart; constraintStart += islands[i].constraintCount;
+		islands[i].directTreeStart = directTreeStart; directTreeStart += islands[i].directTreeCount;
+		islands[i].arbiterCount = islands[i].constraintCount = islands[i].directTreeCount = 0;
+	}
+	
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		struct cpSolverIsland *island = islands + ItemIsland(space, arb->body_a, arb->body_b);
+		space->islandArbiters[island->arbiterStart + island->arbiterCount++] = arb;
+	}
+	
+	for(int i=0; i<constraintCount; i++){
+		cpConstraint *constraint = constraints[i];
+		if(constraint->direct) continue;
+		
+		struct cpSolverIsland *island = islands + ItemIsland(space, constraint->a, constraint->b);
+		space->islandConstraints[island->constraintStart + island->constraintCount++] = constraint;
+	}
+	
+	for(int i=0; i<nodeCount; i++){
+		if(nodes[i].parent >= 0) continue;
+		
+		struct cpSolverIsland *island = islands + DirectTreeIsland(space, i);
+		space->islandDirectTrees[island->directTreeStart + island->directTreeCount++] = i;
+	}
+}
+
+// Momentum added to a solver body since its velocity was 'v' and 'w'.
+static inline cpFloat
+MomentumChange(struct cpSolverBody *body, cpVect v, cpFloat w)
+{
+	cpFloat change = 0.0f;
+	if(body->m_inv > 0.0f) change += cpvlength(cpvsub(body->v, v))/body->m_inv;
+	if(body->i_inv > 0.0f) change += cpfabs(body->w - w)/body->i_inv;
+	return change;
+}
+
+// Constraints don't report the impulses they apply, so measure the momentum they add to their bodies instead.
+// Both bodies are measured since a constraint can push one of them much harder than the other, such as when only one of them can rotate.
+static inline cpFloat
+ConstraintApplyImpulse(cpConstraint *constraint, struct cpSolverBody *bodies, cpFloat dt)
+{
+	struct cpSolverBody *a = bodies + constraint->solver_a;
+	struct cpSolverBody *b = bodies + constraint->solver_b;
+	
+	cpVect va = a->v, vb = b->v;
+	cpFloat wa = a->w, wb = b->w;
+	cpConstraintApplyImpulse(constraint, dt);
+	
+	return cpfmax(MomentumChange(a, va, wa), MomentumChange(b, vb, wb));
+}
+
+// Iterate each island until the impulses it applies fall below the tolerance or it runs out of iterations.
+static void
+SolveIslands(cpSpace *space, cpFloat dt)
+{
+	struct cpSolverBody *solverBodies = space->solverBodies;
+	cpFloat tolerance = space->iterationTolerance;
+	
+	for(int i=0; i<space->solverIslandCount; i++){
+		struct cpSolverIsland *island = space->solverIslands + i;
+		cpArbiter **arbiters = space->islandArbiters + island->arbiterStart;
+		cpConstraint **constraints = space->islandConstraints + island->constraintStart;
+		int *directTrees = space->islandDirectTrees + island->directTreeStart;
+		if(island->arbiterCount + island->constraintCount + island->directTreeCount == 0) continue;
+		
+		for(int j=0; j<space->iterations; j++){
+			cpFloat residual = 0.0f;
+			
+			for(int k=0; k<island->arbiterCount; k++){
+				residual += cpArbiterApplyImpulse(arbiters[k], solverBodies);
+			}
+			
+			for(int k=0; k<island->constraintCount; k++){
+				residual += ConstraintApplyImpulse(constraints[k], solverBodies, dt);
+			}
+			
+			// Same as the batched solver, the trees are solved after the rest of the joints.
+			for(int k=0; k<island->directTreeCount; k++){
+				residual += cpSpaceSolveDirectTree(space, directTrees[k]);
+			}
+			
+			island->iterations++;
+			if(residual < tolerance) break;
+		}
+	}
+}
+
+// The shock iterations can't replace an island's last iterations when it doesn't know which ones they are,
+// so they run over the whole space once all of the islands are done.
+static void
+SolveIslandShocks(cpSpace *space, cpFloat dt)
+{
+	if(space->shockArbiterCount == 0) return;
+	
+	cpConstraint **constraints = space->islandConstraints;
+	struct cpSolverIsland *last = space->solverIslands + space->solverIslandCount - 1;
+	int constraintCount = last->constraintStart + last->constraintCount;
+	
+	for(int i=0; i<space->shockIterations; i++){
+		SolveShockArbiters(space);
+		
+		for(int j=0; j<constraintCount; j++) cpConstraintApplyImpulse(constraints[j], dt);
+		cpSpaceSolveDirectTrees(space);
+		SolveSpringNetworks(space);
+	}
+}
+
+// Integrate the velocities of the bodies and run the impulse solver.
+// Must be called with the space locked after the arbiters and constraints are prestepped.
+static void
+Solve(cpSpace *space, cpFloat dt, cpFloat dt_coef)
+{
+	cpSpaceStepProfile *profile = &space->stepProfile;
+	cpArray *bodies = space->dynamicBodies;
+	cpArray *arbiters = space->arbiters;
+	
+	// The island solver measures each constraint through its class callbacks, so only pack the rows when iterating the whole space.
+	cpBool batched = (space->solverIslandCount == 0);
+	
+	// Integrate velocities.
+	cpProfileTimer timer = cpSpaceProfileStart(space);
+	cpFloat damping = cpfpow(space->damping, dt);
+	cpVect gravity = space->gravity;
+	cpBodyIntegrateVelocities((cpBody **)bodies->arr, bodies->num, gravity, damping, dt);
+	cpSpaceProfileStop(space, &profile->integrateVelocities, timer);
+	
+	// Copy the velocities into the packed solver bodies.
+	timer = cpSpaceProfileStart(space);
+	cpSpaceGatherSolverBodies(space);
+	struct cpSolverBody *solverBodies = space->solverBodies;
+	if(batched) LoadConstraintRows(space, dt);
+	cpSpaceProfileStop(space, &profile->preStep, timer);
+	
+	// Apply cached impulses
+	timer = cpSpaceProfileStart(space);
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiterApplyCachedImpulse((cpArbiter *)arbiters->arr[i], solverBodies, dt_coef);
+	}
+	
+	if(batched){
+		WarmStartConstraintBatches(space, dt_coef);
+	} else {
+		cpConstraint **constraints = space->batchedConstraints;
+		for(int i=0; i<space->constraints->num; i++){
+			cpConstraintApplyCachedImpulse(constraints[i], dt_coef);
+		}
+	}
+	cpSpaceProfileStop(space, &profile->warmStart, timer);
+	
+	// Run the impulse solver.
+	timer = cpSpaceProfileStart(space);
+	if(batched){
+		// The last few iterations propagate shocks if it's enabled.
+		int shockStart = space->iterations - (space->shockArbiterCount > 0 ? space->shockIterations : 0);
+		
+		for(int i=0; i<space->iterations; i++){
+			if(i < shockStart){
+				for(int j=0; j<arbiters->num; j++){
+					cpArbiterApplyImpulse((cpArbiter *)arbiters->arr[j], solverBodies);
+				}
+			} else {
+				SolveShockArbiters(space);
+			}
+			
+			SolveConstraintBatches(space, dt);
+		}
+		
+		StoreConstraintRows(space);
+	} else {
+		SolveIslands(space, dt);
+		
+		// Spring networks don't belong to any one island and always use all of the iterations.
+		for(int i=0; i<space->iterations; i++) SolveSpringNetworks(space);
+		
+		SolveIslandShocks(space, dt);
+	}
+	
+	// Write the solved velocities back to the bodies.
+	cpSpaceScatterSolverBodies(space);
+	cpSpaceProfileStop(space, &profile->solve, timer);
+}
+
+void
+cpSpaceStep(cpSpace *space, cpFloat dt)
+{
+	// don't step if the timestep is 0!
+	if(dt == 0.0f) return;
+	
+	cpSpaceProfileReset(space);
+	cpSpaceStepProfile *profile = &space->stepProfile;
+	cpProfileTimer stepTimer = cpSpaceProfileStart(space), timer;
+	
+	space->stamp++;
+	
+	cpFloat prev_dt = space->curr_dt;
+	space->curr_dt = dt;
+		
+	cpArray *bodies = space->dynamicBodies;
+	cpArray *constraints = space->constraints;
+	cpArray *arbiters = space->arbiters;
+	
+	// Speculative contacts need to cover the movement until collision detection runs again.
+	cpFloat sweep = (space->speculativeContacts ? dt : 0.0f);
+	ResetArbiters(space);
+	Collide(space, dt, sweep);
 	
 	// Rebuild the contact graph (and detect sleeping components if sleeping is enabled)
+	timer = cpSpaceProfileStart(space);
 	cpSpaceProcessComponents(space, dt);
+	cpSpaceProfileStop(space, &profile->processComponents, timer);
 	
 	cpSpaceLock(space); {
 		// Clear out old cached arbiters and call separate callbacks
+		timer = cpSpaceProfileStart(space);
 		cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc)cpSpaceArbiterSetFilter, space);
+		cpSpaceProfileStop(space, &profile->filterArbiters, timer);
+		
+		// Shrink the swept bounding boxes back down to fit the shapes.
+		if(sweep > 0.0f){
+			timer = cpSpaceProfileStart(space);
+			cpShapeCacheBBsForBodies((cpBody **)bodies->arr, bodies->num);
+			cpSpaceProfileStop(space, &profile->updateBBs, timer);
+		}
 
 		// Prestep the arbiters and constraints.
+		timer = cpSpaceProfileStart(space);
 		cpFloat slop = space->collisionSlop;
-		cpFloat biasCoef = 1.0f - cpfpow(space->collisionBias, dt);
+		cpFloat biasCoef = cpSpaceContactBiasCoef(space, dt);
 		for(int i=0; i<arbiters->num; i++){
 			cpArbiterPreStep((cpArbiter *)arbiters->arr[i], dt, slop, biasCoef);
 		}
 
+		// Run all of the pre-solve callbacks first since they might change the constraints.
 		for(int i=0; i<constraints->num; i++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			
-			cpConstraintPreSolveFunc preSolve = constraint->preSolve;
-			if(preSolve) preSolve(constraint, space);
-			
-			constraint->klass->preStep(constraint, dt);
-		}
-	
-		// Integrate velocities.
-		cpFloat damping = cpfpow(space->damping, dt);
-		cpVect gravity = space->gravity;
-		for(int i=0; i<bodies->num; i++){
-			cpBody *body = (cpBody *)bodies->arr[i];
-			body->velocity_func(body, gravity, damping, dt);
+			cpSpaceRunConstraintPreSolve(space, (cpConstraint *)constraints->arr[i]);
 		}
 		
-		// Apply cached impulses
-		cpFloat dt_coef = (prev_dt == 0.0f ? 0.0f : dt/prev_dt);
+		SortConstraints(space);
+		PreStepConstraints(space, dt);
+		PartitionIslands(space);
+		cpSpaceProfileStop(space, &profile->preStep, timer);
+		
+		Solve(space, dt, (prev_dt == 0.0f ? 0.0f : dt/prev_dt));
+		
+		cpSpaceRunPostSolveCallbacks(space);
+		timer = cpSpaceProfileStart(space);
+	} cpSpaceUnlock(space, cpTrue);
+	
+	// Post-step callbacks run when the space is unlocked.
+	cpSpaceProfileStop(space, &profile->callbacks, timer);
+	cpSpaceProfileStopTotal(space, stepTimer);
+}
+
+// Integrate the positions of the bodies for another substep and carry the contacts along with them.
+static void
+Substep(cpSpace *space, cpFloat dt, cpFloat slop, cpFloat biasCoef)
+{
+	cpSpaceStepProfile *profile = &space->stepProfile;
+	cpArray *bodies = space->dynamicBodies;
+	cpArray *arbiters = space->arbiters;
+	
+	// Remember the rotations so the contacts can be rotated by the same amount as their bodies.
+	cpProfileTimer timer = cpSpaceProfileStart(space);
+	int count = space->solverBodyCount;
+	if(count > space->substepRotationCapacity){
+		space->substepRotationCapacity = count;
+		space->substepRotations = (cpVect *)cprealloc(space->substepRotations, count*sizeof(cpVect));
+	}
+	
+	cpVect *rotations = space->substepRotations;
+	cpBody **owners = space->solverBodyOwners;
+	for(int i=0; i<count; i++){
+		cpTransform t = owners[i]->transform;
+		rotations[i] = cpv(t.a, t.b);
+	}
+	
+	cpSpaceBeginBullets(space);
+	cpBodyIntegratePositions((cpBody **)bodies->arr, bodies->num, dt);
+	cpSpaceProfileStop(space, &profile->integratePositions, timer);
+	
+	// Collision detection only swept the bullets through the first substep, so they need to be swept again for every one after it.
+	// The broadphase bounding boxes still cover the whole step, but the other dynamic shapes are checked where collision detection left them.
+	// There won't be a contact to stop a bullet that hits something now, so it's stopped outright.
+	timer = cpSpaceProfileStart(space);
+	cpArray *bullets = space->bullets;
+	cpShapeCacheBBsForBodies((cpBody **)bullets->arr, bullets->num);
+	cpSpaceSweepBullets(space, cpTrue);
+	cpSpaceProfileStop(space, &profile->bullets, timer);
+	
+	timer = cpSpaceProfileStart(space);
+	for(int i=0; i<arbiters->num; i++){
+		cpArbiter *arb = (cpArbiter *)arbiters->arr[i];
+		cpTransform ta = arb->body_a->transform, tb = arb->body_b->transform;
+		cpVect rot_a = cpvunrotate(cpv(ta.a, ta.b), rotations[arb->solver_a]);
+		cpVect rot_b = cpvunrotate(cpv(tb.a, tb.b), rotations[arb->solver_b]);
+		cpArbiterPreSubstep(arb, rot_a, rot_b, dt, slop, biasCoef);
+	}
+	
+	PreStepConstraints(space, dt);
+	cpSpaceProfileStop(space, &profile->preStep, timer);
+	
+	// The impulses from the previous substep are for the same length of time and don't need to be scaled.
+	Solve(space, dt, 1.0f);
+}
+
+void
+cpSpaceStepSubsteps(cpSpace *space, cpFloat dt, int substeps)
+{
+	cpAssertHard(substeps > 0, "The number of substeps must be positive.");
+	
+	// don't step if the timestep is 0!
+	if(dt == 0.0f) return;
+	
+	cpSpaceProfileReset(space);
+	cpSpaceStepProfile *profile = &space->stepProfile;
+	cpProfileTimer stepTimer = cpSpaceProfileStart(space), timer;
+	
+	space->stamp++;
+	
+	// Each substep is a step of its own as far as the solver and the impulses it reports are concerned.
+	cpFloat h = dt/substeps;
+	cpFloat prev_dt = space->curr_dt;
+	space->curr_dt = h;
+	
+	cpArray *bodies = space->dynamicBodies;
+	cpArray *constraints = space->constraints;
+	cpArray *arbiters = space->arbiters;
+	
+	// Collision detection only runs once, so the speculative contacts need to cover the remaining substeps too.
+	ResetArbiters(space);
+	Collide(space, h, dt);
+	
+	// Rebuild the contact graph (and detect sleeping components if sleeping is enabled)
+	timer = cpSpaceProfileStart(space);
+	cpSpaceProcessComponents(space, dt);
+	cpSpaceProfileStop(space, &profile->processComponents, timer);
+	
+	cpSpaceLock(space); {
+		// Clear out old cached arbiters and call separate callbacks
+		timer = cpSpaceProfileStart(space);
+		cpHashSetFilter(space->cachedArbiters, (cpHashSetFilterFunc)cpSpaceArbiterSetFilter, space);
+		cpSpaceProfileStop(space, &profile->filterArbiters, timer);
+
+		// Prestep the arbiters and constraints.
+		timer = cpSpaceProfileStart(space);
+		cpFloat slop = space->collisionSlop;
+		cpFloat biasCoef = cpSpaceContactBiasCoef(space, h);
 		for(int i=0; i<arbiters->num; i++){
-			cpArbiterApplyCachedImpulse((cpArbiter *)arbiters->arr[i], dt_coef);
+			cpArbiterPreStep((cpArbiter *)arbiters->arr[i], h, slop, biasCoef);
 		}
-		
+
+		// Run all of the pre-solve callbacks first since they might change the constraints.
 		for(int i=0; i<constraints->num; i++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			constraint->klass->applyCachedImpulse(constraint, dt_coef);
+			cpSpaceRunConstraintPreSolve(space, (cpConstraint *)constraints->arr[i]);
 		}
 		
-		// Run the impulse solver.
-		for(int i=0; i<space->iterations; i++){
-			for(int j=0; j<arbiters->num; j++){
-				cpArbiterApplyImpulse((cpArbiter *)arbiters->arr[j]);
-			}
-				
-			for(int j=0; j<constraints->num; j++){
-				cpConstraint *constraint = (cpConstraint *)constraints->arr[j];
-				constraint->klass->applyImpulse(constraint, dt);
-			}
-		}
+		SortConstraints(space);
+		PreStepConstraints(space, h);
+		PartitionIslands(space);
+		cpSpaceProfileStop(space, &profile->preStep, timer);
 		
-		// Run the constraint post-solve callbacks
-		for(int i=0; i<constraints->num; i++){
-			cpConstraint *constraint = (cpConstraint *)constraints->arr[i];
-			
-			cpConstraintPostSolveFunc postSolve = constraint->postSolve;
-			if(postSolve) postSolve(constraint, space);
-		}
+		Solve(space, h, (prev_dt == 0.0f ? 0.0f : h/prev_dt));
+		for(int i=1; i<substeps; i++) Substep(space, h, slop, biasCoef);
 		
-		// run the post-solve callbacks
-		for(int i=0; i<arbiters->num; i++){
-			cpArbiter *arb = (cpArbiter *) arbiters->arr[i];
-			
-			cpCollisionHandler *handler = arb->handler;
-			handler->postSolveFunc(arb, space, handler->userData);
-		}
+		// Shrink the swept bounding boxes back down to fit the shapes at their final positions.
+		timer = cpSpaceProfileStart(space);
+		if(substeps > 1) cpShapeCacheBBsForBodies((cpBody **)bodies->arr, bodies->num);
+		cpSpaceProfileStop(space, &profile->updateBBs, timer);
+		
+		cpSpaceRunPostSolveCallbacks(space);
+		timer = cpSpaceProfileStart(space);
 	} cpSpaceUnlock(space, cpTrue);
+	
+	// Post-step callbacks run when the space is unlocked.
+	cpSpaceProfileStop(space, &profile->callbacks, timer);
+	cpSpaceProfileStopTotal(space, stepTimer);
+}
+
+//MARK: Fixed Timestep
+
+// Save the poses of the awake bodies so they can be interpolated after the next step.
+static void
+SaveInterpolationPoses(cpSpace *space)
+{
+	cpArray *bodies = space->dynamicBodies;
+	cpTimestamp stamp = space->stamp + 1;
+	
+	for(int i=0; i<bodies->num; i++){
+		cpBody *body = (cpBody *)bodies->arr[i];
+		body->interpolation.p = body->p;
+		body->interpolation.a = body->a;
+		body->interpolation.stamp = stamp;
+	}
+}
+
+int
+cpSpaceAdvanceWithStepFunc(cpSpace *space, cpFloat frameTime, cpSpaceStepFunc step)
+{
+	cpAssertHard(frameTime >= 0.0f, "Frame time cannot be negative.");
+	cpAssertSpaceUnlocked(space);
+	
+	cpFloat dt = space->fixedTimestep;
+	space->accumulator += frameTime;
+	
+	int steps = 0;
+	while(space->accumulator >= dt){
+		// Avoid the spiral of death by dropping the time that can't be caught up on.
+		if(steps == space->maxStepsPerFrame){
+			space->accumulator = cpfmod(space->accumulator, dt);
+			break;
+		}
+		
+		SaveInterpolationPoses(space);
+		step(space, dt);
+		space->accumulator -= dt;
+		steps++;
+	}
+	
+	return steps;
+}
+
+int
+cpSpaceAdvance(cpSpace *space, cpFloat frameTime)
+{
+	return cpSpaceAdvanceWithStepFunc(space, frameTime, cpSpaceStep);
 }
@@ -0,0 +1,357 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "chipmunk/chipmunk_private.h"
+
+#define LANES CP_SPRING_BUNDLE_WIDTH
+
+// The kernels are written as loops over the lanes of a bundle with a fixed trip count and no dependencies between lanes.
+// Compilers turn them into SIMD code, apart from the gathers and scatters of the bodies.
+
+static inline cpBool
+BundleUsesBody(struct cpSpringBundle *bundle, cpBody *body)
+{
+	for(int l=0; l<bundle->count; l++){
+		if(bundle->bodyA[l] == body || bundle->bodyB[l] == body) return cpTrue;
+	}
+	
+	return cpFalse;
+}
+
+static void
+PreStepBundle(cpSpringNetwork *network, struct cpSpringBundle *bundle, cpFloat dt)
+{
+	cpFloat am[LANES], ai[LANES], apx[LANES], apy[LANES];
+	cpFloat bm[LANES], bi[LANES], bpx[LANES], bpy[LANES];
+	cpFloat dist[LANES], f[LANES], active[LANES];
+	
+	cpFloat *r1x = bundle->r1x, *r1y = bundle->r1y;
+	cpFloat *r2x = bundle->r2x, *r2y = bundle->r2y;
+	cpFloat *nx = bundle->nx, *ny = bundle->ny;
+	
+	for(int l=0; l<LANES; l++){
+		cpBody *a = bundle->bodyA[l], *b = bundle->bodyB[l];
+		am[l] = a->m_inv; ai[l] = a->i_inv; apx[l] = a->p.x; apy[l] = a->p.y;
+		bm[l] = b->m_inv; bi[l] = b->i_inv; bpx[l] = b->p.x; bpy[l] = b->p.y;
+		
+		cpVect r1 = cpTransformVect(a->transform, cpvsub(cpv(bundle->anchorAx[l], bundle->anchorAy[l]), a->cog));
+		cpVect r2 = cpTransformVect(b->transform, cpvsub(cpv(bundle->anchorBx[l], bundle->anchorBy[l]), b->cog));
+		r1x[l] = r1.x; r1y[l] = r1.y;
+		r2x[l] = r2.x; r2y[l] = r2.y;
+		
+		// Springs between sleeping bodies are left out of the solve like the rest of a sleeping component.
+		active[l] = (cpBodyIsSleeping(a) || cpBodyIsSleeping(b) ? 0.0f : 1.0f);
+	}
+	
+	for(int l=0; l<LANES; l++){
+		cpFloat dx = (bpx[l] + r2x[l]) - (apx[l] + r1x[l]);
+		cpFloat dy = (bpy[l] + r2y[l]) - (apy[l] + r1y[l]);
+		dist[l] = cpfsqrt(dx*dx + dy*dy);
+		
+		cpFloat dist_inv = (dist[l] > 0.0f ? 1.0f/dist[l] : 0.0f);
+		nx[l] = dx*dist_inv;
+		ny[l] = dy*dist_inv;
+		
+		cpFloat rn1 = r1x[l]*ny[l] - r1y[l]*nx[l];
+		cpFloat rn2 = r2x[l]*ny[l] - r2y[l]*nx[l];
+		cpFloat k = (am[l] + ai[l]*rn1*rn1) + (bm[l] + bi[l]*rn2*rn2);
+		// Springs between two bodies with infinite mass have nothing to solve.
+		bundle->nMass[l] = (k > 0.0f ? 1.0f/k : 0.0f);
+		bundle->v_coef[l] = (1.0f - cpfexp(-bundle->damping[l]*dt*k))*active[l];
+		bundle->target_vrn[l] = 0.0f;
+		
+		f[l] = (bundle->restLength[l] - dist[l])*bundle->stiffness[l];
+	}
+	
+	cpSpringNetworkForceFunc springForceFunc = network->springForceFunc;
+	if(springForceFunc){
+		for(int l=0; l<bundle->count; l++) f[l] = springForceFunc(network, bundle->spring[l], dist[l]);
+	}
+	
+	// Apply the spring forces.
+	for(int l=0; l<bundle->count; l++){
+		cpFloat j = f[l]*dt*active[l];
+		apply_impulses(bundle->bodyA[l], bundle->bodyB[l], cpv(r1x[l], r1y[l]), cpv(r2x[l], r2y[l]), cpv(nx[l]*j, ny[l]*j));
+	}
+}
+
+// Vectorized version of the damped spring's applyImpulse().
+static void
+SolveBundle(struct cpSpringBundle *bundle, struct cpSolverBody *bodies)
+{
+	cpFloat avx[LANES], avy[LANES], aw[LANES], am[LANES], ai[LANES];
+	cpFloat bvx[LANES], bvy[LANES], bw[LANES], bm[LANES], bi[LANES];
+	
+	for(int l=0; l<LANES; l++){
+		struct cpSolverBody *a = bodies + bundle->a[l], *b = bodies + bundle->b[l];
+		avx[l] = a->v.x; avy[l] = a->v.y; aw[l] = a->w; am[l] = a->m_inv; ai[l] = a->i_inv;
+		bvx[l] = b->v.x; bvy[l] = b->v.y; bw[l] = b->w; bm[l] = b->m_inv; bi[l] = b->i_inv;
+	}
+	
+	cpFloat *r1x = bundle->r1x, *r1y = bundle->r1y;
+	cpFloat *r2x = bundle->r2x, *r2y = bundle->r2y;
+	cpFloat *nx = bundle->nx, *ny = bundle->ny;
+	cpFloat *target_vrn = bundle->target_vrn;
+	
+	for(int l=0; l<LANES; l++){
+		cpFloat vrx = (bvx[l] - r2y[l]*bw[l]) - (avx[l] - r1y[l]*aw[l]);
+		cpFloat vry = (bvy[l] + r2x[l]*bw[l]) - (avy[l] + r1x[l]*aw[l]);
+		cpFloat vrn = vrx*nx[l] + vry*ny[l];
+		
+		// compute velocity loss from drag
+		cpFloat v_damp = (target_vrn[l] - vrn)*bundle->v_coef[l];
+		target_vrn[l] = vrn + v_damp;
+		
+		// Apply the impulse to the gathered velocities so only the results need to be scattered.
+		cpFloat jx = nx[l]*v_damp*bundle->nMass[l], jy = ny[l]*v_damp*bundle->nMass[l];
+		avx[l] -= jx*am[l]; avy[l] -= jy*am[l]; aw[l] -= (r1x[l]*jy - r1y[l]*jx)*ai[l];
+		bvx[l] += jx*bm[l]; bvy[l] += jy*bm[l]; bw[l] += (r2x[l]*jy - r2y[l]*jx)*bi[l];
+	}
+	
+	for(int l=0; l<bundle->count; l++){
+		struct cpSolverBody *a = bodies + bundle->a[l], *b = bodies + bundle->b[l];
+		a->v.x = avx[l]; a->v.y = avy[l]; a->w = aw[l];
+		b->v.x = bvx[l]; b->v.y = bvy[l]; b->w = bw[l];
+	}
+}
+
+void
+cpSpringNetworkPreStep(cpSpringNetwork *network, cpFloat dt)
+{
+	for(int i=0; i<network->bundleCount; i++) PreStepBundle(network, network->bundles + i, dt);
+}
+
+void
+cpSpringNetworkApplyImpulse(cpSpringNetwork *network, struct cpSolverBody *bodies)
+{
+	for(int i=0; i<network->bundleCount; i++) SolveBundle(network->bundles + i, bodies);
+}
+
+cpSpringNetwork *
+cpSpringNetworkAlloc(void)
+{
+	return (cpSpringNetwork *)cpcalloc(1, sizeof(cpSpringNetwork));
+}
+
+cpSpringNetwork *
+cpSpringNetworkInit(cpSpringNetwork *network)
+{
+	network->space = NULL;
+	
+	network->bundles = NULL;
+	network->bundleCount = network->bundleCapacity = 0;
+	network->firstOpen = 0;
+	
+	network->slots = NULL;
+	network->count = network->capacity = 0;
+	
+	network->springForceFunc = NULL;
+	network->userData = NULL;
+	
+	return network;
+}
+
+cpSpringNetwork *
+cpSpringNetworkNew(void)
+{
+	return cpSpringNetworkInit(cpSpringNetworkAlloc());
+}
+
+void
+cpSpringNetworkDestroy(cpSpringNetwork *network)
+{
+	cpfree(network->bundles);
+	cpfree(network->slots);
+}
+
+void
+cpSpringNetworkFree(cpSpringNetwork *network)
+{
+	if(network){
+		cpSpringNetworkDestroy(network);
+		cpfree(network);
+	}
+}
+
+int
+cpSpringNetworkAddSpring(cpSpringNetwork *network, cpBody *a, cpBody *b, cpVect anchorA, cpVect anchorB, cpFloat restLength, cpFloat stiffness, cpFloat damping)
+{
+	cpAssertHard(a != NULL && b != NULL, "Spring is attached to a NULL body.");
+	cpAssertHard(a != b, "Spring is attached to the same body twice.");
+	if(network->space) cpAssertSpaceUnlocked(network->space);
+	
+	// Find the first bundle with a free lane that doesn't use either body yet.
+	int index = network->firstOpen;
+	while(index < network->bundleCount){
+		struct cpSpringBundle *bundle = network->bundles + index;
+		if(bundle->count < LANES && !BundleUsesBody(bundle, a) && !BundleUsesBody(bundle, b)) break;
+		
+		index++;
+	}
+	
+	if(index == network->bundleCount){
+		if(network->bundleCount == network->bundleCapacity){
+			network->bundleCapacity = 3*(network->bundleCapacity + 1)/2;
+			network->bundles = (struct cpSpringBundle *)cprealloc(network->bundles, network->bundleCapacity*sizeof(struct cpSpringBundle));
+		}
+		
+		struct cpSpringBundle *bundle = network->bundles + network->bundleCount++;
+		memset(bundle, 0, sizeof(struct cpSpringBundle));
+		
+		for(int l=0; l<LANES; l++){
+			bundle->bodyA[l] = a;
+			bundle->bodyB[l] = b;
+		}
+	}
+	
+	struct cpSpringBundle *bundle = network->bundles + index;
+	int lane = bundle->count++;
+	
+	if(network->count == network->capacity){
+		network->capacity = 3*(network->capacity + 1)/2;
+		network->slots = (int *)cprealloc(network->slots, network->capacity*sizeof(int));
+	}
+	
+	int spring = network->count++;
+	network->slots[spring] = index*LANES + lane;
+	
+	bundle->spring[lane] = spring;
+	bundle->bodyA[lane] = a;
+	bundle->bodyB[lane] = b;
+	bundle->anchorAx[lane] = anchorA.x; bundle->anchorAy[lane] = anchorA.y;
+	bundle->anchorBx[lane] = anchorB.x; bundle->anchorBy[lane] = anchorB.y;
+	bundle->restLength[lane] = restLength;
+	bundle->stiffness[lane] = stiffness;
+	bundle->damping[lane] = damping;
+	
+	while(network->firstOpen < network->bundleCount && network->bundles[network->firstOpen].count == LANES) network->firstOpen++;
+	
+	if(network->space){
+		cpBodyActivate(a);
+		cpBodyActivate(b);
+	}
+	
+	return spring;
+}
+
+int
+cpSpringNetworkGetCount(const cpSpringNetwork *network)
+{
+	return network->count;
+}
+
+cpSpace *
+cpSpringNetworkGetSpace(const cpSpringNetwork *network)
+{
+	return network->space;
+}
+
+static inline struct cpSpringBundle *
+SpringBundle(const cpSpringNetwork *network, int spring, int *lane)
+{
+	cpAssertHard(0 <= spring && spring < network->count, "Spring index is out of range.");
+	
+	int slot = network->slots[spring];
+	(*lane) = slot%LANES;
+	return network->bundles + slot/LANES;
+}
+
+cpBody *
+cpSpringNetworkGetBodyA(const cpSpringNetwork *network, int spring)
+{
+	int lane;
+	return SpringBundle(network, spring, &lane)->bodyA[lane];
+}
+
+cpBody *
+cpSpringNetworkGetBodyB(const cpSpringNetwork *network, int spring)
+{
+	int lane;
+	return SpringBundle(network, spring, &lane)->bodyB[lane];
+}
+
+cpFloat
+cpSpringNetworkGetRestLength(const cpSpringNetwork *network, int spring)
+{
+	int lane;
+	return SpringBundle(network, spring, &lane)->restLength[lane];
+}
+
+void
+cpSpringNetworkSetRestLength(cpSpringNetwork *network, int spring, cpFloat restLength)
+{
+	int lane;
+	SpringBundle(network, spring, &lane)->restLength[lane] = restLength;
+}
+
+cpFloat
+cpSpringNetworkGetStiffness(const cpSpringNetwork *network, int spring)
+{
+	int lane;
+	return SpringBundle(network, spring, &lane)->stiffness[lane];
+}
+
+void
+cpSpringNetworkSetStiffness(cpSpringNetwork *network, int spring, cpFloat stiffness)
+{
+	int lane;
+	SpringBundle(network, spring, &lane)->stiffness[lane] = stiffness;
+}
+
+cpFloat
+cpSpringNetworkGetDamping(const cpSpringNetwork *network, int spring)
+{
+	int lane;
+	return SpringBundle(network, spring, &lane)->damping[lane];
+}
+
+void
+cpSpringNetworkSetDamping(cpSpringNetwork *network, int spring, cpFloat damping)
+{
+	int lane;
+	SpringBundle(network, spring, &lane)->damping[lane] = damping;
+}
+
+cpSpringNetworkForceFunc
+cpSpringNetworkGetSpringForceFunc(const cpSpringNetwork *network)
+{
+	return network->springForceFunc;
+}
+
+void
+cpSpringNetworkSetSpringForceFunc(cpSpringNetwork *network, cpSpringNetworkForceFunc springForceFunc)
+{
+	network->springForceFunc = springForceFunc;
+}
+
+cpDataPointer
+cpSpringNetworkGetUserData(const cpSpringNetwork *network)
+{
+	return network->userData;
+}
+
+void
+cpSpringNetworkSetUserData(cpSpringNetwork *network, cpDataPointer userData)
+{
+	network->userData = userData;
+}
@@ -0,0 +1,688 @@
+/* Copyright (c) 2013 Scott Lembcke and Howling Moon Software
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stdlib.h"
+
+#include "chipmunk/chipmunk_private.h"
+
+static inline cpSpatialIndexClass *Klass(void);
+
+// The sweep axis only changes when the spread of the objects along the other axis is this many times larger.
+// Keeps it from flipping back and forth on roughly square worlds since switching requires a full sort.
+#define CP_SAP_AXIS_HYSTERESIS 2.0f
+
+//MARK: Basic Structures
+
+typedef struct Proxy Proxy;
+typedef struct Pair Pair;
+typedef struct Endpoint Endpoint;
+
+typedef enum ProxyState {
+	// Inserted since the last reindex and not in the endpoint array yet.
+	PROXY_PENDING,
+	PROXY_LIVE,
+	// Removed, but the endpoints haven't been cleaned out yet.
+	PROXY_DEAD,
+} ProxyState;
+
+struct Proxy {
+	void *obj;
+	cpBB bb;
+	ProxyState state;
+};
+
+// Two proxies that overlap along the sweep axis.
+struct Pair {
+	Proxy *a, *b;
+};
+
+struct Endpoint {
+	cpFloat value;
+	Proxy *proxy;
+	cpBool max;
+};
+
+struct cpSweepAndPrune {
+	cpSpatialIndex spatialIndex;
+	
+	// All of the live and pending proxies.
+	cpHashSet *proxies;
+	// Pairs of live proxies whose bounds overlap along the sweep axis.
+	cpHashSet *pairs;
+	
+	// The min and max endpoints of the live proxies along the sweep axis, kept sorted between steps.
+	Endpoint *endpoints;
+	int count, capacity;
+	
+	cpArray *pending;
+	int deadCount;
+	
+	cpBool sweepY;
+	// Largest extent of any proxy along the sweep axis, bounds how far back queries have to look.
+	cpFloat maxExtent;
+	
+	Proxy *pooledProxies;
+	Pair *pooledPairs;
+	cpArray *allocatedBuffers;
+};
+
+static inline cpFloat
+EndpointValue(cpSweepAndPrune *sap, cpBB bb, cpBool max)
+{
+	if(sap->sweepY){
+		return (max ? bb.t : bb.b);
+	} else {
+		return (max ? bb.r : bb.l);
+	}
+}
+
+// Min endpoints sort before max endpoints with the same value.
+// The order of the endpoints then agrees with cpBBIntersects() about touching bounds.
+static inline cpBool
+EndpointLess(Endpoint *a, Endpoint *b)
+{
+	return (a->value < b->value || (a->value == b->value && !a->max && b->max));
+}
+
+static inline cpBool
+AxisOverlap(cpSweepAndPrune *sap, Proxy *a, Proxy *b)
+{
+	cpBB bba = a->bb, bbb = b->bb;
+	if(sap->sweepY){
+		return (bba.b <= bbb.t && bbb.b <= bba.t);
+	} else {
+		return (bba.l <= bbb.r && bbb.l <= bba.r);
+	}
+}
+
+//MARK: Pooled Allocations
+
+static inline void
+ProxyRecycle(cpSweepAndPrune *sap, Proxy *proxy)
+{
+	proxy->obj = sap->pooledProxies;
+	sap->pooledProxies = proxy;
+}
+
+static Proxy *
+ProxyFromPool(cpSweepAndPrune *sap)
+{
+	Proxy *proxy = sap->pooledProxies;
+	
+	if(proxy){
+		sap->pooledProxies = (Proxy *)proxy->obj;
+		return proxy;
+	} else {
+		// Pool is exhausted, make more
+		int count = CP_BUFFER_BYTES/sizeof(Proxy);
+		cpAssertHard(count, "Internal Error: Buffer size is too small.");
+		
+		Proxy *buffer = (Proxy *)cpcalloc(1, CP_BUFFER_BYTES);
+		cpArrayPush(sap->allocatedBuffers, buffer);
+		
+		// push all but the first one, return the first instead
+		for(int i=1; i<count; i++) ProxyRecycle(sap, buffer + i);
+		return buffer;
+	}
+}
+
+static inline void
+PairRecycle(cpSweepAndPrune *sap, Pair *pair)
+{
+	pair->a = (Proxy *)sap->pooledPairs;
+	sap->pooledPairs = pair;
+}
+
+static Pair *
+PairFromPool(cpSweepAndPrune *sap)
+{
+	Pair *pair = sap->pooledPairs;
+	
+	if(pair){
+		sap->pooledPairs = (Pair *)pair->a;
+		return pair;
+	} else {
+		// Pool is exhausted, make more
+		int count = CP_BUFFER_BYTES/sizeof(Pair);
+		cpAssertHard(count, "Internal Error: Buffer size is too small.");
+		
+		Pair *buffer = (Pair *)cpcalloc(1, CP_BUFFER_BYTES);
+		cpArrayPush(sap->allocatedBuffers, buffer);
+		
+		// push all but the first one, return the first instead
+		for(int i=1; i<count; i++) PairRecycle(sap, buffer + i);
+		return buffer;
+	}
+}
+
+//MARK: Pair Set
+
+static cpBool
+pairSetEql(Pair *key, Pair *pair)
+{
+	return ((key->a == pair->a && key->b == pair->b) || (key->a == pair->b && key->b == pair->a));
+}
+
+static void *
+pairSetTrans(Pair *key, cpSweepAndPrune *sap)
+{
+	Pair *pair = PairFromPool(sap);
+	(*pair) = (*key);
+	
+	return pair;
+}
+
+static inline void
+PairAdd(cpSweepAndPrune *sap, Proxy *a, Proxy *b)
+{
+	Pair key = {a, b};
+	cpHashSetInsert(sap->pairs, CP_HASH_PAIR(a, b), &key, (cpHashSetTransFunc)pairSetTrans, sap);
+}
+
+static inline void
+PairRemove(cpSweepAndPrune *sap, Proxy *a, Proxy *b)
+{
+	Pair key = {a, b};
+	Pair *pair = (Pair *)cpHashSetRemove(sap->pairs, CP_HASH_PAIR(a, b), &key);
+	if(pair) PairRecycle(sap, pair);
+}
+
+static cpBool
+PairClearFilter(Pair *pair, cpSweepAndPrune *sap)
+{
+	PairRecycle(sap, pair);
+	return cpFalse;
+}
+
+static cpBool
+PairDeadFilter(Pair *pair, cpSweepAndPrune *sap)
+{
+	if(pair->a->state == PROXY_DEAD || pair->b->state == PROXY_DEAD){
+		PairRecycle(sap, pair);
+		return cpFalse;
+	} else {
+		return cpTrue;
+	}
+}
+
+//MARK: Memory Management Functions
+
+cpSweepAndPrune *
+cpSweepAndPruneAlloc(void)
+{
+	return (cpSweepAndPrune *)cpcalloc(1, sizeof(cpSweepAndPrune));
+}
+
+static cpBool
+proxySetEql(void *obj, Proxy *proxy)
+{
+	return (obj == proxy->obj);
+}
+
+static void *
+proxySetTrans(void *obj, cpSweepAndPrune *sap)
+{
+	Proxy *proxy = ProxyFromPool(sap);
+	proxy->obj = obj;
+	proxy->bb = sap->spatialIndex.bbfunc(obj);
+	proxy->state = PROXY_PENDING;
+	
+	return proxy;
+}
+
+cpSpatialIndex *
+cpSweepAndPruneInit(cpSweepAndPrune *sap, cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	cpSpatialIndexInit((cpSpatialIndex *)sap, Klass(), bbfunc, staticIndex);
+	
+	sap->proxies = cpHashSetNew(0, (cpHashSetEqlFunc)proxySetEql);
+	sap->pairs = cpHashSetNew(0, (cpHashSetEqlFunc)pairSetEql);
+	
+	sap->endpoints = NULL;
+	sap->count = sap->capacity = 0;
+	
+	sap->pending = cpArrayNew(0);
+	sap->deadCount = 0;
+	
+	sap->sweepY = cpFalse;
+	sap->maxExtent = 0.0f;
+	
+	sap->pooledProxies = NULL;
+	sap->pooledPairs = NULL;
+	sap->allocatedBuffers = cpArrayNew(0);
+	
+	return (cpSpatialIndex *)sap;
+}
+
+cpSpatialIndex *
+cpSweepAndPruneNew(cpSpatialIndexBBFunc bbfunc, cpSpatialIndex *staticIndex)
+{
+	return cpSweepAndPruneInit(cpSweepAndPruneAlloc(), bbfunc, staticIndex);
+}
+
+static void
+cpSweepAndPruneDestroy(cpSweepAndPrune *sap)
+{
+	cpHashSetFree(sap->proxies);
+	cpHashSetFree(sap->pairs);
+	cpfree(sap->endpoints);
+	cpArrayFree(sap->pending);
+	
+	if(sap->allocatedBuffers) cpArrayFreeEach(sap->allocatedBuffers, cpfree);
+	cpArrayFree(sap->allocatedBuffers);
+}
+
+static void
+EndpointsReserve(cpSweepAndPrune *sap, int count)
+{
+	if(count > sap->capacity){
+		int capacity = 3*(sap->capacity + 1)/2;
+		sap->capacity = (capacity > count ? capacity : count);
+		sap->endpoints = (Endpoint *)cprealloc(sap->endpoints, sap->capacity*sizeof(Endpoint));
+	}
+}
+
+//MARK: Misc
+
+static int
+cpSweepAndPruneCount(cpSweepAndPrune *sap)
+{
+	return cpHashSetCount(sap->proxies);
+}
+
+typedef struct eachContext {
+	cpSpatialIndexIteratorFunc func;
+	void *data;
+} eachContext;
+
+static void each_helper(Proxy *proxy, eachContext *context){context->func(proxy->obj, context->data);}
+
+static void
+cpSweepAndPruneEach(cpSweepAndPrune *sap, cpSpatialIndexIteratorFunc func, void *data)
+{
+	eachContext context = {func, data};
+	cpHashSetEach(sap->proxies, (cpHashSetIteratorFunc)each_helper, &context);
+}
+
+static cpBool
+cpSweepAndPruneContains(cpSweepAndPrune *sap, void *obj, cpHashValue hashid)
+{
+	return (cpHashSetFind(sap->proxies, hashid, obj) != NULL);
+}
+
+//MARK: Basic Operations
+
+// New proxies are merged into the endpoint array by the next reindex.
+
+static void
+cpSweepAndPruneInsert(cpSweepAndPrune *sap, void *obj, cpHashValue hashid)
+{
+	Proxy *proxy = (Proxy *)cpHashSetInsert(sap->proxies, hashid, obj, (cpHashSetTransFunc)proxySetTrans, sap);
+	if(proxy->state == PROXY_PENDING) cpArrayPush(sap->pending, proxy);
+}
+
+static void
+cpSweepAndPruneRemove(cpSweepAndPrune *sap, void *obj, cpHashValue hashid)
+{
+	Proxy *proxy = (Proxy *)cpHashSetRemove(sap->proxies, hashid, obj);
+	if(!proxy) return;
+	
+	if(proxy->state == PROXY_PENDING){
+		cpArrayDeleteObj(sap->pending, proxy);
+		ProxyRecycle(sap, proxy);
+	} else {
+		// Cleaned out in one pass by the next reindex.
+		proxy->state = PROXY_DEAD;
+		sap->deadCount++;
+	}
+}
+
+//MARK: Sorting
+
+// Move an endpoint down to its sorted position.
+// Passing over the other endpoints is when proxies start or stop overlapping along the sweep axis.
+static void
+EndpointSortDown(cpSweepAndPrune *sap, int i)
+{
+	Endpoint *endpoints = sap->endpoints;
+	Endpoint endpoint = endpoints[i];
+	
+	for(; i > 0 && EndpointLess(&endpoint, endpoints + i - 1); i--){
+		Endpoint *other = endpoints + i - 1;
+		
+		if(!endpoint.max && other->max){
+			// The min endpoint moved before the other's max.
+			// Checking the bounds handles both endpoints of a proxy moving past each other in the same step.
+			if(AxisOverlap(sap, endpoint.proxy, other->proxy)) PairAdd(sap, endpoint.proxy, other->proxy);
+		} else if(endpoint.max && !other->max){
+			// The max endpoint moved before the other's min.
+			PairRemove(sap, endpoint.proxy, other->proxy);
+		}
+		
+		endpoints[i] = *other;
+	}
+	
+	endpoints[i] = endpoint;
+}
+
+static int
+EndpointCompare(Endpoint *a, Endpoint *b)
+{
+	return (EndpointLess(a, b) ? -1 : (EndpointLess(b, a) ? 1 : 0));
+}
+
+// Sort all of the live and pending proxies from scratch and find the overlapping pairs with a single sweep.
+static void
+Rebuild(cpSweepAndPrune *sap)
+{
+	int count = sap->count;
+	Endpoint *endpoints = sap->endpoints;
+	
+	// Drop the max endpoints, the min endpoints are enough to find all the proxies.
+	int live = 0;
+	for(int i=0; i<count; i++){
+		if(!endpoints[i].max) endpoints[live++].proxy = endpoints[i].proxy;
+	}
+	
+	cpArray *pending = sap->pending;
+	EndpointsReserve(sap, 2*(live + pending->num));
+	endpoints = sap->endpoints;
+	
+	for(int i=0; i<pending->num; i++) endpoints[live++].proxy = (Proxy *)pending->arr[i];
+	pending->num = 0;
+	
+	// Expand back out in place starting from the end.
+	for(int i=live - 1; i>=0; i--){
+		Proxy *proxy = endpoints[i].proxy;
+		proxy->state = PROXY_LIVE;
+		
+		Endpoint min = {EndpointValue(sap, proxy->bb, cpFalse), proxy, cpFalse};
+		Endpoint max = {EndpointValue(sap, proxy->bb, cpTrue), proxy, cpTrue};
+		endpoints[2*i + 0] = min;
+		endpoints[2*i + 1] = max;
+	}
+	
+	count = sap->count = 2*live;
+	if(count > 0) qsort(endpoints, count, sizeof(Endpoint), (int (*)(const void *, const void *))EndpointCompare);
+	
+	// A proxy overlaps the proxies whose min endpoints are between its own endpoints.
+	cpHashSetFilter(sap->pairs, (cpHashSetFilterFunc)PairClearFilter, sap);
+	for(int i=0; i<count; i++){
+		if(endpoints[i].max) continue;
+		
+		Proxy *proxy = endpoints[i].proxy;
+		for(int j=i+1; endpoints[j].proxy != proxy; j++){
+			if(!endpoints[j].max) PairAdd(sap, proxy, endpoints[j].proxy);
+		}
+	}
+}
+
+static void
+RemoveDead(cpSweepAndPrune *sap)
+{
+	cpHashSetFilter(sap->pairs, (cpHashSetFilterFunc)PairDeadFilter, sap);
+	
+	Endpoint *endpoints = sap->endpoints;
+	int count = 0;
+	for(int i=0; i<sap->count; i++){
+		Endpoint endpoint = endpoints[i];
+		
+		if(endpoint.proxy->state != PROXY_DEAD){
+			endpoints[count++] = endpoint;
+		} else if(endpoint.max){
+			// The min endpoint always comes first, so this is the last reference to it.
+			ProxyRecycle(sap, endpoint.proxy);
+		}
+	}
+	
+	sap->count = count;
+	sap->deadCount = 0;
+}
+
+static inline cpFloat
+Variance(cpFloat sum, cpFloat sumSq, int n)
+{
+	cpFloat mean = sum/n;
+	return sumSq/n - mean*mean;
+}
+
+// Refresh the endpoints and restore the sorted order, generating the pair events as endpoints move.
+// Only the objects that moved past their neighbors do any work beyond a linear pass.
+static void
+Update(cpSweepAndPrune *sap, cpBool refresh)
+{
+	if(sap->deadCount) RemoveDead(sap);
+	
+	cpSpatialIndexBBFunc bbfunc = sap->spatialIndex.bbfunc;
+	Endpoint *endpoints = sap->endpoints;
+	int count = sap->count;
+	
+	// Gather the spread of the centers along each axis to pick the sweep axis.
+	cpFloat sumX = 0.0f, sumSqX = 0.0f, sumY = 0.0f, sumSqY = 0.0f;
+	cpFloat extentX = 0.0f, extentY = 0.0f;
+	
+	cpArray *pending = sap->pending;
+	for(int i=0; i<pending->num; i++){
+		Proxy *proxy = (Proxy *)pending->arr[i];
+		if(refresh) proxy->bb = bbfunc(proxy->obj);
+		
+		cpBB bb = proxy->bb;
+		cpFloat x = bb.l + bb.r, y = bb.b + bb.t;
+		sumX += x; sumSqX += x*x;
+		sumY += y; sumSqY += y*y;
+		extentX = cpfmax(extentX, bb.r - bb.l);
+		extentY = cpfmax(extentY, bb.t - bb.b);
+	}
+	
+	// The min endpoint of a proxy comes before its max, so the bounds are updated before the max is reached.
+	for(int i=0; i<count; i++){
+		Endpoint *endpoint = endpoints + i;
+		Proxy *proxy = endpoint->proxy;
+		
+		if(!endpoint->max){
+			if(refresh) proxy->bb = bbfunc(proxy->obj);
+			
+			cpBB bb = proxy->bb;
+			cpFloat x = bb.l + bb.r, y = bb.b + bb.t;
+			sumX += x; sumSqX += x*x;
+			sumY += y; sumSqY += y*y;
+			extentX = cpfmax(extentX, bb.r - bb.l);
+			extentY = cpfmax(extentY, bb.t - bb.b);
+		}
+		
+		endpoint->value = EndpointValue(sap, proxy->bb, endpoint->max);
+	}
+	
+	int n = count/2 + pending->num;
+	if(n > 1){
+		cpFloat varX = Variance(sumX, sumSqX, n), varY = Variance(sumY, sumSqY, n);
+		cpBool sweepY = (sap->sweepY ? varX*CP_SAP_AXIS_HYSTERESIS <= varY : varY > varX*CP_SAP_AXIS_HYSTERESIS);
+		
+		if(sweepY != sap->sweepY){
+			sap->sweepY = sweepY;
+			sap->maxExtent = (sweepY ? extentY : extentX);
+			
+			Rebuild(sap);
+			return;
+		}
+	}
+	
+	sap->maxExtent = (sap->sweepY ? extentY : extentX);
+	
+	// Insertion sort, close to linear since the order barely changes from step to step.
+	for(int i=1; i<count; i++){
+		if(EndpointLess(endpoints + i, endpoints + i - 1)) EndpointSortDown(sap, i);
+	}
+	
+	if(pending->num == 0) return;
+	
+	// Sorting a lot of new proxies in one at a time is slower than starting over.
+	if(4*pending->num > count/2){
+		Rebuild(sap);
+		return;
+	}
+	
+	EndpointsReserve(sap, count + 2*pending->num);
+	for(int i=0; i<pending->num; i++){
+		Proxy *proxy = (Proxy *)pending->arr[i];
+		proxy->state = PROXY_LIVE;
+		
+		// Adding the max endpoint last makes every proxy the min passes over start overlapping.
+		// Then the max endpoint removes the ones that were passed over by both.
+		Endpoint min = {EndpointValue(sap, proxy->bb, cpFalse), proxy, cpFalse};
+		sap->endpoints[sap->count++] = min;
+		EndpointSortDown(sap, sap->count - 1);
+		
+		Endpoint max = {EndpointValue(sap, proxy->bb, cpTrue), proxy, cpTrue};
+		sap->endpoints[sap->count++] = max;
+		EndpointSortDown(sap, sap->count - 1);
+	}
+	
+	pending->num = 0;
+}
+
+//MARK: Reindexing Functions
+
+static void
+cpSweepAndPruneReindex(cpSweepAndPrune *sap)
+{
+	Update(sap, cpTrue);
+}
+
+static void
+cpSweepAndPruneReindexObject(cpSweepAndPrune *sap, void *obj, cpHashValue hashid)
+{
+	Proxy *proxy = (Proxy *)cpHashSetFind(sap->proxies, hashid, obj);
+	if(!proxy) return;
+	
+	// Only the one object is refreshed, but restoring the order is still a linear pass.
+	proxy->bb = sap->spatialIndex.bbfunc(obj);
+	Update(sap, cpFalse);
+}
+
+//MARK: Query Functions
+
+// Index of the first endpoint that could belong to a proxy overlapping the range starting at min.
+static int
+QueryStart(cpSweepAndPrune *sap, cpFloat min)
+{
+	min -= sap->maxExtent;
+	
+	Endpoint *endpoints = sap->endpoints;
+	int start = 0, end = sap->count;
+	while(start < end){
+		int mid = (start + end)/2;
+		if(endpoints[mid].value < min){
+			start = mid + 1;
+		} else {
+			end = mid;
+		}
+	}
+	
+	return start;
+}
+
+static void
+cpSweepAndPruneQuery(cpSweepAndPrune *sap, void *obj, cpBB bb, cpSpatialIndexQueryFunc func, void *data)
+{
+	Endpoint *endpoints = sap->endpoints;
+	cpFloat max = EndpointValue(sap, bb, cpTrue);
+	
+	for(int i=QueryStart(sap, EndpointValue(sap, bb, cpFalse)), count=sap->count; i<count && endpoints[i].value <= max; i++){
+		Proxy *proxy = endpoints[i].proxy;
+		if(!endpoints[i].max && proxy->state == PROXY_LIVE && cpBBIntersects(bb, proxy->bb)) func(obj, proxy->obj, 0, data);
+	}
+	
+	cpArray *pending = sap->pending;
+	for(int i=0; i<pending->num; i++){
+		Proxy *proxy = (Proxy *)pending->arr[i];
+		if(cpBBIntersects(bb, proxy->bb)) func(obj, proxy->obj, 0, data);
+	}
+}
+
+static void
+cpSweepAndPruneSegmentQuery(cpSweepAndPrune *sap, void *obj, cpVect a, cpVect b, cpFloat t_exit, cpSpatialIndexSegmentQueryFunc func, void *data)
+{
+	cpBB bb = cpBBExpand(cpBBNew(a.x, a.y, a.x, a.y), b);
+	
+	Endpoint *endpoints = sap->endpoints;
+	cpFloat max = EndpointValue(sap, bb, cpTrue);
+	
+	for(int i=QueryStart(sap, EndpointValue(sap, bb, cpFalse)), count=sap->count; i<count && endpoints[i].value <= max; i++){
+		Proxy *proxy = endpoints[i].proxy;
+		if(!endpoints[i].max && proxy->state == PROXY_LIVE && cpBBSegmentQuery(proxy->bb, a, b) < t_exit){
+			t_exit = cpfmin(t_exit, func(obj, proxy->obj, data));
+		}
+	}
+	
+	cpArray *pending = sap->pending;
+	for(int i=0; i<pending->num; i++){
+		Proxy *proxy = (Proxy *)pending->arr[i];
+		if(cpBBSegmentQuery(proxy->bb, a, b) < t_exit) t_exit = cpfmin(t_exit, func(obj, proxy->obj, data));
+	}
+}
+
+//MARK: Reindex/Query
+
+typedef struct PairQueryContext {
+	cpSpatialIndexQueryFunc func;
+	void *data;
+} PairQueryContext;
+
+static void
+PairQuery(Pair *pair, PairQueryContext *context)
+{
+	// The pairs only overlap along the sweep axis, check the other one too.
+	Proxy *a = pair->a, *b = pair->b;
+	if(cpBBIntersects(a->bb, b->bb)) context->func(a->obj, b->obj, 0, context->data);
+}
+
+static void
+cpSweepAndPruneReindexQuery(cpSweepAndPrune *sap, cpSpatialIndexQueryFunc func, void *data)
+{
+	Update(sap, cpTrue);
+	
+	PairQueryContext context = {func, data};
+	cpHashSetEach(sap->pairs, (cpHashSetIteratorFunc)PairQuery, &context);
+	
+	// Reindex query is also responsible for colliding against the static index.
+	cpSpatialIndexCollideStatic((cpSpatialIndex *)sap, sap->spatialIndex.staticIndex, func, data);
+}
+
+static cpSpatialIndexClass klass = {
+	(cpSpatialIndexDestroyImpl)cpSweepAndPruneDestroy,
+	
+	(cpSpatialIndexCountImpl)cpSweepAndPruneCount,
+	(cpSpatialIndexEachImpl)cpSweepAndPruneEach,
+	(cpSpatialIndexContainsImpl)cpSweepAndPruneContains,
+	
+	(cpSpatialIndexInsertImpl)cpSweepAndPruneInsert,
+	(cpSpatialIndexRemoveImpl)cpSweepAndPruneRemove,
+	
+	(cpSpatialIndexReindexImpl)cpSweepAndPruneReindex,
+	(cpSpatialIndexReindexObjectImpl)cpSweepAndPruneReindexObject,
+	(cpSpatialIndexReindexQueryImpl)cpSweepAndPruneReindexQuery,
+	
+	(cpSpatialIndexQueryImpl)cpSweepAndPruneQuery,
+	(cpSpatialIndexSegmentQueryImpl)cpSweepAndPruneSegmentQuery,
+};
+
+static inline cpSpatialIndexClass *Klass(){return &klass;}
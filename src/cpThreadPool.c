@@ -0,0 +1,507 @@
+// Copyright 2013 Howling Moon Software. All rights reserved.
+// See http://chipmunk2d.net/legal.php for more information.
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// Needed for sched_getaffinity() and pthread_setaffinity_np().
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#ifndef _WIN32
+#include <pthread.h>
+#elif defined(__MINGW32__)
+#include <pthread.h>
+#else
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <process.h> // _beginthreadex
+#include <windows.h>
+
+#ifndef ETIMEDOUT
+#define ETIMEDOUT 1
+#endif
+
+// Simple pthread implementation for Windows
+// Made from scratch to avoid the LGPL licence from pthread-win32
+enum {
+	SIGNAL = 0,
+	BROADCAST = 1,
+	MAX_EVENTS = 2
+};
+
+typedef HANDLE pthread_t;
+typedef struct
+{
+	// Based on http://www.cs.wustl.edu/~schmidt/win32-cv-1.html since Windows has no condition variable until NT6
+	UINT waiters_count;
+	// Count of the number of waiters.
+
+	CRITICAL_SECTION waiters_count_lock;
+	// Serialize access to <waiters_count_>.
+
+	HANDLE events[MAX_EVENTS];
+} pthread_cond_t;
+typedef CRITICAL_SECTION pthread_mutex_t;
+
+typedef struct {int unused;} pthread_condattr_t; // Dummy, C requires at least one member.
+
+int pthread_cond_destroy(pthread_cond_t* cv)
+{
+	CloseHandle(cv->events[BROADCAST]);
+	CloseHandle(cv->events[SIGNAL]);
+
+	DeleteCriticalSection(&cv->waiters_count_lock);
+
+	return 0;
+}
+
+int pthread_cond_init(pthread_cond_t* cv, const pthread_condattr_t* attr)
+{
+	// Initialize the count to 0.
+	cv->waiters_count = 0;
+
+	// Create an auto-reset event.
+	cv->events[SIGNAL] = CreateEvent(NULL,  // no security
+	                                 FALSE, // auto-reset event
+	                                 FALSE, // non-signaled initially
+	                                 NULL); // unnamed
+
+	// Create a manual-reset event.
+	cv->events[BROADCAST] = CreateEvent(NULL,  // no security
+	                                    TRUE,  // manual-reset
+	                                    FALSE, // non-signaled initially
+	                                    NULL); // unnamed
+
+	InitializeCriticalSection(&cv->waiters_count_lock);
+
+	return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cv)
+{
+	// Avoid race conditions.
+	EnterCriticalSection(&cv->waiters_count_lock);
+	int have_waiters = cv->waiters_count > 0;
+	LeaveCriticalSection(&cv->waiters_count_lock);
+
+	if (have_waiters)
+		SetEvent(cv->events[BROADCAST]);
+
+	return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t* cv)
+{
+	// Avoid race conditions.
+	EnterCriticalSection(&cv->waiters_count_lock);
+	int have_waiters = cv->waiters_count > 0;
+	LeaveCriticalSection(&cv->waiters_count_lock);
+
+	if (have_waiters)
+		SetEvent(cv->events[SIGNAL]);
+
+	return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t* cv, pthread_mutex_t* external_mutex)
+{
+	// Avoid race conditions.
+	EnterCriticalSection(&cv->waiters_count_lock);
+	cv->waiters_count++;
+	LeaveCriticalSection(&cv->waiters_count_lock);
+
+	// It's ok to release the <external_mutex> here since Win32
+	// manual-reset events maintain state when used with
+	// <SetEvent>.  This avoids the "lost wakeup" bug...
+	LeaveCriticalSection(external_mutex);
+
+	// Wait for either event to become signaled due to <pthread_cond_signal>
+	// being called or <pthread_cond_broadcast> being called.
+	int result = WaitForMultipleObjects(2, cv->events, FALSE, INFINITE);
+
+	EnterCriticalSection(&cv->waiters_count_lock);
+	cv->waiters_count--;
+	int last_waiter =
+		result == WAIT_OBJECT_0 + BROADCAST
+		&& cv->waiters_count == 0;
+	LeaveCriticalSection(&cv->waiters_count_lock);
+
+	// Some thread called <pthread_cond_broadcast>.
+	if (last_waiter)
+		// We're the last waiter to be notified or to stop waiting, so
+		// reset the manual event. 
+		ResetEvent(cv->events[BROADCAST]);
+
+	// Reacquire the <external_mutex>.
+	EnterCriticalSection(external_mutex);
+
+	return result == WAIT_TIMEOUT ? ETIMEDOUT : 0;
+}
+
+typedef struct {int unused;} pthread_mutexattr_t; // Dummy, C requires at least one member.
+
+int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr)
+{
+	InitializeCriticalSection(mutex);
+	return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t* mutex)
+{
+	DeleteCriticalSection(mutex);
+	return 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+	EnterCriticalSection(mutex);
+	return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex)
+{
+	LeaveCriticalSection(mutex);
+	return 0;
+}
+
+typedef struct {int unused;} pthread_attr_t; // Dummy, C requires at least one member.
+
+typedef struct
+{
+	void *(*start_routine) (void *);
+	void* arg;
+} pthread_internal_thread;
+
+unsigned int __stdcall ThreadProc(void* userdata)
+{
+	pthread_internal_thread* ud = (pthread_internal_thread*) userdata;
+	ud->start_routine(ud->arg);
+
+	free(ud);
+
+	return 0;
+}
+
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void *(*start_routine) (void *), void *arg)
+{
+	pthread_internal_thread* ud = (pthread_internal_thread*) malloc(sizeof(pthread_internal_thread));
+	ud->start_routine = start_routine;
+	ud->arg = arg;
+
+	*thread = (HANDLE) (_beginthreadex(NULL, 0, &ThreadProc, ud, 0, NULL));
+	if (!*thread)
+		return 1;
+
+	return 0;
+}
+
+int pthread_join(pthread_t thread, void **value_ptr)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+
+	return 0;
+}
+
+#endif
+
+#include "chipmunk/chipmunk_private.h"
+
+//MARK: Atomics
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	
+	static inline unsigned int AtomicLoad(volatile unsigned int *ptr){return (unsigned int)_InterlockedOr((volatile long *)ptr, 0);}
+	static inline void AtomicStore(volatile unsigned int *ptr, unsigned int value){_InterlockedExchange((volatile long *)ptr, (long)value);}
+	static inline unsigned int AtomicIncrement(volatile unsigned int *ptr){return (unsigned int)_InterlockedIncrement((volatile long *)ptr);}
+	static inline unsigned int AtomicDecrement(volatile unsigned int *ptr){return (unsigned int)_InterlockedDecrement((volatile long *)ptr);}
+	#define CP_SPIN_PAUSE() _mm_pause()
+	#define CP_THREAD_YIELD() SwitchToThread()
+#else
+	#include <sched.h>
+	
+	static inline unsigned int AtomicLoad(volatile unsigned int *ptr){return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);}
+	static inline void AtomicStore(volatile unsigned int *ptr, unsigned int value){__atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);}
+	static inline unsigned int AtomicIncrement(volatile unsigned int *ptr){return __atomic_add_fetch(ptr, 1, __ATOMIC_SEQ_CST);}
+	static inline unsigned int AtomicDecrement(volatile unsigned int *ptr){return __atomic_sub_fetch(ptr, 1, __ATOMIC_SEQ_CST);}
+	
+	#if defined(__i386__) || defined(__x86_64__)
+		#define CP_SPIN_PAUSE() __builtin_ia32_pause()
+	#elif defined(__arm__) || defined(__aarch64__)
+		#define CP_SPIN_PAUSE() __asm__ __volatile__("yield")
+	#else
+		#define CP_SPIN_PAUSE()
+	#endif
+	
+	#define CP_THREAD_YIELD() sched_yield()
+#endif
+
+//MARK: Thread Pool
+
+// How many times to poll before putting a waiting thread to sleep.
+// Phases of a step are usually dispatched microseconds apart, so it's much cheaper to spin than to context switch.
+// After spinning, the thread yields a few times in case the CPUs are oversubscribed and it's waiting on a preempted thread.
+#define CP_THREAD_POOL_SPIN_COUNT 1024
+#define CP_THREAD_POOL_YIELD_COUNT 16
+
+struct cpThreadPoolWorker {
+	pthread_t thread;
+	cpThreadPool *pool;
+	unsigned long worker;
+};
+
+struct cpThreadPool {
+	// Number of threads, including the calling thread.
+	unsigned long num_threads;
+	cpBool pinned;
+	
+	// Spinning only helps when every thread has a CPU to itself.
+	int spin_count;
+	
+	// Work function to invoke. NULL tells the workers to exit.
+	cpThreadPoolFunc func;
+	void *data;
+	
+	// Incremented every time the workers are started.
+	volatile unsigned int epoch;
+	// Number of workers still running the current work function, not including the calling thread.
+	volatile unsigned int running;
+	// Number of threads waiting at the barrier, and how many times it has been released.
+	volatile unsigned int barrier_count, barrier_generation;
+	// Number of threads asleep in Wait(). Lets Wake() skip the system call when nobody is sleeping.
+	volatile unsigned int sleepers;
+	
+#ifndef __linux__
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+#endif
+	
+	struct cpThreadPoolWorker *workers;
+};
+
+// Block until *ptr no longer holds value. Spins for a while before going to sleep.
+static void
+Wait(cpThreadPool *pool, volatile unsigned int *ptr, unsigned int value)
+{
+	for(int i=0; i<pool->spin_count; i++){
+		if(AtomicLoad(ptr) != value) return;
+		CP_SPIN_PAUSE();
+	}
+	
+	for(int i=0; i<CP_THREAD_POOL_YIELD_COUNT; i++){
+		if(AtomicLoad(ptr) != value) return;
+		CP_THREAD_YIELD();
+	}
+	
+	AtomicIncrement(&pool->sleepers);
+#ifdef __linux__
+	while(AtomicLoad(ptr) == value){
+		syscall(SYS_futex, ptr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+	}
+#else
+	pthread_mutex_lock(&pool->mutex); {
+		while(AtomicLoad(ptr) == value) pthread_cond_wait(&pool->cond, &pool->mutex);
+	} pthread_mutex_unlock(&pool->mutex);
+#endif
+	AtomicDecrement(&pool->sleepers);
+}
+
+// Wake up any threads waiting for *ptr to change. Must be called after changing it.
+static void
+Wake(cpThreadPool *pool, volatile unsigned int *ptr)
+{
+	if(AtomicLoad(&pool->sleepers) == 0) return;
+	
+#ifdef __linux__
+	syscall(SYS_futex, ptr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	pthread_mutex_lock(&pool->mutex); {
+		pthread_cond_broadcast(&pool->cond);
+	} pthread_mutex_unlock(&pool->mutex);
+#endif
+}
+
+#ifdef __linux__
+// Pin the calling thread to the n-th CPU the process is allowed to run on.
+static void
+PinThread(unsigned long n)
+{
+	cpu_set_t allowed, pinned;
+	if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+	
+	int count = CPU_COUNT(&allowed);
+	if(count == 0) return;
+	n %= (unsigned long)count;
+	
+	for(int cpu=0; cpu<CPU_SETSIZE; cpu++){
+		if(CPU_ISSET(cpu, &allowed) && n-- == 0){
+			CPU_ZERO(&pinned);
+			CPU_SET(cpu, &pinned);
+			pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+			return;
+		}
+	}
+}
+#else
+static void PinThread(unsigned long n){}
+#endif
+
+static void *
+WorkerThreadLoop(struct cpThreadPoolWorker *context)
+{
+	cpThreadPool *pool = context->pool;
+	if(pool->pinned) PinThread(context->worker);
+	
+	unsigned int epoch = 0;
+	for(;;){
+		Wait(pool, &pool->epoch, epoch);
+		epoch = AtomicLoad(&pool->epoch);
+		
+		cpThreadPoolFunc func = pool->func;
+		if(func == NULL) break;
+		
+		func(pool->data, context->worker, pool->num_threads);
+		if(AtomicDecrement(&pool->running) == 0) Wake(pool, &pool->running);
+	}
+	
+	return NULL;
+}
+
+unsigned long
+cpThreadPoolDetectThreads(void)
+{
+	unsigned long threads = 0;
+	
+#if defined(__APPLE__)
+	size_t size = sizeof(threads);
+	sysctlbyname("hw.ncpu", &threads, &size, NULL, 0);
+#elif defined(__linux__)
+	// Respect the affinity mask (taskset, cgroups, etc) before falling back to the number of online CPUs.
+	cpu_set_t allowed;
+	if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0) threads = CPU_COUNT(&allowed);
+	if(threads == 0){
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (online > 0 ? (unsigned long)online : 0);
+	}
+#elif defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	threads = info.dwNumberOfProcessors;
+#endif
+	
+	return (threads > 0 ? threads : 1);
+}
+
+cpThreadPool *
+cpThreadPoolNew(unsigned long threads, cpBool pinned)
+{
+	cpThreadPool *pool = (cpThreadPool *)cpcalloc(1, sizeof(cpThreadPool));
+	pool->num_threads = (threads > 0 ? threads : 1);
+	pool->pinned = pinned;
+	pool->spin_count = (pool->num_threads <= cpThreadPoolDetectThreads() ? CP_THREAD_POOL_SPIN_COUNT : 0);
+	
+#ifndef __linux__
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+#endif
+	
+	// The calling thread is worker 0, so only num_threads - 1 threads are started.
+	pool->workers = (struct cpThreadPoolWorker *)cpcalloc(pool->num_threads, sizeof(struct cpThreadPoolWorker));
+	for(unsigned long i=1; i<pool->num_threads; i++){
+		struct cpThreadPoolWorker *worker = pool->workers + i;
+		worker->pool = pool;
+		worker->worker = i;
+		
+		pthread_create(&worker->thread, NULL, (void*(*)(void*))WorkerThreadLoop, worker);
+	}
+	
+	return pool;
+}
+
+void
+cpThreadPoolFree(cpThreadPool *pool)
+{
+	if(pool == NULL) return;
+	
+	// A NULL work function means break and exit.
+	pool->func = NULL;
+	AtomicIncrement(&pool->epoch);
+	Wake(pool, &pool->epoch);
+	
+	for(unsigned long i=1; i<pool->num_threads; i++){
+		pthread_join(pool->workers[i].thread, NULL);
+	}
+	
+#ifndef __linux__
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->cond);
+#endif
+	
+	cpfree(pool->workers);
+	cpfree(pool);
+}
+
+unsigned long
+cpThreadPoolGetThreads(cpThreadPool *pool)
+{
+	return pool->num_threads;
+}
+
+void
+cpThreadPoolRun(cpThreadPool *pool, cpThreadPoolFunc func, void *data)
+{
+	unsigned long threads = pool->num_threads;
+	
+	if(threads > 1){
+		pool->func = func;
+		pool->data = data;
+		AtomicStore(&pool->running, (unsigned int)(threads - 1));
+		
+		AtomicIncrement(&pool->epoch);
+		Wake(pool, &pool->epoch);
+		
+		func(data, 0, threads);
+		
+		for(unsigned int running = AtomicLoad(&pool->running); running > 0; running = AtomicLoad(&pool->running)){
+			Wait(pool, &pool->running, running);
+		}
+	} else {
+		func(data, 0, 1);
+	}
+}
+
+void
+cpThreadPoolBarrier(cpThreadPool *pool, unsigned long worker_count)
+{
+	if(worker_count <= 1) return;
+	
+	unsigned int generation = AtomicLoad(&pool->barrier_generation);
+	if(AtomicIncrement(&pool->barrier_count) == worker_count){
+		AtomicStore(&pool->barrier_count, 0);
+		AtomicIncrement(&pool->barrier_generation);
+		Wake(pool, &pool->barrier_generation);
+	} else {
+		Wait(pool, &pool->barrier_generation, generation);
+	}
+}